@@ -0,0 +1,236 @@
+#define _XOPEN_SOURCE 700   // clock_gettime(), nanosleep()
+
+#include "captura.h"
+
+#include <time.h>
+
+
+#define PCAP_MAGICO_NS 0xa1b23c4dU          // pcap clássico com instantes em nanossegundos
+#define PCAP_ETHERNET 1                     // LINKTYPE_ETHERNET
+
+int captura_ativa = 0;
+
+// Cabeçalho de cada arquivo pcap
+typedef struct {
+    uint32_t magico;
+    uint16_t versao_maior;
+    uint16_t versao_menor;
+    int32_t fuso;
+    uint32_t precisao;
+    uint32_t snaplen;
+    uint32_t enlace;
+} pcap_arquivo_t;
+
+// Cabeçalho de cada frame no arquivo
+typedef struct {
+    uint32_t segundos;
+    uint32_t nanossegundos;
+    uint32_t capturado;
+    uint32_t tamanho;
+} pcap_frame_t;
+
+static struct {
+    captura_slot_t* slots;
+    uint64_t escrita;                       // Próxima posição a reservar (produtores, CAS)
+    uint64_t leitura;                       // Próxima posição a escrever no arquivo (só a thread)
+    uint64_t perdidos;                      // Frames que encontraram o anel cheio
+
+    char prefixo[256];
+    FILE* arquivo;
+    int indice;                             // Arquivo atual na rotação
+    size_t bytes_arquivo;
+    uint64_t frames;
+    uint64_t arquivos;
+
+    pthread_t thread;
+    int encerrar;
+} captura;
+
+
+// Abre o próximo arquivo da rotação e escreve o cabeçalho pcap
+static int abrir_arquivo(void) {
+    char caminho[300];
+    snprintf(caminho, sizeof(caminho), "%s.%d.pcap", captura.prefixo, captura.indice);
+
+    captura.arquivo = fopen(caminho, "wb");
+    if (!captura.arquivo) {
+        return -1;
+    }
+
+    pcap_arquivo_t cabecalho = { PCAP_MAGICO_NS, 2, 4, 0, 0, CAPTURA_FRAME, PCAP_ETHERNET };
+    fwrite(&cabecalho, sizeof(cabecalho), 1, captura.arquivo);
+    captura.bytes_arquivo = sizeof(cabecalho);
+    captura.arquivos++;
+    return 0;
+}
+
+
+// Os cabeçalhos Ethernet e UDP de rawSocket.h não estão na ordem do fio padrão:
+// no arquivo eles são reordenados para o Wireshark e o tcpdump decodificarem
+static void reordenar_cabecalhos(uint8_t* frame, size_t capturado) {
+    if (capturado < TAMANHO_CABECALHOS) return;
+
+    uint8_t ethernet[sizeof(struct cabecalho_ethernet)];
+    const struct cabecalho_ethernet* eth = (const struct cabecalho_ethernet*)frame;
+    memcpy(ethernet, eth->mac_destino, 6);
+    memcpy(ethernet + 6, eth->mac_origem, 6);
+    memcpy(ethernet + 12, &eth->eth_hdr, 2);
+    memcpy(frame, ethernet, sizeof(ethernet));
+
+    uint8_t* udp = frame + sizeof(struct cabecalho_ethernet) + sizeof(struct cabecalho_ip);
+    struct udp_header original;
+    memcpy(&original, udp, sizeof(original));
+    memcpy(udp, &original.porta_origem, 2);
+    memcpy(udp + 2, &original.porta_destino, 2);
+    memcpy(udp + 4, &original.comprimento, 2);
+    memcpy(udp + 6, &original.checksum, 2);
+}
+
+
+static void escrever_frame(captura_slot_t* slot) {
+    size_t registro = sizeof(pcap_frame_t) + slot->capturado;
+    if (captura.bytes_arquivo + registro > CAPTURA_TAMANHO_ARQUIVO) {
+        fclose(captura.arquivo);
+        captura.indice = (captura.indice + 1) % CAPTURA_ARQUIVOS;
+        if (abrir_arquivo() < 0) {
+            perror("🔴 Erro ao abrir o próximo arquivo da captura");
+            return;
+        }
+    }
+
+    reordenar_cabecalhos(slot->dados, slot->capturado);
+    pcap_frame_t cabecalho = {
+        (uint32_t)(slot->instante_ns / 1000000000), (uint32_t)(slot->instante_ns % 1000000000),
+        slot->capturado, slot->tamanho,
+    };
+    fwrite(&cabecalho, sizeof(cabecalho), 1, captura.arquivo);
+    fwrite(slot->dados, 1, slot->capturado, captura.arquivo);
+    captura.bytes_arquivo += registro;
+    captura.frames++;
+}
+
+
+// Esvazia o anel no arquivo; com ele vazio, descarrega o buffer e espera
+static void* thread_captura(void* arg) {
+    (void)arg;
+
+    while (1) {
+        captura_slot_t* slot = &captura.slots[captura.leitura & (CAPTURA_SLOTS - 1)];
+        if (__atomic_load_n(&slot->sequencia, __ATOMIC_ACQUIRE) == captura.leitura + 1) {
+            if (captura.arquivo) {
+                escrever_frame(slot);
+            }
+            // Slot livre para a próxima volta do anel
+            __atomic_store_n(&slot->sequencia, captura.leitura + CAPTURA_SLOTS, __ATOMIC_RELEASE);
+            captura.leitura++;
+            continue;
+        }
+
+        // Anel vazio: o que foi escrito fica no disco mesmo se o processo for morto
+        if (captura.arquivo) {
+            fflush(captura.arquivo);
+        }
+        if (__atomic_load_n(&captura.encerrar, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        struct timespec pausa = { 0, CAPTURA_ESPERA_MS * 1000000L };
+        nanosleep(&pausa, NULL);
+    }
+}
+
+
+int captura_iniciar(const char* prefixo) {
+    if (!prefixo || !*prefixo) return 0;
+    if (captura_ativa || strlen(prefixo) >= sizeof(captura.prefixo)) return -1;
+
+    captura.slots = malloc(CAPTURA_SLOTS * sizeof(captura_slot_t));
+    if (!captura.slots) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < CAPTURA_SLOTS; i++) {
+        captura.slots[i].sequencia = i;
+    }
+    captura.escrita = 0;
+    captura.leitura = 0;
+    captura.perdidos = 0;
+    captura.frames = 0;
+    captura.arquivos = 0;
+    captura.indice = 0;
+    captura.encerrar = 0;
+    strcpy(captura.prefixo, prefixo);
+
+    if (abrir_arquivo() < 0) {
+        free(captura.slots);
+        captura.slots = NULL;
+        return -1;
+    }
+    if (pthread_create(&captura.thread, NULL, thread_captura, NULL) != 0) {
+        fclose(captura.arquivo);
+        captura.arquivo = NULL;
+        free(captura.slots);
+        captura.slots = NULL;
+        return -1;
+    }
+
+    captura_ativa = 1;
+    printf("🟡 Capturando os frames em %s.N.pcap (%d arquivos de até %d MB)\n", prefixo, CAPTURA_ARQUIVOS,
+           CAPTURA_TAMANHO_ARQUIVO / (1024 * 1024));
+    return 0;
+}
+
+
+void captura_registrar(const void* parte1, size_t tamanho1, const void* parte2, size_t tamanho2) {
+    struct timespec agora;
+    clock_gettime(CLOCK_REALTIME, &agora);
+
+    // Reserva de uma posição: o slot dela está livre quando a sequência é igual à posição
+    uint64_t posicao = __atomic_load_n(&captura.escrita, __ATOMIC_RELAXED);
+    captura_slot_t* slot;
+    while (1) {
+        slot = &captura.slots[posicao & (CAPTURA_SLOTS - 1)];
+        int64_t diferenca = (int64_t)(__atomic_load_n(&slot->sequencia, __ATOMIC_ACQUIRE) - posicao);
+        if (diferenca == 0) {
+            if (__atomic_compare_exchange_n(&captura.escrita, &posicao, posicao + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diferenca < 0) {
+            __atomic_fetch_add(&captura.perdidos, 1, __ATOMIC_RELAXED);   // Volta anterior ainda não escrita
+            return;
+        } else {
+            posicao = __atomic_load_n(&captura.escrita, __ATOMIC_RELAXED);
+        }
+    }
+
+    size_t copia1 = tamanho1 < CAPTURA_FRAME ? tamanho1 : CAPTURA_FRAME;
+    size_t copia2 = tamanho2 < CAPTURA_FRAME - copia1 ? tamanho2 : CAPTURA_FRAME - copia1;
+    memcpy(slot->dados, parte1, copia1);
+    if (copia2 > 0) {
+        memcpy(slot->dados + copia1, parte2, copia2);
+    }
+    slot->instante_ns = (int64_t)agora.tv_sec * 1000000000 + agora.tv_nsec;
+    slot->tamanho = (uint32_t)(tamanho1 + tamanho2);
+    slot->capturado = (uint32_t)(copia1 + copia2);
+
+    // Publica o frame para a thread de escrita
+    __atomic_store_n(&slot->sequencia, posicao + 1, __ATOMIC_RELEASE);
+}
+
+
+void captura_finalizar(void) {
+    if (!captura_ativa) return;
+
+    captura_ativa = 0;
+    __atomic_store_n(&captura.encerrar, 1, __ATOMIC_RELEASE);
+    pthread_join(captura.thread, NULL);
+    if (captura.arquivo) {
+        fclose(captura.arquivo);
+        captura.arquivo = NULL;
+    }
+    free(captura.slots);
+    captura.slots = NULL;
+
+    printf("🟡 Captura: %llu frames em %llu arquivos, %llu perdidos com o anel cheio\n",
+           (unsigned long long)captura.frames, (unsigned long long)captura.arquivos,
+           (unsigned long long)__atomic_load_n(&captura.perdidos, __ATOMIC_RELAXED));
+}
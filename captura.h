@@ -0,0 +1,45 @@
+#ifndef CAPTURA_H
+#define CAPTURA_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "rawSocket.h"
+
+
+#define CAPTURA_SLOTS 4096                  // Frames no anel (potência de 2); com ele cheio, o frame não é capturado
+#define CAPTURA_FRAME 256                   // Bytes guardados por frame (o maior do protocolo tem 42 + 131)
+#define CAPTURA_TAMANHO_ARQUIVO (16 * 1024 * 1024)  // Tamanho de cada arquivo antes da rotação
+#define CAPTURA_ARQUIVOS 8                  // Arquivos na rotação; o mais antigo é sobrescrito
+#define CAPTURA_ESPERA_MS 10                // Pausa da thread de escrita com o anel vazio
+
+
+//////////// Captura pcap ////////////
+
+// Frame copiado por envia_rawsocket ou recebe_rawsocket
+typedef struct {
+    uint64_t sequencia;                     // Posição do anel em que o slot está livre ou pronto
+    int64_t instante_ns;                    // CLOCK_REALTIME
+    uint32_t tamanho;                       // Tamanho do frame no fio
+    uint32_t capturado;                     // Bytes guardados em dados
+    uint8_t dados[CAPTURA_FRAME];
+} captura_slot_t;
+
+// Ativa quando a variável CAPTURA tem o prefixo dos arquivos: <prefixo>.0.pcap, <prefixo>.1.pcap...
+// Desativada, o custo no envio e na recepção é só o teste de captura_ativa
+extern int captura_ativa;
+
+
+//////////// Funções da captura ////////////
+
+// Abre o primeiro arquivo e cria a thread de escrita (prefixo NULL ou vazio: desativada)
+// Retorna -1 se o arquivo ou a thread não puderem ser criados
+int captura_iniciar(const char* prefixo);
+
+// Copia o frame, em até duas partes (cabeçalhos e dados), para o anel, sem travas
+// Vários produtores; com o anel cheio o frame é contado como perdido
+void captura_registrar(const void* parte1, size_t tamanho1, const void* parte2, size_t tamanho2);
+
+// Escreve o que ainda estiver no anel, fecha o arquivo e imprime os contadores
+void captura_finalizar(void);
+
+#endif // CAPTURA_H
@@ -0,0 +1,443 @@
+#define _XOPEN_SOURCE 700   // clock_nanosleep(), rand_r()
+
+#include "protocolo.h"
+#include "recepcao.h"
+#include "multifluxo.h"
+#include "histograma.h"
+#include "metricas.h"
+#include "perturbacao.h"
+#include "captura.h"
+#include "registro.h"
+#include "perfil.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+
+
+//////////// Gerador de carga ////////////
+
+// N jogadores simulados contra um servidor real, sem terminal: cada um abre a própria sessão,
+// anda pelo mapa no ritmo pedido e baixa cada tesouro que encontra. Comandos, download e
+// verificação são os do cliente (recepcao.c); os dados só passam pelo CRC-64, sem ir para o
+// disco. No fim: vazão do servidor, latência de cada movimento e sessões que falharam.
+//   ./carga <ip do servidor> [jogadores] [movimentos/s por jogador] [segundos] [aleatorio|varredura]
+// Com 0 movimentos/s cada jogador manda o próximo assim que o mapa chega. Com ritmo fixo a
+// latência conta do instante agendado, então um servidor atrasado não esconde a fila que criou.
+// Cada jogador tem um raw socket que recebe os frames de toda a interface: com muitos jogadores
+// o próprio gerador gasta CPU em frames dos outros, e vale medir o servidor em outra máquina
+
+#define CARGA_MAX_JOGADORES 1024
+#define CARGA_PORTAS_JOGADOR (NUM_FLUXOS + 1)   // Porta principal e as dos fluxos paralelos
+#define CARGA_ESPERA_MS 100                 // Espera de cada receber_pacote (o prazo é de TIMEOUT_S)
+#define CARGA_TENTATIVAS 10                 // Prazos de TIMEOUT_S seguidos sem resposta: a sessão falhou
+#define CARGA_TOLERANCIA_S 30               // Depois do tempo pedido, downloads em andamento ainda podem terminar
+#define CARGA_INTERVALO_RELATORIO_S 5
+
+typedef enum {
+    CARGA_ALEATORIO = 0,                    // Passeio aleatório, só por direções válidas
+    CARGA_VARREDURA = 1,                    // Zigue-zague pelas linhas, ida e volta
+} modo_carga_type;
+
+typedef enum {
+    FALHA_SOCKET = 0,
+    FALHA_INICIO = 1,
+    FALHA_MOVIMENTO = 2,
+    FALHA_DOWNLOAD = 3,
+    NUM_FALHAS = 4,
+} falha_type;
+
+static const char* nomes_falhas[NUM_FALHAS] = { "socket", "início", "movimento", "download" };
+
+typedef struct {
+    int indice;
+    protocolo_type protocolo;
+    recepcao_t recepcao;                    // Comandos e downloads, os mesmos do cliente
+    posicao_t posicao;
+    int sentido_y;                          // Varredura: 1 subindo, -1 descendo
+    int tesouros;                           // Baixados na partida atual
+    char encontrados[TAMANHO_MAPA][TAMANHO_MAPA];   // Casas dos tesouros já baixados nesta partida
+    unsigned int semente;
+    int criado;
+    pthread_t thread;
+} jogador_t;
+
+static struct {
+    char ip_servidor[16];
+    int num_jogadores;
+    double taxa;                            // Movimentos/s por jogador (0 = sem pausa)
+    int duracao_s;
+    modo_carga_type modo;
+    int64_t fim_us;                         // Nenhum movimento começa depois daqui
+    int64_t limite_us;                      // Downloads em andamento desistem daqui
+} config;
+
+// Contadores de todos os jogadores (acesso atômico)
+static struct {
+    histograma_t latencias_movimento;       // Movimento válido até o mapa, em µs
+    histograma_t tempos_download;           // Mapa com tesouro até o FIM confirmado, em ms
+    uint64_t movimentos;
+    uint64_t invalidos;                     // Contra a parede (o passeio não faz de propósito)
+    uint64_t ocupados;                      // Comandos recusados com SERVIDOR_OCUPADO
+    uint64_t downloads;
+    uint64_t divergentes;                   // CRC-64 do resumo diferente do calculado
+    uint64_t descartados;                   // Continuaram divergentes depois dos pedidos de reenvio
+    uint64_t bytes;
+    uint64_t falhas[NUM_FALHAS];
+    int ativos;
+} carga;
+
+
+static void somar(uint64_t* contador, uint64_t valor) {
+    __atomic_add_fetch(contador, valor, __ATOMIC_RELAXED);
+}
+
+
+static uint64_t ler(uint64_t* contador) {
+    return __atomic_load_n(contador, __ATOMIC_RELAXED);
+}
+
+
+static void dormir_ms(int ms) {
+    struct timespec pausa = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&pausa, NULL);
+}
+
+
+// Dorme até o instante de metricas_agora_us (mesmo relógio, CLOCK_MONOTONIC)
+static void dormir_ate(int64_t instante_us) {
+    struct timespec alvo = { (time_t)(instante_us / 1000000), (long)(instante_us % 1000000) * 1000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &alvo, NULL) == EINTR) {
+    }
+}
+
+
+//////////// Movimento ////////////
+
+static int direcao_valida(posicao_t posicao, mensagem_type direcao) {
+    switch (direcao) {
+        case MSG_MOVE_DIREITA: return posicao.x + 1 < TAMANHO_MAPA;
+        case MSG_MOVE_ESQUERDA: return posicao.x > 0;
+        case MSG_MOVE_CIMA: return posicao.y + 1 < TAMANHO_MAPA;
+        case MSG_MOVE_BAIXO: return posicao.y > 0;
+        default: return 0;
+    }
+}
+
+
+// Varredura: linhas pares para a direita, ímpares para a esquerda; no fim da última linha
+// a varredura volta descendo pelo mesmo caminho
+static mensagem_type direcao_varredura(jogador_t* jogador) {
+    posicao_t p = jogador->posicao;
+    mensagem_type horizontal = (p.y % 2 == 0) ? MSG_MOVE_DIREITA : MSG_MOVE_ESQUERDA;
+    if (direcao_valida(p, horizontal)) {
+        return horizontal;
+    }
+
+    mensagem_type vertical = jogador->sentido_y > 0 ? MSG_MOVE_CIMA : MSG_MOVE_BAIXO;
+    if (!direcao_valida(p, vertical)) {
+        jogador->sentido_y = -jogador->sentido_y;
+        vertical = jogador->sentido_y > 0 ? MSG_MOVE_CIMA : MSG_MOVE_BAIXO;
+    }
+    return vertical;
+}
+
+
+static mensagem_type proxima_direcao(jogador_t* jogador) {
+    if (config.modo == CARGA_VARREDURA) {
+        return direcao_varredura(jogador);
+    }
+
+    mensagem_type validas[4];
+    int quantidade = 0;
+    for (int d = MSG_MOVE_DIREITA; d <= MSG_MOVE_ESQUERDA; d++) {
+        if (direcao_valida(jogador->posicao, (mensagem_type)d)) {
+            validas[quantidade++] = (mensagem_type)d;
+        }
+    }
+    return validas[rand_r(&jogador->semente) % quantidade];
+}
+
+
+//////////// Download ////////////
+
+// Tamanho, nome, dados e verificação do tesouro pela mesma recepção do cliente
+// Os dados vão para /dev/null: só passam pelo CRC-64 e pelos pedidos de reenvio
+static int baixar_tesouro(jogador_t* jogador) {
+    int64_t inicio_us = metricas_agora_us();
+    tesouro_anunciado_t anuncio;
+    if (recepcao_anuncio(&jogador->recepcao, &anuncio) < 0) {
+        return -1;
+    }
+
+    // Os fluxos gravam com pwrite no offset de cada trecho: /dev/null aceita e descarta
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        recepcao_recusar(&jogador->recepcao, ESPACO_INSUFICIENTE);
+        return -1;
+    }
+    int resultado = recepcao_tesouro(&jogador->recepcao, &anuncio, fd);
+    close(fd);
+    if (resultado == -1) {
+        somar(&carga.descartados, 1);     // Não passou na verificação, como um tesouro descartado no cliente
+        return 0;
+    }
+    if (resultado < 0) {
+        return -1;
+    }
+
+    somar(&carga.downloads, 1);
+    somar(&carga.bytes, anuncio.tamanho);
+    histograma_registrar(&carga.tempos_download, (uint64_t)(metricas_agora_us() - inicio_us) / 1000);
+    return 0;
+}
+
+
+//////////// Jogador ////////////
+
+// Sessão completa de um jogador; retorna a etapa em que falhou ou -1 se chegou ao fim do tempo
+static int jogar(jogador_t* jogador) {
+    unsigned short porta = (unsigned short)(PORTA_CLIENTE + jogador->indice * CARGA_PORTAS_JOGADOR);
+    if (inicializar_protocolo(&jogador->protocolo, config.ip_servidor, porta, PORTA_SERVIDOR,
+                              INTERFACE_PADRAO) < 0) {
+        return FALHA_SOCKET;
+    }
+    jogador->protocolo.espera_ms = CARGA_ESPERA_MS;
+    recepcao_iniciar(&jogador->recepcao, &jogador->protocolo, CARGA_TENTATIVAS, 0);
+    jogador->recepcao.limite_us = config.limite_us;
+
+    struct_frame_mapa mapa;
+    if (recepcao_comando(&jogador->recepcao, MSG_START, &mapa) != 1) {
+        return FALHA_INICIO;
+    }
+    jogador->posicao = mapa.posicao_player;
+
+    int64_t intervalo_us = config.taxa > 0 ? (int64_t)(1000000.0 / config.taxa) : 0;
+    // Primeiro movimento em um instante sorteado do intervalo, para os jogadores não andarem juntos
+    int64_t agendado_us = metricas_agora_us();
+    if (intervalo_us > 0) {
+        agendado_us -= (int64_t)(rand_r(&jogador->semente) % (unsigned int)intervalo_us);
+    }
+    while (1) {
+        if (intervalo_us > 0) {
+            agendado_us += intervalo_us;
+            if (agendado_us >= config.fim_us) {
+                break;
+            }
+            dormir_ate(agendado_us);
+        } else {
+            agendado_us = metricas_agora_us();
+            if (agendado_us >= config.fim_us) {
+                break;
+            }
+        }
+
+        int resultado = recepcao_comando(&jogador->recepcao, proxima_direcao(jogador), &mapa);
+        if (resultado < 0) {
+            return FALHA_MOVIMENTO;
+        }
+        somar(&carga.movimentos, 1);
+        if (resultado == 0) {
+            somar(&carga.invalidos, 1);
+            continue;
+        }
+        histograma_registrar(&carga.latencias_movimento, (uint64_t)(metricas_agora_us() - agendado_us));
+        jogador->posicao = mapa.posicao_player;     // Volta a (0,0) quando o servidor reinicia a partida
+
+        // O mapa marca qualquer casa de tesouro; só um tesouro novo vem com o arquivo, como no cliente
+        posicao_t p = jogador->posicao;
+        if (mapa.pegar_tesouro && p.x >= 0 && p.x < TAMANHO_MAPA && p.y >= 0 && p.y < TAMANHO_MAPA &&
+            !jogador->encontrados[p.x][p.y]) {
+            if (baixar_tesouro(jogador) < 0) {
+                return FALHA_DOWNLOAD;
+            }
+            jogador->encontrados[p.x][p.y] = 1;
+
+            // Com o último tesouro o servidor reinicia a partida sem mandar outro mapa
+            if (++jogador->tesouros == MAX_TESOUROS) {
+                memset(jogador->encontrados, 0, sizeof(jogador->encontrados));
+                jogador->tesouros = 0;
+                jogador->posicao.x = 0;
+                jogador->posicao.y = 0;
+                jogador->sentido_y = 1;
+            }
+            agendado_us = metricas_agora_us();      // O download não conta como atraso dos movimentos
+        }
+    }
+    return -1;
+}
+
+
+static void* thread_jogador(void* arg) {
+    jogador_t* jogador = (jogador_t*)arg;
+
+    int falha = jogar(jogador);
+    if (falha >= 0) {
+        somar(&carga.falhas[falha], 1);
+        REG_AVISO("🔴 Jogador %d falhou: %s\n", jogador->indice, nomes_falhas[falha]);
+    }
+    if (falha != FALHA_SOCKET) {
+        finalizar_protocolo(&jogador->protocolo);
+    }
+    somar(&carga.ocupados, jogador->recepcao.ocupados);
+    somar(&carga.divergentes, jogador->recepcao.divergentes);
+    __atomic_sub_fetch(&carga.ativos, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+
+//////////// Relatório ////////////
+
+static uint64_t total_falhas(void) {
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_FALHAS; i++) {
+        total += ler(&carga.falhas[i]);
+    }
+    return total;
+}
+
+
+// Uma linha por histograma: p50, p90, p99, p99.9 e máximo em milissegundos
+static void imprimir_percentis(const char* nome, const histograma_t* histograma, double divisor) {
+    printf("%-22s %7llu amostras  p50 %8.2f  p90 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f ms\n", nome,
+           (unsigned long long)histograma->total,
+           (double)histograma_percentil(histograma, 50.0) / divisor,
+           (double)histograma_percentil(histograma, 90.0) / divisor,
+           (double)histograma_percentil(histograma, 99.0) / divisor,
+           (double)histograma_percentil(histograma, 99.9) / divisor,
+           (double)histograma->maximo / divisor);
+}
+
+
+// Os movimentos param no tempo pedido; os downloads podem seguir até o fim da tolerância
+static void imprimir_relatorio(double segundos) {
+    double segundos_movimento = segundos < config.duracao_s ? segundos : config.duracao_s;
+    uint64_t movimentos = ler(&carga.movimentos);
+    uint64_t bytes = ler(&carga.bytes);
+    uint64_t falhas = total_falhas();
+
+    printf("\n═══════ CARGA: %d jogadores, %s, %.1f s ═══════\n", config.num_jogadores,
+           config.modo == CARGA_VARREDURA ? "varredura" : "aleatorio", segundos);
+    printf("Sessões: %llu completas, %llu falharam", (unsigned long long)(config.num_jogadores - falhas),
+           (unsigned long long)falhas);
+    for (int i = 0; i < NUM_FALHAS; i++) {
+        if (carga.falhas[i] > 0) {
+            printf("  %s %llu", nomes_falhas[i], (unsigned long long)carga.falhas[i]);
+        }
+    }
+    printf("\n");
+    printf("Movimentos: %llu (%.1f/s), %llu inválidos, %llu recusados com servidor ocupado\n",
+           (unsigned long long)movimentos, movimentos / segundos_movimento, (unsigned long long)ler(&carga.invalidos),
+           (unsigned long long)ler(&carga.ocupados));
+    printf("Tesouros: %llu baixados, %.2f MB (%.2f MB/s), %llu com CRC divergente, %llu descartados\n",
+           (unsigned long long)ler(&carga.downloads), bytes / 1e6, bytes / 1e6 / segundos,
+           (unsigned long long)ler(&carga.divergentes), (unsigned long long)ler(&carga.descartados));
+    imprimir_percentis("Movimento até o mapa", &carga.latencias_movimento, 1000.0);
+    imprimir_percentis("Download de tesouro", &carga.tempos_download, 1.0);
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s <ip do servidor> [jogadores] [movimentos/s por jogador, 0 = sem pausa] "
+                        "[segundos] [aleatorio|varredura]\n", argv[0]);
+        return 1;
+    }
+
+    // Antes dos jogadores, para que todas as threads herdem os sinais do perfil bloqueados
+    if (perfil_iniciar() < 0) {
+        fprintf(stderr, "⚠️  Perfil desativado: não foi possível criar a thread de sinais\n");
+    }
+
+    snprintf(config.ip_servidor, sizeof(config.ip_servidor), "%s", argv[1]);
+    config.num_jogadores = argc > 2 ? atoi(argv[2]) : 10;
+    config.taxa = argc > 3 ? atof(argv[3]) : 5.0;
+    config.duracao_s = argc > 4 ? atoi(argv[4]) : 30;
+    config.modo = CARGA_ALEATORIO;
+    if (argc > 5) {
+        if (strcmp(argv[5], "varredura") == 0) {
+            config.modo = CARGA_VARREDURA;
+        } else if (strcmp(argv[5], "aleatorio") != 0) {
+            fprintf(stderr, "🟡 Modo de movimento %s desconhecido, usando aleatorio\n", argv[5]);
+        }
+    }
+    if (config.num_jogadores < 1 || config.num_jogadores > CARGA_MAX_JOGADORES || config.taxa < 0 ||
+        config.duracao_s < 1) {
+        fprintf(stderr, "🔴 Parâmetros inválidos (1 a %d jogadores, taxa >= 0, pelo menos 1 s)\n",
+                CARGA_MAX_JOGADORES);
+        return 1;
+    }
+
+    if (perturbacao_iniciar(getenv("PERTURBACAO")) < 0) {
+        fprintf(stderr, "🔴 PERTURBACAO inválida: %s\n", getenv("PERTURBACAO"));
+        return 1;
+    }
+    if (registro_iniciar() < 0) {
+        fprintf(stderr, "🟡 Sem registro assíncrono: as mensagens são impressas na hora\n");
+    }
+    if (captura_iniciar(getenv("CAPTURA")) < 0) {
+        fprintf(stderr, "🔴 Não foi possível capturar em %s\n", getenv("CAPTURA"));
+        perturbacao_finalizar();
+        return 1;
+    }
+
+    jogador_t* jogadores = calloc((size_t)config.num_jogadores, sizeof(jogador_t));
+    if (!jogadores) {
+        perror("🔴 Erro ao alocar os jogadores");
+        return 1;
+    }
+
+    int64_t inicio_us = metricas_agora_us();
+    config.fim_us = inicio_us + (int64_t)config.duracao_s * 1000000;
+    config.limite_us = config.fim_us + (int64_t)CARGA_TOLERANCIA_S * 1000000;
+    unsigned int semente = (unsigned int)time(NULL);
+    printf("🟢 %d jogadores contra %s:%d por %d s (semente %u)\n", config.num_jogadores, config.ip_servidor,
+           PORTA_SERVIDOR, config.duracao_s, semente);
+
+    for (int i = 0; i < config.num_jogadores; i++) {
+        jogadores[i].indice = i;
+        jogadores[i].sentido_y = 1;
+        jogadores[i].semente = semente + (unsigned int)i;
+        __atomic_add_fetch(&carga.ativos, 1, __ATOMIC_RELAXED);
+        if (pthread_create(&jogadores[i].thread, NULL, thread_jogador, &jogadores[i]) != 0) {
+            __atomic_sub_fetch(&carga.ativos, 1, __ATOMIC_RELAXED);
+            somar(&carga.falhas[FALHA_SOCKET], 1);
+            continue;
+        }
+        jogadores[i].criado = 1;
+    }
+
+    // Progresso a cada intervalo enquanto houver jogadores
+    uint64_t movimentos_antes = 0;
+    uint64_t bytes_antes = 0;
+    int64_t ultimo_us = inicio_us;
+    while (__atomic_load_n(&carga.ativos, __ATOMIC_RELAXED) > 0) {
+        dormir_ms(100);
+        int64_t agora_us = metricas_agora_us();
+        if (agora_us - ultimo_us < (int64_t)CARGA_INTERVALO_RELATORIO_S * 1000000) {
+            continue;
+        }
+        double intervalo_s = (agora_us - ultimo_us) / 1e6;
+        uint64_t movimentos = ler(&carga.movimentos);
+        uint64_t bytes = ler(&carga.bytes);
+        printf("%6.1f s  %4d ativos  %8.1f movimentos/s  %6.2f MB/s  %llu falhas\n", (agora_us - inicio_us) / 1e6,
+               __atomic_load_n(&carga.ativos, __ATOMIC_RELAXED), (movimentos - movimentos_antes) / intervalo_s,
+               (bytes - bytes_antes) / 1e6 / intervalo_s, (unsigned long long)total_falhas());
+        fflush(stdout);
+        movimentos_antes = movimentos;
+        bytes_antes = bytes;
+        ultimo_us = agora_us;
+    }
+    for (int i = 0; i < config.num_jogadores; i++) {
+        if (jogadores[i].criado) {
+            pthread_join(jogadores[i].thread, NULL);
+        }
+    }
+    double segundos = (metricas_agora_us() - inicio_us) / 1e6;
+
+    perturbacao_finalizar();
+    captura_finalizar();
+    registro_finalizar();
+    imprimir_relatorio(segundos);
+    free(jogadores);
+    return total_falhas() > 0 ? 2 : 0;
+}
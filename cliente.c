@@ -1,13 +1,30 @@
 #include "protocolo.h"
 #include "rawSocket.h"
+#include "escritor.h"
+#include "recepcao.h"
+#include "histograma.h"
+#include "metricas.h"
+#include "perturbacao.h"
+#include "captura.h"
+#include "registro.h"
+#include "perfil.h"
 
 #define DIRETORIO_TESOUROS "./transferidos/"
+#define EXTENSAO_CORROMPIDO ".corrompido"   // Tesouro que não passou na verificação
+
+// Latência percebida pelo jogador
+histograma_t latencias_movimento;       // Tecla até o mapa atualizado, em µs
+histograma_t tempos_download;           // Mapa com tesouro até o arquivo salvo, em ms
+int64_t inicio_movimento_us;            // Tecla do movimento em andamento (0 sem movimento)
+
+// Comandos, download e verificação dos tesouros, os mesmos do gerador de carga
+recepcao_t recepcao;
 
 //////////// Protótipos das funções ////////////
 
 // Cria o socket raw e configura o endereço do servidor
-// Inicializa o estado do protocolo do cliente
-int conectar_com_servidor(struct_cliente* cliente, const char* ip_servidor, int porta);
+// Inicializa o estado do protocolo do cliente na porta local informada
+int conectar_com_servidor(struct_cliente* cliente, const char* ip_servidor, int porta, int porta_cliente);
 
 // Envia o comando para iniciar o jogo e aguarda confirmação do servidor
 // Após o ACK, recebe o mapa inicial e configura o estado do cliente
@@ -25,21 +42,17 @@ void imprimir_opcoes_movimento();
 // Valida o comando, transmite o movimento e aguarda resposta
 int gerenciar_comando_movimento(struct_cliente* cliente, char comando);
 
-// Cria e envia o pacote de movimento solicitado pelo jogador
-// Incrementa a sequência e transmite via protocolo do cliente
-int transmitir_movimento(struct_cliente* cliente, mensagem_type tipo_movimento);
-
-// Processa a resposta recebida do servidor e atualiza o estado do cliente
-// Trata erros, movimentação e possível coleta de tesouros
-int gerenciar_resposta_servidor(struct_cliente* cliente);
+// Atualiza o estado do cliente com o mapa recebido do servidor
+// Baixa o tesouro quando o jogador chega em um tesouro novo
+int gerenciar_resposta_servidor(struct_cliente* cliente, const struct_frame_mapa* frameMapa);
 
 // Recebe as informações e o arquivo do tesouro enviado pelo servidor
-// Confirma o recebimento do tamanho e processa o arquivo recebido
-int baixar_tesouro(struct_cliente* cliente);
+// Confere o espaço livre antes de aceitar o tesouro
+int baixar_tesouro(void);
 
-// Recebe o arquivo do tesouro em blocos e salva no diretório local
-// Garante integridade com ACKs e exibe o conteúdo ao final
-int salvar_tesouro(struct_cliente* cliente, const char* nome_tesouro, mensagem_type tipo, uint64_t tamanho);
+// Recebe o arquivo do tesouro e salva no diretório local
+// Só exibe o conteúdo depois que o CRC-64 confere
+int salvar_tesouro(const tesouro_anunciado_t* anuncio);
 
 // Exibe o conteúdo do tesouro recebido, conforme o tipo identificado
 // Mostra vídeo, imagem ou texto e imprime o nome do tesouro
@@ -51,6 +64,9 @@ void reseta_interface();
 // Retorna "DESCONHECIDO" se o código for inválido
 const char* converter_direcao(mensagem_type tipo);
 
+// Imprime os percentis da latência dos movimentos e do download dos tesouros
+void imprimir_latencias(void);
+
 
 // Configura o terminal para modo raw, desativando buffer e eco de teclas
 // Permite leitura imediata de teclas no terminal do cliente (sem buffer)
@@ -72,6 +88,11 @@ void restaurar_modo_terminal(struct termios *orig) {
 
 
 int main(int argc, char* argv[]) {
+    // Antes de qualquer thread, para que todas herdem os sinais do perfil bloqueados
+    if (perfil_iniciar() < 0) {
+        fprintf(stderr, "⚠️  Perfil desativado: não foi possível criar a thread de sinais\n");
+    }
+
     struct termios orig_termios;  // Variável para guardar o estado original
     configurar_terminal_raw(&orig_termios);
 
@@ -79,6 +100,7 @@ int main(int argc, char* argv[]) {
     struct_cliente cliente;
     char ip_servidor[16];
     int porta_servidor = PORTA_SERVIDOR;
+    int porta_cliente = PORTA_CLIENTE;
     
     // Limpar estrutura do cliente
     memset(&cliente, 0, sizeof(cliente));
@@ -96,13 +118,39 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    // Porta local opcional, para vários jogadores na mesma máquina
+    if (argc > 2) {
+        porta_cliente = atoi(argv[2]);
+    }
+    
+    // Enlace perturbado sob demanda, para exercitar retransmissões e NACKs
+    if (perturbacao_iniciar(getenv("PERTURBACAO")) < 0) {
+        fprintf(stderr, "🔴 PERTURBACAO inválida: %s\n", getenv("PERTURBACAO"));
+        restaurar_modo_terminal(&orig_termios);
+        return 1;
+    }
+
+    // Avisos do protocolo (checksum, marcador) formatados fora do caminho de recepção
+    if (registro_iniciar() < 0) {
+        fprintf(stderr, "🟡 Sem registro assíncrono: as mensagens são impressas na hora\n");
+    }
+
+    // Cópia dos frames em pcap sob demanda, para investigar transferências travadas
+    if (captura_iniciar(getenv("CAPTURA")) < 0) {
+        fprintf(stderr, "🔴 Não foi possível capturar em %s\n", getenv("CAPTURA"));
+        perturbacao_finalizar();
+        restaurar_modo_terminal(&orig_termios);
+        return 1;
+    }
+
     // Conectar ao servidor
-    if (conectar_com_servidor(&cliente, ip_servidor, porta_servidor) < 0) {
+    if (conectar_com_servidor(&cliente, ip_servidor, porta_servidor, porta_cliente) < 0) {
         fprintf(stderr, "🔴 Erro ao conectar ao servidor\n");
         return 1;
     }
     
     printf("Conectado ao servidor %s:%d\n", ip_servidor, porta_servidor);
+    recepcao_iniciar(&recepcao, &cliente.protocolo, MAX_RETRY, 1);
     
     // Criar diretório de tesouros se não existir
     system("mkdir -p " DIRETORIO_TESOUROS);
@@ -139,6 +187,13 @@ int main(int argc, char* argv[]) {
             printf("Saindo...\n");
             break;
         }
+
+        if (comando == 'l') {
+            imprimir_latencias();
+            printf("ENTER continuar...");
+            getchar();
+            continue;
+        }
         
         int p = gerenciar_comando_movimento(&cliente, comando);
         if (p == -4){
@@ -158,6 +213,10 @@ int main(int argc, char* argv[]) {
     // encerra o programa
     reseta_interface();
     finalizar_protocolo(&cliente.protocolo);
+    perturbacao_finalizar();
+    captura_finalizar();
+    registro_finalizar();
+    imprimir_latencias();
     printf("Jogo Finalizado. Para sair aperte ENTER\n");
     getchar();
     restaurar_modo_terminal(&orig_termios);
@@ -168,10 +227,10 @@ int main(int argc, char* argv[]) {
 
 // Cria o socket raw e configura o endereço do servidor
 // Inicializa o estado do protocolo do cliente
-int conectar_com_servidor(struct_cliente* cliente, const char* ip_servidor, int porta) 
+int conectar_com_servidor(struct_cliente* cliente, const char* ip_servidor, int porta, int porta_cliente) 
 {
     // Inicializar protocolo com raw socket
-    if (inicializar_protocolo(&cliente->protocolo, ip_servidor, PORTA_CLIENTE, porta, INTERFACE_PADRAO) < 0) {
+    if (inicializar_protocolo(&cliente->protocolo, ip_servidor, porta_cliente, porta, INTERFACE_PADRAO) < 0) {
         fprintf(stderr, "Erro ao inicializar protocolo cliente\n");
         return -1;
     }
@@ -225,72 +284,34 @@ void atualizar_mapa(mapa_cliente_t *clientMap, struct_frame_mapa frameMap, int *
 // Envia o comando para iniciar o jogo e aguarda confirmação do servidor
 // Após o ACK, recebe o mapa inicial e configura o estado do cliente
 int requisitar_inicio_jogo(struct_cliente* cliente) {
-    // Enviar comando para iniciar jogo
-    pack_t frame_inicio;
-    criar_pacote(&frame_inicio, cliente->protocolo.seq_atual, MSG_START, NULL, 0);
-    
     for(int i = 0; i < TAMANHO_MAPA; i++){
         for(int j=0; j < TAMANHO_MAPA; j++){
             cliente->mapa_ativo.local_explorado[i][j] = 0;
         }
     }
 
-    while(1){
-        if (enviar_pacote(&cliente->protocolo, &frame_inicio) < 0) {
-            printf("🔴 Erro ao enviar comando de início\n");
-            sleep(TIMEOUT_S);
-            continue;
-        }
-        else
-            printf("🟢 Comando de inicio enviado Seq: %d \n", cliente->protocolo.seq_atual);
-
-        // Aguardar ACK do servidor
-        if (esperar_ack(&cliente->protocolo) < 0) {
-            printf(" 🟡 Servidor não confirmou início do jogo\n");
-            continue;
-        }
-        else{
-            printf(" 🟢 Servidor confirmou início do jogo\n");
-            break;
-        }
-    }
-
-    while(1){
-        // Receber mapa inicial
-        pack_t frameRecebido;
-        if (receber_pacote(&cliente->protocolo, &frameRecebido) < 0) {
-            printf("🔴 Erro ao receber mapa.\n");
-            enviar_nack(&cliente->protocolo, getSeq(frameRecebido));
-            continue;
-        }
-        else{
-            printf("🟢 Recebido mapa inicial\n");
-            cliente->protocolo.seq_atual = getSeq(frameRecebido);
-            enviar_ack(&cliente->protocolo, getSeq(frameRecebido));
-        }
-        if (frameRecebido.tipo != MSG_INTERFACE) {
-            printf("Resposta inesperada do servidor: tipo %d\n", frameRecebido.tipo);
-            continue;
-        }
-        struct_frame_mapa frameMapa;
-        memcpy(&frameMapa, frameRecebido.dados, sizeof(struct_frame_mapa));
-
-        // Copiar dados do mapa
-        cliente->mapa_ativo.numero_tesouros = 0;
-        atualizar_mapa(&cliente->mapa_ativo, frameMapa, 0); 
-        cliente->jogo_ativo = 1;
-        cliente->tesouros_obtidos = cliente->mapa_ativo.numero_tesouros;
-        break;
+    struct_frame_mapa frameMapa;
+    if (recepcao_comando(&recepcao, MSG_START, &frameMapa) != 1) {
+        printf(" 🔴 Servidor não confirmou início do jogo\n");
+        return -1;
     }
+    printf(" 🟢 Servidor confirmou início do jogo\n");
 
+    // Copiar dados do mapa
+    cliente->mapa_ativo.numero_tesouros = 0;
+    atualizar_mapa(&cliente->mapa_ativo, frameMapa, 0); 
+    cliente->jogo_ativo = 1;
+    cliente->tesouros_obtidos = cliente->mapa_ativo.numero_tesouros;
     return 0;
 }
 
 
 
+
 // Exibe o mapa atualizado do cliente no terminal
 // Mostra posição atual, tesouros coletados e áreas exploradas
 void exibir_mapa_cliente(struct_cliente* cliente) {
+    PERFIL_ESCOPO(PERFIL_INTERFACE);
     printf("\n=== MAPA DO CAÇA AO TESOURO ===\n");
     printf("Posição atual: (%d,%d)\n", 
         cliente->mapa_ativo.posicao_player.x, 
@@ -339,6 +360,7 @@ void imprimir_opcoes_movimento() {
     printf("a. Mover para BAIXO\n");
     printf("s. Mover para ESQUERDA\n");
     printf("d. Mover para DIREITA\n");
+    printf("l. Latência dos movimentos e downloads\n");
     printf("q. Sair do jogo\n");
     printf("═══════════════════════════════\n");
 }
@@ -348,6 +370,7 @@ void imprimir_opcoes_movimento() {
 // Processa o comando do jogador e envia o movimento correspondente ao servidor
 // Valida o comando, transmite o movimento e aguarda resposta
 int gerenciar_comando_movimento(struct_cliente* cliente, char comando) {
+    PERFIL_ESCOPO(PERFIL_PROCESSAR_MOVIMENTO);
     mensagem_type tipo_movimento;
     switch (comando) {
         case 'w':
@@ -369,239 +392,97 @@ int gerenciar_comando_movimento(struct_cliente* cliente, char comando) {
     
     printf("🟢 Enviando movimento: %s...\n", converter_direcao(tipo_movimento));
     
+    // A latência conta da tecla até o mapa atualizado, com as repetições no meio
+    inicio_movimento_us = metricas_agora_us();
 
-    // Enviar movimento para o servidor
-    if (transmitir_movimento(cliente, tipo_movimento) < 0) {
+    // Enviar movimento e esperar o mapa (-4: o servidor não responde mais)
+    struct_frame_mapa frameMapa;
+    int resposta = recepcao_comando(&recepcao, tipo_movimento, &frameMapa);
+    if (resposta == 0) {
+        printf("🔴 Movimento inválido!\n");
+        printf("ENTER para continuar...");
+        getchar();
         return -1;
     }
-    
+    if (resposta == -1) {
+        printf("🔴 Erro do servidor: %d\n", recepcao.erro);
+        printf("ENTER continuar...");
+        getchar();
+        return 0;
+    }
+    if (resposta < 0) {
+        return resposta;
+    }
+    printf("🟢 Movimento valido!\n");
+
     // Processar resposta do servidor
-    return gerenciar_resposta_servidor(cliente);
+    return gerenciar_resposta_servidor(cliente, &frameMapa);
 }
 
 
 
-// Cria e envia o pacote de movimento solicitado pelo jogador
-// Incrementa a sequência e transmite via protocolo do cliente
-int transmitir_movimento(struct_cliente* cliente, mensagem_type tipo_movimento) {
-    pack_t frame_movimento;
 
-
-    cliente->protocolo.seq_atual = (cliente->protocolo.seq_atual + 1) % 32;
-    
-    criar_pacote(&frame_movimento, cliente->protocolo.seq_atual, tipo_movimento, NULL, 0);
-    while(1){
-        enviar_pacote(&cliente->protocolo, &frame_movimento);
-        int i = esperar_ack(&cliente->protocolo);
-        if(i < 0){
-
-            continue;
-        }
-        if(i == 0){
-            printf("🔴 Movimento inválido!\n");
-            printf("ENTER para continuar...");
-            getchar();
-            return -1;
-        }
-        else if (i == 1){
-            printf("🟢 Movimento valido!\n");
-            break;
-        }
-        else{
-            printf("erro na menssagem recebida!\n");
-            continue;
-        }
+// Atualiza o estado do cliente com o mapa recebido do servidor
+// Baixa o tesouro quando o jogador chega em um tesouro novo
+int gerenciar_resposta_servidor(struct_cliente* cliente, const struct_frame_mapa* frameMapa) {
+    int newTreasure = 0;
+    atualizar_mapa(&cliente->mapa_ativo, *frameMapa, &newTreasure);
+    if (inicio_movimento_us > 0) {
+        histograma_registrar(&latencias_movimento, (uint64_t)(metricas_agora_us() - inicio_movimento_us));
+        inicio_movimento_us = 0;
     }
-    return 0;
-}
-
-
-
 
-// Processa a resposta recebida do servidor e atualiza o estado do cliente
-// Trata erros, movimentação e possível coleta de tesouros
-int gerenciar_resposta_servidor(struct_cliente* cliente) {
-    pack_t frame_resposta;
-    struct_frame_mapa frameMapa;
-
-    // Receber resposta do servidor
-    int result = receber_pacote(&cliente->protocolo, &frame_resposta);
-    if (result < 0) {
-        if (result == -2) {
-            printf("Timeout - servidor não respondeu\n");
-        } else {
-            printf("🔴 Erro ao receber resposta do servidor\n");
-        }
-        return -1;
+    if (cliente->mapa_ativo.numero_tesouros > cliente->tesouros_obtidos) {
+        printf("🌟 Tesouro descoberto! 🌟\n");
+        cliente->tesouros_obtidos = cliente->mapa_ativo.numero_tesouros;
     }
-
-    uint8_t tipo = frame_resposta.tipo;
-    uint8_t seq = getSeq(frame_resposta);
-    int isSeq = seqCheck( cliente->protocolo.seq_atual, seq);
-    if(isSeq != 1){
-        return reenvio(&cliente->protocolo, cliente->protocolo.pack);
-    }
-    int newTreasure = 0;
-    switch (tipo) {
-        case MSG_ERRO:
-            cliente->protocolo.seq_atual = getSeq(frame_resposta);
-            printf("🔴 Erro do servidor: %d\n", frame_resposta.dados[0]);
-            printf("ENTER continuar...");
-            getchar();
-            return 0;
-
-        case MSG_INTERFACE:
-            cliente->protocolo.seq_atual = getSeq(frame_resposta);
-            memcpy(&frameMapa, frame_resposta.dados, sizeof(struct_frame_mapa));
-            atualizar_mapa(&cliente->mapa_ativo, frameMapa, &newTreasure);
-
-
-            if (cliente->mapa_ativo.numero_tesouros > cliente->tesouros_obtidos) {
-                printf("🌟 Tesouro descoberto! 🌟\n");
-                cliente->tesouros_obtidos = cliente->mapa_ativo.numero_tesouros;
-            }
-            enviar_ack(&cliente->protocolo, cliente->protocolo.seq_atual); // usa seq recuperado com macro
-            if(frameMapa.pegar_tesouro && newTreasure)
-                if(baixar_tesouro(cliente) == -4)
-                    return -4;
-            return 0;
-       
-        default:
-            printf("Resposta inesperada do servidor: tipo %d\n", tipo);
-            return -1;
+    if(frameMapa->pegar_tesouro && newTreasure){
+        int64_t inicio_download_us = metricas_agora_us();
+        int resultado = baixar_tesouro();
+        if(resultado == -4)
+            return -4;
+        if(resultado >= 0)
+            histograma_registrar(&tempos_download, (uint64_t)(metricas_agora_us() - inicio_download_us) / 1000);
     }
+    return 0;
 }
 
 
 
 // Recebe as informações e o arquivo do tesouro enviado pelo servidor
-// Confirma o recebimento do tamanho e processa o arquivo recebido
-int baixar_tesouro(struct_cliente* cliente) {
-    //Preparando pra receber o tipo tamanho
-    pack_t pack;
-    int debug = receber_pacote(&cliente->protocolo, &pack);
-
-    //tenta receber
-    while(1){
-        if (debug < 0) {
-            printf("🔴 Erro ao receber informações do tesouro\n");
-            debug = receber_pacote(&cliente->protocolo, &pack);
-            continue;
-        }
-        if(pack.tipo != MSG_TAMANHO){
-            debug = receber_pacote(&cliente->protocolo, &pack);
-            continue;
-        }
-        else{
-            uint64_t tamanho_lido;
-            enviar_ack(&cliente->protocolo, getSeq(pack));
-            uint8_t tam[MAX_FRAME];
-            memcpy(tam, pack.dados, sizeof(uint64_t));
-            while(1){
-                memcpy(&tamanho_lido, tam, sizeof(uint64_t));
-                printf("Arquivo do tesouro possui = %llu bytes\n", (unsigned long long)tamanho_lido);
-                break;
-            }
-            receber_pacote(&cliente->protocolo, &pack);
-            int tipo = pack.tipo;
-            if(tipo >= MSG_TEXTO_ACK_NOME && tipo <= MSG_IMAGEM_ACK_NOME){
-
-                mensagem_type tipo_arquivo = pack.tipo;
-                char nome_tesouro[256];
-
-                strncpy(nome_tesouro, (char*)pack.dados, pack.tamanho);
-            
-                uint64_t tamanhoLivre = obter_espaco_livre(DIRETORIO_TESOUROS);
-                if(tamanhoLivre < tamanho_lido){
-                    fprintf(stderr, "impossivel armazenar tamanho disponivel: %llu, tamanho necessario: %llu\n", (unsigned long long) tamanhoLivre, (unsigned long long) tamanho_lido);
-                    printf("Pressione ENTER para continuar...\n");
-                    getchar();
-                    enviar_erro(&cliente->protocolo, getSeq(pack), ESPACO_INSUFICIENTE);
-                    return -4;
-                }
-                enviar_ack(&cliente->protocolo, getSeq(pack));
-                printf("Tamanho disponivel: %llu, tamanho necessario: %llu\n", (unsigned long long) tamanhoLivre, (unsigned long long) tamanho_lido);
-                return salvar_tesouro(cliente, nome_tesouro, tipo_arquivo, tamanho_lido);
-            }
-            else if(tipo == MSG_ERRO){
-                perror("Erro ao abrir arquivo do tesouro\n");
-                printf("ENTER para continuar...\n");
-                getchar();
-                return -4;
-            }
-            else
-                continue;
-            break;
-        }
+// Confere o espaço livre antes de aceitar o tesouro
+int baixar_tesouro(void) {
+    tesouro_anunciado_t anuncio;
+    int resultado = recepcao_anuncio(&recepcao, &anuncio);
+    if (resultado == -1) {
+        perror("Erro ao abrir arquivo do tesouro\n");
+        printf("ENTER para continuar...\n");
+        getchar();
+        return -4;
     }
-
-    return 0;
-}
-
-
-
-// Recebe o arquivo do tesouro em blocos e salva no diretório local
-// Garante integridade com ACKs e exibe o conteúdo ao final
-int salvar_tesouro(struct_cliente* cliente, const char* nome_tesouro, mensagem_type tipo, uint64_t tamanho) {
-    char caminho_completo[512];
-    snprintf(caminho_completo, sizeof(caminho_completo), "%s%s", DIRETORIO_TESOUROS, nome_tesouro);
-
-    FILE* arquivo = fopen(caminho_completo, "wb");
-    if (!arquivo) {
-        perror("Erro ao criar arquivo do tesouro");
-        return -1;
+    if (resultado < 0) {
+        return -4;
     }
 
-    uint64_t bytes_recebidos = 0;
-    pack_t pack;
-    uint8_t seqAtual;
-    uint8_t seq = -1;
-
-    while (bytes_recebidos < tamanho) {
-        memset(&pack, 0, sizeof(pack));
-        if (receber_pacote(&cliente->protocolo, &pack) < 0) {
-            printf("🔴 Erro ao receber dados do tesouro\n");
-            continue;
-        }
+    uint64_t tamanhoLivre = obter_espaco_livre(DIRETORIO_TESOUROS);
+    if(tamanhoLivre < anuncio.tamanho){
+        fprintf(stderr, "impossivel armazenar tamanho disponivel: %llu, tamanho necessario: %llu\n", (unsigned long long) tamanhoLivre, (unsigned long long) anuncio.tamanho);
+        printf("Pressione ENTER para continuar...\n");
+        getchar();
+        recepcao_recusar(&recepcao, ESPACO_INSUFICIENTE);
+        return -4;
+    }
+    printf("Tamanho disponivel: %llu, tamanho necessario: %llu\n", (unsigned long long) tamanhoLivre, (unsigned long long) anuncio.tamanho);
 
-        // Verificar tipo de dados
-        if (pack.tipo != MSG_DADOS){
-            printf("Tipo de pacote inesperado: %d\n", pack.tipo);
-            continue;
-        }
+    // O ACK do nome é enviado pela recepção quando o destino estiver pronto
+    return salvar_tesouro(&anuncio);
+}
 
-        
-        seqAtual = getSeq(pack);
-        if(seq == seqAtual){
-            enviar_ack(&cliente->protocolo, getSeq(pack));
-            continue;
-        }
 
-        if((pack.tamanho < 127) && ((tamanho - (uint64_t)bytes_recebidos) > (uint64_t)pack.tamanho)){
-            enviar_nack(&cliente->protocolo, getSeq(pack));
-            continue;
-        }
-        else if  ((pack.tamanho < 127) && ((tamanho - (uint64_t)bytes_recebidos) < (uint64_t)pack.tamanho)){
-            enviar_nack(&cliente->protocolo, getSeq(pack));
-            continue;
-    }
-        // Escrever dados no arquivo
-        size_t bytes_escritos = fwrite(pack.dados, 1, pack.tamanho, arquivo);
-        
-        if (bytes_escritos != pack.tamanho) {
-            perror("Erro ao escrever no arquivo");
-            continue;
-        }
-        
-        seq = seqAtual;
-        cliente->protocolo.seq_atual = seq;
-        bytes_recebidos += bytes_escritos;
-        printf("🟢 Pacote recebido %u (%zd / %llu)\n", getSeq(pack) ,bytes_recebidos, (unsigned long long)tamanho);
-        enviar_ack(&cliente->protocolo, getSeq(pack));
-    }
-    fclose(arquivo);
 
 
+// Ajusta o dono do arquivo baixado para o usuário real (mesmo rodando com sudo)
+static void ajustar_dono_tesouro(const char* caminho_completo) {
     // Se estiver rodando como root, tenta pegar o dono real
     const char* user_name = getenv("SUDO_USER");
     if (!user_name) {
@@ -617,14 +498,55 @@ int salvar_tesouro(struct_cliente* cliente, const char* nome_tesouro, mensagem_t
             chown(caminho_completo, pw->pw_uid, pw->pw_gid);
         }
     }
-    visualizar_tesouro(nome_tesouro, caminho_completo, tipo);
+}
+
+
+// Tesouro que não passou na verificação: não é exibido e fica com a extensão EXTENSAO_CORROMPIDO
+static void descartar_tesouro(const char* nome_tesouro, const char* caminho_completo) {
+    char corrompido[512 + sizeof(EXTENSAO_CORROMPIDO)];
+    snprintf(corrompido, sizeof(corrompido), "%s%s", caminho_completo, EXTENSAO_CORROMPIDO);
+    if (rename(caminho_completo, corrompido) < 0) {
+        unlink(caminho_completo);
+        fprintf(stderr, "🔴 Tesouro %s corrompido, arquivo removido\n", nome_tesouro);
+        return;
+    }
+    fprintf(stderr, "🔴 Tesouro %s corrompido, guardado em %s\n", nome_tesouro, corrompido);
+}
 
+
+// Recebe o arquivo do tesouro e salva no diretório local
+// Só exibe o conteúdo depois que o CRC-64 confere
+int salvar_tesouro(const tesouro_anunciado_t* anuncio) {
+    char caminho_completo[512];
+    snprintf(caminho_completo, sizeof(caminho_completo), "%s%s", DIRETORIO_TESOUROS, anuncio->nome);
+
+    int fd = escritor_criar_arquivo(caminho_completo, anuncio->tamanho);
+    if (fd < 0) {
+        perror("Erro ao criar arquivo do tesouro");
+        recepcao_recusar(&recepcao, ESPACO_INSUFICIENTE);
+        return -1;
+    }
+
+    int resultado = recepcao_tesouro(&recepcao, anuncio, fd);
+    close(fd);
+    if (resultado == -1) {
+        descartar_tesouro(anuncio->nome, caminho_completo);
+        return -1;
+    }
+    if (resultado < 0) {
+        unlink(caminho_completo);   // Arquivo incompleto
+        return resultado == -4 ? -4 : -1;
+    }
+
+    ajustar_dono_tesouro(caminho_completo);
+    visualizar_tesouro(anuncio->nome, caminho_completo, anuncio->tipo);
     return 0;
 }
 
 
 
 
+
 // Exibe o conteúdo textual de um tesouro no terminal
 // Lê o arquivo linha por linha e aguarda ENTER ao final
 void visualizar_texto(const char *caminho_arquivo) {
@@ -708,3 +630,21 @@ const char* converter_direcao(mensagem_type tipo) {
         default: return "DESCONHECIDO";
     }
 }
+
+
+// Uma linha por histograma: p50, p99, p99.9 e máximo em milissegundos
+static void imprimir_percentis(const char* nome, const histograma_t* histograma, double divisor) {
+    printf("%-26s %6llu amostras  p50 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f ms\n", nome,
+           (unsigned long long)histograma->total,
+           (double)histograma_percentil(histograma, 50.0) / divisor,
+           (double)histograma_percentil(histograma, 99.0) / divisor,
+           (double)histograma_percentil(histograma, 99.9) / divisor,
+           (double)histograma->maximo / divisor);
+}
+
+
+void imprimir_latencias(void) {
+    printf("\n═══════ LATÊNCIA PERCEBIDA ═══════\n");
+    imprimir_percentis("Movimento até o mapa", &latencias_movimento, 1000.0);
+    imprimir_percentis("Download de tesouro", &tempos_download, 1.0);
+}
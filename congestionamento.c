@@ -0,0 +1,136 @@
+#include "congestionamento.h"
+
+
+void congestionamento_iniciar(congestionamento_t* controle) {
+    if (!controle) return;
+    controle->janela = ESCALA_JANELA;
+    controle->limiar = JANELA_MAXIMA * ESCALA_JANELA;
+    controle->anunciada = JANELA_MAXIMA;
+}
+
+
+void congestionamento_confirmou(congestionamento_t* controle, int frames) {
+    if (!controle) return;
+
+    for (int i = 0; i < frames && controle->janela < JANELA_MAXIMA * ESCALA_JANELA; i++) {
+        if (controle->janela < controle->limiar) {
+            controle->janela += ESCALA_JANELA;      // Partida lenta: dobra a cada janela
+        } else {
+            controle->janela += ESCALA_JANELA * ESCALA_JANELA / controle->janela;     // Aumento aditivo
+        }
+    }
+    if (controle->janela > JANELA_MAXIMA * ESCALA_JANELA) {
+        controle->janela = JANELA_MAXIMA * ESCALA_JANELA;
+    }
+}
+
+
+void congestionamento_perda(congestionamento_t* controle) {
+    if (!controle) return;
+
+    controle->limiar = controle->janela / 2;
+    if (controle->limiar < 2 * ESCALA_JANELA) {
+        controle->limiar = 2 * ESCALA_JANELA;
+    }
+    controle->janela = controle->limiar;
+}
+
+
+void congestionamento_expirou(congestionamento_t* controle) {
+    if (!controle) return;
+
+    controle->limiar = controle->janela / 2;
+    if (controle->limiar < 2 * ESCALA_JANELA) {
+        controle->limiar = 2 * ESCALA_JANELA;
+    }
+    controle->janela = ESCALA_JANELA;
+}
+
+
+void congestionamento_anunciada(congestionamento_t* controle, uint32_t frames) {
+    if (!controle || frames == 0) return;
+    controle->anunciada = frames < JANELA_MAXIMA ? frames : JANELA_MAXIMA;
+}
+
+
+int congestionamento_permitidos(const congestionamento_t* controle) {
+    if (!controle) return 1;
+
+    uint32_t permitidos = controle->janela / ESCALA_JANELA;
+    if (permitidos > controle->anunciada) {
+        permitidos = controle->anunciada;
+    }
+    return permitidos > 0 ? (int)permitidos : 1;
+}
+
+
+// Prazo entre PRAZO_MINIMO_MS e PRAZO_MAXIMO_MS
+static int64_t limitar_prazo(int64_t prazo_us) {
+    if (prazo_us < PRAZO_MINIMO_MS * 1000) return PRAZO_MINIMO_MS * 1000;
+    if (prazo_us > PRAZO_MAXIMO_MS * 1000) return PRAZO_MAXIMO_MS * 1000;
+    return prazo_us;
+}
+
+
+void retransmissao_medir(retransmissao_t* prazo, int64_t rtt_us) {
+    if (!prazo || rtt_us < 0) return;
+
+    if (prazo->srtt_us == 0) {
+        prazo->srtt_us = rtt_us > 0 ? rtt_us : 1;
+        prazo->rttvar_us = rtt_us / 2;
+    } else {
+        int64_t erro = rtt_us - prazo->srtt_us;
+        prazo->rttvar_us += ((erro < 0 ? -erro : erro) - prazo->rttvar_us) / 4;
+        prazo->srtt_us += erro / 8;
+        if (prazo->srtt_us <= 0) {
+            prazo->srtt_us = 1;
+        }
+    }
+    prazo->prazo_us = limitar_prazo(prazo->srtt_us + 4 * prazo->rttvar_us);
+}
+
+
+void retransmissao_expirou(retransmissao_t* prazo) {
+    if (!prazo) return;
+    prazo->prazo_us = limitar_prazo(2 * (int64_t)retransmissao_prazo_ms(prazo) * 1000);
+}
+
+
+int retransmissao_prazo_ms(const retransmissao_t* prazo) {
+    if (!prazo || prazo->prazo_us == 0) return PRAZO_INICIAL_MS;
+    return (int)((prazo->prazo_us + 999) / 1000);
+}
+
+
+int janela_distancia(uint8_t seq_atual, int em_voo, uint8_t seq) {
+    int base = (seq_atual + 32 - em_voo + 1) % 32;
+    return (seq + 32 - base) % 32;
+}
+
+
+// Frames do início da janela que somam os bytes recebidos informados pelo receptor
+// -1 se nenhum prefixo soma: a resposta é de outra volta da sequência
+static int prefixo_janela(uint64_t confirmados, const uint8_t* tamanhos, int em_voo, uint32_t recebidos) {
+    uint32_t bytes = (uint32_t)confirmados;
+    for (int i = 0; ; i++) {
+        if (bytes == recebidos) {
+            return i;
+        }
+        if (i == em_voo) {
+            return -1;
+        }
+        bytes += tamanhos[i];
+    }
+}
+
+
+int janela_resposta_valida(uint64_t confirmados, const uint8_t* tamanhos, int em_voo,
+                           uint32_t recebidos, int nack, int distancia) {
+    int prefixo = prefixo_janela(confirmados, tamanhos, em_voo, recebidos);
+
+    // O ACK conta o próprio frame; o NACK conta só os anteriores ao recusado
+    if (nack) {
+        return distancia < em_voo && prefixo == distancia;
+    }
+    return prefixo >= 0 && prefixo == (distancia + 1) % 32;
+}
@@ -0,0 +1,81 @@
+#ifndef CONGESTIONAMENTO_H
+#define CONGESTIONAMENTO_H
+
+#include <stdint.h>
+
+
+#define JANELA_MAXIMA 15                // Frames em voo: menos da metade das 32 sequências
+#define ESCALA_JANELA 256               // Janela em ponto fixo, para o aumento de 1/janela por ACK
+#define DUPLICADOS_PERDA 3              // ACKs repetidos que indicam um frame perdido
+
+#define PRAZO_INICIAL_MS 1000           // Prazo de retransmissão antes da primeira medida (o TIMEOUT_S)
+#define PRAZO_MINIMO_MS 10              // Abaixo disso o relógio dos prazos não distingue atraso de perda
+#define PRAZO_MAXIMO_MS 1000            // Teto das dobras: o cliente espera TIMEOUT_S antes de desistir
+
+
+//////////// Controle de congestionamento ////////////
+
+// AIMD por sessão: partida lenta até o limiar, depois um frame a mais por janela confirmada;
+// perda (NACK ou ACKs repetidos) corta a janela pela metade e o fim do prazo volta a um frame
+typedef struct {
+    uint32_t janela;                    // Em frames × ESCALA_JANELA
+    uint32_t limiar;                    // Fim da partida lenta, também × ESCALA_JANELA
+    uint32_t anunciada;                 // Janela do receptor em frames
+} congestionamento_t;
+
+
+// Prazo de retransmissão pelo RTT medido (Jacobson/Karels): SRTT + 4 × RTTVAR,
+// dobrado a cada prazo vencido até a próxima medida. Zerado, vale PRAZO_INICIAL_MS
+typedef struct {
+    int64_t srtt_us;                    // 0 antes da primeira medida
+    int64_t rttvar_us;
+    int64_t prazo_us;                   // 0 antes da primeira medida ou dobra
+} retransmissao_t;
+
+
+//////////// Funções do controle de congestionamento ////////////
+
+// Começa com um frame e a partida lenta até JANELA_MAXIMA
+void congestionamento_iniciar(congestionamento_t* controle);
+
+// frames acabaram de ser confirmados pelo receptor
+void congestionamento_confirmou(congestionamento_t* controle, int frames);
+
+// Perda detectada por NACK ou ACKs repetidos: metade da janela
+void congestionamento_perda(congestionamento_t* controle);
+
+// Prazo de retransmissão venceu: a janela volta a um frame
+void congestionamento_expirou(congestionamento_t* controle);
+
+// Janela anunciada pelo receptor (0 = não anunciou)
+void congestionamento_anunciada(congestionamento_t* controle, uint32_t frames);
+
+// Frames que podem estar em voo agora
+int congestionamento_permitidos(const congestionamento_t* controle);
+
+//////////// Funções do prazo de retransmissão ////////////
+
+// RTT de um frame confirmado sem ter sido repetido (com repetição não se sabe qual cópia foi confirmada)
+void retransmissao_medir(retransmissao_t* prazo, int64_t rtt_us);
+
+// Prazo venceu sem confirmação: dobra, até PRAZO_MAXIMO_MS
+void retransmissao_expirou(retransmissao_t* prazo);
+
+// Espera atual até a retransmissão, em ms
+int retransmissao_prazo_ms(const retransmissao_t* prazo);
+
+//////////// Funções da janela Go-Back-N ////////////
+
+// Distância módulo 32 da sequência de uma resposta até o frame mais antigo em voo
+// (seq_atual é a sequência do último frame enviado)
+int janela_distancia(uint8_t seq_atual, int em_voo, uint8_t seq);
+
+// A sequência de 5 bits dá a volta a cada 32 frames: um ACK atrasado ou duplicado da volta
+// anterior pode cair na janela pela distância módulo 32. Com a contagem de bytes, a resposta
+// só vale se apontar para o mesmo frame em voo que a sequência (ou para o último confirmado)
+// confirmados: bytes antes do frame mais antigo; tamanhos: bytes de cada frame em voo
+// Retorna 1 se a resposta é da janela atual, 0 se é de outra volta
+int janela_resposta_valida(uint64_t confirmados, const uint8_t* tamanhos, int em_voo,
+                           uint32_t recebidos, int nack, int distancia);
+
+#endif // CONGESTIONAMENTO_H
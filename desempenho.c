@@ -0,0 +1,234 @@
+#define _XOPEN_SOURCE 700   // clock_gettime()
+
+#include "protocolo.h"
+
+#include <time.h>
+
+
+//////////// Microbenchmarks ////////////
+
+// Caminhos quentes do protocolo e do jogo medidos sobre buffers sintéticos, sem placa de rede:
+// montagem e checksum do pack, cabeçalhos do raw socket, leitura de frames e lógica do mapa.
+// Cada medição dobra as iterações até um lote levar TEMPO_MINIMO_NS e então repete o lote
+// REPETICOES vezes, reportando a mediana e o mínimo em ns por operação
+
+#define TEMPO_MINIMO_NS 50000000ULL         // 50 ms por lote
+#define REPETICOES 7
+#define PORTA_BENCH 5000
+#define IP_BENCH "10.0.0.2"
+
+// Definida pelo makefile com as flags da compilação
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS "desconhecidas"
+#endif
+
+// Roda n operações
+typedef void (*lote_t)(uint64_t n);
+
+// Acumula os resultados para o compilador não descartar as operações
+static volatile uint32_t sumidouro;
+
+static uint8_t dados[MAX_FRAME];
+static pack_t pack;
+static rawsocket_t remetente;               // Quem monta os cabeçalhos
+static rawsocket_t receptor;                // Quem confere os frames recebidos
+static unsigned char frame[TAMANHO_CABECALHOS + sizeof(pack_t)];
+static size_t tamanho_frame;
+static struct_jogo jogo;
+static protocolo_type estado;
+static int par[2];                          // socketpair: par[1] escreve frames, estado lê de par[0]
+
+
+static uint64_t agora_ns(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (uint64_t)agora.tv_sec * 1000000000ULL + (uint64_t)agora.tv_nsec;
+}
+
+
+// Ciclos do TSC; 0 fora do x86, e aí bytes/ciclo não é reportado
+static uint64_t agora_ciclos(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static int comparar(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+// bytes é o tamanho processado por operação (0 quando não faz sentido)
+static void medir(const char* nome, lote_t lote, size_t bytes) {
+    uint64_t n = 1;
+    while (1) {
+        uint64_t inicio = agora_ns();
+        lote(n);
+        if (agora_ns() - inicio >= TEMPO_MINIMO_NS || n >= (1ULL << 40)) {
+            break;
+        }
+        n *= 2;
+    }
+
+    double ns_por_op[REPETICOES];
+    double ciclos_por_op[REPETICOES];
+    for (int r = 0; r < REPETICOES; r++) {
+        uint64_t inicio_ciclos = agora_ciclos();
+        uint64_t inicio = agora_ns();
+        lote(n);
+        uint64_t fim = agora_ns();
+        uint64_t fim_ciclos = agora_ciclos();
+        ns_por_op[r] = (double)(fim - inicio) / (double)n;
+        ciclos_por_op[r] = (double)(fim_ciclos - inicio_ciclos) / (double)n;
+    }
+    qsort(ns_por_op, REPETICOES, sizeof(double), comparar);
+    qsort(ciclos_por_op, REPETICOES, sizeof(double), comparar);
+
+    double mediana = ns_por_op[REPETICOES / 2];
+    double ciclos = ciclos_por_op[REPETICOES / 2];
+    printf("%-28s %12llu %10.2f %10.2f", nome, (unsigned long long)n, mediana, ns_por_op[0]);
+    if (bytes > 0 && ciclos > 0) {
+        printf(" %12.3f\n", (double)bytes / ciclos);
+    } else {
+        printf(" %12s\n", "-");
+    }
+}
+
+
+//////////// Operações medidas ////////////
+
+static void lote_criar_pacote(uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        criar_pacote(&pack, (unsigned char)(i & 31), MSG_DADOS, dados, MAX_FRAME);
+        sumidouro += pack.checksum;
+    }
+}
+
+
+static void lote_calcular_checksum(uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        pack.dados[0] = (uint8_t)i;
+        sumidouro += calcular_checksum(&pack);
+    }
+}
+
+
+static void lote_calcula_checksum(uint64_t n) {
+    unsigned char* ip = frame + sizeof(struct cabecalho_ethernet);
+    for (uint64_t i = 0; i < n; i++) {
+        ip[4] = (unsigned char)i;           // Campo id
+        sumidouro += calcula_checksum((unsigned short*)ip, sizeof(struct cabecalho_ip));
+    }
+}
+
+
+static void lote_montar_cabecalhos(uint64_t n) {
+    unsigned char cabecalhos[TAMANHO_CABECALHOS];
+    for (uint64_t i = 0; i < n; i++) {
+        montar_cabecalhos_rawsocket(&remetente, cabecalhos, 4 + (i & 127));
+        sumidouro += cabecalhos[sizeof(struct cabecalho_ethernet) + 10];
+    }
+}
+
+
+static void lote_extrair_dados(uint64_t n) {
+    pack_t recebido;
+    for (uint64_t i = 0; i < n; i++) {
+        sumidouro += extrair_dados_rawsocket(&receptor, frame, tamanho_frame, &recebido, sizeof(recebido),
+                                             NULL, NULL);
+    }
+}
+
+
+// Frame inteiro pelo kernel: send no socketpair e receber_pacote (recvfrom, validação e checksum)
+static void lote_receber_pacote(uint64_t n) {
+    pack_t recebido;
+    for (uint64_t i = 0; i < n; i++) {
+        if (send(par[1], frame, tamanho_frame, 0) < 0) {
+            perror("send");
+            exit(1);
+        }
+        sumidouro += receber_pacote(&estado, &recebido) == 0 ? recebido.checksum : 0;
+    }
+}
+
+
+// Vai e volta na linha do meio; os tesouros já encontrados fazem valida_tesouro percorrer todos
+static void lote_movimento(uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        mensagem_type direcao = jogo.local_player.x < TAMANHO_MAPA - 1 && (i & 1) ? MSG_MOVE_DIREITA
+                                                                                   : MSG_MOVE_ESQUERDA;
+        sumidouro += move_player(&jogo, direcao);
+        sumidouro += valida_tesouro(&jogo, jogo.local_player);
+    }
+}
+
+
+//////////// Preparação ////////////
+
+static void preparar(void) {
+    for (int i = 0; i < MAX_FRAME; i++) {
+        dados[i] = (uint8_t)(i * 31 + 7);
+    }
+    criar_pacote(&pack, 1, MSG_DADOS, dados, MAX_FRAME);
+
+    // O remetente envia para o IP e a porta do receptor
+    memset(&remetente, 0, sizeof(remetente));
+    memset(remetente.mac_destino, 0xFF, 6);
+    remetente.ip_origem = inet_addr("10.0.0.1");
+    remetente.ip_destino = inet_addr(IP_BENCH);
+    remetente.porta_origem = htons(PORTA_BENCH + 1);
+    remetente.porta_destino = htons(PORTA_BENCH);
+
+    memset(&receptor, 0, sizeof(receptor));
+    receptor.ip_origem = remetente.ip_destino;
+    receptor.porta_origem = remetente.porta_destino;
+
+    size_t tamanho_pack = 4 + MAX_FRAME;
+    montar_cabecalhos_rawsocket(&remetente, frame, tamanho_pack);
+    memcpy(frame + TAMANHO_CABECALHOS, &pack, tamanho_pack);
+    tamanho_frame = TAMANHO_CABECALHOS + tamanho_pack;
+
+    // O estado lê como o servidor leria do raw socket
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, par) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    memset(&estado, 0, sizeof(estado));
+    estado.rawsock = receptor;
+    estado.rawsock.sockfd = par[0];
+    estado.porta_origem = PORTA_BENCH;
+
+    // Tesouros fora da linha do jogador, todos já encontrados
+    memset(&jogo, 0, sizeof(jogo));
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        jogo.tesouros[i].posicao.x = i;
+        jogo.tesouros[i].posicao.y = 0;
+        jogo.tesouros[i].encontrado = 1;
+    }
+    jogo.local_player.x = TAMANHO_MAPA / 2;
+    jogo.local_player.y = TAMANHO_MAPA / 2;
+}
+
+
+int main(void) {
+    preparar();
+
+    printf("Compilado com gcc %s, flags: %s\n\n", __VERSION__, BENCH_CFLAGS);
+    printf("%-28s %12s %10s %10s %12s\n", "operação", "iterações", "ns/op", "mín ns/op", "bytes/ciclo");
+    medir("criar_pacote (127 B)", lote_criar_pacote, 4 + MAX_FRAME);
+    medir("calcular_checksum (127 B)", lote_calcular_checksum, 3 + MAX_FRAME);
+    medir("calcula_checksum (IP)", lote_calcula_checksum, sizeof(struct cabecalho_ip));
+    medir("montar_cabecalhos_rawsocket", lote_montar_cabecalhos, TAMANHO_CABECALHOS);
+    medir("extrair_dados_rawsocket", lote_extrair_dados, tamanho_frame);
+    medir("receber_pacote (socketpair)", lote_receber_pacote, tamanho_frame);
+    medir("move_player + valida_tesouro", lote_movimento, 0);
+
+    close(par[0]);
+    close(par[1]);
+    return 0;
+}
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE     // fallocate() e pwritev()
+
+#include "escritor.h"
+#include "perfil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+
+// Grava o vetor de buffers a partir do offset, tratando escritas parciais
+static int gravar_iov(int fd, struct iovec* iov, int quantidade, uint64_t offset) {
+    PERFIL_ESCOPO(PERFIL_ESCRITA_DISCO);
+    while (quantidade > 0) {
+        // Buffers vazios não contam como progresso
+        if (iov->iov_len == 0) {
+            iov++;
+            quantidade--;
+            continue;
+        }
+
+        ssize_t escritos = pwritev(fd, iov, quantidade, (off_t)offset);
+        if (escritos < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (escritos == 0) {
+            // Nada gravado com bytes pendentes: repetir não avançaria
+            errno = ENOSPC;
+            return -1;
+        }
+        offset += (uint64_t)escritos;
+
+        // Avança sobre os iovecs já gravados por completo
+        while (quantidade > 0 && (size_t)escritos >= iov->iov_len) {
+            escritos -= iov->iov_len;
+            iov++;
+            quantidade--;
+        }
+        if (quantidade > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + escritos;
+            iov->iov_len -= escritos;
+        }
+    }
+    return 0;
+}
+
+
+// Thread escritora: grava em lote todos os buffers cheios pendentes
+static void* thread_escritora(void* arg) {
+    escritor_t* escritor = (escritor_t*)arg;
+    struct iovec iov[ESCRITOR_NUM_BUFFERS];
+
+    pthread_mutex_lock(&escritor->trava);
+    while (1) {
+        while (escritor->pendentes == 0 && !escritor->encerrar) {
+            pthread_cond_wait(&escritor->tem_pendente, &escritor->trava);
+        }
+        if (escritor->pendentes == 0) break;
+
+        int primeiro = escritor->proximo_gravar;
+        int quantidade = escritor->pendentes;
+        uint64_t offset = escritor->offset_gravado;
+        pthread_mutex_unlock(&escritor->trava);
+
+        // Fora da trava: a recepção só mexe no buffer atual, que não está na fila
+        size_t total = 0;
+        for (int i = 0; i < quantidade; i++) {
+            int b = (primeiro + i) % ESCRITOR_NUM_BUFFERS;
+            iov[i].iov_base = escritor->buffers[b];
+            iov[i].iov_len = escritor->usados[b];
+            total += escritor->usados[b];
+        }
+        int falhou = gravar_iov(escritor->fd, iov, quantidade, escritor->offset_base + offset) < 0;
+
+        pthread_mutex_lock(&escritor->trava);
+        if (falhou && !__atomic_load_n(&escritor->erro, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&escritor->erro, errno, __ATOMIC_RELEASE);
+        }
+        for (int i = 0; i < quantidade; i++) {
+            escritor->usados[(primeiro + i) % ESCRITOR_NUM_BUFFERS] = 0;
+        }
+        escritor->offset_gravado += total;
+        escritor->proximo_gravar = (primeiro + quantidade) % ESCRITOR_NUM_BUFFERS;
+        escritor->pendentes -= quantidade;
+        pthread_cond_signal(&escritor->tem_livre);
+    }
+    pthread_mutex_unlock(&escritor->trava);
+    return NULL;
+}
+
+
+int escritor_iniciar_trecho(escritor_t* escritor, int fd, uint64_t offset_base, uint64_t tamanho) {
+    if (!escritor || fd < 0) return -1;
+
+    memset(escritor, 0, sizeof(escritor_t));
+    escritor->fd = fd;
+    escritor->offset_base = offset_base;
+    escritor->tamanho = tamanho;
+
+    for (int i = 0; i < ESCRITOR_NUM_BUFFERS; i++) {
+        void* buffer;
+        if (posix_memalign(&buffer, ESCRITOR_ALINHAMENTO, ESCRITOR_TAM_BUFFER) != 0) {
+            while (--i >= 0) free(escritor->buffers[i]);
+            return -1;
+        }
+        escritor->buffers[i] = buffer;
+    }
+
+    pthread_mutex_init(&escritor->trava, NULL);
+    pthread_cond_init(&escritor->tem_pendente, NULL);
+    pthread_cond_init(&escritor->tem_livre, NULL);
+
+    if (pthread_create(&escritor->thread, NULL, thread_escritora, escritor) != 0) {
+        for (int i = 0; i < ESCRITOR_NUM_BUFFERS; i++) free(escritor->buffers[i]);
+        return -1;
+    }
+    return 0;
+}
+
+
+int escritor_criar_arquivo(const char* caminho, uint64_t tamanho) {
+    if (!caminho) return -1;
+
+    int fd = open(caminho, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Reservar o espaço anunciado; sistemas sem suporte seguem sem reserva
+    if (tamanho > 0 && fallocate(fd, 0, 0, (off_t)tamanho) < 0) {
+        if (errno == ENOSPC) {
+            close(fd);
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+    return fd;
+}
+
+
+int escritor_abrir(escritor_t* escritor, const char* caminho, uint64_t tamanho) {
+    if (!escritor || !caminho) return -1;
+
+    int fd = escritor_criar_arquivo(caminho, tamanho);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (escritor_iniciar_trecho(escritor, fd, 0, tamanho) < 0) {
+        close(fd);
+        return -1;
+    }
+    escritor->dono_fd = 1;
+    return 0;
+}
+
+
+// Entrega o buffer atual à thread escritora e espera um buffer livre
+static void entregar_buffer(escritor_t* escritor) {
+    pthread_mutex_lock(&escritor->trava);
+    escritor->pendentes++;
+    pthread_cond_signal(&escritor->tem_pendente);
+    while (escritor->pendentes == ESCRITOR_NUM_BUFFERS) {
+        pthread_cond_wait(&escritor->tem_livre, &escritor->trava);
+    }
+    escritor->atual = (escritor->proximo_gravar + escritor->pendentes) % ESCRITOR_NUM_BUFFERS;
+    pthread_mutex_unlock(&escritor->trava);
+}
+
+
+int escritor_adicionar(escritor_t* escritor, const uint8_t* dados, size_t tamanho) {
+    if (!escritor || (!dados && tamanho > 0)) return -1;
+
+    while (tamanho > 0) {
+        int b = escritor->atual;
+        size_t livre = ESCRITOR_TAM_BUFFER - escritor->usados[b];
+        size_t copiar = tamanho < livre ? tamanho : livre;
+
+        memcpy(escritor->buffers[b] + escritor->usados[b], dados, copiar);
+        escritor->usados[b] += copiar;
+        escritor->offset_preenchido += copiar;
+        dados += copiar;
+        tamanho -= copiar;
+
+        if (escritor->usados[b] == ESCRITOR_TAM_BUFFER) {
+            entregar_buffer(escritor);
+        }
+    }
+    // A thread de gravação publica o erro fora da trava da recepção
+    return __atomic_load_n(&escritor->erro, __ATOMIC_ACQUIRE) ? -1 : 0;
+}
+
+
+size_t escritor_livre(escritor_t* escritor) {
+    if (!escritor) return 0;
+
+    pthread_mutex_lock(&escritor->trava);
+    int pendentes = escritor->pendentes;
+    pthread_mutex_unlock(&escritor->trava);
+
+    size_t livre = ESCRITOR_TAM_BUFFER - escritor->usados[escritor->atual];
+    if (pendentes < ESCRITOR_NUM_BUFFERS - 1) {
+        livre += (size_t)(ESCRITOR_NUM_BUFFERS - 1 - pendentes) * ESCRITOR_TAM_BUFFER;
+    }
+    return livre;
+}
+
+
+int escritor_fechar(escritor_t* escritor) {
+    if (!escritor) return -1;
+
+    pthread_mutex_lock(&escritor->trava);
+    if (escritor->usados[escritor->atual] > 0) {
+        escritor->pendentes++;
+    }
+    escritor->encerrar = 1;
+    pthread_cond_signal(&escritor->tem_pendente);
+    pthread_mutex_unlock(&escritor->trava);
+
+    pthread_join(escritor->thread, NULL);
+
+    // A reserva pode ser maior que o recebido se a transferência terminou antes
+    if (escritor->dono_fd && escritor->offset_gravado != escritor->tamanho) {
+        if (ftruncate(escritor->fd, (off_t)escritor->offset_gravado) < 0 && !escritor->erro) {
+            escritor->erro = errno;
+        }
+    }
+
+    for (int i = 0; i < ESCRITOR_NUM_BUFFERS; i++) {
+        free(escritor->buffers[i]);
+        escritor->buffers[i] = NULL;
+    }
+    pthread_mutex_destroy(&escritor->trava);
+    pthread_cond_destroy(&escritor->tem_pendente);
+    pthread_cond_destroy(&escritor->tem_livre);
+
+    if (escritor->dono_fd && close(escritor->fd) < 0 && !escritor->erro) {
+        escritor->erro = errno;
+    }
+    escritor->fd = -1;
+    return escritor->erro ? -1 : 0;
+}
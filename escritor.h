@@ -0,0 +1,65 @@
+#ifndef ESCRITOR_H
+#define ESCRITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+
+#define ESCRITOR_TAM_BUFFER (256 * 1024)    // Tamanho de cada buffer de escrita
+#define ESCRITOR_NUM_BUFFERS 4              // Buffers em rotação entre recepção e escrita
+#define ESCRITOR_ALINHAMENTO 4096           // Alinhamento dos buffers (página)
+
+
+//////////// Estrutura do escritor de arquivo ////////////
+
+// Os payloads recebidos são acumulados em buffers grandes e alinhados.
+// Quando um buffer enche ele é entregue à thread escritora, que grava
+// todos os buffers pendentes com um único pwritev() no offset correto.
+typedef struct {
+    int fd;
+    int dono_fd;                                    // Fecha e ajusta o arquivo ao final
+    uint64_t offset_base;                           // Início do trecho no arquivo
+    uint64_t tamanho;                               // Tamanho anunciado pelo servidor
+    uint64_t offset_preenchido;                     // Bytes já entregues ao escritor
+    uint64_t offset_gravado;                        // Bytes já gravados em disco
+
+    uint8_t* buffers[ESCRITOR_NUM_BUFFERS];
+    size_t usados[ESCRITOR_NUM_BUFFERS];            // Bytes válidos em cada buffer
+    int atual;                                      // Buffer sendo preenchido
+    int pendentes;                                  // Buffers cheios aguardando gravação
+    int proximo_gravar;                             // Primeiro buffer da fila de gravação
+
+    pthread_t thread;
+    pthread_mutex_t trava;
+    pthread_cond_t tem_pendente;                    // Sinaliza a thread escritora
+    pthread_cond_t tem_livre;                       // Sinaliza a recepção
+    int encerrar;
+    int erro;                                       // errno da primeira falha de escrita
+} escritor_t;
+
+
+//////////// Funções do escritor ////////////
+
+// Cria o arquivo e reserva o espaço anunciado com fallocate
+// Retorna o descritor ou -1 em erro (ENOSPC indica espaço insuficiente)
+int escritor_criar_arquivo(const char* caminho, uint64_t tamanho);
+
+// Cria o arquivo, reserva o espaço anunciado com fallocate e inicia a thread escritora
+// Retorna -1 em erro (ENOSPC indica espaço insuficiente)
+int escritor_abrir(escritor_t* escritor, const char* caminho, uint64_t tamanho);
+
+// Grava um trecho de um arquivo já aberto e reservado, a partir de offset_base
+// O descritor continua pertencendo a quem chamou
+int escritor_iniciar_trecho(escritor_t* escritor, int fd, uint64_t offset_base, uint64_t tamanho);
+
+// Copia os dados recebidos para o buffer atual, entregando-o ao escritor quando cheio
+int escritor_adicionar(escritor_t* escritor, const uint8_t* dados, size_t tamanho);
+
+// Bytes que ainda podem ser adicionados sem esperar a thread escritora
+size_t escritor_livre(escritor_t* escritor);
+
+// Descarrega o buffer parcial, aguarda a gravação de tudo e fecha o arquivo
+int escritor_fechar(escritor_t* escritor);
+
+#endif // ESCRITOR_H
@@ -0,0 +1,66 @@
+#include "histograma.h"
+
+
+int histograma_balde(uint64_t valor) {
+    if (valor < 2 * HISTOGRAMA_SUBBALDES) {
+        return (int)valor;
+    }
+
+    int expoente = 63 - __builtin_clzll(valor);
+    if (expoente >= HISTOGRAMA_BITS) {
+        return HISTOGRAMA_BALDES - 1;
+    }
+    // Os 5 bits mais altos do valor: 1 implícito e a posição entre os 16 baldes da potência
+    uint64_t mantissa = valor >> (expoente - 4);
+    return (expoente - 4) * HISTOGRAMA_SUBBALDES + (int)mantissa;
+}
+
+
+uint64_t histograma_limite_balde(int balde) {
+    if (balde < 2 * HISTOGRAMA_SUBBALDES) {
+        return (uint64_t)balde;
+    }
+    int expoente = balde / HISTOGRAMA_SUBBALDES + 3;
+    uint64_t mantissa = (uint64_t)(balde % HISTOGRAMA_SUBBALDES + HISTOGRAMA_SUBBALDES);
+    return ((mantissa + 1) << (expoente - 4)) - 1;
+}
+
+
+void histograma_registrar(histograma_t* histograma, uint64_t valor) {
+    if (!histograma) return;
+
+    __atomic_add_fetch(&histograma->baldes[histograma_balde(valor)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&histograma->total, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&histograma->soma, valor, __ATOMIC_RELAXED);
+
+    uint64_t maximo = __atomic_load_n(&histograma->maximo, __ATOMIC_RELAXED);
+    while (valor > maximo && !__atomic_compare_exchange_n(&histograma->maximo, &maximo, valor, 1,
+                                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+uint64_t histograma_percentil(const histograma_t* histograma, double percentil) {
+    if (!histograma) return 0;
+
+    uint64_t total = __atomic_load_n(&histograma->total, __ATOMIC_RELAXED);
+    if (total == 0) {
+        return 0;
+    }
+
+    // Posição da amostra procurada, contando de 1
+    uint64_t posicao = (uint64_t)(percentil / 100.0 * (double)total + 0.999999);
+    if (posicao < 1) posicao = 1;
+    if (posicao > total) posicao = total;
+
+    uint64_t maximo = __atomic_load_n(&histograma->maximo, __ATOMIC_RELAXED);
+    uint64_t acumulado = 0;
+    for (int i = 0; i < HISTOGRAMA_BALDES; i++) {
+        acumulado += __atomic_load_n(&histograma->baldes[i], __ATOMIC_RELAXED);
+        if (acumulado >= posicao) {
+            uint64_t limite = histograma_limite_balde(i);
+            return limite < maximo ? limite : maximo;
+        }
+    }
+    return maximo;
+}
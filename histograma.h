@@ -0,0 +1,41 @@
+#ifndef HISTOGRAMA_H
+#define HISTOGRAMA_H
+
+#include <stdint.h>
+
+
+#define HISTOGRAMA_SUBBALDES 16             // Baldes por potência de 2: erro relativo de até 1/16
+#define HISTOGRAMA_BITS 40                  // Valores até 2^40 (em µs, quase 13 dias); acima, o último balde
+#define HISTOGRAMA_BALDES ((HISTOGRAMA_BITS - 3) * HISTOGRAMA_SUBBALDES)
+
+
+//////////// Histograma ////////////
+
+// Baldes log-lineares, como no HDR: os valores abaixo de 32 têm um balde cada,
+// e cada potência de 2 acima é dividida em 16 baldes iguais, então a precisão
+// relativa é a mesma de microssegundos a horas.
+// Registrar é um incremento atômico: várias threads podem usar o mesmo histograma
+typedef struct {
+    uint64_t baldes[HISTOGRAMA_BALDES];
+    uint64_t total;
+    uint64_t soma;
+    uint64_t maximo;
+} histograma_t;
+
+
+//////////// Funções do histograma ////////////
+
+// Conta mais um valor
+void histograma_registrar(histograma_t* histograma, uint64_t valor);
+
+// Balde onde o valor é contado
+int histograma_balde(uint64_t valor);
+
+// Maior valor contado no balde
+uint64_t histograma_limite_balde(int balde);
+
+// Valor abaixo do qual está a fração percentil (0 a 100) das amostras, pelo limite do balde
+// Retorna 0 sem amostras
+uint64_t histograma_percentil(const histograma_t* histograma, double percentil);
+
+#endif // HISTOGRAMA_H
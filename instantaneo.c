@@ -0,0 +1,125 @@
+#define _XOPEN_SOURCE 700   // ftruncate(), pread(), pwrite()
+
+#include "instantaneo.h"
+#include "perfil.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+typedef struct {
+    uint32_t magico;
+    uint32_t capacidade;
+    uint64_t tamanho_registro;
+    uint64_t tamanho_dados;
+} cabecalho_instantaneo_t;
+
+
+static uint64_t* versao_registro(instantaneo_t* instantaneo, uint32_t indice) {
+    return (uint64_t*)(instantaneo->mapa + CABECALHO_INSTANTANEO + (size_t)indice * instantaneo->tamanho_registro);
+}
+
+
+int instantaneo_abrir(instantaneo_t* instantaneo, const char* caminho, size_t tamanho_dados, uint32_t capacidade) {
+    if (!instantaneo || !caminho || tamanho_dados == 0 || capacidade == 0) return -1;
+
+    memset(instantaneo, 0, sizeof(instantaneo_t));
+    instantaneo->fd = -1;
+    instantaneo->tamanho_dados = tamanho_dados;
+    instantaneo->tamanho_registro = (sizeof(uint64_t) + tamanho_dados + 63) & ~(size_t)63;
+    instantaneo->capacidade = capacidade;
+    instantaneo->tamanho_mapa = CABECALHO_INSTANTANEO + (size_t)capacidade * instantaneo->tamanho_registro;
+
+    int fd = open(caminho, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    cabecalho_instantaneo_t esperado;
+    memset(&esperado, 0, sizeof(esperado));
+    esperado.magico = MAGICO_INSTANTANEO;
+    esperado.capacidade = capacidade;
+    esperado.tamanho_registro = instantaneo->tamanho_registro;
+    esperado.tamanho_dados = tamanho_dados;
+
+    // Só aproveita um arquivo do mesmo formato (outra versão do servidor recomeça do zero)
+    struct stat st;
+    cabecalho_instantaneo_t lido;
+    int existente = fstat(fd, &st) == 0 && (size_t)st.st_size == instantaneo->tamanho_mapa &&
+                    pread(fd, &lido, sizeof(lido), 0) == (ssize_t)sizeof(lido) &&
+                    memcmp(&lido, &esperado, sizeof(lido)) == 0;
+
+    // Truncar para zero e crescer de novo zera tudo sem escrever (o arquivo fica esparso)
+    if (!existente && (ftruncate(fd, 0) < 0 || ftruncate(fd, (off_t)instantaneo->tamanho_mapa) < 0 ||
+                       pwrite(fd, &esperado, sizeof(esperado), 0) != (ssize_t)sizeof(esperado))) {
+        close(fd);
+        return -1;
+    }
+
+    void* mapa = mmap(NULL, instantaneo->tamanho_mapa, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapa == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    instantaneo->fd = fd;
+    instantaneo->mapa = mapa;
+    return existente;
+}
+
+
+void instantaneo_gravar(instantaneo_t* instantaneo, uint32_t indice, const void* dados, size_t tamanho) {
+    PERFIL_ESCOPO(PERFIL_INSTANTANEO);
+    if (!instantaneo || !instantaneo->mapa || indice >= instantaneo->capacidade) return;
+    if (tamanho > instantaneo->tamanho_dados) {
+        tamanho = instantaneo->tamanho_dados;
+    }
+
+    // Uma gravação interrompida deixou a versão ímpar: recomeça do par anterior, senão ficaria ímpar para sempre
+    uint64_t* versao = versao_registro(instantaneo, indice);
+    uint64_t atual = *versao & ~(uint64_t)1;
+
+    // Versão ímpar antes de qualquer byte dos dados
+    __atomic_store_n(versao, atual + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(versao + 1, dados, tamanho);
+    __atomic_store_n(versao, atual + 2, __ATOMIC_RELEASE);
+}
+
+
+void* instantaneo_registro(instantaneo_t* instantaneo, uint32_t indice) {
+    if (!instantaneo || !instantaneo->mapa || indice >= instantaneo->capacidade) return NULL;
+    return versao_registro(instantaneo, indice) + 1;
+}
+
+
+int instantaneo_ler(instantaneo_t* instantaneo, uint32_t indice, void* dados) {
+    if (!instantaneo || !instantaneo->mapa || indice >= instantaneo->capacidade) return 0;
+
+    uint64_t* versao = versao_registro(instantaneo, indice);
+    uint64_t atual = __atomic_load_n(versao, __ATOMIC_ACQUIRE);
+    if (atual == 0 || (atual & 1)) {
+        return 0;
+    }
+    memcpy(dados, versao + 1, instantaneo->tamanho_dados);
+    return 1;
+}
+
+
+void instantaneo_apagar(instantaneo_t* instantaneo, uint32_t indice) {
+    if (!instantaneo || !instantaneo->mapa || indice >= instantaneo->capacidade) return;
+    __atomic_store_n(versao_registro(instantaneo, indice), 0, __ATOMIC_RELEASE);
+}
+
+
+void instantaneo_fechar(instantaneo_t* instantaneo) {
+    if (!instantaneo) return;
+    if (instantaneo->mapa) {
+        munmap(instantaneo->mapa, instantaneo->tamanho_mapa);
+        instantaneo->mapa = NULL;
+    }
+    if (instantaneo->fd >= 0) {
+        close(instantaneo->fd);
+        instantaneo->fd = -1;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef INSTANTANEO_H
+#define INSTANTANEO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define MAGICO_INSTANTANEO 0x54534E49u      // "INST"
+#define CABECALHO_INSTANTANEO 64            // Cabeçalho do arquivo, antes do primeiro registro
+
+
+//////////// Arquivo de registros mapeado ////////////
+
+// Registros de tamanho fixo em um arquivo mapeado com MAP_SHARED: gravar é só
+// copiar para a memória, e o que foi gravado sobrevive ao fim do processo.
+// Cada registro começa com uma versão: ímpar durante a gravação, par depois
+// e 0 com a entrada livre, então um processo que morre no meio de uma gravação
+// deixa o registro inválido, e não pela metade.
+typedef struct {
+    int fd;
+    uint8_t* mapa;
+    size_t tamanho_mapa;
+    size_t tamanho_registro;                // Versão + dados, arredondado para 64 bytes
+    size_t tamanho_dados;
+    uint32_t capacidade;
+} instantaneo_t;
+
+
+//////////// Funções do instantâneo ////////////
+
+// Abre (ou cria) o arquivo com capacidade registros de tamanho_dados bytes
+// Retorna 1 se o arquivo já tinha registros neste formato, 0 se foi criado vazio ou -1 em erro
+int instantaneo_abrir(instantaneo_t* instantaneo, const char* caminho, size_t tamanho_dados, uint32_t capacidade);
+
+// Grava os primeiros tamanho bytes do registro (a primeira gravação de uma entrada deve cobrir tudo o que será lido)
+// Uma entrada só pode ter uma thread gravando por vez
+void instantaneo_gravar(instantaneo_t* instantaneo, uint32_t indice, const void* dados, size_t tamanho);
+
+// Dados do registro no mapeamento, para campos gravados fora de instantaneo_gravar
+// (atualizados com acesso atômico e deixados fora do trecho passado a ela)
+void* instantaneo_registro(instantaneo_t* instantaneo, uint32_t indice);
+
+// Copia o registro; retorna 1 se a entrada está ocupada e íntegra, 0 caso contrário
+int instantaneo_ler(instantaneo_t* instantaneo, uint32_t indice, void* dados);
+
+// Libera a entrada
+void instantaneo_apagar(instantaneo_t* instantaneo, uint32_t indice);
+
+// Desfaz o mapeamento (o arquivo continua com os registros)
+void instantaneo_fechar(instantaneo_t* instantaneo);
+
+#endif // INSTANTANEO_H
@@ -0,0 +1,202 @@
+#include "integridade.h"
+#include "perfil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+
+#define CRC64_POLINOMIO 0xC96C5795D7870F42ULL     // ECMA-182 refletido (CRC-64/XZ)
+
+// Tabelas para processar 8 bytes por iteração (slicing-by-8)
+static uint64_t tabela_crc[8][256];
+static pthread_once_t tabela_pronta = PTHREAD_ONCE_INIT;
+
+
+static void gerar_tabela_crc(void) {
+    for (int i = 0; i < 256; i++) {
+        uint64_t crc = (uint64_t)i;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC64_POLINOMIO : crc >> 1;
+        }
+        tabela_crc[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint64_t anterior = tabela_crc[t - 1][i];
+            tabela_crc[t][i] = (anterior >> 8) ^ tabela_crc[0][anterior & 0xFF];
+        }
+    }
+}
+
+
+uint64_t crc64_atualizar(uint64_t crc, const uint8_t* dados, size_t tamanho) {
+    pthread_once(&tabela_pronta, gerar_tabela_crc);
+
+    crc = ~crc;
+    while (tamanho >= 8) {
+        uint64_t palavra;
+        memcpy(&palavra, dados, sizeof(palavra));
+        crc ^= palavra;     // Assume little-endian, como o restante do protocolo
+        crc = tabela_crc[7][crc & 0xFF] ^
+              tabela_crc[6][(crc >> 8) & 0xFF] ^
+              tabela_crc[5][(crc >> 16) & 0xFF] ^
+              tabela_crc[4][(crc >> 24) & 0xFF] ^
+              tabela_crc[3][(crc >> 32) & 0xFF] ^
+              tabela_crc[2][(crc >> 40) & 0xFF] ^
+              tabela_crc[1][(crc >> 48) & 0xFF] ^
+              tabela_crc[0][crc >> 56];
+        dados += 8;
+        tamanho -= 8;
+    }
+    while (tamanho > 0) {
+        crc = (crc >> 8) ^ tabela_crc[0][(crc ^ *dados) & 0xFF];
+        dados++;
+        tamanho--;
+    }
+    return ~crc;
+}
+
+
+// Multiplica a matriz 64x64 sobre GF(2) pelo vetor
+static uint64_t gf2_vezes(const uint64_t* matriz, uint64_t vetor) {
+    uint64_t soma = 0;
+    while (vetor) {
+        if (vetor & 1) {
+            soma ^= *matriz;
+        }
+        vetor >>= 1;
+        matriz++;
+    }
+    return soma;
+}
+
+
+static void gf2_quadrado(uint64_t* quadrado, const uint64_t* matriz) {
+    for (int n = 0; n < 64; n++) {
+        quadrado[n] = gf2_vezes(matriz, matriz[n]);
+    }
+}
+
+
+// Mesmo método do crc32_combine da zlib: aplica ao CRC de A o operador
+// de "tamanho_b bytes zero" por quadrados sucessivos e soma o CRC de B
+uint64_t crc64_combinar(uint64_t crc_a, uint64_t crc_b, uint64_t tamanho_b) {
+    if (tamanho_b == 0) {
+        return crc_a;
+    }
+
+    uint64_t par[64];
+    uint64_t impar[64];
+
+    // Operador de um bit zero
+    impar[0] = CRC64_POLINOMIO;
+    uint64_t linha = 1;
+    for (int n = 1; n < 64; n++) {
+        impar[n] = linha;
+        linha <<= 1;
+    }
+    gf2_quadrado(par, impar);       // dois bits zero
+    gf2_quadrado(impar, par);       // quatro bits zero
+
+    do {
+        gf2_quadrado(par, impar);
+        if (tamanho_b & 1) {
+            crc_a = gf2_vezes(par, crc_a);
+        }
+        tamanho_b >>= 1;
+        if (tamanho_b == 0) {
+            break;
+        }
+        gf2_quadrado(impar, par);
+        if (tamanho_b & 1) {
+            crc_a = gf2_vezes(impar, crc_a);
+        }
+        tamanho_b >>= 1;
+    } while (tamanho_b != 0);
+
+    return crc_a ^ crc_b;
+}
+
+
+uint32_t digest_num_blocos(uint64_t tamanho) {
+    return (uint32_t)((tamanho + BLOCO_VERIFICACAO - 1) / BLOCO_VERIFICACAO);
+}
+
+
+int digest_iniciar(digest_arquivo_t* digest, uint64_t tamanho) {
+    return digest_iniciar_em(digest, tamanho, NULL, 0);
+}
+
+
+int digest_iniciar_em(digest_arquivo_t* digest, uint64_t tamanho, uint64_t* tabela, uint32_t capacidade) {
+    if (!digest) return -1;
+
+    memset(digest, 0, sizeof(digest_arquivo_t));
+    digest->num_blocos = digest_num_blocos(tamanho);
+    if (digest->num_blocos == 0) {
+        return 0;
+    }
+    if (tabela && capacidade >= digest->num_blocos) {
+        memset(tabela, 0, digest->num_blocos * sizeof(uint64_t));
+        digest->crc_blocos = tabela;
+        return 0;
+    }
+    digest->crc_blocos = calloc(digest->num_blocos, sizeof(uint64_t));
+    if (!digest->crc_blocos) return -1;
+    digest->tabela_propria = 1;
+    return 0;
+}
+
+
+void digest_atualizar(digest_arquivo_t* digest, const uint8_t* dados, size_t tamanho) {
+    PERFIL_ESCOPO(PERFIL_CRC64);
+    if (!digest || !dados) return;
+
+    digest->crc_arquivo = crc64_atualizar(digest->crc_arquivo, dados, tamanho);
+
+    // Dividir os dados nas fronteiras de bloco
+    while (tamanho > 0) {
+        size_t no_bloco = digest->processados % BLOCO_VERIFICACAO;
+        size_t restante = BLOCO_VERIFICACAO - no_bloco;
+        size_t parte = tamanho < restante ? tamanho : restante;
+
+        digest->crc_bloco = crc64_atualizar(digest->crc_bloco, dados, parte);
+        digest->processados += parte;
+        dados += parte;
+        tamanho -= parte;
+
+        // Bloco completo (ou último bloco do arquivo, registrado a cada atualização)
+        uint32_t indice = (uint32_t)((digest->processados - 1) / BLOCO_VERIFICACAO);
+        if (indice < digest->num_blocos) {
+            digest->crc_blocos[indice] = digest->crc_bloco;
+        }
+        if (no_bloco + parte == BLOCO_VERIFICACAO) {
+            digest->crc_bloco = 0;
+        }
+    }
+}
+
+
+void digest_anexar(digest_arquivo_t* digest, const digest_arquivo_t* trecho, uint64_t offset) {
+    if (!digest || !trecho) return;
+
+    digest->crc_arquivo = crc64_combinar(digest->crc_arquivo, trecho->crc_arquivo, trecho->processados);
+    digest->processados += trecho->processados;
+
+    uint32_t primeiro = (uint32_t)(offset / BLOCO_VERIFICACAO);
+    for (uint32_t b = 0; b < trecho->num_blocos && primeiro + b < digest->num_blocos; b++) {
+        digest->crc_blocos[primeiro + b] = trecho->crc_blocos[b];
+    }
+}
+
+
+void digest_liberar(digest_arquivo_t* digest) {
+    if (!digest) return;
+    if (digest->tabela_propria) {
+        free(digest->crc_blocos);
+        digest->tabela_propria = 0;
+    }
+    digest->crc_blocos = NULL;
+    digest->num_blocos = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef INTEGRIDADE_H
+#define INTEGRIDADE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define BLOCO_VERIFICACAO 65536     // Granularidade do reenvio de trechos corrompidos
+
+
+//////////// Digest incremental do arquivo ////////////
+
+// Mantém o CRC-64 do arquivo inteiro e de cada bloco de BLOCO_VERIFICACAO bytes,
+// atualizados à medida que os dados passam, sem segunda leitura do arquivo
+typedef struct {
+    uint64_t crc_arquivo;           // CRC-64 de tudo que já passou
+    uint64_t crc_bloco;             // CRC-64 parcial do bloco atual
+    uint64_t* crc_blocos;           // CRC-64 de cada bloco completo
+    uint32_t num_blocos;
+    uint64_t processados;           // Bytes já incluídos no digest
+    int tabela_propria;             // crc_blocos veio do calloc (e não da memória do chamador)
+} digest_arquivo_t;
+
+
+//////////// Funções de CRC-64 ////////////
+
+// Atualiza um CRC-64/XZ com mais dados (comece com crc = 0)
+uint64_t crc64_atualizar(uint64_t crc, const uint8_t* dados, size_t tamanho);
+
+// Retorna o CRC-64 da concatenação A+B a partir do CRC de A, do CRC de B e do tamanho de B
+uint64_t crc64_combinar(uint64_t crc_a, uint64_t crc_b, uint64_t tamanho_b);
+
+// Prepara o digest para um arquivo com o tamanho informado
+int digest_iniciar(digest_arquivo_t* digest, uint64_t tamanho);
+
+// Como digest_iniciar, com a tabela de blocos na memória do chamador (arena da sessão)
+// Se a tabela não couber em capacidade blocos, usa calloc
+int digest_iniciar_em(digest_arquivo_t* digest, uint64_t tamanho, uint64_t* tabela, uint32_t capacidade);
+
+// Inclui os próximos bytes do arquivo no digest
+void digest_atualizar(digest_arquivo_t* digest, const uint8_t* dados, size_t tamanho);
+
+// Acrescenta ao digest do arquivo o digest de um trecho que começa em offset
+// Os trechos devem ser anexados em ordem e começar em fronteira de bloco
+void digest_anexar(digest_arquivo_t* digest, const digest_arquivo_t* trecho, uint64_t offset);
+
+// Libera a tabela de blocos (a memória do chamador não é liberada)
+void digest_liberar(digest_arquivo_t* digest);
+
+// Retorna o número de blocos de verificação de um arquivo
+uint32_t digest_num_blocos(uint64_t tamanho);
+
+#endif // INTEGRIDADE_H
@@ -0,0 +1,510 @@
+#define _GNU_SOURCE     // syscall() e pread()
+
+#include "leitor.h"
+#include "perfil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+#define CONCLUSAO_CANCELAMENTO UINT64_MAX   // user_data dos cancelamentos (o das leituras é o buffer)
+
+
+// Buffers de todos os leitores, reservados no primeiro leitor_abrir
+static slab_t buffers_reservados;
+static pthread_once_t reserva_iniciada = PTHREAD_ONCE_INIT;
+
+
+static void reservar_buffers(void) {
+    if (slab_iniciar(&buffers_reservados, LEITOR_TAM_BUFFER, LEITOR_BUFFERS_RESERVADOS, LEITOR_ALINHAMENTO) < 0) {
+        memset(&buffers_reservados, 0, sizeof(buffers_reservados));
+    }
+}
+
+
+// Buffer do slab; com o slab esgotado (muitos leitores ao mesmo tempo), um buffer avulso
+static uint8_t* obter_buffer(void) {
+    pthread_once(&reserva_iniciada, reservar_buffers);
+    uint8_t* dados = slab_alocar(&buffers_reservados);
+    if (!dados && posix_memalign((void**)&dados, LEITOR_ALINHAMENTO, LEITOR_TAM_BUFFER) != 0) {
+        dados = NULL;
+    }
+    return dados;
+}
+
+
+static void devolver_buffer(uint8_t* dados) {
+    if (slab_contem(&buffers_reservados, dados)) {
+        slab_devolver(&buffers_reservados, dados);
+    } else {
+        free(dados);
+    }
+}
+
+
+//////////// io_uring sem liburing ////////////
+
+static void fechar_anel(leitor_t* leitor) {
+    if (leitor->sqes) munmap(leitor->sqes, leitor->tamanho_sqes);
+    if (leitor->anel_cq) munmap(leitor->anel_cq, leitor->tamanho_cq);
+    if (leitor->anel_sq) munmap(leitor->anel_sq, leitor->tamanho_sq);
+    if (leitor->anel_fd >= 0) close(leitor->anel_fd);
+    leitor->sqes = NULL;
+    leitor->anel_cq = NULL;
+    leitor->anel_sq = NULL;
+    leitor->anel_fd = -1;
+    leitor->usa_io_uring = 0;
+}
+
+
+// Cria o anel; falha em kernels antigos ou quando io_uring está bloqueado (seccomp)
+static int abrir_anel(leitor_t* leitor) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    leitor->anel_fd = (int)syscall(__NR_io_uring_setup, LEITOR_ENTRADAS_ANEL, &p);
+    if (leitor->anel_fd < 0) {
+        return -1;
+    }
+
+    leitor->tamanho_sq = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    leitor->tamanho_cq = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    leitor->tamanho_sqes = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    leitor->anel_sq = mmap(NULL, leitor->tamanho_sq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           leitor->anel_fd, IORING_OFF_SQ_RING);
+    leitor->anel_cq = mmap(NULL, leitor->tamanho_cq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           leitor->anel_fd, IORING_OFF_CQ_RING);
+    leitor->sqes = mmap(NULL, leitor->tamanho_sqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        leitor->anel_fd, IORING_OFF_SQES);
+    if (leitor->anel_sq == MAP_FAILED) leitor->anel_sq = NULL;
+    if (leitor->anel_cq == MAP_FAILED) leitor->anel_cq = NULL;
+    if (leitor->sqes == MAP_FAILED) leitor->sqes = NULL;
+    if (!leitor->anel_sq || !leitor->anel_cq || !leitor->sqes) {
+        fechar_anel(leitor);
+        return -1;
+    }
+
+    uint8_t* sq = (uint8_t*)leitor->anel_sq;
+    uint8_t* cq = (uint8_t*)leitor->anel_cq;
+    leitor->sq_cauda = (unsigned*)(sq + p.sq_off.tail);
+    leitor->sq_mascara = (unsigned*)(sq + p.sq_off.ring_mask);
+    leitor->sq_indices = (unsigned*)(sq + p.sq_off.array);
+    leitor->cq_cabeca = (unsigned*)(cq + p.cq_off.head);
+    leitor->cq_cauda = (unsigned*)(cq + p.cq_off.tail);
+    leitor->cq_mascara = (unsigned*)(cq + p.cq_off.ring_mask);
+    leitor->cqes = cq + p.cq_off.cqes;
+
+    leitor->usa_io_uring = 1;
+    return 0;
+}
+
+
+// Próximo SQE livre, zerado (enviado no próximo io_uring_enter)
+static struct io_uring_sqe* proximo_sqe(leitor_t* leitor) {
+    unsigned cauda = *leitor->sq_cauda;
+    unsigned indice = cauda & *leitor->sq_mascara;
+    struct io_uring_sqe* sqe = &((struct io_uring_sqe*)leitor->sqes)[indice];
+
+    memset(sqe, 0, sizeof(*sqe));
+    leitor->sq_indices[indice] = indice;
+    return sqe;
+}
+
+
+static void publicar_sqe(leitor_t* leitor) {
+    __atomic_store_n(leitor->sq_cauda, *leitor->sq_cauda + 1, __ATOMIC_RELEASE);
+    leitor->a_submeter++;
+}
+
+
+// Prepara um IORING_OP_READ para o restante do buffer
+static void preparar_leitura_anel(leitor_t* leitor, int b) {
+    buffer_leitura_t* buffer = &leitor->buffers[b];
+    struct io_uring_sqe* sqe = proximo_sqe(leitor);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = leitor->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(buffer->dados + buffer->lidos);
+    sqe->len = (uint32_t)(buffer->pedido - buffer->lidos);
+    sqe->off = leitor->offset_base + buffer->offset + buffer->lidos;
+    sqe->user_data = (uint64_t)b;
+    publicar_sqe(leitor);
+}
+
+
+// Prepara o cancelamento da leitura do buffer; a conclusão dele não tem buffer
+static void preparar_cancelamento_anel(leitor_t* leitor, int b) {
+    struct io_uring_sqe* sqe = proximo_sqe(leitor);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)b;
+    sqe->user_data = CONCLUSAO_CANCELAMENTO;
+    publicar_sqe(leitor);
+}
+
+
+// Lê de forma síncrona o que faltar no buffer (opcode não suportado pelo kernel)
+// Quem chama publica BUFFER_PRONTO
+static void ler_buffer(leitor_t* leitor, buffer_leitura_t* buffer) {
+    PERFIL_ESCOPO(PERFIL_LEITURA_DISCO);
+    while (buffer->lidos < buffer->pedido) {
+        ssize_t n = pread(leitor->fd, buffer->dados + buffer->lidos, buffer->pedido - buffer->lidos,
+                          (off_t)(leitor->offset_base + buffer->offset + buffer->lidos));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            buffer->erro = n < 0 ? errno : EIO;
+            break;
+        }
+        buffer->lidos += (size_t)n;
+    }
+}
+
+
+static void publicar_pronto(buffer_leitura_t* buffer) {
+    __atomic_store_n(&buffer->estado, BUFFER_PRONTO, __ATOMIC_RELEASE);
+}
+
+
+// Envia os SQEs pendentes e, se pedido, espera ao menos uma conclusão; depois colhe os CQEs
+static int processar_anel(leitor_t* leitor, unsigned min_conclusoes) {
+    PERFIL_ESCOPO(PERFIL_LEITURA_DISCO);
+    unsigned flags = min_conclusoes > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (leitor->a_submeter > 0 || min_conclusoes > 0) {
+        int r = (int)syscall(__NR_io_uring_enter, leitor->anel_fd, leitor->a_submeter, min_conclusoes, flags, NULL, 0);
+        if (r < 0) {
+            if (errno == EINTR) return 0;
+            return -1;
+        }
+        leitor->a_submeter -= (unsigned)r < leitor->a_submeter ? (unsigned)r : leitor->a_submeter;
+    }
+
+    struct io_uring_cqe* cqes = (struct io_uring_cqe*)leitor->cqes;
+    unsigned cabeca = *leitor->cq_cabeca;
+    unsigned cauda = __atomic_load_n(leitor->cq_cauda, __ATOMIC_ACQUIRE);
+    while (cabeca != cauda) {
+        struct io_uring_cqe* cqe = &cqes[cabeca & *leitor->cq_mascara];
+        uint64_t dados = cqe->user_data;
+        int res = cqe->res;
+        cabeca++;
+        if (dados == CONCLUSAO_CANCELAMENTO) {
+            continue;
+        }
+        buffer_leitura_t* buffer = &leitor->buffers[dados];
+
+        if (leitor->fechando) {
+            // Cancelada ou concluída: o kernel largou o buffer, sem repetir nem completar a leitura
+            buffer->erro = res < 0 ? -res : 0;
+            publicar_pronto(buffer);
+        } else if (res == -EINTR || res == -EAGAIN) {
+            preparar_leitura_anel(leitor, (int)dados);
+        } else if (res < 0) {
+            ler_buffer(leitor, buffer);
+            publicar_pronto(buffer);
+        } else if (res == 0) {
+            buffer->erro = EIO;
+            publicar_pronto(buffer);
+        } else {
+            buffer->lidos += (size_t)res;
+            if (buffer->lidos < buffer->pedido) {
+                preparar_leitura_anel(leitor, (int)dados);     // Leitura parcial
+            } else {
+                publicar_pronto(buffer);
+            }
+        }
+    }
+    __atomic_store_n(leitor->cq_cabeca, cabeca, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+//////////// Pool de threads ////////////
+
+// Compartilhado por todos os leitores sem io_uring: cada pedido é um buffer na fila
+static struct {
+    pthread_mutex_t trava;
+    pthread_cond_t tem_pedido;                      // Sinaliza as threads de leitura
+    pthread_cond_t tem_pronto;                      // Sinaliza quem espera um buffer
+    buffer_leitura_t* primeiro;
+    buffer_leitura_t* ultimo;
+    int num_threads;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0 };
+static pthread_once_t pool_iniciado = PTHREAD_ONCE_INIT;
+
+
+static void* thread_leitora(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&pool.trava);
+    while (1) {
+        while (!pool.primeiro) {
+            pthread_cond_wait(&pool.tem_pedido, &pool.trava);
+        }
+        buffer_leitura_t* buffer = pool.primeiro;
+        pool.primeiro = buffer->proximo;
+        if (!pool.primeiro) {
+            pool.ultimo = NULL;
+        }
+        buffer->proximo = NULL;
+        buffer->na_fila = 0;
+        pthread_mutex_unlock(&pool.trava);
+
+        // Fora da trava: o leitor não toca em buffers com estado BUFFER_LENDO
+        ler_buffer(buffer->dono, buffer);
+
+        pthread_mutex_lock(&pool.trava);
+        publicar_pronto(buffer);
+        pthread_cond_broadcast(&pool.tem_pronto);
+    }
+    return NULL;
+}
+
+
+// As threads vivem até o fim do processo: os leitores só entram e saem da fila
+static void iniciar_pool(void) {
+    pthread_attr_t atributos;
+    pthread_attr_init(&atributos);
+    pthread_attr_setdetachstate(&atributos, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < LEITOR_NUM_THREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &atributos, thread_leitora, NULL) != 0) {
+            break;
+        }
+        pool.num_threads++;
+    }
+    pthread_attr_destroy(&atributos);
+}
+
+
+// Tira da fila os pedidos do leitor e espera as leituras que uma thread já começou
+static void retirar_do_pool(leitor_t* leitor) {
+    pthread_mutex_lock(&pool.trava);
+    buffer_leitura_t** anterior = &pool.primeiro;
+    pool.ultimo = NULL;
+    while (*anterior) {
+        buffer_leitura_t* buffer = *anterior;
+        if (buffer->dono == leitor) {
+            *anterior = buffer->proximo;
+            buffer->proximo = NULL;
+            buffer->na_fila = 0;
+            buffer->estado = BUFFER_LIVRE;
+            continue;
+        }
+        pool.ultimo = buffer;
+        anterior = &buffer->proximo;
+    }
+
+    for (int i = 0; i < LEITOR_NUM_BUFFERS; i++) {
+        while (__atomic_load_n(&leitor->buffers[i].estado, __ATOMIC_ACQUIRE) == BUFFER_LENDO) {
+            pthread_cond_wait(&pool.tem_pronto, &pool.trava);
+        }
+    }
+    pthread_mutex_unlock(&pool.trava);
+}
+
+
+//////////// Funções do leitor ////////////
+
+// Pede ao disco o próximo trecho do arquivo no buffer indicado
+static void pedir_buffer(leitor_t* leitor, int b) {
+    buffer_leitura_t* buffer = &leitor->buffers[b];
+    if (leitor->offset_pedido >= leitor->tamanho) {
+        buffer->estado = BUFFER_LIVRE;
+        return;
+    }
+
+    uint64_t restante = leitor->tamanho - leitor->offset_pedido;
+    buffer->offset = leitor->offset_pedido;
+    buffer->pedido = restante < LEITOR_TAM_BUFFER ? (size_t)restante : LEITOR_TAM_BUFFER;
+    buffer->lidos = 0;
+    buffer->erro = 0;
+    leitor->offset_pedido += buffer->pedido;
+
+    if (leitor->usa_io_uring) {
+        buffer->estado = BUFFER_LENDO;
+        preparar_leitura_anel(leitor, b);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.trava);
+    buffer->estado = BUFFER_LENDO;
+    buffer->dono = leitor;
+    buffer->proximo = NULL;
+    buffer->na_fila = 1;
+    if (pool.ultimo) {
+        pool.ultimo->proximo = buffer;
+    } else {
+        pool.primeiro = buffer;
+    }
+    pool.ultimo = buffer;
+    pthread_cond_signal(&pool.tem_pedido);
+    pthread_mutex_unlock(&pool.trava);
+}
+
+
+// Espera o buffer indicado ficar pronto
+static int aguardar_buffer(leitor_t* leitor, int b) {
+    buffer_leitura_t* buffer = &leitor->buffers[b];
+
+    if (leitor->usa_io_uring) {
+        while (buffer->estado == BUFFER_LENDO) {
+            if (processar_anel(leitor, 1) < 0) {
+                return -1;
+            }
+        }
+    } else {
+        pthread_mutex_lock(&pool.trava);
+        while (__atomic_load_n(&buffer->estado, __ATOMIC_ACQUIRE) == BUFFER_LENDO) {
+            pthread_cond_wait(&pool.tem_pronto, &pool.trava);
+        }
+        pthread_mutex_unlock(&pool.trava);
+    }
+
+    if (buffer->erro) {
+        errno = buffer->erro;
+        return -1;
+    }
+    return 0;
+}
+
+
+int leitor_abrir(leitor_t* leitor, int fd, uint64_t offset_base, uint64_t tamanho) {
+    if (!leitor || fd < 0) return -1;
+
+    memset(leitor, 0, sizeof(leitor_t));
+    leitor->fd = fd;
+    leitor->anel_fd = -1;
+    leitor->offset_base = offset_base;
+    leitor->tamanho = tamanho;
+
+    for (int i = 0; i < LEITOR_NUM_BUFFERS; i++) {
+        leitor->buffers[i].dados = obter_buffer();
+        if (!leitor->buffers[i].dados) {
+            leitor_fechar(leitor);
+            return -1;
+        }
+    }
+
+    if (abrir_anel(leitor) < 0) {
+        pthread_once(&pool_iniciado, iniciar_pool);
+        if (pool.num_threads == 0) {
+            leitor_fechar(leitor);
+            return -1;
+        }
+    }
+
+    // Todas as leituras começam já, antes do primeiro frame sair
+    for (int i = 0; i < LEITOR_NUM_BUFFERS; i++) {
+        pedir_buffer(leitor, i);
+    }
+    if (leitor->usa_io_uring && processar_anel(leitor, 0) < 0) {
+        leitor_fechar(leitor);
+        return -1;
+    }
+    return 0;
+}
+
+
+int leitor_pronto(leitor_t* leitor, size_t tamanho) {
+    if (!leitor) return -1;
+    if (leitor->usa_io_uring && processar_anel(leitor, 0) < 0) {
+        return -1;
+    }
+
+    // Os buffers que leitor_ler vai consumir, a partir da posição atual
+    uint64_t restante_trecho = leitor->tamanho - leitor->offset_consumido;
+    size_t restante = restante_trecho < tamanho ? (size_t)restante_trecho : tamanho;
+    size_t posicao = leitor->posicao;
+    for (int i = 0, b = leitor->atual; restante > 0 && i < LEITOR_NUM_BUFFERS; i++, b = (b + 1) % LEITOR_NUM_BUFFERS) {
+        buffer_leitura_t* buffer = &leitor->buffers[b];
+        if (__atomic_load_n(&buffer->estado, __ATOMIC_ACQUIRE) != BUFFER_PRONTO) {
+            return 0;
+        }
+        size_t disponivel = buffer->lidos - posicao;
+        if (buffer->erro || disponivel >= restante) {
+            return 1;       // Com erro, leitor_ler o informa sem esperar
+        }
+        restante -= disponivel;
+        posicao = 0;
+    }
+    return 1;
+}
+
+
+ssize_t leitor_ler(leitor_t* leitor, uint8_t* destino, size_t tamanho) {
+    if (!leitor || !destino) return -1;
+
+    // Um frame pode atravessar a fronteira entre dois buffers
+    size_t copiados = 0;
+    while (copiados < tamanho && leitor->offset_consumido < leitor->tamanho) {
+        int b = leitor->atual;
+        if (aguardar_buffer(leitor, b) < 0) {
+            return -1;
+        }
+
+        buffer_leitura_t* buffer = &leitor->buffers[b];
+        size_t disponivel = buffer->lidos - leitor->posicao;
+        size_t copiar = tamanho - copiados < disponivel ? tamanho - copiados : disponivel;
+        memcpy(destino + copiados, buffer->dados + leitor->posicao, copiar);
+        leitor->posicao += copiar;
+        leitor->offset_consumido += copiar;
+        copiados += copiar;
+
+        // Buffer esgotado: volta para o fim da fila pedindo o próximo trecho
+        if (leitor->posicao == buffer->lidos) {
+            leitor->posicao = 0;
+            leitor->atual = (b + 1) % LEITOR_NUM_BUFFERS;
+            pedir_buffer(leitor, b);
+            if (leitor->usa_io_uring && processar_anel(leitor, 0) < 0) {
+                return -1;
+            }
+        }
+    }
+    return (ssize_t)copiados;
+}
+
+
+// Cancela as leituras do anel e colhe as conclusões até o kernel largar todos os buffers
+// Retorna -1 se o anel falhar antes disso
+static int cancelar_leituras_anel(leitor_t* leitor) {
+    leitor->fechando = 1;
+    for (int i = 0; i < LEITOR_NUM_BUFFERS; i++) {
+        if (leitor->buffers[i].estado == BUFFER_LENDO) {
+            preparar_cancelamento_anel(leitor, i);
+        }
+    }
+
+    for (int i = 0; i < LEITOR_NUM_BUFFERS; i++) {
+        while (leitor->buffers[i].estado == BUFFER_LENDO) {
+            if (processar_anel(leitor, 1) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+void leitor_fechar(leitor_t* leitor) {
+    if (!leitor) return;
+
+    int buffers_livres = 1;
+    if (leitor->usa_io_uring) {
+        buffers_livres = cancelar_leituras_anel(leitor) == 0;
+        fechar_anel(leitor);
+    } else if (pool.num_threads > 0) {
+        retirar_do_pool(leitor);
+    }
+
+    for (int i = 0; i < LEITOR_NUM_BUFFERS; i++) {
+        // Sem a conclusão das leituras o kernel ainda pode escrever no buffer: melhor perdê-lo
+        if (leitor->buffers[i].dados && buffers_livres) {
+            devolver_buffer(leitor->buffers[i].dados);
+        }
+        leitor->buffers[i].dados = NULL;
+    }
+}
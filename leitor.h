@@ -0,0 +1,100 @@
+#ifndef LEITOR_H
+#define LEITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "memoria.h"
+
+
+#define LEITOR_TAM_BUFFER (256 * 1024)      // Tamanho de cada leitura antecipada
+#define LEITOR_NUM_BUFFERS 4                // Leituras em andamento ao mesmo tempo
+#define LEITOR_ENTRADAS_ANEL (2 * LEITOR_NUM_BUFFERS)   // Uma leitura e um cancelamento por buffer
+#define LEITOR_NUM_THREADS 4                // Threads de leitura compartilhadas quando não há io_uring
+#define LEITOR_ALINHAMENTO 4096             // Alinhamento dos buffers (página)
+#define LEITOR_BUFFERS_RESERVADOS 64        // Buffers em um slab único para todos os leitores
+
+
+typedef enum {
+    BUFFER_LIVRE = 0,
+    BUFFER_LENDO = 1,
+    BUFFER_PRONTO = 2,
+} estado_buffer_type;
+
+
+struct leitor;
+
+typedef struct buffer_leitura {
+    uint8_t* dados;
+    uint64_t offset;                                // Posição no trecho
+    size_t pedido;                                  // Bytes pedidos ao disco
+    size_t lidos;                                   // Bytes já lidos
+    estado_buffer_type estado;                      // BUFFER_PRONTO publicado com acesso atômico
+    int erro;
+
+    struct leitor* dono;                            // Pool de threads: leitor do pedido
+    struct buffer_leitura* proximo;                 // Pool de threads: próximo pedido na fila
+    int na_fila;
+} buffer_leitura_t;
+
+
+//////////// Estrutura do leitor de arquivo ////////////
+
+// Mantém LEITOR_NUM_BUFFERS leituras grandes pedidas à frente do envio.
+// Com io_uring todas ficam no anel do kernel; sem ele, um pool de threads
+// compartilhado por todos os leitores faz pread() de cada buffer. O envio
+// consome os buffers em ordem e cada buffer esgotado volta a ser pedido
+// para o próximo trecho do arquivo.
+typedef struct leitor {
+    int fd;
+    uint64_t offset_base;                           // Início do trecho no arquivo
+    uint64_t tamanho;                               // Bytes do trecho
+    uint64_t offset_pedido;                         // Próximo offset a pedir ao disco
+    uint64_t offset_consumido;                      // Bytes já entregues ao envio
+
+    buffer_leitura_t buffers[LEITOR_NUM_BUFFERS];
+    int atual;                                      // Buffer sendo consumido
+    size_t posicao;                                 // Posição dentro do buffer atual
+
+    // io_uring (usado quando o kernel permite)
+    int usa_io_uring;
+    int anel_fd;
+    void* anel_sq;
+    size_t tamanho_sq;
+    void* anel_cq;
+    size_t tamanho_cq;
+    void* sqes;
+    size_t tamanho_sqes;
+    unsigned* sq_cauda;                             // Campos do anel nos offsets dados pelo kernel
+    unsigned* sq_mascara;
+    unsigned* sq_indices;
+    unsigned* cq_cabeca;
+    unsigned* cq_cauda;
+    unsigned* cq_mascara;
+    void* cqes;
+    unsigned a_submeter;                            // SQEs preparados e ainda não enviados
+    int fechando;                                   // Leituras canceladas: as conclusões não são repetidas
+} leitor_t;
+
+
+//////////// Funções do leitor ////////////
+
+// Começa a ler antecipadamente o trecho [offset_base, offset_base + tamanho) do arquivo
+// O descritor continua pertencendo a quem chamou; os buffers vêm do slab compartilhado
+int leitor_abrir(leitor_t* leitor, int fd, uint64_t offset_base, uint64_t tamanho);
+
+// Retorna 1 se leitor_ler de até tamanho bytes não vai esperar o disco, 0 se a leitura
+// ainda está em andamento ou -1 se o anel falhou (leitor_ler informa o erro)
+// Não bloqueia: a máquina de estados da sessão confere de novo mais tarde
+int leitor_pronto(leitor_t* leitor, size_t tamanho);
+
+// Copia até tamanho bytes do trecho, aguardando só se a leitura ainda não terminou
+// Retorna os bytes copiados (menos apenas no fim do trecho), 0 no fim ou -1 em erro
+ssize_t leitor_ler(leitor_t* leitor, uint8_t* destino, size_t tamanho);
+
+// Cancela as leituras em andamento, aguarda o kernel (ou o pool) largar os buffers e os libera
+// Se o anel falhar antes disso, os buffers ficam sem liberar: o kernel ainda pode escrever neles
+void leitor_fechar(leitor_t* leitor);
+
+#endif // LEITOR_H
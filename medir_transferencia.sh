@@ -0,0 +1,199 @@
+#!/bin/bash
+
+# Mede a transferência de todos os tesouros de objetos/ com o servidor e o cliente reais,
+# cada um em um namespace de rede, ligados por um par veth com o nome de INTERFACE_PADRAO
+# (então o ritmo de envio configurado para a interface também vale aqui).
+#
+# Uso (como root, depois do make): ./medir_transferencia.sh [modos...]
+# Modos do servidor: parada (pare e espere), janela (só a janela) e auto (janela e fluxos paralelos)
+# Variáveis: TEMPO (limite de cada modo em segundos), TAMANHO_VIDEO (bytes dos .mp4 que faltarem em objetos/),
+# PERTURBACAO, repassada ao servidor e ao cliente (perturbacao.h), e RITMO, o ritmo de envio do servidor (transmissor.h)
+#
+# Por modo: MB/s e frames de dados/s no tempo das transferências (histograma transferencia_ms do servidor),
+# retransmissões e CPU por MB do servidor e do cliente (o do cliente inclui redesenhar o mapa a cada movimento)
+# Sai com erro se algum modo não trouxer os 8 tesouros íntegros
+
+RAIZ=$(cd "$(dirname "$0")" && pwd)
+MODOS=${*:-parada janela auto}
+TEMPO=${TEMPO:-300}
+TAMANHO_VIDEO=${TAMANHO_VIDEO:-2097152}
+INTERFACE=$(sed -n 's/^#define INTERFACE_PADRAO "\([^"]*\)".*/\1/p' "$RAIZ/rawSocket.h")
+DISTANCIA=$(sed -n 's/^#define DISTANCIA_PRECARGA \([0-9]*\).*/\1/p' "$RAIZ/precarga.h")
+NS_SERVIDOR=tesouro_servidor
+NS_CLIENTE=tesouro_cliente
+IP_SERVIDOR=10.0.0.1
+IP_CLIENTE=10.0.0.2
+TRABALHO=$(mktemp -d)
+PID_SERVIDOR=
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "Precisa de root: namespaces de rede e raw sockets"
+    exit 1
+fi
+if [ ! -x "$RAIZ/servidor" ] || [ ! -x "$RAIZ/cliente" ]; then
+    echo "Compile antes com make"
+    exit 1
+fi
+
+limpar() {
+    if [ -n "$PID_SERVIDOR" ]; then
+        kill "$PID_SERVIDOR" 2>/dev/null
+        wait "$PID_SERVIDOR" 2>/dev/null
+    fi
+    ip netns del $NS_SERVIDOR 2>/dev/null
+    ip netns del $NS_CLIENTE 2>/dev/null
+    rm -rf "$TRABALHO"
+}
+trap limpar EXIT
+
+
+# Dois namespaces ligados por veth, as duas pontas com o nome da interface do protocolo
+criar_rede() {
+    ip netns add $NS_SERVIDOR || return 1
+    ip netns add $NS_CLIENTE || return 1
+    ip link add tesouro0 netns $NS_SERVIDOR type veth peer name tesouro1 netns $NS_CLIENTE || return 1
+    ip -n $NS_SERVIDOR link set tesouro0 name "$INTERFACE"
+    ip -n $NS_CLIENTE link set tesouro1 name "$INTERFACE"
+    ip -n $NS_SERVIDOR addr add $IP_SERVIDOR/24 dev "$INTERFACE"
+    ip -n $NS_CLIENTE addr add $IP_CLIENTE/24 dev "$INTERFACE"
+    ip -n $NS_SERVIDOR link set "$INTERFACE" up
+    ip -n $NS_CLIENTE link set "$INTERFACE" up
+}
+
+
+# Os nomes são os de setup_jogo; os que faltarem em objetos/ são gerados
+preparar_objetos() {
+    mkdir -p "$TRABALHO/objetos"
+    cp "$RAIZ"/objetos/* "$TRABALHO/objetos/" 2>/dev/null
+    for nome in 1.txt 2.txt 3.txt 4.jpg 5.jpg 6.jpg 7.mp4 8.mp4; do
+        if [ ! -s "$TRABALHO/objetos/$nome" ]; then
+            case $nome in
+                *.mp4) tamanho=$TAMANHO_VIDEO ;;
+                *) tamanho=65536 ;;
+            esac
+            head -c "$tamanho" /dev/urandom > "$TRABALHO/objetos/$nome"
+            echo "objetos/$nome ausente: gerados $tamanho bytes aleatórios"
+        fi
+    done
+}
+
+
+# Varredura do mapa em zigue-zague, uma tecla e um ENTER por movimento
+# (o ENTER é consumido pelas telas que esperam depois de cada tesouro); o q encerra o cliente
+# se a varredura acabar antes dos oito tesouros
+gerar_movimentos() {
+    printf '\n'
+    for y in 0 1 2 3 4 5 6 7; do
+        tecla=d
+        [ $((y % 2)) -eq 1 ] && tecla=a
+        for x in 1 2 3 4 5 6 7; do
+            printf '%s\n' $tecla
+        done
+        [ $y -lt 7 ] && printf 'w\n'
+    done
+    printf 'q\n'
+}
+
+
+# Campos usados do retrato de métricas do servidor
+ler_metricas() {
+    python3 - "$1" <<'FIM'
+import json, socket, sys
+conexao = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+conexao.connect(sys.argv[1])
+texto = b""
+while True:
+    parte = conexao.recv(65536)
+    if not parte:
+        break
+    texto += parte
+retrato = json.loads(texto)
+print(retrato["frames_enviados"]["dados"], retrato["retransmissoes"],
+      retrato["transferencia_ms"]["soma"], retrato["transferencia_ms"]["total"])
+FIM
+}
+
+
+# Tempo de CPU (usuário e sistema) do processo, em ticks
+cpu_processo() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+
+medir_modo() {
+    modo=$1
+    servidor_dir="$TRABALHO/servidor_$modo"
+    cliente_dir="$TRABALHO/cliente_$modo"
+    mkdir -p "$servidor_dir" "$cliente_dir/transferidos"
+    ln -s "$TRABALHO/objetos" "$servidor_dir/objetos"
+
+    (cd "$servidor_dir" && exec ip netns exec $NS_SERVIDOR "$RAIZ/servidor" "$DISTANCIA" 0 0 "$modo" \
+        > servidor.log 2>&1) &
+    PID_SERVIDOR=$!
+
+    for _ in $(seq 50); do
+        [ -S "$servidor_dir/servidor.metricas" ] && break
+        sleep 0.1
+    done
+    if [ ! -S "$servidor_dir/servidor.metricas" ]; then
+        echo "$modo: servidor não iniciou (veja $servidor_dir/servidor.log)"
+        return 1
+    fi
+    cpu_servidor=$(cpu_processo "$PID_SERVIDOR")
+
+    inicio=$(date +%s.%N)
+    TIMEFORMAT='%U %S'
+    { time (cd "$cliente_dir" && timeout "$TEMPO" ip netns exec $NS_CLIENTE "$RAIZ/cliente" $IP_SERVIDOR \
+        < "$TRABALHO/movimentos.txt" > cliente.log 2>&1); } 2> "$TRABALHO/tempo_cliente"
+    fim=$(date +%s.%N)
+
+    read -r frames retransmissoes transferencia_ms transferencias < <(ler_metricas "$servidor_dir/servidor.metricas")
+    cpu_servidor=$(( $(cpu_processo "$PID_SERVIDOR") - cpu_servidor ))
+    kill "$PID_SERVIDOR" 2>/dev/null
+    wait "$PID_SERVIDOR" 2>/dev/null
+    PID_SERVIDOR=
+
+    # Só contam os arquivos que chegaram idênticos
+    arquivos=0
+    bytes=0
+    for arquivo in "$cliente_dir"/transferidos/*; do
+        [ -f "$arquivo" ] || continue
+        if cmp -s "$arquivo" "$TRABALHO/objetos/$(basename "$arquivo")"; then
+            arquivos=$((arquivos + 1))
+            bytes=$((bytes + $(stat -c %s "$arquivo")))
+        fi
+    done
+
+    read -r cpu_cliente_usuario cpu_cliente_sistema < "$TRABALHO/tempo_cliente"
+    awk -v modo="$modo" -v arquivos="$arquivos" -v bytes="$bytes" -v ms="$transferencia_ms" \
+        -v frames="$frames" -v retransmissoes="$retransmissoes" -v total_s="$(echo "$inicio $fim" | awk '{ print $2 - $1 }')" \
+        -v cpu_servidor="$cpu_servidor" -v ticks="$(getconf CLK_TCK)" \
+        -v cpu_cliente="$(echo "$cpu_cliente_usuario $cpu_cliente_sistema" | awk '{ print $1 + $2 }')" '
+    BEGIN {
+        mb = bytes / 1e6
+        s = ms / 1000
+        taxa = s > 0 ? mb / s : 0
+        frames_s = s > 0 ? frames / s : 0
+        ms_servidor = mb > 0 ? cpu_servidor * 1000 / ticks / mb : 0
+        ms_cliente = mb > 0 ? cpu_cliente * 1000 / mb : 0
+        printf "%-8s %5d/8 %8.2f %8.2f %8.1f %9.2f %10.0f %8d %12.1f %12.1f\n", modo, arquivos, mb, s,
+               total_s, taxa, frames_s, retransmissoes, ms_servidor, ms_cliente
+    }'
+
+    # Falha se algum tesouro não chegou íntegro dentro do TEMPO
+    [ "$arquivos" -eq 8 ]
+}
+
+
+criar_rede || { echo "Não foi possível criar os namespaces e o par veth"; exit 1; }
+preparar_objetos
+gerar_movimentos > "$TRABALHO/movimentos.txt"
+
+echo
+printf "%-8s %7s %8s %8s %8s %9s %10s %8s %12s %12s\n" modo arquivos MB "transf s" "total s" MB/s frames/s \
+       retransm "CPU srv ms/MB" "CPU cli ms/MB"
+falhou=0
+for modo in $MODOS; do
+    medir_modo "$modo" || falhou=1
+done
+exit $falhou
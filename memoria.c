@@ -0,0 +1,117 @@
+#define _XOPEN_SOURCE 700   // posix_memalign()
+
+#include "memoria.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static uint64_t montar_topo(uint64_t versao, uint32_t indice) {
+    return (versao << 32) | indice;
+}
+
+
+int slab_iniciar(slab_t* slab, size_t tamanho_objeto, uint32_t capacidade, size_t alinhamento) {
+    if (!slab || tamanho_objeto == 0 || capacidade == 0) return -1;
+    if (alinhamento < sizeof(void*)) {
+        alinhamento = sizeof(void*);
+    }
+
+    memset(slab, 0, sizeof(slab_t));
+    slab->tamanho_objeto = (tamanho_objeto + alinhamento - 1) & ~(alinhamento - 1);
+    slab->capacidade = capacidade;
+
+    if (posix_memalign((void**)&slab->memoria, alinhamento, slab->tamanho_objeto * capacidade) != 0) {
+        slab->memoria = NULL;
+        return -1;
+    }
+    slab->proximo = malloc(capacidade * sizeof(uint32_t));
+    if (!slab->proximo) {
+        free(slab->memoria);
+        slab->memoria = NULL;
+        return -1;
+    }
+
+    // Todos livres, em ordem: os primeiros objetos são os primeiros a sair
+    for (uint32_t i = 0; i < capacidade; i++) {
+        slab->proximo[i] = i + 1 < capacidade ? i + 2 : 0;
+    }
+    slab->topo = montar_topo(0, 1);
+    return 0;
+}
+
+
+void* slab_alocar(slab_t* slab) {
+    if (!slab || !slab->memoria) return NULL;
+
+    uint64_t topo = __atomic_load_n(&slab->topo, __ATOMIC_ACQUIRE);
+    while (1) {
+        uint32_t indice = (uint32_t)topo;
+        if (indice == 0) {
+            return NULL;
+        }
+        uint32_t proximo = __atomic_load_n(&slab->proximo[indice - 1], __ATOMIC_RELAXED);
+        uint64_t novo = montar_topo((topo >> 32) + 1, proximo);
+        if (__atomic_compare_exchange_n(&slab->topo, &topo, novo, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_add_fetch(&slab->em_uso, 1, __ATOMIC_RELAXED);
+            return slab->memoria + (size_t)(indice - 1) * slab->tamanho_objeto;
+        }
+    }
+}
+
+
+void slab_devolver(slab_t* slab, void* objeto) {
+    if (!slab_contem(slab, objeto)) return;
+
+    uint32_t indice = (uint32_t)(((uint8_t*)objeto - slab->memoria) / slab->tamanho_objeto) + 1;
+    uint64_t topo = __atomic_load_n(&slab->topo, __ATOMIC_ACQUIRE);
+    do {
+        __atomic_store_n(&slab->proximo[indice - 1], (uint32_t)topo, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&slab->topo, &topo, montar_topo((topo >> 32) + 1, indice), 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_sub_fetch(&slab->em_uso, 1, __ATOMIC_RELAXED);
+}
+
+
+int slab_contem(const slab_t* slab, const void* objeto) {
+    if (!slab || !slab->memoria || !objeto) return 0;
+    const uint8_t* p = (const uint8_t*)objeto;
+    return p >= slab->memoria && p < slab->memoria + slab->tamanho_objeto * slab->capacidade;
+}
+
+
+void slab_finalizar(slab_t* slab) {
+    if (!slab) return;
+    free(slab->memoria);
+    free(slab->proximo);
+    slab->memoria = NULL;
+    slab->proximo = NULL;
+    slab->capacidade = 0;
+}
+
+
+void arena_iniciar(arena_t* arena, void* memoria, size_t tamanho) {
+    if (!arena) return;
+    arena->memoria = (uint8_t*)memoria;
+    arena->tamanho = memoria ? tamanho : 0;
+    arena->usado = 0;
+}
+
+
+void* arena_alocar(arena_t* arena, size_t tamanho) {
+    if (!arena || !arena->memoria) return NULL;
+
+    size_t inicio = (arena->usado + ARENA_ALINHAMENTO - 1) & ~(size_t)(ARENA_ALINHAMENTO - 1);
+    if (inicio > arena->tamanho || tamanho > arena->tamanho - inicio) {
+        return NULL;
+    }
+    arena->usado = inicio + tamanho;
+    return arena->memoria + inicio;
+}
+
+
+void arena_limpar(arena_t* arena) {
+    if (arena) {
+        arena->usado = 0;
+    }
+}
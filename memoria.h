@@ -0,0 +1,67 @@
+#ifndef MEMORIA_H
+#define MEMORIA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define ARENA_ALINHAMENTO 16        // Alinhamento de cada bloco entregue pela arena
+
+
+//////////// Slab de objetos de tamanho fixo ////////////
+
+// Todos os objetos saem de uma única região reservada no início; alocar e
+// devolver só trocam o topo da lista de livres, sem travas nem malloc.
+// O topo guarda índice + 1 nos 32 bits baixos e uma versão nos altos,
+// para que um objeto devolvido e realocado entre a leitura e o CAS não
+// corrompa a lista.
+typedef struct {
+    uint8_t* memoria;
+    size_t tamanho_objeto;                  // Já arredondado para o alinhamento
+    uint32_t capacidade;
+    uint32_t* proximo;                      // Próximo livre de cada objeto (índice + 1, 0 no fim)
+    uint64_t topo;                          // Lista de livres (acesso atômico)
+    uint32_t em_uso;                        // Objetos alocados (acesso atômico)
+} slab_t;
+
+
+//////////// Arena da sessão ////////////
+
+// Memória de uma sessão entregue em ordem e liberada toda de uma vez
+typedef struct {
+    uint8_t* memoria;
+    size_t tamanho;
+    size_t usado;
+} arena_t;
+
+
+//////////// Funções do slab ////////////
+
+// Reserva a região para capacidade objetos com o alinhamento pedido (potência de 2)
+int slab_iniciar(slab_t* slab, size_t tamanho_objeto, uint32_t capacidade, size_t alinhamento);
+
+// Retira um objeto livre (NULL se o slab estiver esgotado)
+// Pode ser chamada por qualquer thread
+void* slab_alocar(slab_t* slab);
+
+// Devolve um objeto ao slab
+void slab_devolver(slab_t* slab, void* objeto);
+
+// Retorna 1 se o endereço é de um objeto deste slab
+int slab_contem(const slab_t* slab, const void* objeto);
+
+// Libera a região; nenhum objeto pode estar em uso
+void slab_finalizar(slab_t* slab);
+
+//////////// Funções da arena ////////////
+
+// Usa a memoria informada (do chamador) como arena
+void arena_iniciar(arena_t* arena, void* memoria, size_t tamanho);
+
+// Entrega tamanho bytes alinhados a ARENA_ALINHAMENTO (NULL se não couber)
+void* arena_alocar(arena_t* arena, size_t tamanho);
+
+// Descarta tudo que foi entregue pela arena
+void arena_limpar(arena_t* arena);
+
+#endif // MEMORIA_H
@@ -0,0 +1,197 @@
+#define _XOPEN_SOURCE 700   // clock_gettime(), open_memstream()
+
+#include "metricas.h"
+
+#include <time.h>
+#include <sys/un.h>
+
+
+metricas_t metricas;
+
+// Nomes dos mensagem_type no JSON, na ordem do enum
+static const char* nomes_tipos[METRICAS_TIPOS] = {
+    "ack", "nack", "ok_ack", "start", "tamanho", "dados", "texto_nome", "video_nome",
+    "imagem_nome", "fim_arquivo", "direita", "cima", "baixo", "esquerda", "interface", "erro",
+};
+
+// Estado da thread do socket de métricas
+static struct {
+    int fd;
+    int ativo;
+    pthread_t thread;
+    char caminho[108];                      // sun_path
+    rawsocket_t* rawsock;
+    void (*escrever_sessoes)(FILE* saida);
+} servidor_metricas = { .fd = -1 };
+
+
+int64_t metricas_agora_us(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (int64_t)agora.tv_sec * 1000000 + agora.tv_nsec / 1000;
+}
+
+
+void metricas_enviado(uint8_t tipo, size_t bytes) {
+    METRICA_SOMAR(metricas.enviados[tipo & (METRICAS_TIPOS - 1)], 1);
+    METRICA_SOMAR(metricas.bytes_enviados, bytes);
+}
+
+
+void metricas_recebido(uint8_t tipo, size_t bytes) {
+    METRICA_SOMAR(metricas.recebidos[tipo & (METRICAS_TIPOS - 1)], 1);
+    METRICA_SOMAR(metricas.bytes_recebidos, bytes);
+}
+
+
+static uint64_t ler(const uint64_t* contador) {
+    return __atomic_load_n(contador, __ATOMIC_RELAXED);
+}
+
+
+static void escrever_tipos(FILE* saida, const char* nome, const uint64_t* contadores) {
+    fprintf(saida, "  \"%s\": {", nome);
+    for (int i = 0; i < METRICAS_TIPOS; i++) {
+        fprintf(saida, "%s\"%s\": %llu", i ? ", " : "", nomes_tipos[i], (unsigned long long)ler(&contadores[i]));
+    }
+    fprintf(saida, "},\n");
+}
+
+
+// Percentis e os baldes não vazios como [limite superior, contagem]
+static void escrever_histograma(FILE* saida, const char* nome, const histograma_t* histograma) {
+    fprintf(saida, "  \"%s\": {\"total\": %llu, \"soma\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+            "\"p999\": %llu, \"max\": %llu, \"baldes\": [",
+            nome, (unsigned long long)ler(&histograma->total), (unsigned long long)ler(&histograma->soma),
+            (unsigned long long)histograma_percentil(histograma, 50.0),
+            (unsigned long long)histograma_percentil(histograma, 90.0),
+            (unsigned long long)histograma_percentil(histograma, 99.0),
+            (unsigned long long)histograma_percentil(histograma, 99.9),
+            (unsigned long long)ler(&histograma->maximo));
+    int primeiro = 1;
+    for (int i = 0; i < HISTOGRAMA_BALDES; i++) {
+        uint64_t contagem = ler(&histograma->baldes[i]);
+        if (contagem > 0) {
+            fprintf(saida, "%s[%llu, %llu]", primeiro ? "" : ", ",
+                    (unsigned long long)histograma_limite_balde(i), (unsigned long long)contagem);
+            primeiro = 0;
+        }
+    }
+    fprintf(saida, "]},\n");
+}
+
+
+static void escrever_retrato(FILE* saida) {
+    // Só esta thread lê PACKET_STATISTICS, então o acumulado não precisa de trava
+    unsigned int pacotes, descartes;
+    if (servidor_metricas.rawsock && estatisticas_rawsocket(servidor_metricas.rawsock, &pacotes, &descartes) == 0) {
+        METRICA_SOMAR(metricas.pacotes_kernel, pacotes);
+        METRICA_SOMAR(metricas.descartes_kernel, descartes);
+    }
+
+    fprintf(saida, "{\n");
+    escrever_tipos(saida, "frames_enviados", metricas.enviados);
+    escrever_tipos(saida, "frames_recebidos", metricas.recebidos);
+    fprintf(saida, "  \"bytes_enviados\": %llu,\n  \"bytes_recebidos\": %llu,\n",
+            (unsigned long long)ler(&metricas.bytes_enviados), (unsigned long long)ler(&metricas.bytes_recebidos));
+    fprintf(saida, "  \"retransmissoes\": %llu,\n  \"falhas_envio\": %llu,\n  \"falhas_checksum\": %llu,\n",
+            (unsigned long long)ler(&metricas.retransmissoes), (unsigned long long)ler(&metricas.falhas_envio),
+            (unsigned long long)ler(&metricas.falhas_checksum));
+    fprintf(saida, "  \"rejeitados_marcador\": %llu,\n  \"rejeitados_tamanho\": %llu,\n  \"timeouts\": %llu,\n",
+            (unsigned long long)ler(&metricas.rejeitados_marcador),
+            (unsigned long long)ler(&metricas.rejeitados_tamanho), (unsigned long long)ler(&metricas.timeouts));
+    fprintf(saida, "  \"kernel\": {\"pacotes\": %llu, \"descartes\": %llu},\n",
+            (unsigned long long)ler(&metricas.pacotes_kernel), (unsigned long long)ler(&metricas.descartes_kernel));
+    escrever_histograma(saida, "rtt_us", &metricas.rtt_us);
+    escrever_histograma(saida, "transferencia_ms", &metricas.transferencia_ms);
+    fprintf(saida, "  \"sessoes\": ");
+    if (servidor_metricas.escrever_sessoes) {
+        servidor_metricas.escrever_sessoes(saida);
+    } else {
+        fprintf(saida, "[]");
+    }
+    fprintf(saida, "\n}\n");
+}
+
+
+// Cada conexão recebe um retrato e é fechada (socat - UNIX-CONNECT:<caminho>)
+static void* thread_metricas(void* arg) {
+    (void)arg;
+
+    while (1) {
+        int conexao = accept(servidor_metricas.fd, NULL, NULL);
+        if (conexao < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return NULL;    // Socket fechado por metricas_finalizar
+        }
+
+        // Montado na memória e enviado com MSG_NOSIGNAL: quem desconecta no meio não derruba o processo
+        char* texto = NULL;
+        size_t tamanho = 0;
+        FILE* saida = open_memstream(&texto, &tamanho);
+        if (saida) {
+            escrever_retrato(saida);
+            fclose(saida);
+            size_t enviados = 0;
+            while (enviados < tamanho) {
+                ssize_t n = send(conexao, texto + enviados, tamanho - enviados, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    break;
+                }
+                enviados += (size_t)n;
+            }
+            free(texto);
+        }
+        close(conexao);
+    }
+}
+
+
+int metricas_servir(const char* caminho, rawsocket_t* rawsock, void (*escrever_sessoes)(FILE* saida)) {
+    if (!caminho || servidor_metricas.ativo || strlen(caminho) >= sizeof(servidor_metricas.caminho)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strcpy(endereco.sun_path, caminho);
+
+    // Socket de uma execução anterior
+    unlink(caminho);
+    if (bind(fd, (struct sockaddr*)&endereco, sizeof(endereco)) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    servidor_metricas.fd = fd;
+    strcpy(servidor_metricas.caminho, caminho);
+    servidor_metricas.rawsock = rawsock;
+    servidor_metricas.escrever_sessoes = escrever_sessoes;
+    if (pthread_create(&servidor_metricas.thread, NULL, thread_metricas, NULL) != 0) {
+        close(fd);
+        unlink(caminho);
+        servidor_metricas.fd = -1;
+        return -1;
+    }
+    servidor_metricas.ativo = 1;
+    return 0;
+}
+
+
+void metricas_finalizar(void) {
+    if (!servidor_metricas.ativo) return;
+
+    // shutdown acorda o accept da thread
+    shutdown(servidor_metricas.fd, SHUT_RDWR);
+    pthread_join(servidor_metricas.thread, NULL);
+    close(servidor_metricas.fd);
+    unlink(servidor_metricas.caminho);
+    servidor_metricas.fd = -1;
+    servidor_metricas.ativo = 0;
+}
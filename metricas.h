@@ -0,0 +1,68 @@
+#ifndef METRICAS_H
+#define METRICAS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "histograma.h"
+#include "rawSocket.h"
+
+
+#define METRICAS_TIPOS 16                   // mensagem_type ocupa 4 bits no cabeçalho
+
+
+//////////// Contadores do protocolo ////////////
+
+// Contadores do processo inteiro, somados com acesso atômico por qualquer thread
+typedef struct {
+    uint64_t enviados[METRICAS_TIPOS];      // Frames por mensagem_type
+    uint64_t recebidos[METRICAS_TIPOS];
+    uint64_t bytes_enviados;                // Frame inteiro (cabeçalho do pack e dados)
+    uint64_t bytes_recebidos;
+    uint64_t retransmissoes;
+    uint64_t falhas_envio;
+    uint64_t falhas_checksum;               // Caminho -3 de receber_pacote
+    uint64_t rejeitados_marcador;
+    uint64_t rejeitados_tamanho;
+    uint64_t timeouts;
+
+    // PACKET_STATISTICS do socket (o kernel zera a cada leitura, aqui fica o acumulado)
+    uint64_t pacotes_kernel;
+    uint64_t descartes_kernel;
+
+    histograma_t rtt_us;                    // Envio até a confirmação, sem contar frames repetidos
+    histograma_t transferencia_ms;          // Tesouro encontrado até o arquivo confirmado
+} metricas_t;
+
+// Contadores de uma sessão do servidor (acesso atômico: recepção e trabalhadores somam)
+typedef struct {
+    uint64_t enviados;
+    uint64_t recebidos;
+    uint64_t bytes_enviados;
+    uint64_t bytes_recebidos;
+    uint64_t retransmissoes;
+} metricas_sessao_t;
+
+extern metricas_t metricas;
+
+#define METRICA_SOMAR(contador, valor) __atomic_add_fetch(&(contador), (valor), __ATOMIC_RELAXED)
+
+
+//////////// Funções das métricas ////////////
+
+// Relógio monotônico em microssegundos, para os histogramas
+int64_t metricas_agora_us(void);
+
+// Frame enviado ou recebido com sucesso
+void metricas_enviado(uint8_t tipo, size_t bytes);
+void metricas_recebido(uint8_t tipo, size_t bytes);
+
+// Inicia a thread que responde cada conexão no socket Unix caminho com um retrato em JSON
+// rawsock é o socket cujos descartes do kernel são lidos; escrever_sessoes (pode ser NULL)
+// escreve o valor do campo "sessoes"
+int metricas_servir(const char* caminho, rawsocket_t* rawsock, void (*escrever_sessoes)(FILE* saida));
+
+// Fecha o socket e encerra a thread
+void metricas_finalizar(void);
+
+#endif // METRICAS_H
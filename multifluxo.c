@@ -0,0 +1,365 @@
+#include "multifluxo.h"
+#include "escritor.h"
+#include "leitor.h"
+#include "metricas.h"
+
+
+int multifluxo_quantidade(uint64_t tamanho, mensagem_type tipo) {
+    if (tipo != MSG_VIDEO_ACK_NOME || tamanho < LIMIAR_MULTIFLUXO) {
+        return 1;
+    }
+
+    uint32_t blocos = digest_num_blocos(tamanho);
+    return blocos < NUM_FLUXOS ? (int)blocos : NUM_FLUXOS;
+}
+
+
+void multifluxo_trecho(uint64_t tamanho, int num_fluxos, int indice, uint64_t* offset, uint64_t* tamanho_trecho) {
+    uint64_t blocos = digest_num_blocos(tamanho);
+    uint64_t primeiro = blocos * indice / num_fluxos;
+    uint64_t ultimo = blocos * (indice + 1) / num_fluxos;
+
+    uint64_t inicio = primeiro * BLOCO_VERIFICACAO;
+    uint64_t fim = ultimo * BLOCO_VERIFICACAO;
+    if (fim > tamanho) {
+        fim = tamanho;
+    }
+
+    *offset = inicio;
+    *tamanho_trecho = fim - inicio;
+}
+
+
+// Registra o resultado do trecho para multifluxo_concluido
+static void concluir_trecho(fluxo_t* fluxo, int resultado) {
+    fluxo->resultado = resultado;
+    __atomic_store_n(&fluxo->pronto, 1, __ATOMIC_RELEASE);
+}
+
+
+// Registra o resultado (se ainda não houver) e avisa que a thread saiu
+static void* encerrar_fluxo(fluxo_t* fluxo, int resultado) {
+    if (!__atomic_load_n(&fluxo->pronto, __ATOMIC_ACQUIRE)) {
+        concluir_trecho(fluxo, resultado);
+    }
+    __atomic_store_n(&fluxo->terminou, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+static int fluxo_cancelado(fluxo_t* fluxo) {
+    return __atomic_load_n(&fluxo->cancelar, __ATOMIC_RELAXED);
+}
+
+
+// Frame do fluxo pela saída do servidor ou, sem ela, direto pelo socket do fluxo
+static int enviar_fluxo(fluxo_t* fluxo, const pack_t* pack) {
+    if (fluxo->saida.enviar && fluxo->saida.enviar(fluxo->saida.contexto, &fluxo->protocolo.rawsock, pack) == 0) {
+        return 0;
+    }
+    return enviar_pacote(&fluxo->protocolo, pack);
+}
+
+
+static void avisar_confirmado(fluxo_t* fluxo) {
+    if (fluxo->saida.confirmado) {
+        fluxo->saida.confirmado(fluxo->saida.contexto);
+    }
+}
+
+
+// Servidor: envia o trecho em stop-and-wait com a sequência própria do fluxo
+static void* thread_envio(void* arg) {
+    fluxo_t* fluxo = (fluxo_t*)arg;
+    uint8_t buffer[MAX_FRAME];
+    uint64_t enviados = 0;
+    uint64_t retomar_em = 0;
+    pack_t pack;
+
+    // Fluxo de antes de um reinício do servidor: continua após o último ACK
+    uint64_t progresso = fluxo->progresso ? __atomic_load_n(fluxo->progresso, __ATOMIC_ACQUIRE) : 0;
+    if (progresso & 0x80) {
+        retomar_em = progresso >> 8;
+        fluxo->protocolo.seq_atual = (uint8_t)(progresso & 0x1F);
+    }
+
+    // Sem pré-carga, cada fluxo mantém suas leituras do trecho à frente do envio
+    leitor_t leitor;
+    if (!fluxo->dados && leitor_abrir(&leitor, fluxo->fd, fluxo->offset, fluxo->tamanho) < 0) {
+        return encerrar_fluxo(fluxo, -1);
+    }
+
+    while (enviados < fluxo->tamanho) {
+        uint64_t restante = fluxo->tamanho - enviados;
+        size_t ler = restante < MAX_FRAME ? (size_t)restante : MAX_FRAME;
+        ssize_t lidos;
+        if (fluxo->dados) {
+            memcpy(buffer, fluxo->dados + fluxo->offset + enviados, ler);
+            lidos = (ssize_t)ler;
+        } else {
+            lidos = leitor_ler(&leitor, buffer, ler);
+        }
+        if (lidos <= 0 || fluxo_cancelado(fluxo)) {
+            if (!fluxo->dados) {
+                leitor_fechar(&leitor);
+            }
+            return encerrar_fluxo(fluxo, -1);
+        }
+        digest_atualizar(&fluxo->digest, buffer, (size_t)lidos);
+        if (enviados < retomar_em) {
+            enviados += (uint64_t)lidos;    // Já confirmado pelo cliente: só entra no digest
+            continue;
+        }
+
+        fluxo->protocolo.seq_atual = (fluxo->protocolo.seq_atual + 1) % 32;
+        criar_pacote(&pack, fluxo->protocolo.seq_atual, MSG_DADOS, buffer, (unsigned short)lidos);
+        int tentativas = 0;
+        while (!fluxo_cancelado(fluxo)) {
+            if (tentativas++ > 0) {
+                METRICA_SOMAR(metricas.retransmissoes, 1);
+            }
+            int64_t envio_us = metricas_agora_us();
+            if (enviar_fluxo(fluxo, &pack) < 0) {
+                continue;
+            }
+            // O ACK atrasado de um frame anterior não responde a este: repetir na hora geraria outra
+            // cópia e outro ACK atrasado, em cadeia. Só o NACK ou o prazo vencido repetem o frame
+            int64_t prazo_us = envio_us + (int64_t)retransmissao_prazo_ms(&fluxo->retransmissao) * 1000;
+            int resposta;
+            do {
+                int64_t restante_us = prazo_us - metricas_agora_us();
+                fluxo->protocolo.espera_ms = restante_us > 1000 ? (int)((restante_us + 999) / 1000) : 1;
+                resposta = esperar_ack(&fluxo->protocolo);
+            } while (resposta == -1 && metricas_agora_us() < prazo_us);
+            if (resposta < 0) {
+                if (resposta != -3) {
+                    retransmissao_expirou(&fluxo->retransmissao);     // Só o prazo vencido dobra a espera
+                }
+                continue;
+            }
+            avisar_confirmado(fluxo);
+            // RTT só do frame confirmado na primeira tentativa
+            if (tentativas == 1) {
+                int64_t rtt_us = metricas_agora_us() - envio_us;
+                histograma_registrar(&metricas.rtt_us, (uint64_t)rtt_us);
+                retransmissao_medir(&fluxo->retransmissao, rtt_us);
+            }
+            break;
+        }
+        enviados += (uint64_t)lidos;
+        if (fluxo->progresso && !fluxo_cancelado(fluxo)) {
+            __atomic_store_n(fluxo->progresso, PROGRESSO_FLUXO(enviados, fluxo->protocolo.seq_atual), __ATOMIC_RELEASE);
+        }
+    }
+    if (!fluxo->dados) {
+        leitor_fechar(&leitor);
+    }
+
+    // Fim do trecho: o cliente confirma e segue respondendo a repetições até o arquivo ser verificado
+    struct_frame_fim fim;
+    fim.subtipo = FIM_RESUMO;
+    fim.crc64 = fluxo->digest.crc_arquivo;
+    fim.tamanho_bloco = BLOCO_VERIFICACAO;
+    fim.num_blocos = fluxo->digest.num_blocos;
+
+    fluxo->protocolo.seq_atual = (fluxo->protocolo.seq_atual + 1) % 32;
+    fluxo->protocolo.espera_ms = 0;         // O fim tem MAX_RETRY tentativas: cada uma espera TIMEOUT_S
+    criar_pacote(&pack, fluxo->protocolo.seq_atual, MSG_FIM_ARQUIVO, (uint8_t*)&fim, sizeof(fim));
+    for (int tentativa = 0; tentativa < MAX_RETRY && !fluxo_cancelado(fluxo); tentativa++) {
+        if (enviar_fluxo(fluxo, &pack) == 0 && esperar_ack(&fluxo->protocolo) >= 0) {
+            avisar_confirmado(fluxo);
+            return encerrar_fluxo(fluxo, 0);
+        }
+    }
+
+    // Sem a confirmação do fim o cliente pode não ter o trecho inteiro
+    return encerrar_fluxo(fluxo, -1);
+}
+
+
+// Cliente: recebe o trecho em ordem e entrega ao escritor no offset do fluxo
+static void* thread_recepcao(void* arg) {
+    fluxo_t* fluxo = (fluxo_t*)arg;
+    escritor_t escritor;
+    uint64_t recebidos = 0;
+    int recebeu_fim = 0;
+
+    if (escritor_iniciar_trecho(&escritor, fluxo->fd, fluxo->offset, fluxo->tamanho) < 0) {
+        return encerrar_fluxo(fluxo, -1);
+    }
+
+    // O servidor repete cada frame até o ACK: calado por SILENCIO_SERVIDOR_US, ele desistiu do trecho
+    int64_t prazo_us = metricas_agora_us() + SILENCIO_SERVIDOR_US;
+    while (!fluxo_cancelado(fluxo)) {
+        pack_t pack;
+        if (receber_pacote(&fluxo->protocolo, &pack) < 0) {
+            if (metricas_agora_us() >= prazo_us) {
+                break;
+            }
+            continue;
+        }
+        prazo_us = metricas_agora_us() + SILENCIO_SERVIDOR_US;
+
+        uint8_t seq = getSeq(pack);
+        int isSeq = seqCheck(fluxo->protocolo.seq_atual, seq);
+        if (isSeq == 0) {
+            enviar_ack(&fluxo->protocolo, seq);     // ACK anterior se perdeu
+            continue;
+        }
+        if (isSeq != 1) {
+            continue;
+        }
+
+        if (pack.tipo == MSG_FIM_ARQUIVO) {
+            fluxo->protocolo.seq_atual = seq;
+            enviar_ack(&fluxo->protocolo, seq);
+            recebeu_fim = 1;
+            break;
+        }
+        if (pack.tipo != MSG_DADOS || pack.tamanho > fluxo->tamanho - recebidos) {
+            continue;
+        }
+
+        if (escritor_adicionar(&escritor, pack.dados, pack.tamanho) < 0) {
+            break;      // Falha de gravação: o trecho não tem como ficar completo
+        }
+        digest_atualizar(&fluxo->digest, pack.dados, pack.tamanho);
+        recebidos += pack.tamanho;
+        fluxo->protocolo.seq_atual = seq;
+        enviar_ack(&fluxo->protocolo, seq);
+    }
+
+    int resultado = escritor_fechar(&escritor) == 0 && recebidos == fluxo->tamanho ? 0 : -1;
+    if (!recebeu_fim) {
+        return encerrar_fluxo(fluxo, resultado);
+    }
+
+    // O trecho está gravado, mas o ACK do fim pode ter se perdido e o servidor repetir o fim:
+    // sem resposta ele desistiria do arquivo. Continuar confirmando até o canal principal terminar
+    concluir_trecho(fluxo, resultado);
+    fluxo->protocolo.espera_ms = ESPERA_FIM_FLUXO_MS;
+    while (!fluxo_cancelado(fluxo)) {
+        pack_t pack;
+        if (receber_pacote(&fluxo->protocolo, &pack) == 0 && pack.tipo == MSG_FIM_ARQUIVO &&
+            getSeq(pack) == fluxo->protocolo.seq_atual) {
+            enviar_ack(&fluxo->protocolo, fluxo->protocolo.seq_atual);
+        }
+    }
+    return encerrar_fluxo(fluxo, resultado);
+}
+
+
+static int iniciar_fluxos(multifluxo_t* multi, papel_fluxo_type papel, const char* ip_destino,
+                          unsigned short porta_cliente, unsigned short porta_servidor, int fd,
+                          const uint8_t* dados, uint64_t tamanho, int num_fluxos, uint64_t* progresso,
+                          const saida_fluxos_t* saida) {
+    if (!multi || !ip_destino || num_fluxos < 1 || num_fluxos > NUM_FLUXOS) return -1;
+
+    memset(multi, 0, sizeof(multifluxo_t));
+    multi->papel = papel;
+
+    for (int i = 0; i < num_fluxos; i++) {
+        fluxo_t* fluxo = &multi->fluxos[i];
+        fluxo->indice = i;
+        fluxo->fd = fd;
+        fluxo->dados = dados;
+        fluxo->progresso = progresso ? &progresso[i] : NULL;
+        if (saida) {
+            fluxo->saida = *saida;
+        }
+        multifluxo_trecho(tamanho, num_fluxos, i, &fluxo->offset, &fluxo->tamanho);
+
+        unsigned short porta_fluxo_servidor = PORTA_FLUXO_SERVIDOR(porta_servidor, i);
+        unsigned short porta_origem = papel == FLUXO_ENVIO ? porta_fluxo_servidor : PORTA_FLUXO_CLIENTE(porta_cliente, i);
+        unsigned short porta_destino = papel == FLUXO_ENVIO ? PORTA_FLUXO_CLIENTE(porta_cliente, i) : porta_fluxo_servidor;
+        if (inicializar_protocolo(&fluxo->protocolo, ip_destino, porta_origem, porta_destino, INTERFACE_PADRAO) < 0 ||
+            digest_iniciar(&fluxo->digest, fluxo->tamanho) < 0) {
+            multi->num_fluxos = i;
+            multifluxo_aguardar(multi, NULL);
+            return -1;
+        }
+
+        void* (*rotina)(void*) = papel == FLUXO_ENVIO ? thread_envio : thread_recepcao;
+        if (pthread_create(&fluxo->thread, NULL, rotina, fluxo) != 0) {
+            finalizar_protocolo(&fluxo->protocolo);
+            digest_liberar(&fluxo->digest);
+            multi->num_fluxos = i;
+            multifluxo_aguardar(multi, NULL);
+            return -1;
+        }
+        multi->num_fluxos = i + 1;
+    }
+    return 0;
+}
+
+
+int multifluxo_iniciar(multifluxo_t* multi, papel_fluxo_type papel, const char* ip_destino,
+                       unsigned short porta_cliente, unsigned short porta_servidor, int fd,
+                       const uint8_t* dados, uint64_t tamanho, int num_fluxos) {
+    return iniciar_fluxos(multi, papel, ip_destino, porta_cliente, porta_servidor, fd, dados, tamanho, num_fluxos, NULL,
+                          NULL);
+}
+
+
+int multifluxo_iniciar_envio(multifluxo_t* multi, const char* ip_destino, unsigned short porta_cliente,
+                             unsigned short porta_servidor, int fd, const uint8_t* dados, uint64_t tamanho,
+                             int num_fluxos, uint64_t* progresso, const saida_fluxos_t* saida) {
+    return iniciar_fluxos(multi, FLUXO_ENVIO, ip_destino, porta_cliente, porta_servidor, fd, dados, tamanho,
+                          num_fluxos, progresso, saida);
+}
+
+
+int multifluxo_concluido(multifluxo_t* multi) {
+    if (!multi) return 1;
+
+    for (int i = 0; i < multi->num_fluxos; i++) {
+        if (!__atomic_load_n(&multi->fluxos[i].pronto, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int multifluxo_juntar_digest(multifluxo_t* multi, digest_arquivo_t* digest) {
+    if (!multi || !multifluxo_concluido(multi)) return -1;
+
+    // Trechos em ordem crescente de offset: o CRC do arquivo é combinado em sequência
+    int resultado = 0;
+    for (int i = 0; i < multi->num_fluxos; i++) {
+        fluxo_t* fluxo = &multi->fluxos[i];
+        if (fluxo->resultado < 0) {
+            resultado = -1;
+        }
+        if (digest) {
+            digest_anexar(digest, &fluxo->digest, fluxo->offset);
+        }
+    }
+    return resultado;
+}
+
+
+void multifluxo_cancelar(multifluxo_t* multi) {
+    if (!multi) return;
+
+    for (int i = 0; i < multi->num_fluxos; i++) {
+        __atomic_store_n(&multi->fluxos[i].cancelar, 1, __ATOMIC_RELAXED);
+    }
+}
+
+
+int multifluxo_aguardar(multifluxo_t* multi, digest_arquivo_t* digest) {
+    if (!multi) return -1;
+
+    for (int i = 0; i < multi->num_fluxos; i++) {
+        pthread_join(multi->fluxos[i].thread, NULL);
+    }
+    int resultado = multifluxo_juntar_digest(multi, digest);
+
+    for (int i = 0; i < multi->num_fluxos; i++) {
+        digest_liberar(&multi->fluxos[i].digest);
+        finalizar_protocolo(&multi->fluxos[i].protocolo);
+    }
+    multi->num_fluxos = 0;
+    return resultado;
+}
@@ -0,0 +1,111 @@
+#ifndef MULTIFLUXO_H
+#define MULTIFLUXO_H
+
+#include <pthread.h>
+#include "protocolo.h"
+#include "congestionamento.h"
+
+
+#define NUM_FLUXOS 4                                    // Máximo de fluxos paralelos por arquivo
+#define LIMIAR_MULTIFLUXO (4 * BLOCO_VERIFICACAO)       // Tamanho mínimo para dividir o arquivo
+#define ESPERA_FIM_FLUXO_MS 20                          // Recepção concluída: espera por um fim repetido
+
+#define MAX_TRANSFERENCIAS_MULTIFLUXO 8                  // Arquivos enviados em paralelo ao mesmo tempo pelo servidor
+
+// Cada fluxo usa seu próprio par de portas logo acima das portas principais
+// Do lado do cliente a base é a porta de cada cliente, para vários clientes na mesma máquina;
+// do lado do servidor cada transferência em andamento ocupa uma faixa de NUM_FLUXOS portas
+#define PORTA_FLUXO_CLIENTE(porta, i) ((porta) + 1 + (i))
+#define PORTA_BASE_FLUXOS(faixa) (PORTA_SERVIDOR + 1 + (faixa) * NUM_FLUXOS)
+#define PORTA_FLUXO_SERVIDOR(base, i) ((base) + (i))
+
+// Progresso de um fluxo de envio em 64 bits: bytes confirmados, marca de válido e sequência
+#define PROGRESSO_FLUXO(enviados, seq) (((uint64_t)(enviados) << 8) | 0x80 | ((seq) & 0x1F))
+
+
+typedef enum {
+    FLUXO_ENVIO = 0,                // Servidor: lê o trecho e envia
+    FLUXO_RECEPCAO = 1,             // Cliente: recebe o trecho e grava no offset
+} papel_fluxo_type;
+
+
+//////////// Saída dos fluxos de envio ////////////
+
+// Como os frames de um fluxo de envio saem: o servidor os passa pela thread de transmissão,
+// com o ritmo da sessão; sem enviar (ou se ele recusar o frame) o fluxo envia pelo seu socket
+typedef struct {
+    int (*enviar)(void* contexto, const rawsocket_t* destino, const pack_t* pack);   // 0 se aceito
+    void (*confirmado)(void* contexto);     // ACK recebido em um fluxo, ou NULL
+    void* contexto;
+} saida_fluxos_t;
+
+
+//////////// Estrutura de um fluxo ////////////
+
+// Um trecho contíguo do arquivo transferido com estado de sequência próprio
+typedef struct {
+    int indice;
+    protocolo_type protocolo;       // Par de portas e sequência exclusivos do fluxo
+    uint64_t offset;                // Início do trecho no arquivo
+    uint64_t tamanho;               // Bytes do trecho
+    int fd;                         // Arquivo de origem (servidor) ou destino (cliente)
+    const uint8_t* dados;           // Arquivo já em memória pela pré-carga (servidor) ou NULL
+    digest_arquivo_t digest;        // CRC-64 do trecho
+    int resultado;
+    int pronto;                     // Resultado final: na recepção a thread ainda repete o ACK do fim (acesso atômico)
+    int terminou;                   // Escrito pela thread ao sair (acesso atômico)
+    int cancelar;                   // Pedido para desistir das retransmissões (acesso atômico)
+    uint64_t* progresso;            // Envio: PROGRESSO_FLUXO gravado a cada ACK, ou NULL (acesso atômico)
+    retransmissao_t retransmissao;  // Envio: prazo do ACK pelo RTT do fluxo
+    saida_fluxos_t saida;           // Envio: como os frames saem (tudo NULL: direto pelo socket)
+    pthread_t thread;
+} fluxo_t;
+
+
+typedef struct {
+    fluxo_t fluxos[NUM_FLUXOS];
+    int num_fluxos;
+    papel_fluxo_type papel;
+} multifluxo_t;
+
+
+//////////// Funções de transferência paralela ////////////
+
+// Decide quantos fluxos usar para o arquivo (1 = transferência normal)
+int multifluxo_quantidade(uint64_t tamanho, mensagem_type tipo);
+
+// Calcula o trecho do fluxo indicado, sempre alinhado a BLOCO_VERIFICACAO
+void multifluxo_trecho(uint64_t tamanho, int num_fluxos, int indice, uint64_t* offset, uint64_t* tamanho_trecho);
+
+// Abre os sockets de cada fluxo e inicia uma thread por trecho
+// No envio, dados aponta para o arquivo pré-carregado; com NULL os trechos são lidos de fd
+int multifluxo_iniciar(multifluxo_t* multi, papel_fluxo_type papel, const char* ip_destino,
+                       unsigned short porta_cliente, unsigned short porta_servidor, int fd,
+                       const uint8_t* dados, uint64_t tamanho, int num_fluxos);
+
+// Como multifluxo_iniciar no envio, com um progresso por fluxo (NUM_FLUXOS posições)
+// Um fluxo com progresso válido continua dali, refazendo só o digest do que o cliente já confirmou;
+// zerado, começa do início. saida (copiada, pode ser NULL) leva os frames à transmissão do servidor
+int multifluxo_iniciar_envio(multifluxo_t* multi, const char* ip_destino, unsigned short porta_cliente,
+                             unsigned short porta_servidor, int fd, const uint8_t* dados, uint64_t tamanho,
+                             int num_fluxos, uint64_t* progresso, const saida_fluxos_t* saida);
+
+// Retorna 1 se todos os fluxos já têm o resultado: no envio as threads saíram; na recepção
+// os trechos estão gravados e as threads só confirmam de novo um fim repetido pelo servidor,
+// até multifluxo_cancelar (o ACK do fim pode se perder: o servidor só desiste depois de MAX_RETRY)
+int multifluxo_concluido(multifluxo_t* multi);
+
+// Com os fluxos concluídos, junta os digests dos trechos no digest do arquivo sem esperar as threads
+// Retorna -1 se algum fluxo falhou
+int multifluxo_juntar_digest(multifluxo_t* multi, digest_arquivo_t* digest);
+
+// Faz os fluxos desistirem das retransmissões (e a recepção de esperar um fim repetido);
+// ainda é preciso chamar multifluxo_aguardar
+void multifluxo_cancelar(multifluxo_t* multi);
+
+// Aguarda todos os fluxos e junta os digests dos trechos no digest do arquivo (se não for NULL)
+// Na recepção, chame multifluxo_cancelar antes: as threads esperam por ele depois do fim
+// Retorna -1 se algum fluxo falhou
+int multifluxo_aguardar(multifluxo_t* multi, digest_arquivo_t* digest);
+
+#endif // MULTIFLUXO_H
@@ -0,0 +1,370 @@
+#define _XOPEN_SOURCE 700   // clock_gettime(), sigwait(), pthread_sigmask()
+
+#include "perfil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+
+static const char* nomes_escopos[PERFIL_NUM_ESCOPOS] = {
+    "despachar_frame", "processar_frame", "processar_prazo", "processar_movimento",
+    "enviar_pacote", "receber_pacote", "montar_pacote", "checksum", "cabecalhos", "extrair_dados",
+    "sendmsg", "recvfrom", "crc64", "logica_jogo", "interface", "leitura_disco", "escrita_disco",
+    "instantaneo",
+};
+
+int perfil_ativo = 0;
+
+static struct {
+    perfil_thread_t* threads[PERFIL_THREADS];
+    int num_threads;                        // Posições já reservadas
+    int proxima_thread;
+    pthread_key_t chave;                    // Só pelo destrutor: a árvore fica livre quando a thread termina
+
+    uint64_t contador_inicial;              // Calibração do contador contra o CLOCK_MONOTONIC_RAW
+    int64_t ns_inicial;
+
+    sigset_t sinais;
+    pthread_t thread;
+    int encerrar;
+    pthread_mutex_t trava_relatorio;
+} perfil = { .trava_relatorio = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread perfil_thread_t* perfil_thread;
+static __thread int sem_arvore;             // PERFIL_THREADS esgotado: a thread não é medida
+
+
+static int64_t agora_ns(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &agora);
+    return (int64_t)agora.tv_sec * 1000000000 + agora.tv_nsec;
+}
+
+
+// Ciclos do TSC no x86; nos outros, nanossegundos
+static uint64_t contador(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return (uint64_t)agora_ns();
+#endif
+}
+
+
+static void liberar_arvore(void* arvore) {
+    perfil_thread_t* t = (perfil_thread_t*)arvore;
+    t->atual = 0;
+    __atomic_store_n(&t->livre, 1, __ATOMIC_RELEASE);
+}
+
+
+// Reaproveita a árvore de uma thread que terminou (os números somam) ou reserva uma nova
+static perfil_thread_t* obter_arvore(void) {
+    int reservadas = __atomic_load_n(&perfil.num_threads, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < reservadas && i < PERFIL_THREADS; i++) {
+        perfil_thread_t* t = __atomic_load_n(&perfil.threads[i], __ATOMIC_ACQUIRE);
+        int livre = 1;
+        if (t && __atomic_compare_exchange_n(&t->livre, &livre, 0, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_add_fetch(&t->threads, 1, __ATOMIC_RELAXED);
+            pthread_setspecific(perfil.chave, t);
+            return t;
+        }
+    }
+
+    int posicao = __atomic_fetch_add(&perfil.num_threads, 1, __ATOMIC_ACQ_REL);
+    if (posicao >= PERFIL_THREADS) {
+        return NULL;
+    }
+    perfil_thread_t* t = calloc(1, sizeof(perfil_thread_t));
+    if (!t) {
+        return NULL;
+    }
+    t->numero = __atomic_add_fetch(&perfil.proxima_thread, 1, __ATOMIC_RELAXED);
+    t->threads = 1;
+    t->num_nos = 1;
+    t->nos[0].escopo = -1;
+    t->nos[0].pai = -1;
+    pthread_setspecific(perfil.chave, t);
+    __atomic_store_n(&perfil.threads[posicao], t, __ATOMIC_RELEASE);
+    return t;
+}
+
+
+perfil_marca_t perfil_entrar(perfil_escopo_type escopo) {
+    perfil_marca_t marca = { -1, 0, 0 };
+    perfil_thread_t* t = perfil_thread;
+    if (!t) {
+        if (sem_arvore || !(t = perfil_thread = obter_arvore())) {
+            sem_arvore = 1;
+            return marca;
+        }
+    }
+
+    int pai = t->atual;
+    int no = t->filhos[pai][escopo];
+    if (no == 0) {
+        if (t->num_nos >= PERFIL_NOS) {
+            __atomic_store_n(&t->perdidos, t->perdidos + 1, __ATOMIC_RELAXED);
+            return marca;
+        }
+        // O nó fica completo antes de o relatório poder vê-lo
+        no = t->num_nos;
+        t->nos[no].escopo = (int16_t)escopo;
+        t->nos[no].pai = (int16_t)pai;
+        t->filhos[pai][escopo] = (int16_t)no;
+        __atomic_store_n(&t->num_nos, no + 1, __ATOMIC_RELEASE);
+    }
+
+    t->atual = no;
+    marca.no = no;
+    marca.pai = pai;
+    marca.inicio = contador();
+    return marca;
+}
+
+
+void perfil_sair(const perfil_marca_t* marca) {
+    uint64_t duracao = contador() - marca->inicio;
+    perfil_thread_t* t = perfil_thread;
+    perfil_no_t* no = &t->nos[marca->no];
+    __atomic_store_n(&no->chamadas, no->chamadas + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&no->ciclos, no->ciclos + duracao, __ATOMIC_RELAXED);
+    t->atual = marca->pai;
+}
+
+
+//////////// Relatório ////////////
+
+// Cópia de uma árvore, com o tempo exclusivo (sem os filhos) de cada nó
+typedef struct {
+    int num_nos;
+    perfil_no_t nos[PERFIL_NOS];
+    uint64_t exclusivos[PERFIL_NOS];
+} retrato_t;
+
+
+static void retratar(perfil_thread_t* t, retrato_t* r) {
+    r->num_nos = __atomic_load_n(&t->num_nos, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < r->num_nos; i++) {
+        r->nos[i].escopo = t->nos[i].escopo;
+        r->nos[i].pai = t->nos[i].pai;
+        r->nos[i].chamadas = __atomic_load_n(&t->nos[i].chamadas, __ATOMIC_RELAXED);
+        r->nos[i].ciclos = __atomic_load_n(&t->nos[i].ciclos, __ATOMIC_RELAXED);
+        r->exclusivos[i] = r->nos[i].ciclos;
+    }
+    // Filhos sempre depois do pai: uma passada desconta o tempo de cada filho do pai
+    for (int i = r->num_nos - 1; i > 0; i--) {
+        int pai = r->nos[i].pai;
+        if (pai > 0) {
+            r->exclusivos[pai] = r->exclusivos[pai] > r->nos[i].ciclos ? r->exclusivos[pai] - r->nos[i].ciclos : 0;
+        }
+    }
+}
+
+
+// O escopo já está aberto mais acima no caminho (recursão): o tempo inclusivo dele já foi contado
+static int dentro_de_si(const retrato_t* r, int no) {
+    for (int p = r->nos[no].pai; p > 0; p = r->nos[p].pai) {
+        if (r->nos[p].escopo == r->nos[no].escopo) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Ciclos do contador por nanossegundo, medidos desde perfil_iniciar
+static double ciclos_por_ns(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    int64_t decorrido = agora_ns() - perfil.ns_inicial;
+    if (decorrido < 10000000) {
+        struct timespec pausa = { 0, 10000000L };
+        nanosleep(&pausa, NULL);
+    }
+    uint64_t ciclos = contador() - perfil.contador_inicial;
+    decorrido = agora_ns() - perfil.ns_inicial;
+    return decorrido > 0 ? (double)ciclos / (double)decorrido : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+
+// Filhos em ordem de tempo inclusivo, do maior para o menor
+static void imprimir_arvore(FILE* saida, const retrato_t* r, int no, int nivel, double ns_ciclo) {
+    int filhos[PERFIL_NOS];
+    int quantidade = 0;
+    for (int i = no + 1; i < r->num_nos; i++) {
+        if (r->nos[i].pai != no) continue;
+        int j = quantidade++;
+        while (j > 0 && r->nos[filhos[j - 1]].ciclos < r->nos[i].ciclos) {
+            filhos[j] = filhos[j - 1];
+            j--;
+        }
+        filhos[j] = i;
+    }
+
+    int recuo = nivel * 2 < 22 ? nivel * 2 : 22;
+    for (int k = 0; k < quantidade; k++) {
+        const perfil_no_t* filho = &r->nos[filhos[k]];
+        fprintf(saida, "  %*s%-*s %10llu %12.3f %12.3f %12.0f\n", recuo, "", 24 - recuo,
+                nomes_escopos[filho->escopo], (unsigned long long)filho->chamadas, filho->ciclos * ns_ciclo / 1e6,
+                r->exclusivos[filhos[k]] * ns_ciclo / 1e6,
+                filho->chamadas ? filho->ciclos * ns_ciclo / filho->chamadas : 0.0);
+        imprimir_arvore(saida, r, filhos[k], nivel + 1, ns_ciclo);
+    }
+}
+
+
+void perfil_relatorio(FILE* saida, const char* motivo) {
+    if (!perfil_ativo) return;
+
+    pthread_mutex_lock(&perfil.trava_relatorio);
+    double ns_ciclo = 1.0 / ciclos_por_ns();
+    int reservadas = __atomic_load_n(&perfil.num_threads, __ATOMIC_ACQUIRE);
+    if (reservadas > PERFIL_THREADS) {
+        reservadas = PERFIL_THREADS;
+    }
+
+    retrato_t* retratos = calloc((size_t)(reservadas > 0 ? reservadas : 1), sizeof(retrato_t));
+    if (!retratos) {
+        pthread_mutex_unlock(&perfil.trava_relatorio);
+        return;
+    }
+
+    // Plano: cada escopo somado em todos os caminhos e threads
+    uint64_t chamadas[PERFIL_NUM_ESCOPOS] = { 0 };
+    uint64_t inclusivos[PERFIL_NUM_ESCOPOS] = { 0 };
+    uint64_t exclusivos[PERFIL_NUM_ESCOPOS] = { 0 };
+    uint64_t total_exclusivo = 0;
+    uint64_t perdidos = 0;
+    for (int i = 0; i < reservadas; i++) {
+        perfil_thread_t* t = __atomic_load_n(&perfil.threads[i], __ATOMIC_ACQUIRE);
+        if (!t) continue;
+        retratar(t, &retratos[i]);
+        perdidos += __atomic_load_n(&t->perdidos, __ATOMIC_RELAXED);
+        for (int n = 1; n < retratos[i].num_nos; n++) {
+            int escopo = retratos[i].nos[n].escopo;
+            chamadas[escopo] += retratos[i].nos[n].chamadas;
+            exclusivos[escopo] += retratos[i].exclusivos[n];
+            total_exclusivo += retratos[i].exclusivos[n];
+            if (!dentro_de_si(&retratos[i], n)) {
+                inclusivos[escopo] += retratos[i].nos[n].ciclos;
+            }
+        }
+    }
+
+    fprintf(saida, "\n═══════ PERFIL (%s, %.3f ciclos/ns) ═══════\n", motivo, 1.0 / ns_ciclo);
+    fprintf(saida, "%-26s %10s %12s %12s %12s %7s\n", "escopo", "chamadas", "total ms", "exclusivo ms",
+            "ns/chamada", "% excl");
+    int ordem[PERFIL_NUM_ESCOPOS];
+    for (int e = 0; e < PERFIL_NUM_ESCOPOS; e++) {
+        int j = e;
+        while (j > 0 && exclusivos[ordem[j - 1]] < exclusivos[e]) {
+            ordem[j] = ordem[j - 1];
+            j--;
+        }
+        ordem[j] = e;
+    }
+    for (int k = 0; k < PERFIL_NUM_ESCOPOS; k++) {
+        int e = ordem[k];
+        if (chamadas[e] == 0) continue;
+        fprintf(saida, "%-26s %10llu %12.3f %12.3f %12.0f %6.1f%%\n", nomes_escopos[e],
+                (unsigned long long)chamadas[e], inclusivos[e] * ns_ciclo / 1e6, exclusivos[e] * ns_ciclo / 1e6,
+                inclusivos[e] * ns_ciclo / chamadas[e],
+                total_exclusivo ? 100.0 * exclusivos[e] / total_exclusivo : 0.0);
+    }
+
+    // Hierárquico: a árvore de caminhos de cada thread
+    for (int i = 0; i < reservadas; i++) {
+        perfil_thread_t* t = __atomic_load_n(&perfil.threads[i], __ATOMIC_ACQUIRE);
+        if (!t || retratos[i].num_nos <= 1) continue;
+        fprintf(saida, "\nThread [%d] (%d threads)\n", t->numero, __atomic_load_n(&t->threads, __ATOMIC_RELAXED));
+        fprintf(saida, "  %-24s %10s %12s %12s %12s\n", "escopo", "chamadas", "total ms", "exclusivo ms", "ns/chamada");
+        imprimir_arvore(saida, &retratos[i], 0, 0, ns_ciclo);
+    }
+    if (perdidos > 0) {
+        fprintf(saida, "🟡 %llu entradas sem nó livre na árvore da thread\n", (unsigned long long)perdidos);
+    }
+    fflush(saida);
+
+    free(retratos);
+    pthread_mutex_unlock(&perfil.trava_relatorio);
+}
+
+
+//////////// Sinais ////////////
+
+// Os sinais do perfil estão bloqueados em todas as threads: só esta os recebe, por sigwait,
+// e o relatório pode usar stdio e travas à vontade
+static void* thread_sinais(void* arg) {
+    (void)arg;
+
+    while (1) {
+        int sinal;
+        if (sigwait(&perfil.sinais, &sinal) != 0) {
+            continue;
+        }
+        if (__atomic_load_n(&perfil.encerrar, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        if (sinal == SIGUSR1) {
+            perfil_relatorio(stderr, "SIGUSR1");
+            continue;
+        }
+
+        // SIGINT e SIGTERM: relatório e o término de sempre, pela ação padrão do sinal
+        perfil_relatorio(stderr, sinal == SIGINT ? "SIGINT" : "SIGTERM");
+        sigset_t sinal_recebido;
+        sigemptyset(&sinal_recebido);
+        sigaddset(&sinal_recebido, sinal);
+        signal(sinal, SIG_DFL);
+        pthread_sigmask(SIG_UNBLOCK, &sinal_recebido, NULL);
+        raise(sinal);
+        return NULL;
+    }
+}
+
+
+int perfil_iniciar(void) {
+    const char* variavel = getenv("PERFIL");
+    if (!variavel || !*variavel || strcmp(variavel, "0") == 0) return 0;
+    if (perfil_ativo) return 0;
+
+    if (pthread_key_create(&perfil.chave, liberar_arvore) != 0) {
+        return -1;
+    }
+    perfil.contador_inicial = contador();
+    perfil.ns_inicial = agora_ns();
+
+    // Bloqueados antes das outras threads existirem: elas herdam a máscara
+    sigemptyset(&perfil.sinais);
+    sigaddset(&perfil.sinais, SIGUSR1);
+    sigaddset(&perfil.sinais, SIGINT);
+    sigaddset(&perfil.sinais, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &perfil.sinais, NULL);
+    if (pthread_create(&perfil.thread, NULL, thread_sinais, NULL) != 0) {
+        pthread_sigmask(SIG_UNBLOCK, &perfil.sinais, NULL);
+        pthread_key_delete(perfil.chave);
+        return -1;
+    }
+
+    __atomic_store_n(&perfil_ativo, 1, __ATOMIC_RELEASE);
+    atexit(perfil_finalizar);
+    fprintf(stderr, "🟡 Perfil por escopos ativo: relatório com kill -USR1 %ld e na saída\n", (long)getpid());
+    return 0;
+}
+
+
+void perfil_finalizar(void) {
+    if (!perfil_ativo) return;
+
+    perfil_relatorio(stderr, "saída");
+    __atomic_store_n(&perfil.encerrar, 1, __ATOMIC_RELEASE);
+    pthread_kill(perfil.thread, SIGUSR1);
+    pthread_join(perfil.thread, NULL);
+    __atomic_store_n(&perfil_ativo, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,117 @@
+#ifndef PERFIL_H
+#define PERFIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+
+#define PERFIL_NOS 128                      // Caminhos de escopos distintos por thread; além disso não são medidos
+#define PERFIL_THREADS 64                   // Threads com árvore própria; as demais não são medidas
+
+
+//////////// Escopos medidos ////////////
+
+typedef enum {
+    PERFIL_DESPACHAR_FRAME = 0,             // Servidor: recepção e entrega de um frame à sessão
+    PERFIL_PROCESSAR_FRAME,                 // Servidor: frame tratado pela sessão (trabalhador)
+    PERFIL_PROCESSAR_PRAZO,                 // Servidor: prazo vencido tratado pela sessão
+    PERFIL_PROCESSAR_MOVIMENTO,             // Cliente: tecla até o mapa (e o tesouro) recebidos
+    PERFIL_ENVIAR_PACOTE,
+    PERFIL_RECEBER_PACOTE,                  // Inclui a espera pelo frame no recvfrom
+    PERFIL_MONTAR_PACOTE,                   // criar_pacote
+    PERFIL_CHECKSUM,                        // Checksum do pack
+    PERFIL_CABECALHOS,                      // Ethernet, IP e UDP do raw socket
+    PERFIL_EXTRAIR_DADOS,                   // Conferência dos cabeçalhos recebidos
+    PERFIL_SENDMSG,
+    PERFIL_RECVFROM,
+    PERFIL_CRC64,                           // Digest do arquivo
+    PERFIL_LOGICA_JOGO,                     // move_player e valida_tesouro
+    PERFIL_INTERFACE,                       // Desenho do mapa
+    PERFIL_LEITURA_DISCO,
+    PERFIL_ESCRITA_DISCO,
+    PERFIL_INSTANTANEO,                     // Cópia da sessão no arquivo mapeado
+    PERFIL_NUM_ESCOPOS,
+} perfil_escopo_type;
+
+
+//////////// Perfil por escopos ////////////
+
+// Cada thread guarda uma árvore com os caminhos de escopos em que já entrou (processar_frame >
+// enviar_pacote > sendmsg...), com as chamadas e o tempo de cada caminho em ciclos do TSC
+// (CLOCK_MONOTONIC_RAW fora do x86). Só a thread dona escreve na árvore; o relatório lê com
+// acesso atômico, sem travar ninguém. O tempo é de relógio: um escopo que bloqueia (recvfrom,
+// espera de disco) conta a espera
+typedef struct {
+    uint64_t chamadas;
+    uint64_t ciclos;                        // Inclui os escopos filhos
+    int16_t escopo;                         // -1 na raiz
+    int16_t pai;
+} perfil_no_t;
+
+typedef struct {
+    int numero;                             // Número da primeira thread que usou a árvore
+    int threads;                            // Threads que já usaram (a árvore de uma que terminou é reaproveitada)
+    int livre;
+    int num_nos;
+    int atual;                              // Nó do escopo aberto mais interno
+    uint64_t perdidos;                      // Entradas sem nó livre
+    perfil_no_t nos[PERFIL_NOS];
+    int16_t filhos[PERFIL_NOS][PERFIL_NUM_ESCOPOS];     // 0 = caminho ainda não visto
+} perfil_thread_t;
+
+// Escopo aberto: devolvido por perfil_abrir e fechado no fim do bloco
+typedef struct {
+    int no;                                 // -1 com o perfil desativado
+    int pai;
+    uint64_t inicio;
+} perfil_marca_t;
+
+// Ativo quando a variável PERFIL existe e não é 0; desativado, cada escopo custa um teste
+extern int perfil_ativo;
+
+
+//////////// Funções do perfil ////////////
+
+// Com PERFIL definida: bloqueia SIGUSR1, SIGINT e SIGTERM em todas as threads (chamar antes de
+// criar qualquer uma) e cria a thread que imprime o relatório em stderr a cada SIGUSR1.
+// SIGINT e SIGTERM imprimem o relatório e encerram o processo como antes; a saída normal também imprime
+int perfil_iniciar(void);
+
+// Entra no escopo a partir do escopo aberto da thread
+perfil_marca_t perfil_entrar(perfil_escopo_type escopo);
+
+// Soma a duração do escopo e volta ao escopo pai
+void perfil_sair(const perfil_marca_t* marca);
+
+// Relatório plano (por escopo, todas as threads) e hierárquico (árvore de cada thread)
+void perfil_relatorio(FILE* saida, const char* motivo);
+
+// Imprime o relatório final e encerra a thread de sinais (registrada com atexit)
+void perfil_finalizar(void);
+
+
+static inline perfil_marca_t perfil_abrir(perfil_escopo_type escopo) {
+    perfil_marca_t marca = { -1, 0, 0 };
+    if (perfil_ativo) {
+        marca = perfil_entrar(escopo);
+    }
+    return marca;
+}
+
+static inline void perfil_fechar(perfil_marca_t* marca) {
+    if (marca->no >= 0) {
+        perfil_sair(marca);
+    }
+}
+
+// Mede do ponto da macro até o fim do bloco, por qualquer saída (return, continue, break)
+// Um escopo por bloco; para medir só um trecho, o trecho vai em um bloco próprio
+#if defined(__GNUC__)
+#define PERFIL_ESCOPO(escopo) \
+    perfil_marca_t perfil_marca __attribute__((cleanup(perfil_fechar))) = perfil_abrir(escopo)
+#else
+#define PERFIL_ESCOPO(escopo) ((void)0)
+#endif
+
+#endif // PERFIL_H
@@ -0,0 +1,389 @@
+#define _XOPEN_SOURCE 700   // clock_gettime(), pthread_condattr_setclock()
+
+#include "perturbacao.h"
+
+#include <time.h>
+
+
+// Frame retido até o horário de envio
+typedef struct {
+    int64_t envio_us;
+    uint64_t ordem;                         // Desempate: mesmo horário, ordem de chegada
+    rawsocket_t destino;
+    size_t tamanho;
+    uint8_t dados[PERTURBACAO_FRAME];
+} frame_atrasado_t;
+
+static struct {
+    int ativa;                              // Só muda antes e depois das threads do protocolo
+    perturbacao_config_t config;
+    perturbacao_contadores_t contadores;
+    uint64_t sorteio;                       // Estado do xorshift64*
+
+    pthread_mutex_t trava;                  // Sorteios, contadores e fila
+    pthread_cond_t tem_frame;
+    pthread_t thread;
+    int tem_thread;
+    int encerrar;
+    frame_atrasado_t* fila;                 // Heap pelo horário de envio
+    size_t num_fila;
+    uint64_t ordem;
+    int64_t ultimo_envio_us;                // Horário do último frame enfileirado
+    frame_atrasado_t retido;                // Frame reordenado, à espera do próximo envio
+    int tem_retido;
+} perturbacao;
+
+
+static int64_t agora_us(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (int64_t)agora.tv_sec * 1000000 + agora.tv_nsec / 1000;
+}
+
+
+// xorshift64*: rápido e reproduzível pela semente (chamado com a trava)
+static uint64_t sortear(void) {
+    uint64_t x = perturbacao.sorteio;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    perturbacao.sorteio = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+
+// Fração uniforme em [0, 1)
+static double sortear_fracao(void) {
+    return (double)(sortear() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+static int ocorre(double taxa) {
+    return taxa > 0 && sortear_fracao() < taxa;
+}
+
+
+static void inverter_bit(uint8_t* dados, size_t tamanho) {
+    uint64_t sorteado = sortear();
+    dados[(sorteado >> 3) % tamanho] ^= (uint8_t)(1u << (sorteado & 7));
+}
+
+
+// Atraso sorteado de um frame, em µs
+static int64_t sortear_atraso(void) {
+    int64_t atraso = (int64_t)perturbacao.config.atraso_ms * 1000;
+    if (perturbacao.config.variacao_ms > 0) {
+        int64_t variacao = (int64_t)perturbacao.config.variacao_ms * 1000;
+        atraso += (int64_t)(sortear() % (uint64_t)(2 * variacao + 1)) - variacao;
+    }
+    return atraso > 0 ? atraso : 0;
+}
+
+
+static int antes(const frame_atrasado_t* a, const frame_atrasado_t* b) {
+    return a->envio_us < b->envio_us || (a->envio_us == b->envio_us && a->ordem < b->ordem);
+}
+
+
+static void trocar(frame_atrasado_t* a, frame_atrasado_t* b) {
+    frame_atrasado_t troca = *a;
+    *a = *b;
+    *b = troca;
+}
+
+
+// Chamado com a trava e espaço na fila
+static void enfileirar(const rawsocket_t* rs, const uint8_t* dados, size_t tamanho, int64_t envio_us) {
+    frame_atrasado_t* heap = perturbacao.fila;
+    size_t i = perturbacao.num_fila++;
+    heap[i].envio_us = envio_us;
+    heap[i].ordem = perturbacao.ordem++;
+    heap[i].destino = *rs;
+    heap[i].tamanho = tamanho;
+    memcpy(heap[i].dados, dados, tamanho);
+
+    while (i > 0 && antes(&heap[i], &heap[(i - 1) / 2])) {
+        trocar(&heap[i], &heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    if (i == 0) {
+        pthread_cond_signal(&perturbacao.tem_frame);   // Novo primeiro da fila: a thread acorda mais cedo
+    }
+}
+
+
+static void retirar_primeiro(frame_atrasado_t* frame) {
+    frame_atrasado_t* heap = perturbacao.fila;
+    *frame = heap[0];
+    size_t n = --perturbacao.num_fila;
+    heap[0] = heap[n];
+
+    size_t i = 0;
+    while (1) {
+        size_t menor = i;
+        size_t esquerda = 2 * i + 1;
+        size_t direita = 2 * i + 2;
+        if (esquerda < n && antes(&heap[esquerda], &heap[menor])) menor = esquerda;
+        if (direita < n && antes(&heap[direita], &heap[menor])) menor = direita;
+        if (menor == i) break;
+        trocar(&heap[i], &heap[menor]);
+        i = menor;
+    }
+}
+
+
+// Envia cada frame atrasado no seu horário e o reordenado que passou do prazo
+static void* thread_atrasos(void* arg) {
+    (void)arg;
+    frame_atrasado_t frame;
+
+    pthread_mutex_lock(&perturbacao.trava);
+    while (!perturbacao.encerrar) {
+        if (perturbacao.num_fila == 0 && !perturbacao.tem_retido) {
+            pthread_cond_wait(&perturbacao.tem_frame, &perturbacao.trava);
+            continue;
+        }
+        int do_retido = perturbacao.tem_retido &&
+                        (perturbacao.num_fila == 0 || perturbacao.retido.envio_us < perturbacao.fila[0].envio_us);
+        int64_t envio = do_retido ? perturbacao.retido.envio_us : perturbacao.fila[0].envio_us;
+        if (envio > agora_us()) {
+            struct timespec prazo = { (time_t)(envio / 1000000), (long)(envio % 1000000) * 1000 };
+            pthread_cond_timedwait(&perturbacao.tem_frame, &perturbacao.trava, &prazo);
+            continue;
+        }
+
+        if (do_retido) {
+            frame = perturbacao.retido;
+            perturbacao.tem_retido = 0;
+        } else {
+            retirar_primeiro(&frame);
+        }
+        pthread_mutex_unlock(&perturbacao.trava);
+        envia_rawsocket(&frame.destino, frame.dados, frame.tamanho);
+        pthread_mutex_lock(&perturbacao.trava);
+    }
+    pthread_mutex_unlock(&perturbacao.trava);
+    return NULL;
+}
+
+
+// Lê "nome=valor" separados por vírgula
+static int ler_config(const char* texto, perturbacao_config_t* config) {
+    memset(config, 0, sizeof(perturbacao_config_t));
+    config->semente = 1;
+
+    const char* p = texto;
+    while (*p) {
+        char nome[16];
+        double valor;
+        int lidos;
+        if (sscanf(p, " %15[a-z] = %lf%n", nome, &valor, &lidos) != 2) {
+            return -1;
+        }
+        p += lidos;
+
+        if (strcmp(nome, "perda") == 0) config->perda = valor;
+        else if (strcmp(nome, "reordem") == 0) config->reordem = valor;
+        else if (strcmp(nome, "duplicacao") == 0) config->duplicacao = valor;
+        else if (strcmp(nome, "corrupcao") == 0) config->corrupcao = valor;
+        else if (strcmp(nome, "atraso") == 0) config->atraso_ms = (int)valor;
+        else if (strcmp(nome, "variacao") == 0) config->variacao_ms = (int)valor;
+        else if (strcmp(nome, "entrada") == 0) config->entrada = valor != 0;
+        else if (strcmp(nome, "semente") == 0) config->semente = (uint64_t)valor;
+        else return -1;
+
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+    }
+
+    if (config->perda < 0 || config->perda > 1 || config->reordem < 0 || config->reordem > 1 ||
+        config->duplicacao < 0 || config->duplicacao > 1 || config->corrupcao < 0 || config->corrupcao > 1 ||
+        config->atraso_ms < 0 || config->variacao_ms < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+
+int perturbacao_iniciar(const char* config) {
+    if (!config || !*config) return 0;
+    if (perturbacao.ativa || ler_config(config, &perturbacao.config) < 0) return -1;
+
+    // xorshift não sai do zero
+    perturbacao.sorteio = perturbacao.config.semente ? perturbacao.config.semente : 1;
+    memset(&perturbacao.contadores, 0, sizeof(perturbacao.contadores));
+    pthread_mutex_init(&perturbacao.trava, NULL);
+
+    // Só atraso e reordenação precisam da fila e da thread
+    if (perturbacao.config.atraso_ms > 0 || perturbacao.config.variacao_ms > 0 || perturbacao.config.reordem > 0) {
+        perturbacao.fila = malloc(PERTURBACAO_FILA * sizeof(frame_atrasado_t));
+        if (!perturbacao.fila) {
+            pthread_mutex_destroy(&perturbacao.trava);
+            return -1;
+        }
+
+        // Horários de envio no relógio monotônico, o mesmo da espera
+        pthread_condattr_t atributos;
+        pthread_condattr_init(&atributos);
+        pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+        pthread_cond_init(&perturbacao.tem_frame, &atributos);
+        pthread_condattr_destroy(&atributos);
+
+        perturbacao.encerrar = 0;
+        perturbacao.num_fila = 0;
+        if (pthread_create(&perturbacao.thread, NULL, thread_atrasos, NULL) != 0) {
+            pthread_cond_destroy(&perturbacao.tem_frame);
+            pthread_mutex_destroy(&perturbacao.trava);
+            free(perturbacao.fila);
+            perturbacao.fila = NULL;
+            return -1;
+        }
+        perturbacao.tem_thread = 1;
+    }
+
+    perturbacao.ativa = 1;
+    printf("🟡 Enlace perturbado: perda %.3f, reordem %.3f, duplicação %.3f, corrupção %.4f, "
+           "atraso %d±%d ms%s, semente %llu\n",
+           perturbacao.config.perda, perturbacao.config.reordem, perturbacao.config.duplicacao,
+           perturbacao.config.corrupcao, perturbacao.config.atraso_ms, perturbacao.config.variacao_ms,
+           perturbacao.config.entrada ? " (também na entrada)" : "", (unsigned long long)perturbacao.config.semente);
+    return 0;
+}
+
+
+int perturbacao_envia(rawsocket_t* rs, const void* data, size_t data_len) {
+    // Frame grande demais para a fila vai sem as perturbações
+    if (!perturbacao.ativa || !rs || !data || data_len == 0 || data_len > PERTURBACAO_FRAME) {
+        return envia_rawsocket(rs, data, data_len);
+    }
+
+    // Sorteios e fila com a trava; os envios imediatos ficam para depois dela
+    uint8_t imediatos[2][PERTURBACAO_FRAME];
+    int num_imediatos = 0;
+    frame_atrasado_t liberado;
+    int tem_liberado = 0;
+
+    pthread_mutex_lock(&perturbacao.trava);
+    if (ocorre(perturbacao.config.perda)) {
+        perturbacao.contadores.descartados++;
+        pthread_mutex_unlock(&perturbacao.trava);
+        return (int)(TAMANHO_CABECALHOS + data_len);
+    }
+
+    // O frame reordenado antes sai logo depois deste
+    if (perturbacao.tem_retido) {
+        liberado = perturbacao.retido;
+        perturbacao.tem_retido = 0;
+        tem_liberado = 1;
+    }
+
+    int copias = 1;
+    if (ocorre(perturbacao.config.duplicacao)) {
+        perturbacao.contadores.duplicados++;
+        copias = 2;
+    }
+
+    int original_imediato = 0;
+    int64_t ultimo_envio_us = 0;
+    for (int i = 0; i < copias; i++) {
+        uint8_t frame[PERTURBACAO_FRAME];
+        memcpy(frame, data, data_len);
+        if (ocorre(perturbacao.config.corrupcao)) {
+            perturbacao.contadores.corrompidos++;
+            inverter_bit(frame, data_len);
+        }
+
+        if (perturbacao.fila && !perturbacao.tem_retido && ocorre(perturbacao.config.reordem)) {
+            perturbacao.contadores.reordenados++;
+            perturbacao.retido.envio_us = agora_us() + PRAZO_REORDEM_US;
+            perturbacao.retido.destino = *rs;
+            perturbacao.retido.tamanho = data_len;
+            memcpy(perturbacao.retido.dados, frame, data_len);
+            perturbacao.tem_retido = 1;
+            pthread_cond_signal(&perturbacao.tem_frame);
+            continue;
+        }
+
+        // A fila é um enlace: a variação atrasa o frame, mas ele não passa à frente dos anteriores
+        int64_t atraso = perturbacao.fila ? sortear_atraso() : 0;
+        if ((atraso > 0 || perturbacao.num_fila > 0) && perturbacao.num_fila < PERTURBACAO_FILA) {
+            perturbacao.contadores.atrasados++;
+            ultimo_envio_us = agora_us() + atraso;
+            if (ultimo_envio_us < perturbacao.ultimo_envio_us) {
+                ultimo_envio_us = perturbacao.ultimo_envio_us;
+            }
+            perturbacao.ultimo_envio_us = ultimo_envio_us;
+            enfileirar(rs, frame, data_len, ultimo_envio_us);
+        } else {
+            memcpy(imediatos[num_imediatos++], frame, data_len);
+            original_imediato |= i == 0;
+        }
+    }
+
+    // Se este frame foi atrasado, o liberado vai atrás dele na fila
+    if (tem_liberado && ultimo_envio_us > 0 && perturbacao.num_fila < PERTURBACAO_FILA) {
+        enfileirar(&liberado.destino, liberado.dados, liberado.tamanho, ultimo_envio_us);
+        tem_liberado = 0;
+    }
+    pthread_mutex_unlock(&perturbacao.trava);
+
+    // O resultado do envio é o do original, se ele saiu agora
+    int resultado = (int)(TAMANHO_CABECALHOS + data_len);
+    for (int i = 0; i < num_imediatos; i++) {
+        int enviados = envia_rawsocket(rs, imediatos[i], data_len);
+        if (i == 0 && original_imediato) {
+            resultado = enviados;
+        }
+    }
+    if (tem_liberado) {
+        envia_rawsocket(&liberado.destino, liberado.dados, liberado.tamanho);
+    }
+    return resultado;
+}
+
+
+int perturbacao_recebe(rawsocket_t* rs, void* buffer, size_t buffer_size, unsigned int* ip_origem,
+                       unsigned short* porta_origem) {
+    int recebidos = recebe_rawsocket(rs, buffer, buffer_size, ip_origem, porta_origem);
+    if (!perturbacao.ativa || !perturbacao.config.entrada || recebidos <= 0) {
+        return recebidos;
+    }
+
+    pthread_mutex_lock(&perturbacao.trava);
+    if (ocorre(perturbacao.config.perda)) {
+        perturbacao.contadores.descartados++;
+        recebidos = 0;
+    } else if (ocorre(perturbacao.config.corrupcao)) {
+        perturbacao.contadores.corrompidos++;
+        inverter_bit((uint8_t*)buffer, (size_t)recebidos);
+    }
+    pthread_mutex_unlock(&perturbacao.trava);
+    return recebidos;
+}
+
+
+void perturbacao_finalizar(void) {
+    if (!perturbacao.ativa) return;
+
+    if (perturbacao.tem_thread) {
+        pthread_mutex_lock(&perturbacao.trava);
+        perturbacao.encerrar = 1;
+        pthread_cond_signal(&perturbacao.tem_frame);
+        pthread_mutex_unlock(&perturbacao.trava);
+        pthread_join(perturbacao.thread, NULL);
+        pthread_cond_destroy(&perturbacao.tem_frame);
+        free(perturbacao.fila);
+        perturbacao.fila = NULL;
+        perturbacao.tem_thread = 0;
+    }
+
+    printf("🟡 Perturbação: %llu descartados, %llu reordenados, %llu duplicados, %llu corrompidos, %llu atrasados\n",
+           (unsigned long long)perturbacao.contadores.descartados,
+           (unsigned long long)perturbacao.contadores.reordenados,
+           (unsigned long long)perturbacao.contadores.duplicados,
+           (unsigned long long)perturbacao.contadores.corrompidos,
+           (unsigned long long)perturbacao.contadores.atrasados);
+    pthread_mutex_destroy(&perturbacao.trava);
+    perturbacao.ativa = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef PERTURBACAO_H
+#define PERTURBACAO_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "rawSocket.h"
+
+
+#define PERTURBACAO_FILA 4096               // Frames esperando o atraso; com a fila cheia saem na hora
+#define PERTURBACAO_FRAME 256               // Maior frame que pode ser atrasado (o pack tem até 131 bytes)
+#define PRAZO_REORDEM_US 1000               // Frame reordenado sai sozinho se nenhum outro for enviado antes
+
+
+//////////// Perturbação do enlace ////////////
+
+// Configuração lida da variável PERTURBACAO, por exemplo
+// "perda=0.01,reordem=0.005,duplicacao=0.001,corrupcao=0.001,atraso=20,variacao=5,semente=42"
+// As taxas são probabilidades por frame (0 a 1) e os atrasos, em ms
+// O frame reordenado troca de lugar com o próximo enviado: reter mais tempo faria ACKs antigos
+// voltarem depois de a sequência de 5 bits dar a volta. A variação muda o atraso de cada frame,
+// mas a ordem de saída é mantida, como na fila de um enlace; só reordem troca frames
+typedef struct {
+    double perda;
+    double reordem;
+    double duplicacao;
+    double corrupcao;                       // Um bit invertido em um byte sorteado do frame
+    int atraso_ms;
+    int variacao_ms;                        // Atraso uniforme em [atraso - variacao, atraso + variacao], sem ultrapassar o anterior
+    int entrada;                            // 1: perda e corrupção também nos frames recebidos
+    uint64_t semente;                       // Mesma semente, mesma sequência de sorteios
+} perturbacao_config_t;
+
+// Quantos frames cada perturbação atingiu
+typedef struct {
+    uint64_t descartados;
+    uint64_t reordenados;
+    uint64_t duplicados;
+    uint64_t corrompidos;
+    uint64_t atrasados;
+} perturbacao_contadores_t;
+
+
+//////////// Funções da perturbação ////////////
+
+// Ativa a perturbação com a configuração em texto (NULL ou vazio: desativada, sem custo no envio)
+// Retorna -1 se a configuração for inválida
+int perturbacao_iniciar(const char* config);
+
+// envia_rawsocket com as perturbações de saída; frames descartados ou atrasados
+// contam como enviados (retorna o tamanho com os cabeçalhos)
+int perturbacao_envia(rawsocket_t* rs, const void* data, size_t data_len);
+
+// recebe_rawsocket com perda e corrupção de entrada (frame descartado retorna 0, como um ignorado)
+int perturbacao_recebe(rawsocket_t* rs, void* buffer, size_t buffer_size, unsigned int* ip_origem,
+                       unsigned short* porta_origem);
+
+// Encerra a thread dos atrasos (frames ainda na fila são perdidos) e imprime os contadores
+void perturbacao_finalizar(void);
+
+#endif // PERTURBACAO_H
@@ -0,0 +1,373 @@
+#define _XOPEN_SOURCE 700   // read(), fstat(), ssize_t e clock_gettime()
+
+#include "precarga.h"
+#include "perfil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+
+static int distancia_manhattan(posicao_t a, posicao_t b) {
+    return abs((int)a.x - (int)b.x) + abs((int)a.y - (int)b.y);
+}
+
+
+static int64_t agora_ms(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (int64_t)agora.tv_sec * 1000 + agora.tv_nsec / 1000000;
+}
+
+
+// Bytes que a carga de um arquivo ocupa: os dados e, nos pequenos, os frames prontos
+static uint64_t memoria_arquivo(uint64_t tamanho) {
+    uint64_t memoria = tamanho;
+    if (tamanho <= LIMITE_PRE_QUADROS) {
+        memoria += (tamanho + MAX_FRAME - 1) / MAX_FRAME * sizeof(pack_t);
+    }
+    return memoria;
+}
+
+
+// Libera o conteúdo e devolve a memória dele ao orçamento (com a trava, exceto na carga local da thread)
+static void liberar_conteudo(precarga_t* precarga, precarga_tesouro_t* tesouro) {
+    precarga->em_memoria -= tesouro->memoria;
+    tesouro->memoria = 0;
+    free(tesouro->dados);
+    free(tesouro->quadros);
+    digest_liberar(&tesouro->digest);
+    tesouro->dados = NULL;
+    tesouro->quadros = NULL;
+    tesouro->num_quadros = 0;
+    tesouro->tamanho = 0;
+    tesouro->estado = PRECARGA_VAZIA;
+}
+
+
+// Lê o arquivo inteiro, calcula o digest e monta os frames de dados (fora da trava)
+static int carregar_arquivo(precarga_tesouro_t* carga) {
+    int fd = open(carga->caminho, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    carga->tamanho = (uint64_t)st.st_size;
+
+    carga->dados = malloc(carga->tamanho);
+    if (!carga->dados) {
+        close(fd);
+        return -1;
+    }
+
+    {
+        PERFIL_ESCOPO(PERFIL_LEITURA_DISCO);
+        uint64_t lidos = 0;
+        while (lidos < carga->tamanho) {
+            ssize_t n = read(fd, carga->dados + lidos, carga->tamanho - lidos);
+            if (n <= 0) {
+                close(fd);
+                return -1;
+            }
+            lidos += (uint64_t)n;
+        }
+    }
+    close(fd);
+
+    if (digest_iniciar(&carga->digest, carga->tamanho) < 0) {
+        return -1;
+    }
+    digest_atualizar(&carga->digest, carga->dados, carga->tamanho);
+
+    // Arquivos pequenos já ficam em frames; o envio só troca a sequência
+    if (carga->tamanho <= LIMITE_PRE_QUADROS) {
+        size_t num_quadros = (size_t)((carga->tamanho + MAX_FRAME - 1) / MAX_FRAME);
+        carga->quadros = malloc(num_quadros * sizeof(pack_t));
+        if (carga->quadros) {
+            for (size_t i = 0; i < num_quadros; i++) {
+                uint64_t offset = (uint64_t)i * MAX_FRAME;
+                uint64_t restante = carga->tamanho - offset;
+                unsigned short tamanho = restante < MAX_FRAME ? (unsigned short)restante : MAX_FRAME;
+                criar_pacote(&carga->quadros[i], 0, MSG_DADOS, carga->dados + offset, tamanho);
+            }
+            carga->num_quadros = num_quadros;
+        }
+    }
+    return 0;
+}
+
+
+// Abre espaço no orçamento liberando os tesouros prontos sem transferência, os de interesse
+// mais antigo primeiro, e reserva os bytes da carga do tesouro indicado
+static int reservar_memoria(precarga_t* precarga, int indice, uint64_t bytes) {
+    // Nada sai da memória se nem liberando tudo o que está sem uso a carga coubesse
+    uint64_t liberavel = 0;
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        precarga_tesouro_t* tesouro = &precarga->tesouros[i];
+        if (i != indice && tesouro->estado == PRECARGA_PRONTA && tesouro->usuarios == 0) {
+            liberavel += tesouro->memoria;
+        }
+    }
+    if (precarga->em_memoria - liberavel + bytes > precarga->orcamento) {
+        return -1;
+    }
+
+    while (precarga->em_memoria + bytes > precarga->orcamento) {
+        int escolhido = -1;
+        for (int i = 0; i < MAX_TESOUROS; i++) {
+            precarga_tesouro_t* tesouro = &precarga->tesouros[i];
+            if (i == indice || tesouro->estado != PRECARGA_PRONTA || tesouro->usuarios > 0) {
+                continue;
+            }
+            if (escolhido < 0 || tesouro->interesse_ms < precarga->tesouros[escolhido].interesse_ms) {
+                escolhido = i;
+            }
+        }
+        if (escolhido < 0) {
+            return -1;
+        }
+        liberar_conteudo(precarga, &precarga->tesouros[escolhido]);
+    }
+    precarga->em_memoria += bytes;
+    return 0;
+}
+
+
+// Nenhum jogador por perto há abandono_ms: os pedidos ainda não lidos são esquecidos e
+// os arquivos grandes sem transferência saem da memória (os pequenos ficam até o orçamento pedir)
+static void abandonar_distantes(precarga_t* precarga, int64_t agora) {
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        precarga_tesouro_t* tesouro = &precarga->tesouros[i];
+        if (agora - tesouro->interesse_ms < precarga->abandono_ms) {
+            continue;
+        }
+        if (tesouro->estado == PRECARGA_PENDENTE) {
+            tesouro->estado = PRECARGA_VAZIA;
+        } else if (tesouro->estado == PRECARGA_PRONTA && tesouro->usuarios == 0 &&
+                   tesouro->tamanho > LIMITE_PRE_QUADROS) {
+            liberar_conteudo(precarga, tesouro);
+        }
+    }
+}
+
+
+// Prazo da próxima varredura de abandono, no relógio monotônico da condição
+static struct timespec prazo_varredura(const precarga_t* precarga) {
+    int64_t intervalo_ms = precarga->abandono_ms > 1 ? precarga->abandono_ms / 2 : 1;
+    struct timespec prazo;
+    clock_gettime(CLOCK_MONOTONIC, &prazo);
+    prazo.tv_sec += (time_t)(intervalo_ms / 1000);
+    prazo.tv_nsec += (long)(intervalo_ms % 1000) * 1000000L;
+    if (prazo.tv_nsec >= 1000000000L) {
+        prazo.tv_sec++;
+        prazo.tv_nsec -= 1000000000L;
+    }
+    return prazo;
+}
+
+
+static void registrar_falha(precarga_tesouro_t* tesouro) {
+    tesouro->estado = PRECARGA_FALHOU;
+    tesouro->falha_ms = agora_ms();
+}
+
+
+// Escolhe o pedido pendente mais próximo do jogador
+static int proximo_pendente(precarga_t* precarga) {
+    int escolhido = -1;
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        precarga_tesouro_t* tesouro = &precarga->tesouros[i];
+        if (tesouro->estado != PRECARGA_PENDENTE) {
+            continue;
+        }
+        if (escolhido < 0 || tesouro->distancia < precarga->tesouros[escolhido].distancia) {
+            escolhido = i;
+        }
+    }
+    return escolhido;
+}
+
+
+static void* thread_precarga(void* arg) {
+    precarga_t* precarga = (precarga_t*)arg;
+
+    pthread_mutex_lock(&precarga->trava);
+    while (1) {
+        int indice;
+        while (!precarga->encerrar && (indice = proximo_pendente(precarga)) < 0) {
+            struct timespec prazo = prazo_varredura(precarga);
+            pthread_cond_timedwait(&precarga->tem_pedido, &precarga->trava, &prazo);
+            abandonar_distantes(precarga, agora_ms());
+        }
+        if (precarga->encerrar) {
+            break;
+        }
+
+        precarga_tesouro_t* tesouro = &precarga->tesouros[indice];
+        tesouro->estado = PRECARGA_CARREGANDO;
+
+        precarga_tesouro_t carga;
+        memset(&carga, 0, sizeof(carga));
+        memcpy(carga.caminho, tesouro->caminho, sizeof(carga.caminho));
+
+        // A carga só começa se o arquivo couber no orçamento
+        pthread_mutex_unlock(&precarga->trava);
+        struct stat st;
+        int existe = stat(carga.caminho, &st) == 0 && st.st_size > 0;
+        pthread_mutex_lock(&precarga->trava);
+
+        uint64_t reserva = existe ? memoria_arquivo((uint64_t)st.st_size) : 0;
+        if (!existe || reservar_memoria(precarga, indice, reserva) < 0) {
+            registrar_falha(tesouro);
+            continue;
+        }
+
+        pthread_mutex_unlock(&precarga->trava);
+        int resultado = carregar_arquivo(&carga);
+        pthread_mutex_lock(&precarga->trava);
+
+        precarga->em_memoria -= reserva;
+        if (resultado < 0) {
+            liberar_conteudo(precarga, &carga);
+            registrar_falha(tesouro);
+        } else {
+            tesouro->dados = carga.dados;
+            tesouro->tamanho = carga.tamanho;
+            tesouro->digest = carga.digest;
+            tesouro->quadros = carga.quadros;
+            tesouro->num_quadros = carga.num_quadros;
+            tesouro->memoria = carga.tamanho + carga.num_quadros * sizeof(pack_t);
+            precarga->em_memoria += tesouro->memoria;
+            tesouro->estado = PRECARGA_PRONTA;
+        }
+    }
+    pthread_mutex_unlock(&precarga->trava);
+    return NULL;
+}
+
+
+int precarga_iniciar(precarga_t* precarga, int distancia) {
+    if (!precarga) return -1;
+
+    memset(precarga, 0, sizeof(precarga_t));
+    precarga->distancia = distancia;
+    precarga->orcamento = PRECARGA_ORCAMENTO;
+    precarga->nova_tentativa_ms = PRECARGA_NOVA_TENTATIVA_MS;
+    precarga->abandono_ms = PRECARGA_ABANDONO_MS;
+    pthread_mutex_init(&precarga->trava, NULL);
+
+    // A varredura de abandono espera no relógio monotônico
+    pthread_condattr_t atributos;
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_cond_init(&precarga->tem_pedido, &atributos);
+    pthread_condattr_destroy(&atributos);
+
+    if (pthread_create(&precarga->thread, NULL, thread_precarga, precarga) != 0) {
+        pthread_cond_destroy(&precarga->tem_pedido);
+        pthread_mutex_destroy(&precarga->trava);
+        return -1;
+    }
+    return 0;
+}
+
+
+void precarga_atualizar(precarga_t* precarga, const struct_jogo* jogo) {
+    if (!precarga || !jogo) return;
+
+    int novos = 0;
+    int64_t agora = agora_ms();
+    pthread_mutex_lock(&precarga->trava);
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        const tesouro_t* tesouro = &jogo->tesouros[i];
+        precarga_tesouro_t* entrada = &precarga->tesouros[i];
+        if (tesouro->encontrado) {
+            continue;
+        }
+
+        int distancia = distancia_manhattan(jogo->local_player, tesouro->posicao);
+        if (distancia > precarga->distancia) {
+            continue;
+        }
+
+        // Falha de leitura ou de orçamento: depois de nova_tentativa_ms o pedido volta a valer
+        if (entrada->estado == PRECARGA_FALHOU && agora - entrada->falha_ms >= precarga->nova_tentativa_ms) {
+            entrada->estado = PRECARGA_VAZIA;
+        }
+        if (entrada->estado == PRECARGA_VAZIA) {
+            strncpy(entrada->caminho, tesouro->patch, sizeof(entrada->caminho) - 1);
+            entrada->caminho[sizeof(entrada->caminho) - 1] = '\0';
+            entrada->estado = PRECARGA_PENDENTE;
+            novos++;
+        }
+        entrada->distancia = distancia;
+        entrada->interesse_ms = agora;
+    }
+    if (novos > 0) {
+        pthread_cond_signal(&precarga->tem_pedido);
+    }
+    pthread_mutex_unlock(&precarga->trava);
+}
+
+
+int precarga_obter(precarga_t* precarga, int indice, precarga_tesouro_t** tesouro) {
+    if (!tesouro) return -1;
+    *tesouro = NULL;
+    if (!precarga || indice < 0 || indice >= MAX_TESOUROS) return 0;
+
+    precarga_tesouro_t* entrada = &precarga->tesouros[indice];
+    pthread_mutex_lock(&precarga->trava);
+
+    // Leitura ainda não começou: mais barato ler direto do disco no envio
+    if (entrada->estado == PRECARGA_PENDENTE) {
+        entrada->estado = PRECARGA_VAZIA;
+    }
+    int carregando = entrada->estado == PRECARGA_CARREGANDO;
+    if (entrada->estado == PRECARGA_PRONTA) {
+        entrada->usuarios++;
+        *tesouro = entrada;
+    }
+
+    pthread_mutex_unlock(&precarga->trava);
+    return carregando;
+}
+
+
+void precarga_liberar_tesouro(precarga_t* precarga, int indice) {
+    if (!precarga || indice < 0 || indice >= MAX_TESOUROS) return;
+
+    pthread_mutex_lock(&precarga->trava);
+    precarga_tesouro_t* tesouro = &precarga->tesouros[indice];
+    if (tesouro->estado == PRECARGA_PRONTA && tesouro->usuarios > 0) {
+        tesouro->usuarios--;
+        if (tesouro->usuarios == 0 && tesouro->tamanho > LIMITE_PRE_QUADROS) {
+            liberar_conteudo(precarga, tesouro);
+        }
+    }
+    pthread_mutex_unlock(&precarga->trava);
+}
+
+
+void precarga_finalizar(precarga_t* precarga) {
+    if (!precarga) return;
+
+    pthread_mutex_lock(&precarga->trava);
+    precarga->encerrar = 1;
+    pthread_cond_signal(&precarga->tem_pedido);
+    pthread_mutex_unlock(&precarga->trava);
+    pthread_join(precarga->thread, NULL);
+
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        liberar_conteudo(precarga, &precarga->tesouros[i]);
+    }
+    pthread_cond_destroy(&precarga->tem_pedido);
+    pthread_mutex_destroy(&precarga->trava);
+}
@@ -0,0 +1,84 @@
+#ifndef PRECARGA_H
+#define PRECARGA_H
+
+#include <pthread.h>
+#include "protocolo.h"
+
+
+#define DISTANCIA_PRECARGA 2                    // Distância de Manhattan que dispara a pré-carga
+#define LIMITE_PRE_QUADROS (4 * 1024 * 1024)    // Arquivos até este tamanho já ficam em frames prontos
+                                                // e continuam em memória para as outras sessões
+#define PRECARGA_ORCAMENTO (256ULL * 1024 * 1024)   // Memória de todos os tesouros pré-carregados
+#define PRECARGA_NOVA_TENTATIVA_MS 2000         // Carga que falhou pode ser pedida de novo depois disso
+#define PRECARGA_ABANDONO_MS 10000              // Arquivo grande sem jogador por perto sai da memória
+
+
+typedef enum {
+    PRECARGA_VAZIA = 0,
+    PRECARGA_PENDENTE = 1,          // Jogador se aproximou, aguardando a thread
+    PRECARGA_CARREGANDO = 2,
+    PRECARGA_PRONTA = 3,
+    PRECARGA_FALHOU = 4,            // Leitura falhou ou não coube no orçamento: nova tentativa mais tarde
+} estado_precarga_type;
+
+
+//////////// Estrutura de um tesouro pré-carregado ////////////
+
+typedef struct {
+    estado_precarga_type estado;
+    int distancia;                  // Distância do jogador quando foi pedido
+    int usuarios;                   // Transferências usando o conteúdo agora
+    int64_t interesse_ms;           // Último jogador dentro da distância
+    int64_t falha_ms;               // Quando a última carga falhou
+    uint64_t memoria;               // Bytes do conteúdo contados no orçamento
+    char caminho[256];
+
+    uint8_t* dados;                 // Conteúdo completo do arquivo
+    uint64_t tamanho;
+    digest_arquivo_t digest;        // CRC-64 do arquivo e dos blocos, já calculados
+    pack_t* quadros;                // MSG_DADOS pré-montados com sequência 0
+    size_t num_quadros;
+} precarga_tesouro_t;
+
+
+//////////// Estrutura do estágio de pré-carga ////////////
+
+typedef struct {
+    precarga_tesouro_t tesouros[MAX_TESOUROS];
+    int distancia;
+    uint64_t em_memoria;            // Soma do conteúdo carregado ou reservado para a carga em andamento
+    uint64_t orcamento;             // PRECARGA_ORCAMENTO, ou outro limite definido sob a trava
+    int64_t nova_tentativa_ms;
+    int64_t abandono_ms;
+
+    pthread_t thread;
+    pthread_mutex_t trava;
+    pthread_cond_t tem_pedido;
+    int encerrar;
+} precarga_t;
+
+
+//////////// Funções de pré-carga ////////////
+
+// Inicia a thread de pré-carga com a distância de disparo informada
+int precarga_iniciar(precarga_t* precarga, int distancia);
+
+// Compara a posição do jogador com os tesouros não encontrados e pede a carga dos próximos
+// Todas as partidas usam os mesmos arquivos, então o índice do tesouro identifica o arquivo
+// A thread libera os arquivos grandes sem jogador por perto há abandono_ms e, para caber no
+// orçamento, os carregados sem uso há mais tempo
+void precarga_atualizar(precarga_t* precarga, const struct_jogo* jogo);
+
+// Coloca em *tesouro o tesouro pré-carregado, ou NULL se o envio deve ler do disco
+// Retorna 1 sem bloquear se a carga ainda está em andamento (tentar de novo depois)
+// Cada tesouro obtido deve ser devolvido com precarga_liberar_tesouro
+int precarga_obter(precarga_t* precarga, int indice, precarga_tesouro_t** tesouro);
+
+// Devolve o tesouro depois da transferência; arquivos grandes saem da memória
+// quando nenhuma sessão os usa, os pequenos ficam para os próximos jogadores
+void precarga_liberar_tesouro(precarga_t* precarga, int indice);
+
+// Encerra a thread e libera tudo
+void precarga_finalizar(precarga_t* precarga);
+
+#endif // PRECARGA_H
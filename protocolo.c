@@ -1,4 +1,9 @@
 #include "protocolo.h"
+#include "metricas.h"
+#include "perturbacao.h"
+#include "registro.h"
+#include "sondas.h"
+#include "perfil.h"
 
 uint8_t getSeq(pack_t pack){
     return pack.seq_inicio | (pack.seq_fim << 1);
@@ -16,6 +21,9 @@ void reseta_interface() {
 int reenvio(protocolo_type* estado, pack_t pack){
     if((pack.tipo == MSG_ACK)||(pack.tipo == MSG_NACK)||(pack.tipo == MSG_OK_ACK))
         return 0;
+    METRICA_SOMAR(metricas.retransmissoes, 1);
+    SONDA(reenvio, getSeq(pack), pack.tipo, pack.tamanho,
+          SONDA_SESSAO(estado->rawsock.ip_destino, ntohs(estado->rawsock.porta_destino)));
     return enviar_pacote(estado, &pack);
 }
 
@@ -33,6 +41,7 @@ int seqCheck(uint8_t seqAtual, uint8_t seqPack){
 
 // --- Cálculo de checksum ---
 uint8_t calcular_checksum(const pack_t* p) {
+    PERFIL_ESCOPO(PERFIL_CHECKSUM);
     uint8_t checksum = 0;
     checksum ^= p->tamanho;
     checksum ^= (p->seq_inicio | (p->seq_fim << 1));
@@ -91,6 +100,7 @@ void finalizar_protocolo(protocolo_type* estado) {
 
 int criar_pacote(pack_t* pack, unsigned char seq, mensagem_type tipo,
                uint8_t* dados, unsigned short tamanho) {
+    PERFIL_ESCOPO(PERFIL_MONTAR_PACOTE);
     if (!pack || tamanho > 127 || seq > 31 || tipo > 15) {
         printf("🔴 Erro: valores fora dos limites do cabeçalho\n");
         return -1;
@@ -116,33 +126,72 @@ int criar_pacote(pack_t* pack, unsigned char seq, mensagem_type tipo,
 }
 
 
+// O checksum é um XOR, então basta retirar a sequência antiga e incluir a nova
+void definir_seq_pacote(pack_t* pack, unsigned char seq) {
+    uint8_t anterior = getSeq(*pack);
+    pack->seq_inicio = seq & 0x01;
+    pack->seq_fim = (seq >> 1) & 0x0F;
+    pack->checksum ^= anterior ^ (seq & 0x1F);
+}
+
+
+
+quadro_t* quadro_alocar(slab_t* slab) {
+    quadro_t* quadro = (quadro_t*)slab_alocar(slab);
+    if (quadro) {
+        __atomic_store_n(&quadro->referencias, 1, __ATOMIC_RELAXED);
+    }
+    return quadro;
+}
+
+quadro_t* quadro_reter(quadro_t* quadro) {
+    if (quadro) {
+        __atomic_add_fetch(&quadro->referencias, 1, __ATOMIC_RELAXED);
+    }
+    return quadro;
+}
+
+void quadro_soltar(slab_t* slab, quadro_t* quadro) {
+    if (quadro && __atomic_sub_fetch(&quadro->referencias, 1, __ATOMIC_ACQ_REL) == 0) {
+        slab_devolver(slab, quadro);
+    }
+}
+
 
 int enviar_pacote(protocolo_type* estado, const pack_t* pack) {
-    if (!estado || !pack) return -1;
+    if (!estado) return -1;
+    return enviar_pacote_rawsocket(&estado->rawsock, pack);
+}
+
+int enviar_pacote_rawsocket(rawsocket_t* rawsock, const pack_t* pack) {
+    PERFIL_ESCOPO(PERFIL_ENVIAR_PACOTE);
+    if (!rawsock || !pack) return -1;
 
     int tamanho_total = 4 + pack->tamanho;
 
     
     for (int tentativa = 0; tentativa < MAX_RETRY; tentativa++) {
-        int enviados = envia_rawsocket(&estado->rawsock, pack, tamanho_total);
+        int enviados = perturbacao_envia(rawsock, pack, tamanho_total);
         
 
 
         if (enviados == 42 + tamanho_total) {
            // fprintf(stderr,"Tamanho enviado %d oq achamos que seria enviado %d", enviados, tam );
-
+            metricas_enviado(pack->tipo, (size_t)tamanho_total);
+            SONDA(enviar_pacote, getSeq(*pack), pack->tipo, tamanho_total,
+                  SONDA_SESSAO(rawsock->ip_destino, ntohs(rawsock->porta_destino)));
             return 0;
         }
 
         if (enviados < 0) {
-            fprintf(stderr, "🔴 Erro no envio (tentativa %d/%d)\n", 
-                   tentativa + 1, MAX_RETRY);
+            REG_ERRO("🔴 Erro no envio (tentativa %d/%d)\n", tentativa + 1, MAX_RETRY);
         }
 
         sleep(TIMEOUT_S);
     }
 
-    fprintf(stderr, "🔴 Falha ao enviar após %d tentativas\n", MAX_RETRY);
+    REG_ERRO("🔴 Falha ao enviar após %d tentativas\n", MAX_RETRY);
+    METRICA_SOMAR(metricas.falhas_envio, 1);
     return -4;
 }
 
@@ -155,28 +204,33 @@ const char *uint8_to_bits(uint8_t num) {
     return bits;
 }
 
-int receber_pacote(protocolo_type* estado, pack_t* pack) {
-    if (!estado || !pack) return -1;
-
-    // Configurar timeout no raw socket
-    struct timeval timeout = { .tv_sec = TIMEOUT_S, .tv_usec = 0 };
-    if (setsockopt(estado->rawsock.sockfd, SOL_SOCKET, SO_RCVTIMEO, 
-                   &timeout, sizeof(timeout)) < 0) {
-        perror("🔴 Erro ao configurar timeout");
-        return -1;
+// Recebe e valida um frame, informando o remetente
+static int receber_quadro(protocolo_type* estado, pack_t* pack, unsigned int* ip_remetente,
+                          unsigned short* porta_remetente) {
+    // Configurar timeout no raw socket (só quando muda: evita uma chamada ao kernel por frame)
+    int espera = estado->espera_ms > 0 ? estado->espera_ms : TIMEOUT_S * 1000;
+    if (espera != estado->espera_aplicada_ms) {
+        struct timeval timeout = { .tv_sec = espera / 1000, .tv_usec = (espera % 1000) * 1000 };
+        if (setsockopt(estado->rawsock.sockfd, SOL_SOCKET, SO_RCVTIMEO, 
+                       &timeout, sizeof(timeout)) < 0) {
+            perror("🔴 Erro ao configurar timeout");
+            return -1;
+        }
+        estado->espera_aplicada_ms = espera;
     }
 
     unsigned int ip_origem;
     unsigned short porta_origem;
     
-    int recebidos = recebe_rawsocket(&estado->rawsock, pack, sizeof(pack_t), 
+    int recebidos = perturbacao_recebe(&estado->rawsock, pack, sizeof(pack_t), 
                                      &ip_origem, &porta_origem);
 
     if (recebidos < 0) {
         if (recebidos == -2) {
+            METRICA_SOMAR(metricas.timeouts, 1);
             return -2; // Timeout
         }
-        fprintf(stderr, "Erro no recebimento\n");
+        REG_ERRO("Erro no recebimento\n");
         return -1;
     }
     
@@ -185,14 +239,15 @@ int receber_pacote(protocolo_type* estado, pack_t* pack) {
     }
 
     if (recebidos < 4) {
-        fprintf(stderr, "Pacote muito pequeno recebido: %d bytes\n", recebidos);
+        REG_AVISO("Pacote muito pequeno recebido: %d bytes\n", recebidos);
+        METRICA_SOMAR(metricas.rejeitados_tamanho, 1);
         return -1;
     }
 
     uint8_t tamanho = pack->tamanho;
     if (tamanho > 127 || recebidos != 4 + tamanho) {
-        fprintf(stderr, "Tamanho de pacote inválido: recebido %d, esperado %u\n", 
-               recebidos, 4 + tamanho);
+        REG_AVISO("Tamanho de pacote inválido: recebido %d, esperado %u\n", recebidos, 4 + tamanho);
+        METRICA_SOMAR(metricas.rejeitados_tamanho, 1);
         return -1;
     }
         //fprintf(stderr, "Tamanho de pack válido: recebido %d, esperado %u\n", 
@@ -200,8 +255,9 @@ int receber_pacote(protocolo_type* estado, pack_t* pack) {
 
     uint8_t mark = pack->marcador;
     if (mark != 0x7E) {
-        fprintf(stderr, "Marcador inválido: recebido %s, esperado %s\n", 
-               uint8_to_bits(mark), uint8_to_bits(0x7E));
+        // Em hexadecimal: o texto de uint8_to_bits é estático e não sobrevive até a escrita do registro
+        REG_AVISO("Marcador inválido: recebido 0x%02x, esperado 0x%02x\n", mark, 0x7E);
+        METRICA_SOMAR(metricas.rejeitados_marcador, 1);
         return -1;
     }
 
@@ -209,10 +265,31 @@ int receber_pacote(protocolo_type* estado, pack_t* pack) {
     uint8_t checksum_recebido = pack->checksum;
     uint8_t checksum_calculado = calcular_checksum(pack);
     if (checksum_recebido != checksum_calculado) {
-        fprintf(stderr, "Checksum inválido: esperado %u, recebido %u\n",
-                checksum_calculado, checksum_recebido);
+        REG_AVISO("Checksum inválido: esperado %u, recebido %u\n", checksum_calculado, checksum_recebido);
+        METRICA_SOMAR(metricas.falhas_checksum, 1);
         return -3; // erro de integridade
     }
+    metricas_recebido(pack->tipo, (size_t)recebidos);
+
+    *ip_remetente = ip_origem;
+    *porta_remetente = porta_origem;
+    return 0;
+}
+
+int receber_pacote(protocolo_type* estado, pack_t* pack) {
+    PERFIL_ESCOPO(PERFIL_RECEBER_PACOTE);
+    if (!estado || !pack) return -1;
+
+    unsigned int ip_origem;
+    unsigned short porta_origem;
+    int resultado = receber_quadro(estado, pack, &ip_origem, &porta_origem);
+    if (resultado < 0) {
+        return resultado;
+    }
+
+    SONDA(receber_pacote, getSeq(*pack), pack->tipo, 4 + pack->tamanho, SONDA_SESSAO(ip_origem, porta_origem));
+    estado->ip_remetente = ip_origem;
+    estado->porta_remetente = porta_origem;
 
     // Atualizar informações do remetente (para respostas)
     struct in_addr addr;
@@ -226,51 +303,101 @@ int receber_pacote(protocolo_type* estado, pack_t* pack) {
     return 0;
 }
 
+int vincular_protocolo(protocolo_type* estado, const protocolo_type* escuta, unsigned int ip_destino,
+                       unsigned short porta_destino) {
+    if (!estado || !escuta) return -1;
+
+    memset(estado, 0, sizeof(protocolo_type));
+
+    // Mesmo descritor da escuta; só o destino é próprio
+    estado->rawsock = escuta->rawsock;
+    estado->porta_origem = escuta->porta_origem;
+
+    struct in_addr addr;
+    addr.s_addr = ip_destino;
+    strncpy(estado->ip_destino, inet_ntoa(addr), sizeof(estado->ip_destino) - 1);
+    estado->porta_destino = porta_destino;
+    return destino_rawsocket(&estado->rawsock, estado->ip_destino, porta_destino);
+}
+
 int enviar_ack(protocolo_type* estado, uint8_t seq)  {
-    pack_t pack;
-    criar_pacote(&pack, seq, MSG_ACK, NULL, 0);
-    memcpy(&estado->pack, &pack, sizeof(pack_t));
-    return enviar_pacote(estado, &pack);
+    criar_pacote(&estado->pack, seq, MSG_ACK, NULL, 0);
+    return enviar_pacote(estado, &estado->pack);
+}
+
+int enviar_ack_janela(protocolo_type* estado, uint8_t seq, uint8_t janela, uint64_t recebidos) {
+    struct_frame_janela resposta = { janela, (uint32_t)recebidos };
+    criar_pacote(&estado->pack, seq, MSG_ACK, (uint8_t*)&resposta, sizeof(resposta));
+    return enviar_pacote(estado, &estado->pack);
+}
+
+int enviar_nack_janela(protocolo_type* estado, uint8_t seq, uint8_t janela, uint64_t recebidos) {
+    struct_frame_janela resposta = { janela, (uint32_t)recebidos };
+    criar_pacote(&estado->pack, seq, MSG_NACK, (uint8_t*)&resposta, sizeof(resposta));
+    return enviar_pacote(estado, &estado->pack);
 }
 
 int enviar_nack(protocolo_type* estado, uint8_t seq) {
-    pack_t pack;
-    criar_pacote(&pack, seq, MSG_NACK, NULL, 0);
-    memcpy(&estado->pack, &pack, sizeof(pack_t));
-    return enviar_pacote(estado, &pack);
+    criar_pacote(&estado->pack, seq, MSG_NACK, NULL, 0);
+    return enviar_pacote(estado, &estado->pack);
 }
 
 int enviar_ok_ack (protocolo_type* estado, uint8_t seq) {
-    pack_t pack;
-    criar_pacote(&pack, seq, MSG_OK_ACK, NULL, 0);
-    memcpy(&estado->pack, &pack, sizeof(pack_t));
-    return enviar_pacote(estado, &pack);
+    criar_pacote(&estado->pack, seq, MSG_OK_ACK, NULL, 0);
+    return enviar_pacote(estado, &estado->pack);
 }
 
 int enviar_erro(protocolo_type* estado, uint8_t seq, erro_type erro) {
-    pack_t pack;
     uint8_t dados_erro = (uint8_t)erro;
-    criar_pacote(&pack, seq, MSG_ERRO, &dados_erro, 1);
-    memcpy(&estado->pack, &pack, sizeof(pack_t));
-    return enviar_pacote(estado, &pack);
+    criar_pacote(&estado->pack, seq, MSG_ERRO, &dados_erro, 1);
+    return enviar_pacote(estado, &estado->pack);
 }
 
-int esperar_ack(protocolo_type* estado) {
-    pack_t resposta;
+int criar_erro_ocupado(pack_t* pack, uint8_t seq, uint16_t espera_ms) {
+    struct_frame_ocupado ocupado;
+    ocupado.erro = SERVIDOR_OCUPADO;
+    ocupado.espera_ms = espera_ms;
+    return criar_pacote(pack, seq, MSG_ERRO, (uint8_t*)&ocupado, sizeof(ocupado));
+}
+
+int ler_erro_ocupado(const pack_t* pack, uint16_t* espera_ms) {
+    if (pack->tipo != MSG_ERRO || pack->tamanho < sizeof(struct_frame_ocupado) ||
+        pack->dados[0] != SERVIDOR_OCUPADO) {
+        return 0;
+    }
+    struct_frame_ocupado ocupado;
+    memcpy(&ocupado, pack->dados, sizeof(ocupado));
+    *espera_ms = ocupado.espera_ms;
+    return 1;
+}
+
+// Espera a resposta ao último pacote; o resultado é o de esperar_ack
+static int aguardar_resposta(protocolo_type* estado, pack_t* resposta) {
+    // O raw socket entrega os frames de toda a interface: um frame para outra porta
+    // (fluxos paralelos, outras sessões) não encerra a espera, só o prazo encerra
+    int espera_ms = estado->espera_ms > 0 ? estado->espera_ms : TIMEOUT_S * 1000;
+    int64_t prazo_us = metricas_agora_us() + (int64_t)espera_ms * 1000;
+    uint16_t ocupado_ms;
 
     do{
-        int result = receber_pacote(estado, &resposta);
-        int isSeq = seqCheck(estado->seq_atual, getSeq(resposta));
+        int result = receber_pacote(estado, resposta);
+        if (result == -2 && metricas_agora_us() < prazo_us) {
+            continue;
+        }
+        int isSeq = seqCheck(estado->seq_atual, getSeq(*resposta));
         if (isSeq == 0){
             if (result < 0) {
                 return result;
             }
-            if (resposta.tipo == MSG_OK_ACK){
+            if (resposta->tipo == MSG_OK_ACK){
                 return 1;
-            } else if (resposta.tipo == MSG_ACK) {
+            } else if (resposta->tipo == MSG_ACK) {
                 return 0;
-            } else if (resposta.tipo == MSG_NACK) {
+            } else if (resposta->tipo == MSG_NACK) {
                 return -3; 
+            } else if (ler_erro_ocupado(resposta, &ocupado_ms)) {
+                estado->espera_ocupado_ms = ocupado_ms;
+                return -5;
             }
         }
         else 
@@ -279,6 +406,31 @@ int esperar_ack(protocolo_type* estado) {
      // Resposta inesperada
 }
 
+int esperar_ack(protocolo_type* estado) {
+    pack_t resposta;
+    memset(&resposta, 0, sizeof(resposta));
+    int resultado = aguardar_resposta(estado, &resposta);
+    SONDA(esperar_ack, getSeq(resposta), resposta.tipo, resultado,
+          SONDA_SESSAO(estado->rawsock.ip_destino, ntohs(estado->rawsock.porta_destino)));
+    return resultado;
+}
+
+// Semente dos sorteios: cada partida avança um passo, então sessões criadas no mesmo segundo
+// recebem mapas diferentes sem compartilhar o estado do rand() entre as threads
+static uint64_t semente_jogos;
+
+void semear_jogos(uint64_t semente) {
+    __atomic_store_n(&semente_jogos, semente, __ATOMIC_RELAXED);
+}
+
+// splitmix64: cada chamada embaralha o próximo passo da sequência da partida
+static uint32_t sortear_jogo(uint64_t* estado) {
+    uint64_t z = (*estado += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
 void setup_jogo(struct_jogo* jogo) {
 
     if (!jogo) return;
@@ -291,19 +443,17 @@ void setup_jogo(struct_jogo* jogo) {
     jogo->local_player.y = 0;
     jogo->local_explorado[0][0] = 1;
     
-    // Seed para random
-    srand(time(NULL));
+    // Sequência própria desta partida
+    uint64_t estado = __atomic_add_fetch(&semente_jogos, 0xD1B54A32D192ED03ULL, __ATOMIC_RELAXED);
     
     // Sortear posições dos tesouros
-    printf("Sorteando tesouros...\n");
-    
     for (int i = 0; i < MAX_TESOUROS; i++) {
         int x, y;
         int posicao_ocupada;
         
         do {
-            x = rand() % TAMANHO_MAPA;
-            y = rand() % TAMANHO_MAPA;
+            x = (int)(sortear_jogo(&estado) % TAMANHO_MAPA);
+            y = (int)(sortear_jogo(&estado) % TAMANHO_MAPA);
             
             // Verificar se posição já está ocupada
             posicao_ocupada = 0;
@@ -357,13 +507,13 @@ void setup_jogo(struct_jogo* jogo) {
         uint64_t tamanho_arquivo;
         memcpy(&tamanho_arquivo, jogo->tesouros[i].tamanho, sizeof(uint64_t));
         
-        printf("Tesouro %d: %s na posição (%d,%d) - %llu bytes\n",
-               i + 1, jogo->tesouros[i].nome_tesouro, x, y, 
-               (unsigned long long)tamanho_arquivo);
+        REG_INFO("Tesouro %s na posição (%d,%d) - %llu bytes\n",
+                 jogo->tesouros[i].nome_tesouro, x, y, (unsigned long long)tamanho_arquivo);
     }
 }
 
 int move_player(struct_jogo* jogo, mensagem_type direcao) {
+    PERFIL_ESCOPO(PERFIL_LOGICA_JOGO);
     if (!jogo) return -1;
     
     posicao_t nova_posicao = jogo->local_player;
@@ -388,17 +538,20 @@ int move_player(struct_jogo* jogo, mensagem_type direcao) {
     // Verificar limites do grid
     if (nova_posicao.x < 0 || nova_posicao.x >= TAMANHO_MAPA ||
         nova_posicao.y < 0 || nova_posicao.y >= TAMANHO_MAPA) {
+        SONDA(move_player, nova_posicao.x, nova_posicao.y, direcao, -1);
         return -1; // Movimento inválido
     }
     
     // Atualizar posição
     jogo->local_player = nova_posicao;
     jogo->local_explorado[nova_posicao.x][nova_posicao.y] = 1;
+    SONDA(move_player, nova_posicao.x, nova_posicao.y, direcao, 0);
     
     return 0; // Movimento válido
 }
 
 int valida_tesouro(struct_jogo* jogo, posicao_t posicao) {
+    PERFIL_ESCOPO(PERFIL_LOGICA_JOGO);
     if (!jogo) return -1;
     
     for (int i = 0; i < MAX_TESOUROS; i++) {
@@ -408,14 +561,17 @@ int valida_tesouro(struct_jogo* jogo, posicao_t posicao) {
             
             jogo->tesouros[i].encontrado = 1;
             jogo->tesouros_achados++;
+            SONDA(valida_tesouro, posicao.x, posicao.y, i, jogo->tesouros_achados);
             return i; // Índice do tesouro encontrado
         }
     }
     
+    SONDA(valida_tesouro, posicao.x, posicao.y, -1, jogo->tesouros_achados);
     return -1; // Nenhum tesouro encontrado
 }
 
 void interface_servidor(struct_jogo* jogo) {
+    PERFIL_ESCOPO(PERFIL_INTERFACE);
     if (!jogo) return;
     reseta_interface();  
     printf("\n=== MAPA DO SERVIDOR ===\n");
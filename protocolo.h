@@ -19,12 +19,15 @@
 #include <sys/time.h>    // Para struct timeval
 #include <strings.h>     // Para strcasecmp()
 #include "rawSocket.h"   // Incluir o raw socket
+#include "integridade.h" // CRC-64 do arquivo
+#include "memoria.h"     // Slab dos frames
 
 
 
 #define MAX_FRAME 127               // ok
 #define MAX_RETRY 3                 // ok
 #define TIMEOUT_S 1                 // ok
+#define SILENCIO_SERVIDOR_US ((int64_t)MAX_RETRY * TIMEOUT_S * 1000000)  // O servidor repete antes disso
 #define MAX_ESPACO 1048576          // ok (não usa)
 #define MAX_NOME 63                 // ok (não usa)
 #define PORTA_CLIENTE 23623        // ok
@@ -66,6 +69,7 @@ typedef enum {
 typedef enum {
     SEM_PERMISSAO = 0,              
     ESPACO_INSUFICIENTE = 1,        
+    SERVIDOR_OCUPADO = 2,           // Comando recusado por sobrecarga: repetir depois da espera indicada
 } erro_type;
 
 
@@ -91,6 +95,16 @@ typedef struct {
 } pack_t;
 #pragma pack(pop)
 
+
+//////////// Frame do slab ////////////
+
+// Pacote em um buffer do slab, compartilhado por contagem de referências:
+// a sessão guarda o pendente e quem ainda vai transmiti-lo guarda outra
+typedef struct {
+    pack_t pack;
+    int referencias;                // Acesso atômico
+} quadro_t;
+
  
 //////////// Tipos de tesouro ////////////
 
@@ -137,6 +151,13 @@ typedef struct {
     unsigned short porta_destino;    // Porta de destino
     unsigned short porta_origem;     // Porta de origem
 
+    unsigned int ip_remetente;       // Origem do último frame recebido (ordem de rede)
+    unsigned short porta_remetente;
+
+    int espera_ms;                   // Espera máxima do receber_pacote (0 = TIMEOUT_S)
+    int espera_aplicada_ms;          // SO_RCVTIMEO já configurado no socket (0 = nenhum)
+    int espera_ocupado_ms;           // Espera pedida pelo último SERVIDOR_OCUPADO recebido
+
     pack_t pack;
 } protocolo_type;                
 
@@ -165,6 +186,64 @@ typedef struct{
 #pragma pack(pop)
 
 
+//////////// Frames de fim de arquivo ////////////
+
+// Subtipos carregados no primeiro byte de MSG_FIM_ARQUIVO
+typedef enum {
+    FIM_RESUMO = 0,                 // servidor -> cliente: CRC-64 do arquivo inteiro
+    FIM_TABELA = 1,                 // servidor -> cliente: CRC-64 de cada bloco (após NACK do resumo)
+    FIM_PEDIDO = 2,                 // cliente -> servidor: reenviar intervalo (tamanho 0 encerra)
+} fim_type;
+
+#define CRC_POR_FRAME 15            // CRCs de bloco que cabem em um frame de tabela
+
+#pragma pack(push, 1)
+typedef struct {
+    uint8_t subtipo;
+    uint64_t crc64;                 // CRC-64/XZ do arquivo
+    uint32_t tamanho_bloco;         // BLOCO_VERIFICACAO
+    uint32_t num_blocos;
+} struct_frame_fim;
+
+typedef struct {
+    uint8_t subtipo;
+    uint32_t primeiro_bloco;
+    uint8_t quantidade;
+    uint64_t crc64[CRC_POR_FRAME];
+} struct_frame_tabela;
+
+typedef struct {
+    uint8_t subtipo;
+    uint64_t offset;
+    uint32_t tamanho;
+} struct_frame_pedido;
+#pragma pack(pop)
+
+
+//////////// Frame de resposta da janela ////////////
+
+// Dados do ACK e do NACK durante a janela de dados: a contagem de bytes identifica o frame
+// respondido mesmo depois que a sequência de 5 bits dá a volta
+#pragma pack(push, 1)
+typedef struct {
+    uint8_t janela;                 // Frames que o receptor aceita em seguida
+    uint32_t recebidos;             // Bytes recebidos em ordem (32 bits baixos)
+} struct_frame_janela;
+#pragma pack(pop)
+
+
+//////////// Frame de servidor ocupado ////////////
+
+// Dados do MSG_ERRO com SERVIDOR_OCUPADO: o comando não foi processado
+// e pode ser repetido com a mesma sequência depois de espera_ms
+#pragma pack(push, 1)
+typedef struct {
+    uint8_t erro;                   // SERVIDOR_OCUPADO
+    uint16_t espera_ms;
+} struct_frame_ocupado;
+#pragma pack(pop)
+
+
 
 // Estrutura para informações do mapa do cliente
 typedef struct {
@@ -208,15 +287,45 @@ int inicializar_protocolo(protocolo_type* estado, const char* ip_destino, unsign
 // Funções para gerenciamento do protocolo, conectando a porta do cliente e do servidor
 int criar_pacote(pack_t* pack, unsigned char seq, mensagem_type tipo, uint8_t* dados, unsigned short tamanho);
 
+// Checksum do pack: XOR do tamanho, sequência, tipo e dados
+uint8_t calcular_checksum(const pack_t* p);
+
+// Troca a sequência de um pacote já montado, ajustando o checksum sem recalcular os dados
+void definir_seq_pacote(pack_t* pack, unsigned char seq);
+
+// Retira um frame do slab com uma referência (NULL se esgotado)
+quadro_t* quadro_alocar(slab_t* slab);
+
+// Mais uma referência ao frame
+quadro_t* quadro_reter(quadro_t* quadro);
+
+// Solta uma referência; o frame volta ao slab com a última
+void quadro_soltar(slab_t* slab, quadro_t* quadro);
+
 // Funcao para enviar um pacote
 int enviar_pacote(protocolo_type* estado, const pack_t* pack); 
 
+// Envia um pacote pelo raw socket já apontado para o destino (thread de transmissão)
+int enviar_pacote_rawsocket(rawsocket_t* rawsock, const pack_t* pack);
+
 // Funcao que recebe um pacote
-int receber_pacote(protocolo_type* estado, pack_t* pack);               
+// O remetente fica em ip_remetente/porta_remetente e passa a ser o destino
+int receber_pacote(protocolo_type* estado, pack_t* pack);
+
+// Vincula o estado a um cliente usando o socket já aberto de outro estado (sessão do servidor)
+int vincular_protocolo(protocolo_type* estado, const protocolo_type* escuta, unsigned int ip_destino,
+                       unsigned short porta_destino);               
 
 // Funcao que envia ack
 int enviar_ack(protocolo_type* estado, uint8_t seq);
 
+// ACK que anuncia quantos frames de dados o receptor aceita em seguida (janela)
+// e quantos bytes já recebeu em ordem
+int enviar_ack_janela(protocolo_type* estado, uint8_t seq, uint8_t janela, uint64_t recebidos);
+
+// NACK de um frame da janela, com a mesma contagem de bytes do ACK
+int enviar_nack_janela(protocolo_type* estado, uint8_t seq, uint8_t janela, uint64_t recebidos);
+
 // Funcao que envia nack
 int enviar_nack(protocolo_type* estado, uint8_t seq); 
 
@@ -226,7 +335,15 @@ int enviar_ok_ack(protocolo_type* estado, uint8_t seq);
 // Funcao que envia erro
 int enviar_erro(protocolo_type* estado, uint8_t seq, erro_type erro);
 
+// Monta o MSG_ERRO de servidor ocupado com a espera sugerida ao cliente
+int criar_erro_ocupado(pack_t* pack, uint8_t seq, uint16_t espera_ms);
+
+// Confere se o pacote é o MSG_ERRO de servidor ocupado, lendo a espera sugerida
+// Retorna 1 se for, 0 caso contrário
+int ler_erro_ocupado(const pack_t* pack, uint16_t* espera_ms);
+
 // Funcao que espera o recebimento de um ack
+// Retorna -5 com o servidor ocupado (a espera pedida fica em espera_ocupado_ms)
 int esperar_ack(protocolo_type* estado);                                
 
 // Finaliza o protocolo fechando o raw socket
@@ -234,6 +351,9 @@ void finalizar_protocolo(protocolo_type* estado);
 
 //////////// Funções do jogo ////////////
 
+// Define a semente dos sorteios de setup_jogo (uma vez, no início do servidor)
+void semear_jogos(uint64_t semente);
+
 // Comeca o jogo definindo posicoes 0 para o jogador e sorteia os tesouros, alem de colocar cada tipo no tesouro
 void setup_jogo(struct_jogo* jogo);                                     
 
@@ -1,4 +1,6 @@
 #include "rawSocket.h"
+#include "captura.h"
+#include "perfil.h"
 
 
 // Define o destino
@@ -58,32 +60,21 @@ int inicia_rawsocket(rawsocket_t* rs, const char* interface) {
 }
 
 
-// Envia dados usando raw socket
-int envia_rawsocket(rawsocket_t* rs, const void* data, size_t data_len) {
-    if (!rs || !data || data_len == 0) return -1;
-    // Buffer para o pacote completo
-    unsigned char packet[MAXIMO_PACOTE];
-    memset(packet, 0, sizeof(packet));
-    
-    // Calcular tamanhos
+// Monta os cabeçalhos Ethernet, IP e UDP de um frame com data_len bytes de dados
+void montar_cabecalhos_rawsocket(const rawsocket_t* rs, unsigned char* cabecalhos, size_t data_len) {
+    PERFIL_ESCOPO(PERFIL_CABECALHOS);
     size_t eth_header_size = sizeof(struct cabecalho_ethernet);
     size_t cabecalho_ip_size = sizeof(struct cabecalho_ip);
     size_t udp_header_size = sizeof(struct udp_header);
-    size_t total_size = eth_header_size + cabecalho_ip_size + udp_header_size + data_len;
-    
-    if (total_size > MAXIMO_PACOTE) {
-        fprintf(stderr, "Pacote muito grande: %zu bytes\n", total_size);
-        return -1;
-    }
-    
+
     // Cabeçalho Ethernet
-    struct cabecalho_ethernet* eth_hdr = (struct cabecalho_ethernet*)packet;
+    struct cabecalho_ethernet* eth_hdr = (struct cabecalho_ethernet*)cabecalhos;
     memcpy(eth_hdr->mac_destino, rs->mac_destino, 6);
     memcpy(eth_hdr->mac_origem, rs->mac_origem, 6);
     eth_hdr->eth_hdr = htons(0x0800); // IP
     
     // Cabeçalho IP
-    struct cabecalho_ip* ip_hdr = (struct cabecalho_ip*)(packet + eth_header_size);
+    struct cabecalho_ip* ip_hdr = (struct cabecalho_ip*)(cabecalhos + eth_header_size);
     ip_hdr->versao_ihl = 0x45; // Versão 4, IHL 5 (20 bytes)
     ip_hdr->servico = 0;
     ip_hdr->comprimento = htons(cabecalho_ip_size + udp_header_size + data_len);
@@ -99,24 +90,57 @@ int envia_rawsocket(rawsocket_t* rs, const void* data, size_t data_len) {
     ip_hdr->checksum = calcula_checksum((unsigned short*)ip_hdr, cabecalho_ip_size);
     
     // Cabeçalho UDP
-    struct udp_header* udp_hdr = (struct udp_header*)(packet + eth_header_size + cabecalho_ip_size);
+    struct udp_header* udp_hdr = (struct udp_header*)(cabecalhos + eth_header_size + cabecalho_ip_size);
     udp_hdr->porta_origem = rs->porta_origem;
     udp_hdr->porta_destino = rs->porta_destino;
     udp_hdr->comprimento = htons(udp_header_size + data_len);
     udp_hdr->checksum = 0;
+}
+
+
+// Envia dados usando raw socket
+int envia_rawsocket(rawsocket_t* rs, const void* data, size_t data_len) {
+    if (!rs || !data || data_len == 0) return -1;
+    // Só os cabeçalhos são montados aqui; os dados seguem do buffer de quem chamou
+    unsigned char cabecalhos[TAMANHO_CABECALHOS];
     
-    // Copiar dados
-    memcpy(packet + eth_header_size + cabecalho_ip_size + udp_header_size, data, data_len);
+    size_t total_size = sizeof(cabecalhos) + data_len;
+    
+    if (total_size > MAXIMO_PACOTE) {
+        fprintf(stderr, "Pacote muito grande: %zu bytes\n", total_size);
+        return -1;
+    }
     
-    // Enviar pacote
-    ssize_t sent = sendto(rs->sockfd, packet, total_size, 0,
-                         (struct sockaddr*)&rs->socket_address,
-                         sizeof(rs->socket_address));
+    montar_cabecalhos_rawsocket(rs, cabecalhos, data_len);
+    
+    // Enviar cabeçalhos e dados juntos, sem copiar os dados para um buffer intermediário
+    struct iovec partes[2];
+    partes[0].iov_base = cabecalhos;
+    partes[0].iov_len = sizeof(cabecalhos);
+    partes[1].iov_base = (void*)data;
+    partes[1].iov_len = data_len;
+
+    struct msghdr mensagem;
+    memset(&mensagem, 0, sizeof(mensagem));
+    mensagem.msg_name = &rs->socket_address;
+    mensagem.msg_namelen = sizeof(rs->socket_address);
+    mensagem.msg_iov = partes;
+    mensagem.msg_iovlen = 2;
+
+    ssize_t sent;
+    {
+        PERFIL_ESCOPO(PERFIL_SENDMSG);
+        sent = sendmsg(rs->sockfd, &mensagem, 0);
+    }
     
     if (sent < 0) {
         perror("Erro ao enviar pacote");
         return -1;
     }
+
+    if (captura_ativa) {
+        captura_registrar(cabecalhos, sizeof(cabecalhos), data, data_len);
+    }
     
     return sent;
 }
@@ -136,8 +160,11 @@ int recebe_rawsocket(rawsocket_t* rs, void* buffer, size_t buffer_size,
     struct sockaddr_ll addr;
     socklen_t addr_len = sizeof(addr);
     
-    ssize_t received = recvfrom(rs->sockfd, packet, sizeof(packet), 0,
-                               (struct sockaddr*)&addr, &addr_len);
+    ssize_t received;
+    {
+        PERFIL_ESCOPO(PERFIL_RECVFROM);
+        received = recvfrom(rs->sockfd, packet, sizeof(packet), 0, (struct sockaddr*)&addr, &addr_len);
+    }
     
     if (received < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -147,14 +174,33 @@ int recebe_rawsocket(rawsocket_t* rs, void* buffer, size_t buffer_size,
         return -1;
     }
     
+    int dados = extrair_dados_rawsocket(rs, packet, received, buffer, buffer_size, ip_origem, porta_origem);
+
+    // Só os frames do protocolo (os endereçados a esta porta) vão para a captura
+    if (captura_ativa && dados > 0) {
+        captura_registrar(packet, (size_t)received, NULL, 0);
+    }
+    return dados;
+}
+
+
+// Confere os cabeçalhos de um frame recebido e copia os dados para buffer
+int extrair_dados_rawsocket(const rawsocket_t* rs, const unsigned char* packet, size_t received,
+                            void* buffer, size_t buffer_size,
+                            unsigned int* ip_origem, unsigned short* porta_origem) {
+    PERFIL_ESCOPO(PERFIL_EXTRAIR_DADOS);
+    if (received < TAMANHO_CABECALHOS) {
+        return 0; // Curto demais para os cabeçalhos, ignorar
+    }
+
     // Verificar se é um pacote IP
-    struct cabecalho_ethernet* eth_hdr = (struct cabecalho_ethernet*)packet;
+    const struct cabecalho_ethernet* eth_hdr = (const struct cabecalho_ethernet*)packet;
     if (ntohs(eth_hdr->eth_hdr) != 0x0800) {
         return 0; // Não é IP, ignorar
     }
     
     // Verificar cabeçalho IP
-    struct cabecalho_ip* ip_hdr = (struct cabecalho_ip*)(packet + sizeof(struct cabecalho_ethernet));
+    const struct cabecalho_ip* ip_hdr = (const struct cabecalho_ip*)(packet + sizeof(struct cabecalho_ethernet));
     if (ip_hdr->protocol != 17) {
         return 0; // Não é UDP, ignorar
     }
@@ -165,7 +211,7 @@ int recebe_rawsocket(rawsocket_t* rs, void* buffer, size_t buffer_size,
     }
     
     // Cabeçalho UDP
-    struct udp_header* udp_hdr = (struct udp_header*)(packet + sizeof(struct cabecalho_ethernet) + sizeof(struct cabecalho_ip));
+    const struct udp_header* udp_hdr = (const struct udp_header*)(packet + sizeof(struct cabecalho_ethernet) + sizeof(struct cabecalho_ip));
     
     // Verificar porta
     if (udp_hdr->porta_destino != rs->porta_origem) {
@@ -175,6 +221,9 @@ int recebe_rawsocket(rawsocket_t* rs, void* buffer, size_t buffer_size,
     // Extrair dados
     size_t header_size = sizeof(struct cabecalho_ethernet) + sizeof(struct cabecalho_ip) + sizeof(struct udp_header);
     size_t data_size = ntohs(udp_hdr->comprimento) - sizeof(struct udp_header);
+    if (ntohs(udp_hdr->comprimento) < sizeof(struct udp_header) || data_size > received - header_size) {
+        return 0; // Comprimento UDP maior que o frame, ignorar
+    }
     
     if (data_size > buffer_size) {
         fprintf(stderr, "Buffer muito pequeno para os dados recebidos\n");
@@ -199,6 +248,21 @@ void fecha_rawsocket(rawsocket_t* rs) {
 }
 
 
+// Contadores do kernel desde a última leitura (PACKET_STATISTICS zera a cada chamada)
+int estatisticas_rawsocket(rawsocket_t* rs, unsigned int* pacotes, unsigned int* descartes) {
+    if (!rs || rs->sockfd < 0) return -1;
+
+    struct tpacket_stats estatisticas;
+    socklen_t tamanho = sizeof(estatisticas);
+    if (getsockopt(rs->sockfd, SOL_PACKET, PACKET_STATISTICS, &estatisticas, &tamanho) < 0) {
+        return -1;
+    }
+    *pacotes = estatisticas.tp_packets;
+    *descartes = estatisticas.tp_drops;
+    return 0;
+}
+
+
 int dados_interface(const char* interface, unsigned char* mac, unsigned int* ip) {
     if (!interface || !mac || !ip) return -1;
 
@@ -84,10 +84,21 @@ struct udp_header {
 };
 
 
+// Ethernet, IP e UDP antes dos dados de cada frame
+#define TAMANHO_CABECALHOS (sizeof(struct cabecalho_ethernet) + sizeof(struct cabecalho_ip) + sizeof(struct udp_header))
+
+
 //////////// Funções de rawsocket ////////////
 int envia_rawsocket(rawsocket_t* rs, const void* data, size_t data_len);
 int recebe_rawsocket(rawsocket_t* rs, void* buffer, size_t buffer_size, unsigned int* ip_origem, unsigned short* porta_origem);
 void fecha_rawsocket(rawsocket_t* rs);
+int estatisticas_rawsocket(rawsocket_t* rs, unsigned int* pacotes, unsigned int* descartes);
+
+// Montagem e leitura dos cabeçalhos, sem passar pelo socket
+void montar_cabecalhos_rawsocket(const rawsocket_t* rs, unsigned char* cabecalhos, size_t data_len);
+int extrair_dados_rawsocket(const rawsocket_t* rs, const unsigned char* packet, size_t received,
+                            void* buffer, size_t buffer_size,
+                            unsigned int* ip_origem, unsigned short* porta_origem);
 
 int inicia_rawsocket(rawsocket_t* rs, const char* interface);
 int destino_rawsocket(rawsocket_t* rs, const char* ip_destino, unsigned short porta_destino);
@@ -0,0 +1,577 @@
+#define _XOPEN_SOURCE 700   // pwrite()
+
+#include "recepcao.h"
+#include "escritor.h"
+#include "multifluxo.h"
+#include "metricas.h"
+
+#include <stdarg.h>
+
+
+void recepcao_iniciar(recepcao_t* recepcao, protocolo_type* protocolo, int tentativas, int exibir) {
+    memset(recepcao, 0, sizeof(*recepcao));
+    recepcao->protocolo = protocolo;
+    recepcao->tentativas = tentativas > 0 ? tentativas : MAX_RETRY;
+    recepcao->exibir = exibir;
+}
+
+
+// Mensagem de andamento, só quando a recepção exibe no terminal
+static void mostrar(const recepcao_t* recepcao, FILE* saida, const char* formato, ...) {
+    if (!recepcao->exibir) {
+        return;
+    }
+    va_list argumentos;
+    va_start(argumentos, formato);
+    vfprintf(saida, formato, argumentos);
+    va_end(argumentos);
+}
+
+
+// Prazo a partir de agora, sem passar do limite da recepção
+static int64_t prazo_recepcao(const recepcao_t* recepcao, int64_t espera_us) {
+    int64_t prazo_us = metricas_agora_us() + espera_us;
+    if (recepcao->limite_us > 0 && prazo_us > recepcao->limite_us) {
+        prazo_us = recepcao->limite_us;
+    }
+    return prazo_us;
+}
+
+
+// O servidor repete cada frame até o ACK: calado por tentativas * TIMEOUT_S, ele foi embora
+static int64_t prazo_silencio(const recepcao_t* recepcao) {
+    return prazo_recepcao(recepcao, (int64_t)recepcao->tentativas * TIMEOUT_S * 1000000);
+}
+
+
+// Próximo frame para a porta do jogador até o prazo; o raw socket também entrega os frames
+// de outras portas, que só fazem receber_pacote voltar sem nada
+static int receber_ate(protocolo_type* protocolo, pack_t* pack, int64_t prazo_us) {
+    while (1) {
+        if (receber_pacote(protocolo, pack) == 0) {
+            return 0;
+        }
+        if (metricas_agora_us() >= prazo_us) {
+            return -2;
+        }
+    }
+}
+
+
+// Servidor recusou o comando por sobrecarga: espera o tempo pedido antes de repetir
+static void aguardar_servidor_ocupado(recepcao_t* recepcao, uint16_t espera_ms) {
+    recepcao->ocupados++;
+    mostrar(recepcao, stdout, "🟡 Servidor ocupado, nova tentativa em %d ms\n", espera_ms);
+    struct timespec pausa = { espera_ms / 1000, (long)(espera_ms % 1000) * 1000000L };
+    nanosleep(&pausa, NULL);
+}
+
+
+//////////// Comandos ////////////
+
+int recepcao_comando(recepcao_t* recepcao, mensagem_type tipo, struct_frame_mapa* mapa) {
+    protocolo_type* protocolo = recepcao->protocolo;
+    uint8_t anterior = protocolo->seq_atual;
+    uint8_t seq = tipo == MSG_START ? 0 : (anterior + 1) % 32;
+
+    pack_t comando;
+    criar_pacote(&comando, seq, tipo, NULL, 0);
+    enviar_pacote(protocolo, &comando);
+
+    // Depois do OK_ACK o mapa é o pacote pendente do servidor, que o repete até o ACK:
+    // voltar aos comandos sem ele faria o próximo movimento usar a sequência do mapa
+    int confirmado = 0;
+    int prazos = 0;
+    uint16_t espera_ms;
+    while (1) {
+        pack_t resposta;
+        if (receber_ate(protocolo, &resposta, prazo_recepcao(recepcao, (int64_t)TIMEOUT_S * 1000000)) < 0) {
+            if (++prazos > recepcao->tentativas ||
+                (recepcao->limite_us > 0 && metricas_agora_us() >= recepcao->limite_us)) {
+                mostrar(recepcao, stderr, confirmado ? "🔴 O servidor não enviou o mapa\n"
+                                                     : "🔴 O servidor não confirmou o comando\n");
+                return -4;
+            }
+            if (confirmado) {
+                mostrar(recepcao, stdout, "Aguardando o mapa do servidor...\n");
+            } else {
+                enviar_pacote(protocolo, &comando);
+            }
+            continue;
+        }
+
+        uint8_t recebida = getSeq(resposta);
+        if (recebida == (seq + 1) % 32 || (tipo == MSG_START && resposta.tipo == MSG_INTERFACE)) {
+            if (resposta.tipo == MSG_INTERFACE) {
+                protocolo->seq_atual = recebida;
+                memcpy(mapa, resposta.dados, sizeof(struct_frame_mapa));
+                enviar_ack(protocolo, recebida);
+                return 1;
+            }
+            if (resposta.tipo == MSG_ERRO) {
+                protocolo->seq_atual = recebida;
+                recepcao->erro = resposta.dados[0];
+                return -1;
+            }
+            continue;
+        }
+
+        if (recebida == seq) {
+            if (resposta.tipo == MSG_OK_ACK || (resposta.tipo == MSG_ACK && tipo == MSG_START)) {
+                confirmado = 1;
+                prazos = 0;
+            } else if (resposta.tipo == MSG_ACK) {
+                protocolo->seq_atual = seq;
+                return 0;
+            } else if (resposta.tipo == MSG_NACK && !confirmado) {
+                enviar_pacote(protocolo, &comando);
+            } else if (ler_erro_ocupado(&resposta, &espera_ms)) {
+                // Mesmo comando, com a mesma sequência, depois da espera pedida
+                aguardar_servidor_ocupado(recepcao, espera_ms);
+                prazos = 0;
+                enviar_pacote(protocolo, &comando);
+            }
+            continue;
+        }
+
+        // Último mapa ou FIM do servidor repetido: o ACK dele se perdeu
+        if (tipo != MSG_START && recebida == anterior &&
+            (resposta.tipo == MSG_INTERFACE || resposta.tipo == MSG_FIM_ARQUIVO)) {
+            enviar_ack(protocolo, recebida);
+        }
+    }
+}
+
+
+//////////// Anúncio do tesouro ////////////
+
+int recepcao_anuncio(recepcao_t* recepcao, tesouro_anunciado_t* anuncio) {
+    protocolo_type* protocolo = recepcao->protocolo;
+    uint8_t seq_tamanho = (protocolo->seq_atual + 1) % 32;
+    uint8_t seq_nome = (seq_tamanho + 1) % 32;
+    int tem_tamanho = 0;
+    pack_t pack;
+
+    memset(anuncio, 0, sizeof(*anuncio));
+
+    // O servidor repete cada pacote até o ACK: o mapa (se o ACK dele se perdeu), o tamanho e o nome
+    int64_t prazo_us = prazo_silencio(recepcao);
+    while (1) {
+        if (receber_ate(protocolo, &pack, prazo_us) < 0) {
+            mostrar(recepcao, stderr, "🔴 O servidor não enviou o tesouro\n");
+            return -4;
+        }
+        prazo_us = prazo_silencio(recepcao);
+        uint8_t seq = getSeq(pack);
+
+        if (pack.tipo == MSG_TAMANHO && seq == seq_tamanho) {
+            enviar_ack(protocolo, seq);
+            if (!tem_tamanho) {
+                memcpy(&anuncio->tamanho, pack.dados, sizeof(uint64_t));
+                mostrar(recepcao, stdout, "Arquivo do tesouro possui = %llu bytes\n",
+                        (unsigned long long)anuncio->tamanho);
+                tem_tamanho = 1;
+            }
+            continue;
+        }
+        // Sem o arquivo o servidor responde o tamanho com MSG_ERRO
+        if (tem_tamanho && pack.tipo == MSG_ERRO && (seq == seq_tamanho || seq == seq_nome)) {
+            recepcao->erro = pack.dados[0];
+            return -1;
+        }
+        if (tem_tamanho && seq == seq_nome && pack.tipo >= MSG_TEXTO_ACK_NOME && pack.tipo <= MSG_IMAGEM_ACK_NOME) {
+            break;
+        }
+        if (seq == protocolo->seq_atual) {
+            enviar_ack(protocolo, seq);     // Mapa repetido
+        }
+    }
+
+    anuncio->tipo = pack.tipo;
+    size_t tamanho_nome = strnlen((const char*)pack.dados, pack.tamanho);
+    if (tamanho_nome >= sizeof(anuncio->nome)) {
+        tamanho_nome = sizeof(anuncio->nome) - 1;
+    }
+    memcpy(anuncio->nome, pack.dados, tamanho_nome);
+    anuncio->nome[tamanho_nome] = '\0';
+
+    // Depois do nome o servidor informa em quantos fluxos o arquivo virá
+    // e a primeira porta dos fluxos (servidores antigos não mandam: faixa 0)
+    size_t fim_nome = strnlen((const char*)pack.dados, pack.tamanho) + 1;
+    anuncio->num_fluxos = 1;
+    anuncio->porta_fluxos = PORTA_BASE_FLUXOS(0);
+    if (pack.tamanho > fim_nome && pack.dados[fim_nome] > 1) {
+        anuncio->num_fluxos = pack.dados[fim_nome];
+    }
+    if (pack.tamanho >= fim_nome + 3) {
+        anuncio->porta_fluxos = (unsigned short)(pack.dados[fim_nome + 1] | (pack.dados[fim_nome + 2] << 8));
+    }
+
+    protocolo->seq_atual = seq_nome;
+    return 0;
+}
+
+
+void recepcao_recusar(recepcao_t* recepcao, erro_type erro) {
+    enviar_erro(recepcao->protocolo, recepcao->protocolo->seq_atual, erro);
+}
+
+
+//////////// Verificação ////////////
+
+// Pede ao servidor o reenvio de um intervalo do arquivo e grava os dados no offset
+// O primeiro MSG_DADOS do intervalo também vale como confirmação do pedido
+static int pedir_intervalo(recepcao_t* recepcao, int fd, uint64_t offset, uint32_t tamanho, uint64_t* crc) {
+    protocolo_type* protocolo = recepcao->protocolo;
+    struct_frame_pedido pedido;
+    pedido.subtipo = FIM_PEDIDO;
+    pedido.offset = offset;
+    pedido.tamanho = tamanho;
+
+    pack_t pack_pedido;
+    uint8_t seq_pedido = (protocolo->seq_atual + 1) % 32;
+    criar_pacote(&pack_pedido, seq_pedido, MSG_FIM_ARQUIVO, (uint8_t*)&pedido, sizeof(pedido));
+    protocolo->seq_atual = seq_pedido;
+    enviar_pacote(protocolo, &pack_pedido);
+
+    int confirmado = 0;
+    uint32_t recebidos = 0;
+    *crc = 0;
+    int64_t prazo_us = prazo_silencio(recepcao);
+    while (recebidos < tamanho) {
+        if (metricas_agora_us() >= prazo_us) {
+            mostrar(recepcao, stderr, "🔴 Servidor não respondeu ao pedido de reenvio\n");
+            return -1;
+        }
+        pack_t pack;
+        int result = receber_pacote(protocolo, &pack);
+        if (result == -2 && !confirmado) {
+            enviar_pacote(protocolo, &pack_pedido);
+            continue;
+        }
+        if (result < 0) {
+            continue;
+        }
+        prazo_us = prazo_silencio(recepcao);
+
+        uint8_t seq = getSeq(pack);
+        if (pack.tipo == MSG_ACK && seq == seq_pedido) {
+            confirmado = 1;
+            continue;
+        }
+        if (pack.tipo != MSG_DADOS) {
+            continue;
+        }
+
+        int isSeq = seqCheck(protocolo->seq_atual, seq);
+        if (isSeq == 0) {
+            enviar_ack(protocolo, seq);
+            continue;
+        }
+        if (isSeq != 1 || pack.tamanho > tamanho - recebidos) {
+            continue;
+        }
+        confirmado = 1;
+
+        if (pwrite(fd, pack.dados, pack.tamanho, (off_t)(offset + recebidos)) != pack.tamanho) {
+            mostrar(recepcao, stderr, "🔴 Erro ao regravar intervalo do tesouro: %s\n", strerror(errno));
+            return -1;
+        }
+        *crc = crc64_atualizar(*crc, pack.dados, pack.tamanho);
+        recebidos += pack.tamanho;
+        protocolo->seq_atual = seq;
+        enviar_ack(protocolo, seq);
+    }
+    return 0;
+}
+
+
+// Recebe a tabela de CRC por bloco enviada após o NACK do resumo
+static int receber_tabela_blocos(recepcao_t* recepcao, uint64_t* crc_referencia, uint32_t num_blocos) {
+    protocolo_type* protocolo = recepcao->protocolo;
+    uint32_t recebidos = 0;
+
+    int64_t prazo_us = prazo_silencio(recepcao);
+    while (recebidos < num_blocos) {
+        pack_t pack;
+        if (receber_ate(protocolo, &pack, prazo_us) < 0) {
+            mostrar(recepcao, stderr, "🔴 Servidor não enviou a tabela de blocos\n");
+            return -1;
+        }
+        prazo_us = prazo_silencio(recepcao);
+        if (pack.tipo != MSG_FIM_ARQUIVO) {
+            continue;
+        }
+
+        uint8_t seq = getSeq(pack);
+        int isSeq = seqCheck(protocolo->seq_atual, seq);
+        if (isSeq == 0) {
+            // Servidor não recebeu nossa resposta: repetir NACK do resumo ou ACK da tabela
+            if (pack.dados[0] == FIM_RESUMO) {
+                enviar_nack(protocolo, seq);
+            } else {
+                enviar_ack(protocolo, seq);
+            }
+            continue;
+        }
+        if (isSeq != 1 || pack.dados[0] != FIM_TABELA) {
+            continue;
+        }
+
+        struct_frame_tabela tabela;
+        memcpy(&tabela, pack.dados, sizeof(tabela));
+        for (int i = 0; i < tabela.quantidade && i < CRC_POR_FRAME; i++) {
+            if (tabela.primeiro_bloco + i < num_blocos) {
+                crc_referencia[tabela.primeiro_bloco + i] = tabela.crc64[i];
+            }
+        }
+        recebidos = tabela.primeiro_bloco + tabela.quantidade;
+        protocolo->seq_atual = seq;
+        enviar_ack(protocolo, seq);
+    }
+    return 0;
+}
+
+
+// Aguarda MSG_FIM_ARQUIVO e compara o CRC-64 com o calculado durante o download
+// Em caso de divergência, pede o reenvio apenas dos blocos corrompidos
+static int verificar_tesouro(recepcao_t* recepcao, int fd, const digest_arquivo_t* digest) {
+    protocolo_type* protocolo = recepcao->protocolo;
+    pack_t pack;
+    struct_frame_fim fim;
+
+    int64_t prazo_us = prazo_silencio(recepcao);
+    while (1) {
+        if (receber_ate(protocolo, &pack, prazo_us) < 0) {
+            mostrar(recepcao, stderr, "🔴 Servidor não enviou o CRC-64 do tesouro\n");
+            return -1;
+        }
+        prazo_us = prazo_silencio(recepcao);
+        uint8_t seq = getSeq(pack);
+        if (pack.tipo == MSG_DADOS && seq == protocolo->seq_atual) {
+            enviar_ack(protocolo, seq);     // ACK do último dado se perdeu
+            continue;
+        }
+        if (pack.tipo == MSG_FIM_ARQUIVO && pack.dados[0] == FIM_RESUMO &&
+            seqCheck(protocolo->seq_atual, seq) == 1) {
+            protocolo->seq_atual = seq;
+            memcpy(&fim, pack.dados, sizeof(fim));
+            break;
+        }
+    }
+
+    if (fim.crc64 == digest->crc_arquivo && fim.num_blocos == digest->num_blocos) {
+        mostrar(recepcao, stdout, "🟢 CRC-64 do tesouro confere (%016llx)\n", (unsigned long long)fim.crc64);
+        enviar_ack(protocolo, protocolo->seq_atual);
+        return 0;
+    }
+
+    recepcao->divergentes++;
+    mostrar(recepcao, stdout, "🟡 CRC-64 divergente, verificando blocos...\n");
+    enviar_nack(protocolo, protocolo->seq_atual);
+    if (fim.num_blocos != digest->num_blocos) {
+        return -1;
+    }
+
+    uint64_t* crc_referencia = calloc(digest->num_blocos, sizeof(uint64_t));
+    if (!crc_referencia) {
+        return -1;
+    }
+    int resultado = receber_tabela_blocos(recepcao, crc_referencia, digest->num_blocos);
+
+    for (uint32_t b = 0; resultado == 0 && b < digest->num_blocos; b++) {
+        if (digest->crc_blocos[b] == crc_referencia[b]) {
+            continue;
+        }
+
+        uint64_t offset = (uint64_t)b * BLOCO_VERIFICACAO;
+        uint64_t restante = digest->processados - offset;
+        uint32_t tamanho = restante < BLOCO_VERIFICACAO ? (uint32_t)restante : BLOCO_VERIFICACAO;
+
+        int corrigido = 0;
+        for (int tentativa = 0; tentativa < MAX_RETRY && !corrigido; tentativa++) {
+            uint64_t crc;
+            mostrar(recepcao, stdout, "Pedindo reenvio do bloco %u (%u bytes)\n", b, tamanho);
+            if (pedir_intervalo(recepcao, fd, offset, tamanho, &crc) < 0) {
+                break;
+            }
+            corrigido = (crc == crc_referencia[b]);
+        }
+        if (!corrigido) {
+            resultado = -1;
+        }
+    }
+    free(crc_referencia);
+
+    // Pedido vazio encerra a fase de verificação no servidor
+    struct_frame_pedido fim_pedido;
+    fim_pedido.subtipo = FIM_PEDIDO;
+    fim_pedido.offset = 0;
+    fim_pedido.tamanho = 0;
+    protocolo->seq_atual = (protocolo->seq_atual + 1) % 32;
+    criar_pacote(&pack, protocolo->seq_atual, MSG_FIM_ARQUIVO, (uint8_t*)&fim_pedido, sizeof(fim_pedido));
+    for (int tentativa = 0; tentativa < MAX_RETRY; tentativa++) {
+        enviar_pacote(protocolo, &pack);
+        if (esperar_ack(protocolo) >= 0) {
+            break;
+        }
+    }
+    return resultado;
+}
+
+
+//////////// Dados do tesouro ////////////
+
+// Janela anunciada ao servidor: frames que o escritor ainda aceita sem fazer a recepção esperar
+static uint8_t janela_recepcao(escritor_t* escritor) {
+    size_t frames = escritor_livre(escritor) / MAX_FRAME;
+    if (frames > UINT8_MAX) {
+        frames = UINT8_MAX;
+    }
+    return frames > 0 ? (uint8_t)frames : 1;
+}
+
+
+// Exibe o progresso do download no máximo a cada INTERVALO_PROGRESSO_MS
+// Sempre exibe a última atualização, quando o arquivo termina
+static void imprimir_progresso(const recepcao_t* recepcao, int64_t* ultimo_us, uint64_t recebidos,
+                               uint64_t tamanho) {
+    int64_t agora_us = metricas_agora_us();
+    if (agora_us - *ultimo_us < (int64_t)INTERVALO_PROGRESSO_MS * 1000 && recebidos < tamanho) {
+        return;
+    }
+    *ultimo_us = agora_us;
+    mostrar(recepcao, stdout, "🟢 Recebidos %llu / %llu bytes\n", (unsigned long long)recebidos,
+            (unsigned long long)tamanho);
+}
+
+
+// Recebe o arquivo em um trecho único, em ordem, com a janela que o escritor comporta
+static int receber_trecho(recepcao_t* recepcao, const tesouro_anunciado_t* anuncio, int fd,
+                          digest_arquivo_t* digest) {
+    protocolo_type* protocolo = recepcao->protocolo;
+    uint64_t tamanho = anuncio->tamanho;
+
+    escritor_t escritor;
+    if (escritor_iniciar_trecho(&escritor, fd, 0, tamanho) < 0) {
+        return -2;
+    }
+
+    // Destino pronto: confirmar o nome para o servidor começar os dados
+    enviar_ack_janela(protocolo, protocolo->seq_atual, janela_recepcao(&escritor), 0);
+
+    uint64_t recebidos = 0;
+    int64_t ultimo_progresso_us = 0;
+    int64_t prazo_us = prazo_silencio(recepcao);
+    while (recebidos < tamanho) {
+        pack_t pack;
+        if (receber_ate(protocolo, &pack, prazo_us) < 0) {
+            mostrar(recepcao, stderr, "🔴 O servidor parou de enviar o tesouro\n");
+            escritor_fechar(&escritor);
+            return -4;
+        }
+        prazo_us = prazo_silencio(recepcao);
+
+        // O servidor envia uma janela de frames: só o próximo em ordem é aceito,
+        // os repetidos e os fora de ordem (e o nome repetido, se o ACK dele se perdeu)
+        // repetem o ACK do último aceito
+        uint8_t seq = getSeq(pack);
+        if (seqCheck(protocolo->seq_atual, seq) != 1 || pack.tipo != MSG_DADOS) {
+            enviar_ack_janela(protocolo, protocolo->seq_atual, janela_recepcao(&escritor), recebidos);
+            continue;
+        }
+
+        // Só o último frame do arquivo pode vir incompleto
+        uint64_t restante = tamanho - recebidos;
+        if (pack.tamanho > restante || (pack.tamanho < MAX_FRAME && pack.tamanho != restante)) {
+            enviar_nack_janela(protocolo, seq, janela_recepcao(&escritor), recebidos);
+            continue;
+        }
+
+        // Entregar dados ao escritor (gravação em lote fora do caminho de recepção)
+        // Sem conseguir gravar não adianta seguir recebendo: recusar o tesouro
+        // encerra a transferência no servidor em vez de deixá-lo repetir a janela
+        if (escritor_adicionar(&escritor, pack.dados, pack.tamanho) < 0) {
+            mostrar(recepcao, stderr, "🔴 Erro ao escrever no arquivo: %s\n", strerror(errno));
+            enviar_erro(protocolo, seq, ESPACO_INSUFICIENTE);
+            escritor_fechar(&escritor);
+            return -2;
+        }
+        digest_atualizar(digest, pack.dados, pack.tamanho);
+
+        protocolo->seq_atual = seq;
+        recebidos += pack.tamanho;
+        enviar_ack_janela(protocolo, seq, janela_recepcao(&escritor), recebidos);
+        imprimir_progresso(recepcao, &ultimo_progresso_us, recebidos, tamanho);
+    }
+
+    if (escritor_fechar(&escritor) < 0) {
+        mostrar(recepcao, stderr, "🔴 Erro ao gravar arquivo do tesouro: %s\n", strerror(errno));
+        return -2;
+    }
+    return verificar_tesouro(recepcao, fd, digest);
+}
+
+
+// Recebe o tesouro em vários fluxos paralelos, um por trecho do arquivo
+// Cada fluxo grava no seu offset; o digest é verificado no canal principal
+static int receber_fluxos(recepcao_t* recepcao, const tesouro_anunciado_t* anuncio, int fd,
+                          digest_arquivo_t* digest) {
+    protocolo_type* protocolo = recepcao->protocolo;
+
+    multifluxo_t multi;
+    if (multifluxo_iniciar(&multi, FLUXO_RECEPCAO, protocolo->ip_destino, protocolo->porta_origem,
+                           anuncio->porta_fluxos, fd, NULL, anuncio->tamanho, anuncio->num_fluxos) < 0) {
+        mostrar(recepcao, stderr, "🔴 Erro ao abrir fluxos paralelos\n");
+        return -2;
+    }
+
+    // Sockets dos fluxos abertos: confirmar o nome para o servidor começar os trechos
+    mostrar(recepcao, stdout, "🟢 Recebendo %s em %d fluxos paralelos\n", anuncio->nome, anuncio->num_fluxos);
+    enviar_ack(protocolo, protocolo->seq_atual);
+
+    // Se o ACK se perder o servidor repete o nome em vez de iniciar os trechos
+    // Cada fluxo desiste sozinho quando o servidor para de enviar o seu trecho
+    int espera_ms = protocolo->espera_ms;
+    int expirou = 0;
+    protocolo->espera_ms = ESPERA_FLUXOS_MS;
+    while (!multifluxo_concluido(&multi)) {
+        if (recepcao->limite_us > 0 && metricas_agora_us() >= recepcao->limite_us) {
+            expirou = 1;
+            break;
+        }
+        pack_t pack;
+        if (receber_pacote(protocolo, &pack) == 0 && getSeq(pack) == protocolo->seq_atual) {
+            enviar_ack(protocolo, protocolo->seq_atual);
+        }
+    }
+    protocolo->espera_ms = espera_ms;
+
+    // Os fluxos continuam confirmando um fim repetido enquanto o canal principal verifica o arquivo
+    int resultado = -4;
+    if (!expirou) {
+        resultado = multifluxo_juntar_digest(&multi, digest);
+        if (resultado < 0) {
+            mostrar(recepcao, stderr, "🔴 Falha em um dos fluxos paralelos\n");
+        }
+        // Mesmo com um trecho perdido o servidor espera a verificação para encerrar o tesouro
+        int verificado = verificar_tesouro(recepcao, fd, digest);
+        resultado = resultado < 0 || verificado < 0 ? -1 : 0;
+    }
+    multifluxo_cancelar(&multi);
+    multifluxo_aguardar(&multi, NULL);
+    return resultado;
+}
+
+
+int recepcao_tesouro(recepcao_t* recepcao, const tesouro_anunciado_t* anuncio, int fd) {
+    digest_arquivo_t digest;
+    if (digest_iniciar(&digest, anuncio->tamanho) < 0) {
+        return -2;
+    }
+
+    int resultado = anuncio->num_fluxos > 1 ? receber_fluxos(recepcao, anuncio, fd, &digest)
+                                            : receber_trecho(recepcao, anuncio, fd, &digest);
+    digest_liberar(&digest);
+    return resultado;
+}
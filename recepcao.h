@@ -0,0 +1,63 @@
+#ifndef RECEPCAO_H
+#define RECEPCAO_H
+
+#include "protocolo.h"
+#include "integridade.h"
+
+
+#define INTERVALO_PROGRESSO_MS 250   // Intervalo mínimo entre linhas de progresso
+#define ESPERA_FLUXOS_MS 20          // Espera no canal principal entre verificações dos fluxos paralelos
+
+
+//////////// Lado do jogador no protocolo ////////////
+
+// Comandos com a resposta do servidor, anúncio e dados do tesouro (trecho único ou fluxos
+// paralelos) e a verificação pelo CRC-64 com o reenvio dos blocos divergentes. O cliente e o
+// gerador de carga usam as mesmas funções; só o destino dos dados e as mensagens mudam.
+// Cada espera desiste depois de tentativas * TIMEOUT_S sem nenhum frame do servidor
+typedef struct {
+    protocolo_type* protocolo;
+    int tentativas;                 // Prazos de TIMEOUT_S seguidos sem resposta: o servidor foi embora
+    int exibir;                     // Andamento no terminal (o gerador de carga fica calado)
+    int64_t limite_us;              // Nenhuma espera passa deste instante (0 = sem limite)
+    uint8_t erro;                   // Código do último MSG_ERRO recebido no lugar do mapa ou do tesouro
+    uint64_t ocupados;              // Comandos repetidos depois de SERVIDOR_OCUPADO
+    uint64_t divergentes;           // Tesouros com o CRC-64 do resumo diferente do calculado
+} recepcao_t;
+
+// Tesouro anunciado depois do mapa: tamanho, nome e como os dados virão
+typedef struct {
+    char nome[256];
+    mensagem_type tipo;             // MSG_TEXTO_ACK_NOME a MSG_IMAGEM_ACK_NOME
+    uint64_t tamanho;
+    int num_fluxos;
+    unsigned short porta_fluxos;    // Primeira porta dos fluxos no servidor
+} tesouro_anunciado_t;
+
+
+//////////// Funções da recepção ////////////
+
+// Prepara a recepção sobre o protocolo já conectado
+void recepcao_iniciar(recepcao_t* recepcao, protocolo_type* protocolo, int tentativas, int exibir);
+
+// Envia MSG_START ou um movimento e espera a confirmação e o mapa, repetindo o comando a cada
+// TIMEOUT_S sem confirmação e depois da espera pedida com SERVIDOR_OCUPADO
+// Retorna 1 com o mapa (já confirmado), 0 para movimento inválido, -1 para MSG_ERRO do
+// servidor (código em recepcao->erro) e -4 quando o servidor não responde mais
+int recepcao_comando(recepcao_t* recepcao, mensagem_type tipo, struct_frame_mapa* mapa);
+
+// Espera o tamanho e o nome do tesouro depois de um mapa com tesouro novo
+// O ACK do nome fica para recepcao_tesouro, quando o destino estiver pronto
+// Retorna 0, -1 se o servidor não conseguiu abrir o arquivo ou -4 sem resposta
+int recepcao_anuncio(recepcao_t* recepcao, tesouro_anunciado_t* anuncio);
+
+// Recusa o tesouro anunciado (por exemplo, ESPACO_INSUFICIENTE)
+void recepcao_recusar(recepcao_t* recepcao, erro_type erro);
+
+// Recebe o tesouro anunciado gravando no descritor (cada byte no seu offset) e verifica o
+// CRC-64, pedindo de novo os blocos divergentes. O descritor continua com quem chamou
+// Retorna 0 com o arquivo íntegro, -1 se ele não passou na verificação, -2 se a gravação
+// falhou e -4 se o servidor parou de enviar os dados
+int recepcao_tesouro(recepcao_t* recepcao, const tesouro_anunciado_t* anuncio, int fd);
+
+#endif // RECEPCAO_H
@@ -0,0 +1,344 @@
+#define _XOPEN_SOURCE 700   // clock_gettime(), nanosleep(), localtime_r()
+
+#include "registro.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+static const char* nomes_niveis[] = { "DEPUR", "INFO", "AVISO", "ERRO" };
+
+static struct {
+    int ativo;
+    registro_buffer_t* buffers[REGISTRO_THREADS];
+    int num_buffers;                        // Posições de buffers já reservadas
+    int proxima_thread;                     // Número da próxima thread nos registros
+    pthread_key_t chave;                    // Só pelo destrutor: libera o buffer quando a thread termina
+    pthread_t thread;
+    int encerrar;
+} registro;
+
+// Buffer da thread; o indicador direto marca as threads que não conseguiram um
+static __thread registro_buffer_t* buffer_thread;
+static __thread int numero_thread;
+static registro_buffer_t direto;
+
+
+static int64_t agora_ns(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_REALTIME, &agora);
+    return (int64_t)agora.tv_sec * 1000000000 + agora.tv_nsec;
+}
+
+
+// A thread terminou: o buffer fica para a próxima que precisar de um, com o que ainda não foi escrito
+static void liberar_buffer(void* buffer) {
+    __atomic_store_n(&((registro_buffer_t*)buffer)->livre, 1, __ATOMIC_RELEASE);
+}
+
+
+// Reaproveita o buffer de uma thread que terminou ou reserva um novo
+static registro_buffer_t* obter_buffer(void) {
+    numero_thread = __atomic_add_fetch(&registro.proxima_thread, 1, __ATOMIC_RELAXED);
+
+    int reservados = __atomic_load_n(&registro.num_buffers, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < reservados && i < REGISTRO_THREADS; i++) {
+        registro_buffer_t* buffer = __atomic_load_n(&registro.buffers[i], __ATOMIC_ACQUIRE);
+        int livre = 1;
+        if (buffer && __atomic_compare_exchange_n(&buffer->livre, &livre, 0, 0, __ATOMIC_ACQUIRE,
+                                                  __ATOMIC_RELAXED)) {
+            pthread_setspecific(registro.chave, buffer);
+            return buffer;
+        }
+    }
+
+    int posicao = __atomic_fetch_add(&registro.num_buffers, 1, __ATOMIC_ACQ_REL);
+    if (posicao >= REGISTRO_THREADS) {
+        return &direto;
+    }
+    registro_buffer_t* buffer = calloc(1, sizeof(registro_buffer_t));
+    if (!buffer) {
+        return &direto;
+    }
+    pthread_setspecific(registro.chave, buffer);
+    __atomic_store_n(&registro.buffers[posicao], buffer, __ATOMIC_RELEASE);
+    return buffer;
+}
+
+
+// Converte o argumento pela letra da conversão; os modificadores de tamanho do formato
+// são trocados por ll, já que todo argumento foi guardado como 64 bits
+static size_t formatar_conversao(char* texto, size_t tamanho, const char* especificacao, size_t comprimento,
+                                 char conversao, uint64_t argumento) {
+    char formato[32];
+    if (comprimento > sizeof(formato) - 4) {
+        comprimento = sizeof(formato) - 4;
+    }
+    memcpy(formato, especificacao, comprimento);
+
+    int escritos;
+    switch (conversao) {
+        case 'd': case 'i':
+            memcpy(formato + comprimento, "ll", 2);
+            formato[comprimento + 2] = conversao;
+            formato[comprimento + 3] = '\0';
+            escritos = snprintf(texto, tamanho, formato, (long long)argumento);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            memcpy(formato + comprimento, "ll", 2);
+            formato[comprimento + 2] = conversao;
+            formato[comprimento + 3] = '\0';
+            escritos = snprintf(texto, tamanho, formato, (unsigned long long)argumento);
+            break;
+        case 'c':
+            formato[comprimento] = 'c';
+            formato[comprimento + 1] = '\0';
+            escritos = snprintf(texto, tamanho, formato, (int)argumento);
+            break;
+        case 's':
+            formato[comprimento] = 's';
+            formato[comprimento + 1] = '\0';
+            escritos = snprintf(texto, tamanho, formato,
+                                argumento ? (const char*)(uintptr_t)argumento : "(null)");
+            break;
+        case 'p':
+            escritos = snprintf(texto, tamanho, "%p", (void*)(uintptr_t)argumento);
+            break;
+        default:
+            escritos = snprintf(texto, tamanho, "%%%c", conversao);
+            break;
+    }
+    if (escritos < 0) {
+        return 0;
+    }
+    return (size_t)escritos < tamanho ? (size_t)escritos : tamanho - 1;
+}
+
+
+// Avança sobre sinalizadores, largura, precisão e modificadores de tamanho de uma conversão
+// (p aponta para o %); retorna a letra da conversão e o comprimento do que segue para o snprintf
+static const char* pular_especificacao(const char* p, size_t* comprimento) {
+    const char* inicio = p++;
+    while (*p && strchr("-+ #0123456789.", *p)) {
+        p++;
+    }
+    *comprimento = (size_t)(p - inicio);
+    while (*p && strchr("hlLqjzt", *p)) {
+        p++;
+    }
+    return p;
+}
+
+
+void registro_montar(registro_t* reg, int nivel, const char* formato, uint64_t a, uint64_t b, uint64_t c,
+                     uint64_t d) {
+    reg->instante_ns = 0;
+    reg->nivel = nivel;
+    reg->thread = 0;
+    reg->formato = formato;
+    reg->argumentos[0] = a;
+    reg->argumentos[1] = b;
+    reg->argumentos[2] = c;
+    reg->argumentos[3] = d;
+
+    // Cada %s passa a apontar para a sua cópia; sem espaço, o texto sai cortado ou vazio
+    size_t usado = 0;
+    int argumento = 0;
+    const char* p = formato;
+    while (*p && argumento < REGISTRO_ARGUMENTOS) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        size_t comprimento;
+        p = pular_especificacao(p, &comprimento);
+        if (!*p) {
+            break;
+        }
+        if (*p++ == 's' && reg->argumentos[argumento]) {
+            const char* origem = (const char*)(uintptr_t)reg->argumentos[argumento];
+            size_t copiar = usado < REGISTRO_TEXTO ? strnlen(origem, REGISTRO_TEXTO - usado - 1) : 0;
+            size_t posicao = usado < REGISTRO_TEXTO ? usado : REGISTRO_TEXTO - 1;
+            memcpy(reg->textos + posicao, origem, copiar);
+            reg->textos[posicao + copiar] = '\0';
+            reg->argumentos[argumento] = posicao + 1;
+            usado = posicao + copiar + 1;
+        }
+        argumento++;
+    }
+}
+
+
+void registro_formatar(const registro_t* reg, char* texto, size_t tamanho) {
+    if (tamanho == 0) return;
+
+    size_t usado = 0;
+    int argumento = 0;
+    const char* p = reg->formato;
+    while (*p && usado + 1 < tamanho) {
+        if (*p != '%') {
+            texto[usado++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            texto[usado++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Sinalizadores, largura e precisão seguem para o snprintf; os modificadores de tamanho, não
+        const char* inicio = p;
+        size_t comprimento;
+        p = pular_especificacao(p, &comprimento);
+        if (!*p) {
+            break;
+        }
+        uint64_t valor = argumento < REGISTRO_ARGUMENTOS ? reg->argumentos[argumento] : 0;
+        argumento++;
+        if (*p == 's' && valor) {
+            valor = valor <= REGISTRO_TEXTO ? (uint64_t)(uintptr_t)(reg->textos + valor - 1) : 0;
+        }
+        usado += formatar_conversao(texto + usado, tamanho - usado, inicio, comprimento, *p++, valor);
+    }
+    texto[usado] = '\0';
+}
+
+
+// Uma linha por registro: horário, nível, thread e a mensagem (sem a quebra de linha do formato)
+static void imprimir(const registro_t* reg) {
+    char mensagem[512];
+    registro_formatar(reg, mensagem, sizeof(mensagem));
+    size_t tamanho = strlen(mensagem);
+    while (tamanho > 0 && mensagem[tamanho - 1] == '\n') {
+        mensagem[--tamanho] = '\0';
+    }
+
+    time_t segundos = (time_t)(reg->instante_ns / 1000000000);
+    struct tm hora;
+    localtime_r(&segundos, &hora);
+    FILE* saida = reg->nivel >= REGISTRO_AVISO ? stderr : stdout;
+    fprintf(saida, "%02d:%02d:%02d.%06ld %-5s [%d] %s\n", hora.tm_hour, hora.tm_min, hora.tm_sec,
+            (long)(reg->instante_ns % 1000000000 / 1000), nomes_niveis[reg->nivel & 3], reg->thread, mensagem);
+}
+
+
+// Escreve os registros de todos os buffers em ordem de horário; retorna quantos
+static int escrever_pendentes(void) {
+    int escritos = 0;
+    int reservados = __atomic_load_n(&registro.num_buffers, __ATOMIC_ACQUIRE);
+    if (reservados > REGISTRO_THREADS) {
+        reservados = REGISTRO_THREADS;
+    }
+
+    while (1) {
+        registro_buffer_t* proximo = NULL;
+        for (int i = 0; i < reservados; i++) {
+            registro_buffer_t* buffer = __atomic_load_n(&registro.buffers[i], __ATOMIC_ACQUIRE);
+            if (!buffer || buffer->leitura == __atomic_load_n(&buffer->escrita, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            const registro_t* reg = &buffer->registros[buffer->leitura & (REGISTRO_CAPACIDADE - 1)];
+            if (!proximo ||
+                reg->instante_ns < proximo->registros[proximo->leitura & (REGISTRO_CAPACIDADE - 1)].instante_ns) {
+                proximo = buffer;
+            }
+        }
+        if (!proximo) {
+            return escritos;
+        }
+
+        imprimir(&proximo->registros[proximo->leitura & (REGISTRO_CAPACIDADE - 1)]);
+        __atomic_store_n(&proximo->leitura, proximo->leitura + 1, __ATOMIC_RELEASE);
+        escritos++;
+    }
+}
+
+
+static void* thread_registro(void* arg) {
+    (void)arg;
+
+    while (1) {
+        if (escrever_pendentes() > 0) {
+            fflush(stdout);
+            fflush(stderr);
+            continue;
+        }
+        if (__atomic_load_n(&registro.encerrar, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        struct timespec pausa = { 0, REGISTRO_ESPERA_MS * 1000000L };
+        nanosleep(&pausa, NULL);
+    }
+}
+
+
+int registro_iniciar(void) {
+    if (registro.ativo) return 0;
+
+    if (pthread_key_create(&registro.chave, liberar_buffer) != 0) {
+        return -1;
+    }
+    registro.encerrar = 0;
+    if (pthread_create(&registro.thread, NULL, thread_registro, NULL) != 0) {
+        pthread_key_delete(registro.chave);
+        return -1;
+    }
+    __atomic_store_n(&registro.ativo, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+void registro_gravar(int nivel, const char* formato, uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+    registro_t reg;
+    registro_montar(&reg, nivel, formato, a, b, c, d);
+    reg.instante_ns = agora_ns();
+
+    registro_buffer_t* buffer = buffer_thread;
+    if (!buffer && __atomic_load_n(&registro.ativo, __ATOMIC_ACQUIRE)) {
+        buffer = buffer_thread = obter_buffer();
+    }
+    reg.thread = numero_thread;
+
+    // Sem a thread de escrita (ou sem buffer para esta thread), a impressão é na hora
+    if (!buffer || buffer == &direto || !__atomic_load_n(&registro.ativo, __ATOMIC_ACQUIRE)) {
+        imprimir(&reg);
+        return;
+    }
+
+    uint64_t escrita = buffer->escrita;
+    if (escrita - __atomic_load_n(&buffer->leitura, __ATOMIC_ACQUIRE) >= REGISTRO_CAPACIDADE) {
+        __atomic_fetch_add(&buffer->perdidos, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    buffer->registros[escrita & (REGISTRO_CAPACIDADE - 1)] = reg;
+    __atomic_store_n(&buffer->escrita, escrita + 1, __ATOMIC_RELEASE);
+}
+
+
+void registro_finalizar(void) {
+    if (!registro.ativo) return;
+
+    // Daqui em diante os registros são impressos na hora
+    __atomic_store_n(&registro.ativo, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&registro.encerrar, 1, __ATOMIC_RELEASE);
+    pthread_join(registro.thread, NULL);
+    escrever_pendentes();
+
+    uint64_t perdidos = 0;
+    int reservados = registro.num_buffers < REGISTRO_THREADS ? registro.num_buffers : REGISTRO_THREADS;
+    for (int i = 0; i < reservados; i++) {
+        if (registro.buffers[i]) {
+            perdidos += __atomic_load_n(&registro.buffers[i]->perdidos, __ATOMIC_RELAXED);
+        }
+    }
+    if (perdidos > 0) {
+        fprintf(stderr, "🟡 %llu registros perdidos com o buffer da thread cheio\n", (unsigned long long)perdidos);
+    }
+    fflush(stdout);
+    fflush(stderr);
+}
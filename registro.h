@@ -0,0 +1,89 @@
+#ifndef REGISTRO_H
+#define REGISTRO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+
+#define REGISTRO_DEPURACAO 0
+#define REGISTRO_INFO 1
+#define REGISTRO_AVISO 2
+#define REGISTRO_ERRO 3
+
+// Níveis abaixo deste nem são compilados (make CFLAGS+=-DREGISTRO_NIVEL_MINIMO=0 liga a depuração)
+#ifndef REGISTRO_NIVEL_MINIMO
+#define REGISTRO_NIVEL_MINIMO REGISTRO_INFO
+#endif
+
+#define REGISTRO_ARGUMENTOS 4               // Argumentos por registro
+#define REGISTRO_TEXTO 64                   // Bytes para as cópias dos argumentos %s de um registro
+#define REGISTRO_CAPACIDADE 1024            // Registros no buffer de cada thread (potência de 2)
+#define REGISTRO_THREADS 64                 // Threads com buffer próprio; as demais escrevem direto
+#define REGISTRO_ESPERA_MS 5                // Pausa da thread de escrita com os buffers vazios
+
+
+//////////// Registro assíncrono ////////////
+
+// O caminho quente só grava o formato (um literal), o instante e os argumentos como inteiros
+// no buffer da própria thread; a thread de escrita formata e imprime fora dele.
+// Os argumentos podem ser inteiros de qualquer tamanho ou, para %s, textos: eles são copiados
+// para o próprio registro (até REGISTRO_TEXTO bytes somando todos, o resto é cortado), então
+// nomes de sessões e buffers reaproveitados podem ser registrados. %f não é suportado
+typedef struct {
+    int64_t instante_ns;                    // CLOCK_REALTIME
+    int nivel;
+    int thread;                             // Número da thread que gravou
+    const char* formato;
+    uint64_t argumentos[REGISTRO_ARGUMENTOS];   // Para %s: posição em textos + 1 (0 é NULL)
+    char textos[REGISTRO_TEXTO];
+} registro_t;
+
+// Buffer de uma thread: ela é a única que escreve, a thread de escrita é a única que lê
+typedef struct {
+    uint64_t escrita;
+    uint64_t leitura;
+    uint64_t perdidos;                      // Registros que encontraram o buffer cheio
+    int livre;                              // A thread dona terminou: outra pode assumir o buffer
+    registro_t registros[REGISTRO_CAPACIDADE];
+} registro_buffer_t;
+
+
+// Formatos com até REGISTRO_ARGUMENTOS argumentos: os que faltam viram 0 e são ignorados
+#define REGISTRAR(nivel, ...) \
+    do { \
+        if ((nivel) >= REGISTRO_NIVEL_MINIMO) { \
+            REGISTRAR_ARGUMENTOS(nivel, __VA_ARGS__, 0, 0, 0, 0, 0); \
+        } \
+    } while (0)
+
+#define REGISTRAR_ARGUMENTOS(nivel, formato, a, b, c, d, ...) \
+    registro_gravar(nivel, formato, (uint64_t)(uintptr_t)(a), (uint64_t)(uintptr_t)(b), \
+                    (uint64_t)(uintptr_t)(c), (uint64_t)(uintptr_t)(d))
+
+#define REG_DEPURACAO(...) REGISTRAR(REGISTRO_DEPURACAO, __VA_ARGS__)
+#define REG_INFO(...) REGISTRAR(REGISTRO_INFO, __VA_ARGS__)
+#define REG_AVISO(...) REGISTRAR(REGISTRO_AVISO, __VA_ARGS__)
+#define REG_ERRO(...) REGISTRAR(REGISTRO_ERRO, __VA_ARGS__)
+
+
+//////////// Funções do registro ////////////
+
+// Cria a thread de escrita; antes dela (e depois de registro_finalizar) os registros são
+// formatados e impressos na hora. Avisos e erros vão para stderr, o resto para stdout
+int registro_iniciar(void);
+
+// Grava um registro no buffer da thread, sem travas nem chamadas ao sistema além do relógio
+void registro_gravar(int nivel, const char* formato, uint64_t a, uint64_t b, uint64_t c, uint64_t d);
+
+// Preenche o registro com o formato e os argumentos, copiando os textos dos %s
+void registro_montar(registro_t* registro, int nivel, const char* formato, uint64_t a, uint64_t b, uint64_t c,
+                     uint64_t d);
+
+// Formata um registro como printf, com os argumentos convertidos pela letra de cada %
+void registro_formatar(const registro_t* registro, char* texto, size_t tamanho);
+
+// Escreve o que ainda estiver nos buffers, encerra a thread e imprime os registros perdidos
+void registro_finalizar(void);
+
+#endif // REGISTRO_H
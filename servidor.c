@@ -1,203 +1,1234 @@
+#define _XOPEN_SOURCE 700   // fmemopen()
+
 #include "protocolo.h"
 #include "rawSocket.h"
+#include "multifluxo.h"
+#include "precarga.h"
+#include "leitor.h"
+#include "sessao.h"
+#include "trabalho.h"
+#include "transmissor.h"
+#include "perturbacao.h"
+#include "captura.h"
+#include "registro.h"
+#include "sondas.h"
+#include "perfil.h"
+
+#include <poll.h>
+
+
+#define ESPERA_CARGA_MS 10          // Nova consulta à pré-carga enquanto o tesouro é lido
+#define ESPERA_FLUXOS_MS 20         // Intervalo entre verificações dos fluxos paralelos
+#define ESPERA_LEITURA_MS 2         // Nova consulta ao leitor com a janela vazia e o disco ainda lendo
+#define ESPERA_DESPACHO_MS 20       // Nova tentativa de um prazo com a fila da sessão cheia
+#define ARQUIVO_SESSOES "sessoes.estado"    // Instantâneo das sessões, retomadas se o servidor reiniciar
+#define MAX_TRANSFERENCIAS 128      // Tesouros sendo enviados ao mesmo tempo
+#define LIMITE_TAREFAS 64           // Sessões esperando um trabalhador acima das quais o servidor está sobrecarregado
+#define LIMITE_TRANSMISSAO (CAPACIDADE_TRANSMISSAO / 2)     // Frames esperando a transmissão, idem
+#define ESPERA_OCUPADO_MS 1000      // Espera sugerida a um cliente recusado (mais até a metade, pelo endereço)
+#define SOCKET_METRICAS "servidor.metricas"     // Socket Unix com o retrato das métricas em JSON
+#define INTERVALO_MAPA_MS 250       // Intervalo mínimo entre dois desenhos do mapa (MAPA_SERVIDOR)
+
+// Como o conteúdo dos tesouros é enviado (argumento opcional, para comparar os modos no medir_transferencia.sh)
+typedef enum {
+    MODO_AUTOMATICO = 0,            // Janela de congestionamento, e vídeos grandes em fluxos paralelos
+    MODO_JANELA,                    // Só a janela, sem fluxos paralelos
+    MODO_PARADA                     // Pare e espere: um frame em voo por vez
+} modo_transferencia_type;
+
+// Variáveis globais
+protocolo_type escuta;
+tabela_sessoes_t sessoes;
+precarga_t precarga;
+pool_trabalho_t pool;
+transmissor_t transmissor;
+int faixas_fluxos[MAX_TRANSFERENCIAS_MULTIFLUXO];     // Faixas de portas em uso pelos fluxos paralelos (acesso atômico)
+int transferencias_ativas;                          // Vagas de MAX_TRANSFERENCIAS em uso (acesso atômico)
+modo_transferencia_type modo_transferencia = MODO_AUTOMATICO;
+
+// Mapa do único jogador no terminal do servidor (MAPA_SERVIDOR=1), só para depuração:
+// os trabalhadores copiam o jogo e só a thread principal limpa a tela e desenha
+struct {
+    int ativo;
+    pthread_mutex_t trava;
+    struct_jogo jogo;
+    int alterado;                   // Cópia mais nova que o último desenho
+    int64_t desenho_ms;
+} vista_mapa = { .trava = PTHREAD_MUTEX_INITIALIZER };
+
+//////////// Protótipos das funções ////////////
+
+// Abre o socket do servidor, compartilhado por todas as sessões
+int iniciar_escuta(int porta);
+
+// Entrega o evento à sessão e a coloca no pool se nenhum trabalhador estiver com ela
+// A referência do frame passa para a sessão (ou é solta se a fila estiver cheia)
+void entregar_evento(sessao_t* sessao, evento_sessao_type tipo, quadro_t* quadro);
+
+// Prazo da sessão venceu na roda de temporizadores
+void entregar_prazo(sessao_t* sessao);
+
+// Fila dos trabalhadores ou da transmissão acima do limite: novas sessões e transferências esperam
+int sobrecarregado(void);
+
+// Responde SERVIDOR_OCUPADO ao frame de um cliente sem sessão, que não foi admitido
+void recusar_cliente(const pack_t* pack, unsigned int ip, unsigned short porta);
+
+// Tarefa do pool: processa em ordem os eventos da sessão
+void executar_sessao(void* argumento);
+
+// Thread de métricas: lista as sessões ativas com os contadores de cada uma
+void escrever_sessoes(FILE* saida);
+
+// Sessão restaurada do instantâneo: reabre o arquivo do tesouro e repete o pendente
+void retomar_sessao(sessao_t* sessao, const registro_sessao_t* registro);
+
+// Processa a mensagem recebida de um cliente conforme o estado da sessão
+// Nunca bloqueia: cada frame só avança a máquina de estados da sessão
+int gerenciar_mensagem_cliente(sessao_t* sessao, const pack_t* pack);
+
+// Trata o prazo vencido da sessão: retransmissão, pré-carga ou fluxos paralelos
+int gerenciar_prazo(sessao_t* sessao);
+
+//  Processa o movimento solicitado e atualiza a posição do jogador, envia o mapa atualizado ou o tesouro se encontrado
+int gerenciar_movimento(sessao_t* sessao, mensagem_type direcao);
+
+// Prepara o pacote com o mapa atualizado e envia ao cliente, informa posição do jogador e se encontrou tesouro
+// A etapa indica se o tamanho do tesouro vem depois da confirmação
+int transmitir_mapa_cliente(sessao_t* sessao, etapa_sessao_type etapa);
+
+// Envia o tamanho do tesouro encontrado para o cliente
+int transmitir_tesouro(sessao_t* sessao);
+
+// Abre o arquivo do tesouro (ou usa a pré-carga) e envia o nome e o número de fluxos
+int transmitir_arquivo_tesouro(sessao_t* sessao);
+
+// Começa o envio do conteúdo: frame a frame ou em fluxos paralelos
+int iniciar_dados_tesouro(sessao_t* sessao);
+
+// Completa a janela de dados, ou envia MSG_FIM_ARQUIVO quando todo o arquivo foi confirmado
+int transmitir_janela_dados(sessao_t* sessao);
+
+// Envia MSG_FIM_ARQUIVO com o digest do arquivo
+int finalizar_arquivo_tesouro(sessao_t* sessao);
+
+// Libera arquivo, leitor, digest, fluxos e pré-carga da transferência da sessão
+void encerrar_transferencia(sessao_t* sessao);
+
+// Registra o movimento do jogador com horário, direção, posição e quantidade de tesouros
+void imprimir_movimento(sessao_t* sessao, const char* direcao, int sucesso);
+
+// Trabalhador: copia o jogo da sessão para o mapa de depuração, se ele estiver ligado
+void publicar_mapa(const sessao_t* sessao);
+
+// Thread principal: desenha o mapa de depuração, se mudou, no máximo a cada INTERVALO_MAPA_MS
+void desenhar_mapa(void);
+
+// Verifica se existe um tesouro na posição informada
+// Retorna 1 se existir, ou 0 caso contrário
+int checar_tesouro_posicao(tesouro_t treasures[MAX_TESOUROS], posicao_t pos);
+
+
+int main(int argc, char* argv[])
+{
+    int porta_cliente = PORTA_CLIENTE;
+    int distancia_precarga = DISTANCIA_PRECARGA;
+    int num_trabalhadores = 0;
+    int limite_sessoes = MAX_SESSOES;
+
+    // Antes de qualquer thread, para que todas herdem os sinais do perfil bloqueados
+    if (perfil_iniciar() < 0) {
+        fprintf(stderr, "⚠️  Perfil desativado: não foi possível criar a thread de sinais\n");
+    }
+
+    printf("=== SERVIDOR CAÇA AO TESOURO ATIVO ===\n");
+
+    // Uma semente para o processo; cada partida segue a partir dela
+    semear_jogos(((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid());
+
+    // Distância opcional para começar a carregar um tesouro
+    if (argc > 1) {
+        distancia_precarga = atoi(argv[1]);
+    }
+
+    // Número opcional de trabalhadores (0 = um por núcleo)
+    if (argc > 2) {
+        num_trabalhadores = atoi(argv[2]);
+    }
+
+    // Limite opcional de sessões simultâneas (no máximo MAX_SESSOES)
+    if (argc > 3) {
+        limite_sessoes = atoi(argv[3]);
+        if (limite_sessoes <= 0 || limite_sessoes > MAX_SESSOES) {
+            limite_sessoes = MAX_SESSOES;
+        }
+    }
+
+    // Modo opcional de envio dos tesouros: auto, janela ou parada
+    if (argc > 4) {
+        if (strcmp(argv[4], "janela") == 0) {
+            modo_transferencia = MODO_JANELA;
+        } else if (strcmp(argv[4], "parada") == 0) {
+            modo_transferencia = MODO_PARADA;
+        } else if (strcmp(argv[4], "auto") != 0) {
+            fprintf(stderr, "🟡 Modo de transferência %s desconhecido, usando auto\n", argv[4]);
+        }
+    }
+
+    // Mapa do jogador no terminal sob demanda: o desenho limpa a tela a cada movimento
+    vista_mapa.ativo = getenv("MAPA_SERVIDOR") && atoi(getenv("MAPA_SERVIDOR")) > 0;
+
+    // Enlace perturbado sob demanda, para exercitar retransmissões e NACKs
+    if (perturbacao_iniciar(getenv("PERTURBACAO")) < 0) {
+        fprintf(stderr, "🔴 PERTURBACAO inválida: %s\n", getenv("PERTURBACAO"));
+        return 1;
+    }
+
+    // Mensagens das sessões formatadas e impressas fora dos trabalhadores e da transmissão
+    if (registro_iniciar() < 0) {
+        fprintf(stderr, "🟡 Sem registro assíncrono: as mensagens são impressas na hora\n");
+    }
+
+    // Cópia dos frames em pcap sob demanda, para investigar transferências travadas
+    if (captura_iniciar(getenv("CAPTURA")) < 0) {
+        fprintf(stderr, "🔴 Não foi possível capturar em %s\n", getenv("CAPTURA"));
+        perturbacao_finalizar();
+        return 1;
+    }
+
+    // Abrir o socket compartilhado pelas sessões
+    if (iniciar_escuta(porta_cliente) < 0) {
+        fprintf(stderr, "Erro ao iniciar o servidor\n");
+        return 1;
+    }
+
+    printf("Servidor iniciado na porta %d\n", PORTA_SERVIDOR);
+
+    if (sessoes_iniciar(&sessoes, &escuta, encerrar_transferencia) < 0) {
+        fprintf(stderr, "🔴 Erro ao criar a tabela de sessões\n");
+        finalizar_protocolo(&escuta);
+        return 1;
+    }
+
+    if (precarga_iniciar(&precarga, distancia_precarga) < 0) {
+        fprintf(stderr, "🔴 Erro ao iniciar a pré-carga\n");
+        sessoes_finalizar(&sessoes);
+        finalizar_protocolo(&escuta);
+        return 1;
+    }
+
+    // Ritmo da interface: o padrão da tabela ou o da variável RITMO
+    ritmo_interface_t ritmo;
+    if (transmissor_ritmo(&ritmo, escuta.rawsock.interface, getenv("RITMO")) < 0) {
+        fprintf(stderr, "🔴 RITMO inválido: %s\n", getenv("RITMO"));
+        precarga_finalizar(&precarga);
+        sessoes_finalizar(&sessoes);
+        finalizar_protocolo(&escuta);
+        return 1;
+    }
+
+    // Estágio de transmissão: os trabalhadores só enfileiram, uma thread faz os envios no ritmo da interface
+    if (transmissor_iniciar(&transmissor, &sessoes.quadros, &ritmo, MAX_SESSOES) < 0) {
+        fprintf(stderr, "🔴 Erro ao iniciar a transmissão\n");
+        precarga_finalizar(&precarga);
+        sessoes_finalizar(&sessoes);
+        finalizar_protocolo(&escuta);
+        return 1;
+    }
+
+    if (transmissor.ritmo.taxa_global || transmissor.ritmo.taxa_sessao) {
+        printf("🟢 Ritmo de envio em %s: %llu KB/s no total, %llu KB/s por sessão, rajada de %llu bytes%s\n",
+               escuta.rawsock.interface, (unsigned long long)transmissor.ritmo.taxa_global / 1000,
+               (unsigned long long)transmissor.ritmo.taxa_sessao / 1000,
+               (unsigned long long)transmissor.ritmo.rajada, getenv("RITMO") ? " (RITMO)" : "");
+    }
+
+    if (trabalho_iniciar(&pool, num_trabalhadores) < 0) {
+        fprintf(stderr, "🔴 Erro ao iniciar os trabalhadores\n");
+        transmissor_finalizar(&transmissor);
+        precarga_finalizar(&precarga);
+        sessoes_finalizar(&sessoes);
+        finalizar_protocolo(&escuta);
+        return 1;
+    }
+    printf("🟢 %d trabalhadores processando as sessões\n", pool.num_trabalhadores);
+    printf("🟢 Até %d sessões e %d transferências simultâneas\n", limite_sessoes, MAX_TRANSFERENCIAS);
+    if (modo_transferencia != MODO_AUTOMATICO) {
+        printf("🟢 Tesouros enviados %s\n", modo_transferencia == MODO_PARADA ? "frame a frame (pare e espere)"
+                                                                            : "só pela janela, sem fluxos paralelos");
+    }
+
+    // Sessões de antes de um reinício continuam de onde pararam, sem novo MSG_START
+    int restauradas = sessoes_persistir(&sessoes, ARQUIVO_SESSOES, retomar_sessao);
+    if (restauradas < 0) {
+        fprintf(stderr, "🟡 Sem instantâneo das sessões em %s: elas não sobrevivem a um reinício\n", ARQUIVO_SESSOES);
+    } else if (restauradas > 0) {
+        printf("🟢 %d sessões retomadas do instantâneo\n", restauradas);
+    }
+
+    if (metricas_servir(SOCKET_METRICAS, &escuta.rawsock, escrever_sessoes) < 0) {
+        fprintf(stderr, "🟡 Sem socket de métricas em %s\n", SOCKET_METRICAS);
+    } else {
+        printf("🟢 Métricas em %s\n", SOCKET_METRICAS);
+    }
+
+    printf("\nAguardando conexão dos clientes...\n");
+
+    // Loop principal do servidor: só recebe e despacha (estágio de recepção)
+    // Prazos vencidos e frames recebidos viram eventos das sessões, processados pelos trabalhadores,
+    // que entregam as respostas à thread de transmissão
+    // Os frames são recebidos direto em um buffer do slab, que segue com o evento até o trabalhador
+    // Todos os prazos estão na roda de temporizadores: o poll acorda pelo socket ou pelo timerfd dela
+    struct pollfd espera[2];
+    espera[0].fd = escuta.rawsock.sockfd;
+    espera[0].events = POLLIN;
+    espera[1].fd = sessoes.roda.fd;
+    espera[1].events = POLLIN;
+    quadro_t* recebido = NULL;
+    while (1) {
+        if (poll(espera, 2, -1) < 0) {
+            continue;   // Interrompido por sinal
+        }
+
+        if (espera[1].revents & POLLIN) {
+            sessoes_disparar(&sessoes, sessoes_agora_ms(), entregar_prazo);
+        }
+        desenhar_mapa();
+        if (!(espera[0].revents & POLLIN)) {
+            continue;
+        }
+
+        PERFIL_ESCOPO(PERFIL_DESPACHAR_FRAME);
+        if (!recebido && !(recebido = quadro_alocar(&sessoes.quadros))) {
+            // Não acontece com QUADROS_SESSOES frames, mas sem buffer não há onde receber
+            REG_ERRO("🔴 Sem frames livres para recepção\n");
+            struct timespec pausa = { 0, ESPERA_DESPACHO_MS * 1000000L };
+            nanosleep(&pausa, NULL);
+            continue;
+        }
+
+        // O socket está legível: a leitura não espera
+        if (receber_pacote(&escuta, &recebido->pack) < 0) {
+            continue; // Continuar aguardando próxima mensagem (o frame fica para a próxima)
+        }
+
+        // Admissão: no limite de sessões ou com o servidor sobrecarregado, o cliente novo é
+        // recusado com uma espera
+        sessao_t* sessao = sessoes_admitir(&sessoes, escuta.ip_remetente, escuta.porta_remetente,
+                                           limite_sessoes, sobrecarregado);
+        if (!sessao) {
+            recusar_cliente(&recebido->pack, escuta.ip_remetente, escuta.porta_remetente);
+            continue;   // O frame fica para a próxima recepção
+        }
+        __atomic_store_n(&sessao->ultimo_contato, time(NULL), __ATOMIC_RELAXED);
+        METRICA_SOMAR(sessao->metricas.recebidos, 1);
+        METRICA_SOMAR(sessao->metricas.bytes_recebidos, 4 + recebido->pack.tamanho);
+        entregar_evento(sessao, EVENTO_FRAME, recebido);
+        recebido = NULL;
+    }
+
+    metricas_finalizar();
+    trabalho_finalizar(&pool);
+    transmissor_finalizar(&transmissor);
+    perturbacao_finalizar();
+    quadro_soltar(&sessoes.quadros, recebido);
+    precarga_finalizar(&precarga);
+    sessoes_finalizar(&sessoes);
+    finalizar_protocolo(&escuta);
+    captura_finalizar();
+    registro_finalizar();
+    return 0;
+}
+
+int iniciar_escuta(int porta) {
+    const char* interface = INTERFACE_PADRAO;
+    // Inicializar protocolo com raw socket; o destino de cada resposta vem da sessão
+    if (inicializar_protocolo(&escuta, "0.0.0.0", PORTA_SERVIDOR, porta, interface) < 0) {
+        fprintf(stderr, "🔴Erro ao inicializar protocolo do servidor\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int sobrecarregado(void) {
+    return trabalho_pendentes(&pool) > LIMITE_TAREFAS || transmissor_pendentes(&transmissor) > LIMITE_TRANSMISSAO;
+}
+
+
+// Espera sugerida a um cliente recusado, espalhada pelo endereço para as novas tentativas não chegarem juntas
+static uint16_t espera_ocupado(unsigned int ip, unsigned short porta) {
+    return (uint16_t)(ESPERA_OCUPADO_MS + (ip ^ porta) % (ESPERA_OCUPADO_MS / 2));
+}
+
+
+void recusar_cliente(const pack_t* pack, unsigned int ip, unsigned short porta) {
+    protocolo_type destino;
+    if (vincular_protocolo(&destino, &escuta, ip, porta) < 0) {
+        return;
+    }
+    quadro_t* quadro = quadro_alocar(&sessoes.quadros);
+    if (!quadro) {
+        return;     // O cliente repete o frame pelo timeout
+    }
+    criar_erro_ocupado(&quadro->pack, getSeq(*pack), espera_ocupado(ip, porta));
+    if (transmissor_enviar(&transmissor, quadro, &destino.rawsock, SEM_REMETENTE) < 0) {
+        quadro_soltar(&sessoes.quadros, quadro);
+    }
+}
+
+
+void entregar_evento(sessao_t* sessao, evento_sessao_type tipo, quadro_t* quadro) {
+    int resultado = sessao_entregar(sessao, tipo, quadro);
+    if (resultado < 0) {
+        // Fila da sessão cheia: frames o cliente retransmite, prazos são tentados de novo
+        quadro_soltar(&sessoes.quadros, quadro);
+        if (tipo == EVENTO_PRAZO) {
+            sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + ESPERA_DESPACHO_MS);
+        }
+        return;
+    }
+    if (resultado == 1 && trabalho_enviar(&pool, executar_sessao, sessao) < 0) {
+        executar_sessao(sessao);
+    }
+}
+
+
+void entregar_prazo(sessao_t* sessao) {
+    entregar_evento(sessao, EVENTO_PRAZO, NULL);
+}
+
+
+// A sessão como remetente dos frames na fila do transmissor
+static remetente_t remetente_sessao(const sessao_t* sessao) {
+    remetente_t remetente = { (int)(sessao - sessoes.sessoes), sessao->geracao };
+    return remetente;
+}
+
+
+void executar_sessao(void* argumento) {
+    sessao_t* sessao = (sessao_t*)argumento;
+
+    do {
+        evento_sessao_t evento;
+        while (sessao_proximo_evento(sessao, &evento)) {
+            if (__atomic_load_n(&sessao->falhou, __ATOMIC_ACQUIRE) ||
+                transmissor_falhou(&transmissor, remetente_sessao(sessao))) {
+                // Envio falhou na thread de transmissão: pedir a remoção
+                __atomic_store_n(&sessao->falhou, 1, __ATOMIC_RELEASE);
+                quadro_soltar(&sessoes.quadros, evento.quadro);
+                sessoes_falhou(&sessoes, sessao);
+                continue;
+            }
+
+            if (sessao->jogo_pendente) {
+                setup_jogo(&sessao->jogo);
+                sessao->jogo_alterado = 1;
+                sessao->jogo_pendente = 0;
+            }
+
+            int resultado;
+            if (evento.tipo == EVENTO_FRAME) {
+                {
+                    PERFIL_ESCOPO(PERFIL_PROCESSAR_FRAME);
+                    resultado = gerenciar_mensagem_cliente(sessao, &evento.quadro->pack);
+                }
+                quadro_soltar(&sessoes.quadros, evento.quadro);
+            } else if (sessoes_agendada(&sessoes, sessao)) {
+                continue;   // A sessão reagendou depois que este prazo disparou
+            } else {
+                PERFIL_ESCOPO(PERFIL_PROCESSAR_PRAZO);
+                resultado = gerenciar_prazo(sessao);
+            }
+
+            if (resultado == -4) {
+                // Falha de envio para este cliente: a thread principal remove a sessão, as demais continuam
+                __atomic_store_n(&sessao->falhou, 1, __ATOMIC_RELEASE);
+                sessoes_falhou(&sessoes, sessao);
+                continue;
+            }
+            sessoes_gravar(&sessoes, sessao);
+        }
+    } while (sessao_liberar(sessao));
+}
+
+
+// Reabre o arquivo da transferência restaurada e refaz o digest do que o cliente já recebeu
+// A pré-carga não sobrevive ao reinício: os dados passam a vir do arquivo
+static int reabrir_transferencia(sessao_t* sessao, uint64_t posicao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    tesouro_t* tesouro = &sessao->jogo.tesouros[transferencia->indice_tesouro];
+
+    transferencia->arquivo = fopen(tesouro->patch, "rb");
+    if (!transferencia->arquivo) {
+        return -1;
+    }
+    if (sessao->estado == SESSAO_AGUARDA_ACK && sessao->etapa == ETAPA_NOME) {
+        return 0;   // O digest começa com os dados
+    }
+    // Os fluxos refazem o digest dos seus trechos; o do arquivo junta os deles no fim
+    if (sessao->estado == SESSAO_MULTIFLUXO) {
+        uint32_t num_blocos = digest_num_blocos(transferencia->tamanho);
+        uint64_t* tabela = arena_alocar(&sessao->arena, (size_t)num_blocos * sizeof(uint64_t));
+        if (digest_iniciar_em(&transferencia->digest, transferencia->tamanho, tabela, tabela ? num_blocos : 0) < 0) {
+            return -1;
+        }
+        transferencia->tem_digest = 1;
+        return 0;
+    }
+
+    uint32_t num_blocos = digest_num_blocos(transferencia->tamanho);
+    uint64_t* tabela = arena_alocar(&sessao->arena, (size_t)num_blocos * sizeof(uint64_t));
+    if (digest_iniciar_em(&transferencia->digest, transferencia->tamanho, tabela, tabela ? num_blocos : 0) < 0) {
+        return -1;
+    }
+    transferencia->tem_digest = 1;
+
+    // Nos dados, o digest vai até o último frame enviado; depois do fim, cobre o arquivo inteiro
+    uint64_t limite = transferencia->tamanho;
+    if (sessao->etapa == ETAPA_DADOS) {
+        limite = transferencia->enviados;
+        posicao = transferencia->enviados;
+    }
+    uint8_t buffer[16384];
+    while (transferencia->digest.processados < limite) {
+        uint64_t restante = limite - transferencia->digest.processados;
+        size_t lidos = fread(buffer, 1, restante < sizeof(buffer) ? (size_t)restante : sizeof(buffer),
+                             transferencia->arquivo);
+        if (lidos == 0) {
+            return -1;
+        }
+        digest_atualizar(&transferencia->digest, buffer, lidos);
+    }
+    return fseek(transferencia->arquivo, (long)posicao, SEEK_SET);
+}
+
+
+// Fluxo paralelo: o frame entra na fila do transmissor com o ritmo da sessão
+// Sai pelo socket da escuta, que vive mais que os sockets dos fluxos (o frame pode ficar na fila)
+static int enviar_quadro_fluxo(void* contexto, const rawsocket_t* destino, const pack_t* pack) {
+    sessao_t* sessao = (sessao_t*)contexto;
+    quadro_t* quadro = quadro_alocar(&sessoes.quadros);
+    if (!quadro) {
+        return -1;
+    }
+    quadro->pack = *pack;
+
+    rawsocket_t saida = *destino;
+    saida.sockfd = escuta.rawsock.sockfd;
+    METRICA_SOMAR(sessao->metricas.enviados, 1);
+    METRICA_SOMAR(sessao->metricas.bytes_enviados, 4 + pack->tamanho);
+    if (transmissor_enviar(&transmissor, quadro, &saida, remetente_sessao(sessao)) < 0) {
+        quadro_soltar(&sessoes.quadros, quadro);
+        return -1;
+    }
+    return 0;
+}
+
+
+// ACK em um fluxo paralelo: o canal principal fica quieto durante a transferência
+static void fluxo_confirmado(void* contexto) {
+    sessao_t* sessao = (sessao_t*)contexto;
+    __atomic_store_n(&sessao->ultimo_contato, time(NULL), __ATOMIC_RELAXED);
+}
+
+
+// Saída dos fluxos paralelos da sessão
+static saida_fluxos_t saida_fluxos(sessao_t* sessao) {
+    saida_fluxos_t saida = { enviar_quadro_fluxo, fluxo_confirmado, sessao };
+    return saida;
+}
+
+
+void retomar_sessao(sessao_t* sessao, const registro_sessao_t* registro) {
+    transferencia_t* transferencia = &sessao->transferencia;
+
+    if (sessao->estado == SESSAO_AGUARDA_ACK && sessao->etapa == ETAPA_DADOS) {
+        // A janela recomeça do último frame confirmado e com o tamanho máximo: o cliente pode
+        // ter recebido frames que o servidor não viu confirmados, e o ACK deles precisa cair na janela
+        transferencia->confirmados = transferencia->enviados;
+        congestionamento_iniciar(&transferencia->congestionamento);
+        transferencia->congestionamento.janela = JANELA_MAXIMA * ESCALA_JANELA;
+    } else if (sessao->estado == SESSAO_AGUARDA_ACK && !sessao->pendente) {
+        sessao->estado = SESSAO_OCIOSA;
+        return;
+    }
+
+    // Tesouro já aceito antes do reinício: ocupa a vaga mesmo acima do limite
+    if (sessao->estado != SESSAO_OCIOSA && !(sessao->estado == SESSAO_AGUARDA_ACK && sessao->etapa == ETAPA_MAPA)) {
+        __atomic_add_fetch(&transferencias_ativas, 1, __ATOMIC_ACQ_REL);
+        transferencia->tem_vaga = 1;
+    }
+
+    int com_arquivo = sessao->estado == SESSAO_AGUARDA_PEDIDO || sessao->estado == SESSAO_MULTIFLUXO ||
+                      (sessao->estado == SESSAO_AGUARDA_ACK && sessao->etapa >= ETAPA_NOME);
+    if (com_arquivo && reabrir_transferencia(sessao, registro->posicao_arquivo) < 0) {
+        fprintf(stderr, "🔴 Erro ao reabrir o tesouro da sessão restaurada\n");
+        encerrar_transferencia(sessao);
+        sessao->estado = SESSAO_OCIOSA;
+        return;
+    }
+
+    // A faixa de portas já foi informada ao cliente no frame do nome
+    if (transferencia->faixa_fluxos >= 0) {
+        __atomic_store_n(&faixas_fluxos[transferencia->faixa_fluxos], 1, __ATOMIC_RELEASE);
+    }
+
+    // Novas threads para os fluxos paralelos, cada uma a partir do último ACK que recebeu
+    if (sessao->estado == SESSAO_MULTIFLUXO) {
+        saida_fluxos_t saida = saida_fluxos(sessao);
+        if (multifluxo_iniciar_envio(&transferencia->multi, sessao->protocolo.ip_destino, sessao->porta,
+                                     PORTA_BASE_FLUXOS(transferencia->faixa_fluxos), fileno(transferencia->arquivo),
+                                     NULL, transferencia->tamanho, transferencia->num_fluxos,
+                                     sessoes_progresso_fluxos(&sessoes, sessao), &saida) < 0) {
+            fprintf(stderr, "🔴 Erro ao retomar os fluxos paralelos\n");
+            encerrar_transferencia(sessao);
+            sessao->estado = SESSAO_OCIOSA;
+            return;
+        }
+        sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + ESPERA_FLUXOS_MS);
+        return;
+    }
+
+    // Repetir o pendente já, sem esperar o prazo
+    if (sessao->estado == SESSAO_AGUARDA_ACK || sessao->estado == SESSAO_AGUARDA_CARGA) {
+        sessoes_agendar(&sessoes, sessao, sessoes_agora_ms());
+    }
+}
+
+
+// Vaga para mais um envio de tesouro: recusada no limite de transferências ou com o servidor sobrecarregado
+static int reservar_transferencia(transferencia_t* transferencia) {
+    if (sobrecarregado()) {
+        return 0;
+    }
+    int ativas = __atomic_load_n(&transferencias_ativas, __ATOMIC_RELAXED);
+    do {
+        if (ativas >= MAX_TRANSFERENCIAS) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&transferencias_ativas, &ativas, ativas + 1, 0, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+    transferencia->tem_vaga = 1;
+    return 1;
+}
+
+
+static void liberar_transferencia(transferencia_t* transferencia) {
+    if (transferencia->tem_vaga) {
+        __atomic_sub_fetch(&transferencias_ativas, 1, __ATOMIC_ACQ_REL);
+        transferencia->tem_vaga = 0;
+    }
+}
+
+
+// Faixa de portas livre para os fluxos paralelos (-1 se todas estão em uso)
+static int reservar_faixa_fluxos(void) {
+    for (int i = 0; i < MAX_TRANSFERENCIAS_MULTIFLUXO; i++) {
+        int livre = 0;
+        if (__atomic_compare_exchange_n(&faixas_fluxos[i], &livre, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static void liberar_faixa_fluxos(transferencia_t* transferencia) {
+    if (transferencia->faixa_fluxos >= 0) {
+        __atomic_store_n(&faixas_fluxos[transferencia->faixa_fluxos], 0, __ATOMIC_RELEASE);
+        transferencia->faixa_fluxos = -1;
+    }
+}
+
+
+static int eh_confirmacao(mensagem_type tipo) {
+    return tipo == MSG_ACK || tipo == MSG_NACK || tipo == MSG_OK_ACK;
+}
+
+
+// Passa o frame (e a referência) para a thread de transmissão
+// Sem ela, envia daqui mesmo; falhas de envio marcam a sessão para remoção
+static int transmitir(sessao_t* sessao, quadro_t* quadro) {
+    METRICA_SOMAR(sessao->metricas.enviados, 1);
+    METRICA_SOMAR(sessao->metricas.bytes_enviados, 4 + quadro->pack.tamanho);
+    if (transmissor_enviar(&transmissor, quadro, &sessao->protocolo.rawsock, remetente_sessao(sessao)) == 0) {
+        return 0;
+    }
+    int resultado = enviar_pacote(&sessao->protocolo, &quadro->pack);
+    quadro_soltar(&sessoes.quadros, quadro);
+    return resultado;
+}
+
+
+// Transmite uma cópia do pacote (respostas guardadas na sessão e erros)
+static int transmitir_copia(sessao_t* sessao, const pack_t* pack) {
+    quadro_t* quadro = quadro_alocar(&sessoes.quadros);
+    if (!quadro) {
+        return enviar_pacote(&sessao->protocolo, pack);
+    }
+    quadro->pack = *pack;
+    return transmitir(sessao, quadro);
+}
+
+
+// Frame do slab para o próximo pacote pendente
+static quadro_t* novo_quadro(void) {
+    quadro_t* quadro = quadro_alocar(&sessoes.quadros);
+    if (!quadro) {
+        REG_ERRO("🔴 Sem frames livres para a sessão\n");
+    }
+    return quadro;
+}
+
+
+// Próxima retransmissão no prazo medido pelo RTT do cliente
+static void agendar_retransmissao(sessao_t* sessao) {
+    sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + retransmissao_prazo_ms(&sessao->retransmissao));
+}
+
+
+// RTT de um frame confirmado sem ter sido repetido: vai para as métricas e para o prazo
+static void medir_rtt(sessao_t* sessao, int64_t envio_us) {
+    int64_t rtt_us = metricas_agora_us() - envio_us;
+    histograma_registrar(&metricas.rtt_us, (uint64_t)rtt_us);
+    retransmissao_medir(&sessao->retransmissao, rtt_us);
+}
+
+
+// Envia o pacote e passa a aguardar a confirmação, retransmitindo no prazo
+// A sessão fica com a referência do frame, que substitui o pendente anterior
+// A etapa define o que fazer quando o ACK chegar
+static int enviar_com_confirmacao(sessao_t* sessao, quadro_t* quadro, etapa_sessao_type etapa) {
+    quadro_soltar(&sessoes.quadros, sessao->pendente);
+    sessao->pendente = quadro;
+    sessao->pendente_us = metricas_agora_us();
+    sessao->etapa = etapa;
+    sessao->estado = SESSAO_AGUARDA_ACK;
+    agendar_retransmissao(sessao);
+    return transmitir(sessao, quadro_reter(quadro));
+}
+
+
+// Frames repetidos para o cliente; o pendente deixa de valer para o RTT (não se sabe qual cópia foi confirmada)
+static void contar_retransmissao(sessao_t* sessao, int frames) {
+    METRICA_SOMAR(metricas.retransmissoes, frames);
+    METRICA_SOMAR(sessao->metricas.retransmissoes, frames);
+    sessao->pendente_us = 0;
+}
+
+
+// Repete o último pacote pendente, se houver (confirmações não são repetidas)
+static int reenviar_pendente(sessao_t* sessao) {
+    if (!sessao->pendente || eh_confirmacao(sessao->pendente->pack.tipo)) {
+        return 0;
+    }
+    contar_retransmissao(sessao, 1);
+    return transmitir(sessao, quadro_reter(sessao->pendente));
+}
+
+
+// Responde um comando do cliente, guardando a resposta caso ele repita o comando
+static int responder_comando(sessao_t* sessao, uint8_t seq, mensagem_type tipo) {
+    criar_pacote(&sessao->resposta, seq, tipo, NULL, 0);
+    sessao->tem_resposta = 1;
+    return transmitir_copia(sessao, &sessao->resposta);
+}
+
+
+// Envia MSG_ERRO ao cliente
+static int responder_erro(sessao_t* sessao, uint8_t seq, erro_type erro) {
+    pack_t pack;
+    uint8_t dados_erro = (uint8_t)erro;
+    criar_pacote(&pack, seq, MSG_ERRO, &dados_erro, 1);
+    return transmitir_copia(sessao, &pack);
+}
+
+
+// Comando recusado por sobrecarga: a sequência volta atrás para o cliente repetir o mesmo comando
+static int recusar_comando(sessao_t* sessao) {
+    pack_t pack;
+    criar_erro_ocupado(&pack, sessao->protocolo.seq_atual, espera_ocupado(sessao->ip, sessao->porta));
+    sessao->protocolo.seq_atual = (uint8_t)((sessao->protocolo.seq_atual + 31) % 32);
+    return transmitir_copia(sessao, &pack);
+}
+
+
+// Tempo desde o tesouro encontrado até o cliente confirmar o arquivo (sessões retomadas não medem)
+static void registrar_transferencia(sessao_t* sessao) {
+    if (sessao->transferencia.inicio_us > 0) {
+        uint64_t decorrido_us = (uint64_t)(metricas_agora_us() - sessao->transferencia.inicio_us);
+        histograma_registrar(&metricas.transferencia_ms, decorrido_us / 1000);
+        SONDA(transferencia_fim, sessao->transferencia.tamanho, decorrido_us, sessao->transferencia.indice_tesouro,
+              SONDA_SESSAO(sessao->ip, sessao->porta));
+    }
+}
+
+
+// Encerra a transferência e volta a aguardar comandos; reinicia o jogo se todos os tesouros saíram
+static int concluir_transferencia(sessao_t* sessao) {
+    encerrar_transferencia(sessao);
+    sessoes_desagendar(&sessoes, sessao);
+    sessao->estado = SESSAO_OCIOSA;
+
+    // Verificar se jogo terminou
+    if (sessao->jogo.tesouros_achados >= MAX_TESOUROS) {
+        REG_INFO("🟢 Missão cumprida! Tesouros coletados com sucesso!\n");
+
+        REG_INFO("Reiniciando...\n");
+        setup_jogo(&sessao->jogo);
+        sessao->jogo_alterado = 1;
+        publicar_mapa(sessao);
+        precarga_atualizar(&precarga, &sessao->jogo);
+    }
+    return 0;
+}
+
+
+// Envia o próximo frame da tabela de CRCs de bloco
+// Com a tabela completa, a sessão passa a aguardar os pedidos de reenvio
+static int transmitir_tabela_blocos(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    digest_arquivo_t* digest = &transferencia->digest;
+    uint32_t primeiro = transferencia->proximo_bloco;
+    if (primeiro >= digest->num_blocos) {
+        sessao->estado = SESSAO_AGUARDA_PEDIDO;
+        return 1;
+    }
+
+    struct_frame_tabela tabela;
+    memset(&tabela, 0, sizeof(tabela));
+    tabela.subtipo = FIM_TABELA;
+    tabela.primeiro_bloco = primeiro;
+    tabela.quantidade = 0;
+    while (tabela.quantidade < CRC_POR_FRAME && primeiro + tabela.quantidade < digest->num_blocos) {
+        tabela.crc64[tabela.quantidade] = digest->crc_blocos[primeiro + tabela.quantidade];
+        tabela.quantidade++;
+    }
+    quadro_t* quadro = novo_quadro();
+    if (!quadro) {
+        return -1;
+    }
+    transferencia->proximo_bloco += tabela.quantidade;
+
+    sessao->protocolo.seq_atual = (sessao->protocolo.seq_atual + 1) % 32;
+    criar_pacote(&quadro->pack, sessao->protocolo.seq_atual, MSG_FIM_ARQUIVO, (uint8_t*)&tabela, sizeof(tabela));
+    return enviar_com_confirmacao(sessao, quadro, ETAPA_TABELA);
+}
+
+
+// Envia o próximo frame do intervalo pedido pelo cliente após falha no digest
+static int transmitir_intervalo(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    if (transferencia->restante_intervalo == 0) {
+        sessao->estado = SESSAO_AGUARDA_PEDIDO;
+        return 1;
+    }
+
+    quadro_t* quadro = novo_quadro();
+    if (!quadro) {
+        return -1;
+    }
+
+    uint8_t buffer[MAX_FRAME];
+    size_t ler = transferencia->restante_intervalo < MAX_FRAME ? transferencia->restante_intervalo : MAX_FRAME;
+    size_t bytes_lidos = fread(buffer, 1, ler, transferencia->arquivo);
+    if (bytes_lidos == 0) {
+        quadro_soltar(&sessoes.quadros, quadro);
+        concluir_transferencia(sessao);
+        return -1;
+    }
+    transferencia->restante_intervalo -= bytes_lidos;
 
-// Variáveis globais
-protocolo_type estado_servidor;
-struct_jogo jogo;
+    sessao->protocolo.seq_atual = (sessao->protocolo.seq_atual + 1) % 32;
+    criar_pacote(&quadro->pack, sessao->protocolo.seq_atual, MSG_DADOS, buffer, bytes_lidos);
+    return enviar_com_confirmacao(sessao, quadro, ETAPA_INTERVALO);
+}
 
-//////////// Protótipos das funções ////////////
 
-// Conecta cliente com servidor
-int conectar_cliente(const char* ip_servidor, int porta);
+// Pacote pendente confirmado: segue para a próxima etapa
+static int avancar_sessao(sessao_t* sessao) {
+    switch (sessao->etapa) {
+        case ETAPA_MAPA:
+            sessao->estado = SESSAO_OCIOSA;
+            return 1;
 
-// Processa a mensagem recebida do cliente pelo socket e executa ações de jogo conforme o tipo de mensagem
-int gerenciar_mensagem_cliente();
+        case ETAPA_MAPA_TESOURO:
+            return transmitir_tesouro(sessao);
 
-//  Processa o movimento solicitado e atualiza a posição do jogador, envia o mapa atualizado ou o tesouro se encontrado
-int gerenciar_movimento(mensagem_type direcao);
+        case ETAPA_TAMANHO: {
+            uint64_t tamanho_lido;
+            memcpy(&tamanho_lido, sessao->jogo.tesouros[sessao->transferencia.indice_tesouro].tamanho, sizeof(uint64_t));
+            REG_DEPURACAO("Arquivo possui = = %llu bytes\n", (unsigned long long)tamanho_lido);
+            return transmitir_arquivo_tesouro(sessao);
+        }
 
-// Prepara o pacote com o mapa atualizado e envia ao cliente, informa posição do jogador e se encontrou tesouro
-int transmitir_mapa_cliente();
+        case ETAPA_NOME:
+            return iniciar_dados_tesouro(sessao);
 
-// Envia informações do tesouro encontrado para o cliente
-// Depois transmite o arquivo associado ao tesouro
-int transmitir_tesouro(int indice_tesouro);
+        case ETAPA_DADOS:
+            return transmitir_janela_dados(sessao);
 
-// Envia o nome e o conteúdo do arquivo de tesouro para o cliente
-// Realiza o envio em blocos, aguardando ACK para cada pacote
-int transmitir_arquivo_tesouro(const char* caminho_arquivo, const char* nome_tesouro, mensagem_type tipo);
+        case ETAPA_FIM:
+            REG_INFO("🟢 Cliente confirmou o CRC-64 do arquivo\n");
+            registrar_transferencia(sessao);
+            return concluir_transferencia(sessao);
 
-// Exibe no terminal o log do movimento do jogador
-// Mostra horário, direção, posição e quantidade de tesouros
-void imprimir_movimento(const char* direcao, int sucesso);
+        case ETAPA_TABELA:
+            return transmitir_tabela_blocos(sessao);
 
-// Verifica se existe um tesouro na posição informada
-// Retorna 1 se existir, ou 0 caso contrário
-int checar_tesouro_posicao(tesouro_t treasures[MAX_TESOUROS], posicao_t pos);
+        case ETAPA_INTERVALO:
+            return transmitir_intervalo(sessao);
+    }
+    return 0;
+}
 
 
-int main(int argc, char* argv[]) 
-{
-    int porta_servidor = PORTA_CLIENTE;
-    char ip_servidor[16];
+// Sequência do frame mais antigo em voo
+static uint8_t base_janela(sessao_t* sessao) {
+    return (uint8_t)((sessao->protocolo.seq_atual + 32 - sessao->transferencia.em_voo + 1) % 32);
+}
 
-    printf("=== SERVIDOR CAÇA AO TESOURO ATIVO ===\n");
-    
-    // Obter IP do servidor
-    if (argc > 1) {
-        strcpy(ip_servidor, argv[1]);
-    } else {
-        printf("Digite o IP do cliente: ");
-        if (scanf("%15s", ip_servidor) != 1) {
-            fprintf(stderr, "Erro ao ler IP do cliente\n");
-            return 1;
+
+// Solta os frames confirmados do início da janela
+static void deslizar_janela(transferencia_t* transferencia, int frames) {
+    for (int i = 0; i < frames; i++) {
+        transferencia->confirmados += transferencia->janela[i]->pack.tamanho;
+        quadro_soltar(&sessoes.quadros, transferencia->janela[i]);
+    }
+    memmove(transferencia->janela, transferencia->janela + frames,
+            (size_t)(transferencia->em_voo - frames) * sizeof(quadro_t*));
+    memmove(transferencia->envio_us, transferencia->envio_us + frames,
+            (size_t)(transferencia->em_voo - frames) * sizeof(int64_t));
+    transferencia->em_voo -= frames;
+}
+
+
+// Repete todos os frames em voo, a partir do mais antigo (Go-Back-N)
+static int reenviar_janela(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    agendar_retransmissao(sessao);
+    contar_retransmissao(sessao, transferencia->em_voo);
+    for (int i = 0; i < transferencia->em_voo; i++) {
+        transferencia->envio_us[i] = 0;
+        SONDA(reenvio, getSeq(transferencia->janela[i]->pack), transferencia->janela[i]->pack.tipo,
+              transferencia->janela[i]->pack.tamanho, SONDA_SESSAO(sessao->ip, sessao->porta));
+        if (transmitir(sessao, quadro_reter(transferencia->janela[i])) < 0) {
+            return -4;
         }
     }
+    return 0;
+}
 
 
-        // Conectar ao servidor
-    if (conectar_cliente(ip_servidor, porta_servidor) < 0) {
-        fprintf(stderr, "Erro ao conectar ao cliente\n");
+// Resposta com a contagem de bytes do cliente conferida contra os frames em voo
+// (sem contagem, como no ACK do nome ou de um cliente antigo, vale só a sequência)
+static int resposta_na_janela(transferencia_t* transferencia, const pack_t* pack, int distancia) {
+    if (pack->tamanho < sizeof(struct_frame_janela)) {
         return 1;
     }
-    
-    printf("Servidor iniciado na porta %d\n", PORTA_SERVIDOR);
-    
-    // Inicializar jogo    
-    setup_jogo(&jogo);
-    interface_servidor(&jogo);
-    
-    printf("\nAguardando conexão do cliente...\n");
-    
-    // Loop principal do servidor
-    while (1) {
-        int p = gerenciar_mensagem_cliente();
-        if (p == -4){
-            finalizar_protocolo(&estado_servidor);
-            reseta_interface();
-            perror("Erro fatal!!! Digite ENTER para matar o programa\n");
-            getchar();
+    struct_frame_janela resposta;
+    memcpy(&resposta, pack->dados, sizeof(resposta));
+    uint8_t tamanhos[JANELA_MAXIMA];
+    for (int i = 0; i < transferencia->em_voo; i++) {
+        tamanhos[i] = transferencia->janela[i]->pack.tamanho;
+    }
+    return janela_resposta_valida(transferencia->confirmados, tamanhos, transferencia->em_voo,
+                                  resposta.recebidos, pack->tipo == MSG_NACK, distancia);
+}
+
+
+// Resposta do cliente durante os dados: o ACK é cumulativo e desliza a janela
+// ACKs repetidos do último frame confirmado ou um NACK indicam perda
+static int gerenciar_janela(sessao_t* sessao, const pack_t* pack) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    uint8_t base = base_janela(sessao);
+    int distancia = janela_distancia(sessao->protocolo.seq_atual, transferencia->em_voo, getSeq(*pack));
+    int confirmados = distancia < transferencia->em_voo ? distancia + 1 : 0;
+
+    if (eh_confirmacao(pack->tipo) && !resposta_na_janela(transferencia, pack, distancia)) {
+        return 0;   // Resposta atrasada de outra volta: não desliza nem conta como duplicada
+    }
+
+    switch (pack->tipo) {
+        case MSG_ACK:
+        case MSG_OK_ACK:
+            if (pack->tamanho >= 1) {
+                congestionamento_anunciada(&transferencia->congestionamento, pack->dados[0]);
+            }
+            if (confirmados > 0) {
+                // RTT pelo frame mais novo confirmado, se ele não foi repetido
+                if (transferencia->envio_us[confirmados - 1] > 0) {
+                    medir_rtt(sessao, transferencia->envio_us[confirmados - 1]);
+                }
+                deslizar_janela(transferencia, confirmados);
+                transferencia->duplicados = 0;
+                congestionamento_confirmou(&transferencia->congestionamento, confirmados);
+                return transmitir_janela_dados(sessao);
+            }
+            // O cliente recebeu um frame fora de ordem: só uma retransmissão por perda
+            // (com a janela vazia à espera do disco não há o que repetir)
+            if (transferencia->em_voo > 0 && getSeq(*pack) == (base + 31) % 32 &&
+                ++transferencia->duplicados == DUPLICADOS_PERDA) {
+                congestionamento_perda(&transferencia->congestionamento);
+                return reenviar_janela(sessao);
+            }
+            return 0;
+
+        case MSG_NACK:
+            if (confirmados == 0) {
+                return 0;   // NACK atrasado de um frame já repetido
+            }
+            // Os frames antes do recusado chegaram em ordem
+            if (confirmados > 1) {
+                deslizar_janela(transferencia, confirmados - 1);
+            }
+            congestionamento_perda(&transferencia->congestionamento);
+            transferencia->duplicados = 0;
+            return reenviar_janela(sessao);
+
+        case MSG_ERRO:
+            // Cliente recusou o tesouro (sem espaço, por exemplo)
+            REG_ERRO("🔴 Cliente recusou o tesouro\n");
+            concluir_transferencia(sessao);
+            return -1;
+
+        default:
+            return 0;
+    }
+}
+
+
+// Resposta do cliente enquanto um pacote aguarda confirmação
+static int gerenciar_confirmacao(sessao_t* sessao, const pack_t* pack) {
+    if (sessao->etapa == ETAPA_DADOS) {
+        return gerenciar_janela(sessao, pack);
+    }
+
+    if (getSeq(*pack) != sessao->protocolo.seq_atual) {
+        // Confirmação atrasada de um pacote anterior
+        if (eh_confirmacao(pack->tipo)) {
             return 0;
         }
-        if (p < 0) {
-            continue; // Continuar aguardando próxima mensagem
-        }
-        
-        // Verificar se jogo terminou
-        if (jogo.tesouros_achados >= MAX_TESOUROS) {
-            printf("\n🟢 Missão cumprida! Tesouros coletados com sucesso!\n");
-            
-            printf("Reiniciando...\n");
-            setup_jogo(&jogo);
-            interface_servidor(&jogo);
+        // Frame seguinte do cliente: ele só o envia depois de receber o pacote pendente
+        // (mapa, fim do arquivo, último frame da tabela), então o ACK se perdeu e o frame vale como confirmação
+        if (seqCheck(sessao->protocolo.seq_atual, getSeq(*pack)) == 1) {
+            sessao->tem_resposta = 0;
+            sessoes_desagendar(&sessoes, sessao);
+            int resultado = avancar_sessao(sessao);
+            if (resultado < 0 || sessao->estado == SESSAO_AGUARDA_ACK) {
+                return resultado;
+            }
+            return gerenciar_mensagem_cliente(sessao, pack);
         }
+        // O cliente ainda não recebeu o pacote pendente
+        return reenviar_pendente(sessao);
+    }
+
+    switch (pack->tipo) {
+        case MSG_ACK:
+        case MSG_OK_ACK:
+            // O cliente só confirma depois de receber a resposta do comando anterior
+            sessao->tem_resposta = 0;
+            sessoes_desagendar(&sessoes, sessao);
+            if (sessao->pendente_us > 0) {
+                medir_rtt(sessao, sessao->pendente_us);
+                sessao->pendente_us = 0;
+            }
+            return avancar_sessao(sessao);
+
+        case MSG_NACK:
+            if (sessao->etapa == ETAPA_FIM) {
+                // Digest não confere: enviar o CRC de cada bloco para o cliente localizar o erro
+                REG_AVISO("🟡 Cliente reportou digest inválido, enviando tabela de blocos\n");
+                sessoes_desagendar(&sessoes, sessao);
+                sessao->transferencia.proximo_bloco = 0;
+                return transmitir_tabela_blocos(sessao);
+            }
+            return reenviar_pendente(sessao);
+
+        case MSG_ERRO:
+            // Cliente recusou o tesouro (sem espaço, por exemplo)
+            REG_ERRO("🔴 Cliente recusou o tesouro\n");
+            concluir_transferencia(sessao);
+            return -1;
+
+        default:
+            return 0;
     }
-    
-    finalizar_protocolo(&estado_servidor);
-    return 0;
 }
 
-int conectar_cliente(const char* ip_servidor, int porta) {
-    const char* interface = INTERFACE_PADRAO;
-    // Inicializar protocolo com raw socket
-    if (inicializar_protocolo(&estado_servidor, ip_servidor, PORTA_SERVIDOR, porta, interface) < 0) {
-        fprintf(stderr, "🔴Erro ao inicializar protocolo cliente\n");
+
+// Pedido de reenvio de intervalo, depois da tabela de blocos
+// Tamanho 0 encerra a verificação do arquivo
+static int gerenciar_pedido(sessao_t* sessao, const pack_t* pack) {
+    if (pack->tipo != MSG_FIM_ARQUIVO) {
+        return 0;
+    }
+
+    uint8_t seq = getSeq(*pack);
+    if (seqCheck(sessao->protocolo.seq_atual, seq) != 1) {
+        return 0;
+    }
+
+    struct_frame_pedido pedido;
+    memcpy(&pedido, pack->dados, sizeof(pedido));
+    if (pedido.subtipo != FIM_PEDIDO) {
+        return 0;
+    }
+
+    sessao->protocolo.seq_atual = seq;
+    if (responder_comando(sessao, seq, MSG_ACK) < 0) {
+        return -4;
+    }
+    if (pedido.tamanho == 0) {
+        REG_INFO("🟢 Cliente concluiu a verificação do arquivo\n");
+        registrar_transferencia(sessao);
+        return concluir_transferencia(sessao);
+    }
+
+    REG_INFO("Reenviando intervalo %llu (+%u bytes)\n", (unsigned long long)pedido.offset, pedido.tamanho);
+    if (fseek(sessao->transferencia.arquivo, (long)pedido.offset, SEEK_SET) != 0) {
+        concluir_transferencia(sessao);
         return -1;
     }
-    
-    return 0;
+    sessao->transferencia.restante_intervalo = pedido.tamanho;
+    return transmitir_intervalo(sessao);
 }
 
+
 // Processa a mensagem recebida do cliente pelo socket
-// Executa ações de jogo conforme o tipo de mensagem
-int gerenciar_mensagem_cliente() {
-    pack_t pack;
-    
-    // Receber frame do cliente
-    int result = receber_pacote(&estado_servidor, &pack);
-    if(jogo.partida_iniciada == 1){
-        int isSeq = seqCheck(estado_servidor.seq_atual , getSeq(pack));
-        switch(isSeq){
-            case 1:
-                break;
-            default:
-                if((pack.tipo == MSG_ACK)||(pack.tipo == MSG_NACK)||(pack.tipo == MSG_OK_ACK))
-                    return 0;
-                //fprintf(stderr, "Seq Esperado %u Seq recebido %u\n", ((estado_servidor.seq_atual+1)%32), getSeq(pack));
-                //estado_servidor.seq_atual = getSeq(pack);
+// Executa ações de jogo conforme o tipo de mensagem e o estado da sessão
+int gerenciar_mensagem_cliente(sessao_t* sessao, const pack_t* pack) {
+    uint8_t seq = getSeq(*pack);
 
-                return reenvio(&estado_servidor, estado_servidor.pack);
+    // Comando repetido: a resposta se perdeu, repetir ela e o pacote que veio depois
+    if (sessao->tem_resposta && !eh_confirmacao(pack->tipo) && seq == getSeq(sessao->resposta)) {
+        contar_retransmissao(sessao, 1);
+        if (transmitir_copia(sessao, &sessao->resposta) < 0) {
+            return -4;
         }
-
-        if (result < 0) {
-            if (result == -2) {
-                // Timeout normal
-                return 0;
-            }
-            return -1;
+        if (sessao->estado == SESSAO_AGUARDA_ACK && sessao->pendente) {
+            contar_retransmissao(sessao, 1);
+            return transmitir(sessao, quadro_reter(sessao->pendente));
         }
+        return 0;
+    }
 
+    // Cliente reiniciado na mesma porta: começa uma nova partida
+    if (pack->tipo == MSG_START && (sessao->jogo.partida_iniciada == 1 || sessao->estado != SESSAO_OCIOSA)) {
+        concluir_transferencia(sessao);
+        setup_jogo(&sessao->jogo);
+        sessao->jogo_alterado = 1;
+    }
 
-        // printf("RECEBIDO SEQ: %d \n", getSeq(pack));
-        // sleep(2);
-        estado_servidor.seq_atual = getSeq(pack);
-        // printf("ATUAL SEQ: %d \n", estado_servidor.seq_atual);
-    //        sleep(2);
+    switch (sessao->estado) {
+        case SESSAO_AGUARDA_ACK:
+            return gerenciar_confirmacao(sessao, pack);
+        case SESSAO_AGUARDA_PEDIDO:
+            return gerenciar_pedido(sessao, pack);
+        case SESSAO_AGUARDA_CARGA:
+        case SESSAO_MULTIFLUXO:
+            return 0;   // O cliente só volta a falar depois do próximo pacote do servidor
+        case SESSAO_OCIOSA:
+            break;
+    }
 
+    if(sessao->jogo.partida_iniciada == 1){
+        int isSeq = seqCheck(sessao->protocolo.seq_atual , seq);
+        if (isSeq != 1) {
+            if(eh_confirmacao(pack->tipo))
+                return 0;
+            //fprintf(stderr, "Seq Esperado %u Seq recebido %u\n", ((sessao->protocolo.seq_atual+1)%32), seq);
+            return reenviar_pendente(sessao);
+        }
     }
+    sessao->protocolo.seq_atual = seq;
 
     // Processar mensagem baseado no tipo
-    switch (pack.tipo) {
+    switch (pack->tipo) {
         case MSG_START:
-            printf("🟢 Solicitação de início do jogo recebida\n");
-            jogo.partida_iniciada = 1;
+            REG_INFO("🟢 Solicitação de início do jogo recebida\n");
+            sessao->jogo.partida_iniciada = 1;
+            sessao->jogo_alterado = 1;
 
-            // Enviar ACK com a mesma sequência recebida
-            if (enviar_ack(&estado_servidor, getSeq(pack)) < 0) {
-                printf("🔴 Erro crítico ao enviar ACK\n");
-                return -1;
+            // Enviar ACK com a mesma sequência recebida e depois o mapa inicial
+            if (responder_comando(sessao, seq, MSG_ACK) < 0) {
+                REG_ERRO("🔴 Erro crítico ao enviar ACK\n");
+                return -4;
             }
-            while(1){
-                // Enviar mapa inicial com nova sequência
-                estado_servidor.seq_atual = (getSeq(pack) + 1) % 32;
+            return transmitir_mapa_cliente(sessao, ETAPA_MAPA);
 
-                if (transmitir_mapa_cliente() < 0) {
-                    sleep(TIMEOUT_S);
-                    continue;
-                }
-                if(esperar_ack(&estado_servidor) < 0){
-                    continue;
-                }
-                else
-                    break;
-            }
-            return 1;
-            
         case MSG_MOVE_DIREITA:
 
-            return gerenciar_movimento(MSG_MOVE_DIREITA);
-            
+            return gerenciar_movimento(sessao, MSG_MOVE_DIREITA);
+
         case MSG_MOVE_ESQUERDA:
 
-            return gerenciar_movimento(MSG_MOVE_ESQUERDA);
-            
+            return gerenciar_movimento(sessao, MSG_MOVE_ESQUERDA);
+
         case MSG_MOVE_CIMA:
 
-            return gerenciar_movimento(MSG_MOVE_CIMA);
-            
+            return gerenciar_movimento(sessao, MSG_MOVE_CIMA);
+
         case MSG_MOVE_BAIXO:
 
-            return gerenciar_movimento(MSG_MOVE_BAIXO);
-            
+            return gerenciar_movimento(sessao, MSG_MOVE_BAIXO);
+
         default:
-            printf("Mensagem não reconhecida: %d\n", pack.tipo);
-            return enviar_erro(&estado_servidor, getSeq(pack), SEM_PERMISSAO);
+            REG_AVISO("Mensagem não reconhecida: %d\n", pack->tipo);
+            return responder_erro(sessao, seq, SEM_PERMISSAO);
     }
     return 1;
 }
 
 
-int gerenciar_movimento(mensagem_type direcao) {
+// Trata o prazo vencido da sessão
+int gerenciar_prazo(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+
+    switch (sessao->estado) {
+        case SESSAO_AGUARDA_ACK:
+            if (sessao->etapa == ETAPA_DADOS) {
+                if (transferencia->em_voo == 0) {
+                    return transmitir_janela_dados(sessao);     // Leitura do disco em andamento ou sessão retomada
+                }
+                // Sem ACK dentro do prazo: a janela volta a um frame, o prazo dobra e os frames em voo são repetidos
+                congestionamento_expirou(&transferencia->congestionamento);
+                retransmissao_expirou(&sessao->retransmissao);
+                transferencia->duplicados = 0;
+                return reenviar_janela(sessao);
+            }
+            // Sem confirmação dentro do prazo: retransmitir o pacote pendente com o prazo dobrado
+            retransmissao_expirou(&sessao->retransmissao);
+            agendar_retransmissao(sessao);
+            contar_retransmissao(sessao, 1);
+            return transmitir(sessao, quadro_reter(sessao->pendente));
+
+        case SESSAO_AGUARDA_CARGA:
+            return transmitir_arquivo_tesouro(sessao);
+
+        case SESSAO_MULTIFLUXO:
+            if (!multifluxo_concluido(&transferencia->multi)) {
+                sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + ESPERA_FLUXOS_MS);
+                return 1;
+            }
+            if (multifluxo_aguardar(&transferencia->multi, &transferencia->digest) < 0) {
+                REG_ERRO("🔴 Falha em um dos fluxos paralelos\n");
+                concluir_transferencia(sessao);
+                return -1;
+            }
+            liberar_faixa_fluxos(transferencia);
+            return finalizar_arquivo_tesouro(sessao);
+
+        default:
+            return 0;
+    }
+}
+
+
+int gerenciar_movimento(sessao_t* sessao, mensagem_type direcao) {
     const char* nome_direcao;
     switch (direcao) {
         case MSG_MOVE_DIREITA: nome_direcao = "DIREITA"; break;
@@ -206,70 +1237,65 @@ int gerenciar_movimento(mensagem_type direcao) {
         case MSG_MOVE_BAIXO: nome_direcao = "BAIXO"; break;
         default: nome_direcao = "DESCONHECIDA"; break;
     }
-    
+
+    posicao_t anterior = sessao->jogo.local_player;
+
     // Tentar mover jogador
-    if (move_player(&jogo, direcao) < 0) {
-        printf("🔴 Movimento %s inválido: - posição atual: (%d,%d)\n", 
-               nome_direcao, jogo.local_player.x, jogo.local_player.y);
-        imprimir_movimento(nome_direcao, 0);
-        
+    if (move_player(&sessao->jogo, direcao) < 0) {
+        REG_AVISO("🔴 Movimento %s inválido: - posição atual: (%d,%d)\n",
+                  nome_direcao, sessao->jogo.local_player.x, sessao->jogo.local_player.y);
+        imprimir_movimento(sessao, nome_direcao, 0);
+
         // Enviar erro de movimento inválido
-        return enviar_ack(&estado_servidor, estado_servidor.seq_atual);
+        return responder_comando(sessao, sessao->protocolo.seq_atual, MSG_ACK);
     }
-    
-    printf("🟢 Movimento %s realizado: (%d,%d)\n", 
-           nome_direcao, jogo.local_player.x, jogo.local_player.y);
-    imprimir_movimento(nome_direcao, 1);
-
-    // Mostrar mapa atualizado
-    interface_servidor(&jogo);
 
-    if (enviar_ok_ack(&estado_servidor, estado_servidor.seq_atual) < 0) {
-        return -1;
+    // Tesouro na nova posição: sem vaga para o envio, o movimento é desfeito e o cliente
+    // repete o mesmo comando depois da espera
+    transferencia_t* transferencia = &sessao->transferencia;
+    int indice_tesouro = valida_tesouro(&sessao->jogo, sessao->jogo.local_player);
+    if (indice_tesouro >= 0 && !reservar_transferencia(transferencia)) {
+        posicao_t destino = sessao->jogo.local_player;
+        sessao->jogo.local_explorado[destino.x][destino.y] = 0;    // Casa de tesouro ainda não encontrado: nunca visitada
+        sessao->jogo.local_player = anterior;
+        sessao->jogo.tesouros[indice_tesouro].encontrado = 0;
+        sessao->jogo.tesouros_achados--;
+        REG_AVISO("🟡 Sem vaga para enviar o tesouro, movimento %s adiado\n", nome_direcao);
+        return recusar_comando(sessao);
     }
-    
-    // Verificar se há tesouro na nova posição
-    int indice_tesouro = valida_tesouro(&jogo, jogo.local_player);
-    if (indice_tesouro >= 0) {
-        printf("🌟 Tesouro descoberto 🌟 %s na posição (%d,%d)\n", 
-               jogo.tesouros[indice_tesouro].nome_tesouro,
-               jogo.local_player.x, jogo.local_player.y);
-        int i = 0;
-        estado_servidor.seq_atual = (estado_servidor.seq_atual + 1) % 32;
-        while(1){
-
-            if(transmitir_mapa_cliente() == -4)
-                return -4;
-            if(esperar_ack(&estado_servidor) >= 0){
-                break;
-            }
-            else if(i >= MAX_RETRY)
-                continue;
-            i += 1;
-        }
-        estado_servidor.seq_atual = (estado_servidor.seq_atual + 1) % 32;
-        return transmitir_tesouro(indice_tesouro);
-    } else {
-        int j = 0;
-        estado_servidor.seq_atual = (estado_servidor.seq_atual + 1) % 32;
-        while(1){
 
+    sessao->jogo_alterado = 1;
+    REG_INFO("🟢 Movimento %s realizado: (%d,%d)\n",
+             nome_direcao, sessao->jogo.local_player.x, sessao->jogo.local_player.y);
+    imprimir_movimento(sessao, nome_direcao, 1);
 
-            // Apenas enviar nova posição
+    // Começar a ler os tesouros próximos enquanto o mapa é enviado
+    precarga_atualizar(&precarga, &sessao->jogo);
 
+    // Mostrar mapa atualizado (só faz sentido com um jogador)
+    publicar_mapa(sessao);
 
-            if (transmitir_mapa_cliente() < 0) {
-                sleep(TIMEOUT_S);
-                continue;
-            }
-            if(esperar_ack(&estado_servidor) >= 0)
-                break;
-            else if(j >= MAX_RETRY)
-                continue;
-            j += 1;
-        }
-        return 1;
+    if (responder_comando(sessao, sessao->protocolo.seq_atual, MSG_OK_ACK) < 0) {
+        return -4;
+    }
+
+    // Sem tesouro na nova posição
+    if (indice_tesouro < 0) {
+        // Apenas enviar nova posição
+        return transmitir_mapa_cliente(sessao, ETAPA_MAPA);
     }
+
+    REG_INFO("🌟 Tesouro descoberto 🌟 %s na posição (%d,%d)\n",
+             sessao->jogo.tesouros[indice_tesouro].nome_tesouro,
+             sessao->jogo.local_player.x, sessao->jogo.local_player.y);
+
+    memset(transferencia, 0, sizeof(transferencia_t));
+    transferencia->indice_tesouro = indice_tesouro;
+    transferencia->faixa_fluxos = -1;
+    transferencia->tem_vaga = 1;
+    transferencia->inicio_us = metricas_agora_us();
+    arena_limpar(&sessao->arena);
+    return transmitir_mapa_cliente(sessao, ETAPA_MAPA_TESOURO);
 }
 
 
@@ -286,155 +1312,422 @@ int checar_tesouro_posicao(tesouro_t treasures[MAX_TESOUROS], posicao_t pos){
 }
 
 
-int transmitir_mapa_cliente() {
-    pack_t pack;
+int transmitir_mapa_cliente(sessao_t* sessao, etapa_sessao_type etapa) {
     struct_frame_mapa mapa_dados;
-    
+    quadro_t* quadro = novo_quadro();
+    if (!quadro) {
+        return -1;
+    }
+
     // Preparar dados do mapa para o cliente
-    mapa_dados.posicao_player = jogo.local_player;
-    
+    mapa_dados.posicao_player = sessao->jogo.local_player;
+
     //confere se achou um tesouro
-    mapa_dados.pegar_tesouro = checar_tesouro_posicao(jogo.tesouros, mapa_dados.posicao_player);
+    mapa_dados.pegar_tesouro = checar_tesouro_posicao(sessao->jogo.tesouros, mapa_dados.posicao_player);
 
-    if (criar_pacote(&pack, estado_servidor.seq_atual, MSG_INTERFACE, 
+    sessao->protocolo.seq_atual = (sessao->protocolo.seq_atual + 1) % 32;
+    if (criar_pacote(&quadro->pack, sessao->protocolo.seq_atual, MSG_INTERFACE,
                 (uint8_t*)&mapa_dados, sizeof(mapa_dados)) < 0) {
+        quadro_soltar(&sessoes.quadros, quadro);
         return -1;
     }
 
-    memcpy(&estado_servidor.pack, &pack, sizeof(pack_t));    
-    return enviar_pacote(&estado_servidor, &pack);
+    return enviar_com_confirmacao(sessao, quadro, etapa);
 }
 
 
-// Envia informações do tesouro encontrado para o cliente
-// Depois transmite o arquivo associado ao tesouro
-int transmitir_tesouro(int indice_tesouro) {
-    tesouro_t* tesouro = &jogo.tesouros[indice_tesouro];
-    
+// Envia o tamanho do tesouro encontrado; o nome e o arquivo seguem após a confirmação
+int transmitir_tesouro(sessao_t* sessao) {
+    tesouro_t* tesouro = &sessao->jogo.tesouros[sessao->transferencia.indice_tesouro];
+
     // Cria o pack
-    pack_t pack;
-    
-    while(1){
-        if (criar_pacote(&pack, estado_servidor.seq_atual, MSG_TAMANHO,
-                       tesouro->tamanho, sizeof(tesouro->tamanho)) < 0) {
-            fprintf(stderr, "🔴 Erro ao criar pacote do tesouro\n");
-            continue;
-        }
-        break;
+    quadro_t* quadro = novo_quadro();
+    if (!quadro) {
+        concluir_transferencia(sessao);
+        return -1;
+    }
+    sessao->protocolo.seq_atual = (sessao->protocolo.seq_atual + 1) % 32;
+    if (criar_pacote(&quadro->pack, sessao->protocolo.seq_atual, MSG_TAMANHO,
+                     tesouro->tamanho, sizeof(tesouro->tamanho)) < 0) {
+        REG_ERRO("🔴 Erro ao criar pacote do tesouro\n");
+        quadro_soltar(&sessoes.quadros, quadro);
+        concluir_transferencia(sessao);
+        return -1;
     }
-    while(1){
-        printf("ENVIANDO TAMANHO TESOURO\n");
-        // Envia o pack
-        if (enviar_pacote(&estado_servidor, &pack) < 0){
-            continue;
-        }
 
+    REG_DEPURACAO("ENVIANDO TAMANHO TESOURO\n");
+    return enviar_com_confirmacao(sessao, quadro, ETAPA_TAMANHO);
+}
 
-        // Aguardar ACK
-        int typeAck = esperar_ack(&estado_servidor);
-        if (typeAck == -4){
-            continue;
-            // printf("erro fatal\n");
-            // return -4;  
-        }
-        else if(typeAck < 0){
-            continue;
-        }
-        else{
-            uint64_t tamanho_lido;
-            memcpy(&tamanho_lido, tesouro->tamanho, sizeof(uint64_t));
-            printf("Arquivo possui = = %llu bytes\n", (unsigned long long)tamanho_lido);
-            break;
-        }
+
+// Envia o nome do arquivo de tesouro para o cliente
+// Se a pré-carga ainda estiver lendo o arquivo, tenta de novo em ESPERA_CARGA_MS
+int transmitir_arquivo_tesouro(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    tesouro_t* tesouro = &sessao->jogo.tesouros[transferencia->indice_tesouro];
+
+    if (precarga_obter(&precarga, transferencia->indice_tesouro, &transferencia->pre) == 1) {
+        sessao->estado = SESSAO_AGUARDA_CARGA;
+        sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + ESPERA_CARGA_MS);
+        return 1;
+    }
+    const precarga_tesouro_t* pre = transferencia->pre;
+    if (pre) {
+        REG_INFO("🟢 Tesouro já carregado em memória (%llu bytes)\n", (unsigned long long)pre->tamanho);
     }
 
     // Determinar tipo do arquivo
-    mensagem_type tipo = determinar_tipo_arquivo(tesouro->nome_tesouro);
+    transferencia->tipo = determinar_tipo_arquivo(tesouro->nome_tesouro);
 
-    return transmitir_arquivo_tesouro(tesouro->patch, tesouro->nome_tesouro, tipo);
-}
+    // O arquivo em memória continua acessível como FILE* para o reenvio de intervalos
+    transferencia->arquivo = pre ? fmemopen(pre->dados, pre->tamanho, "rb") : fopen(tesouro->patch, "rb");
+    if (!transferencia->arquivo) {
+        responder_erro(sessao, sessao->protocolo.seq_atual, SEM_PERMISSAO);
+        REG_ERRO("🔴 Erro ao abrir arquivo do tesouro %s\n", tesouro->nome_tesouro);
+        concluir_transferencia(sessao);
+        return -1;
+    }
+
+    REG_DEPURACAO("Nome do arquivo: %s\n", tesouro->nome_tesouro);
+
+    struct stat st;
+    transferencia->tamanho = 0;
+    if (pre) {
+        transferencia->tamanho = pre->tamanho;
+    } else if (fstat(fileno(transferencia->arquivo), &st) == 0) {
+        transferencia->tamanho = (uint64_t)st.st_size;
+    }
 
+    // Vídeos grandes são divididos em trechos enviados em paralelo, se houver faixa de portas livre
+    transferencia->num_fluxos = modo_transferencia == MODO_AUTOMATICO
+                              ? multifluxo_quantidade(transferencia->tamanho, transferencia->tipo) : 1;
+    if (transferencia->num_fluxos > 1) {
+        transferencia->faixa_fluxos = reservar_faixa_fluxos();
+        if (transferencia->faixa_fluxos < 0) {
+            transferencia->num_fluxos = 1;
+        }
+    }
 
-// Envia o nome e o conteúdo do arquivo de tesouro para o cliente
-// Realiza o envio em blocos, aguardando ACK para cada pacote
-int transmitir_arquivo_tesouro(const char* caminho_arquivo, const char* nome_tesouro, mensagem_type tipo) {
+    // Primeiro enviar o nome do arquivo, seguido do número de fluxos e da porta do primeiro fluxo
+    uint8_t dados_nome[MAX_FRAME];
+    size_t tamanho_nome = strlen(tesouro->nome_tesouro) + 1;
+    if (tamanho_nome + 3 > MAX_FRAME) {
+        concluir_transferencia(sessao);
+        return -1;
+    }
+    unsigned short porta_fluxos = PORTA_BASE_FLUXOS(transferencia->faixa_fluxos >= 0 ? transferencia->faixa_fluxos : 0);
+    memcpy(dados_nome, tesouro->nome_tesouro, tamanho_nome);
+    dados_nome[tamanho_nome] = (uint8_t)transferencia->num_fluxos;
+    dados_nome[tamanho_nome + 1] = (uint8_t)(porta_fluxos & 0xFF);
+    dados_nome[tamanho_nome + 2] = (uint8_t)(porta_fluxos >> 8);
 
-    FILE* arquivo = fopen(caminho_arquivo, "rb");
-    if (!arquivo) {
-        enviar_erro(&estado_servidor, estado_servidor.seq_atual, SEM_PERMISSAO);
-        fprintf(stderr, "🔴 Erro ao abrir arquivo do tesouro %s \n", nome_tesouro);
+    quadro_t* quadro = novo_quadro();
+    if (!quadro) {
+        concluir_transferencia(sessao);
+        return -1;
+    }
+    sessao->protocolo.seq_atual = (sessao->protocolo.seq_atual + 1) % 32;
+    if (criar_pacote(&quadro->pack, sessao->protocolo.seq_atual, transferencia->tipo,
+              dados_nome, tamanho_nome + 3) < 0) {
+        quadro_soltar(&sessoes.quadros, quadro);
+        concluir_transferencia(sessao);
         return -1;
     }
+    return enviar_com_confirmacao(sessao, quadro, ETAPA_NOME);
+}
 
-    printf("Nome do arquivo: %s\n", nome_tesouro);
 
-    // Primeiro enviar o nome do arquivo
-    pack_t pack_nome;
-    estado_servidor.seq_atual = (estado_servidor.seq_atual + 1) % 32;
-    if (criar_pacote(&pack_nome, estado_servidor.seq_atual, tipo, 
-              (uint8_t*)nome_tesouro, strlen(nome_tesouro) + 1) < 0) {
-        fclose(arquivo);
+// Nome confirmado: o cliente já está pronto para receber o conteúdo
+int iniciar_dados_tesouro(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    const precarga_tesouro_t* pre = transferencia->pre;
+
+    // Digest calculado durante o envio, sem reler o arquivo; a tabela de blocos fica na arena da sessão
+    uint32_t num_blocos = digest_num_blocos(transferencia->tamanho);
+    uint64_t* tabela = arena_alocar(&sessao->arena, (size_t)num_blocos * sizeof(uint64_t));
+    if (digest_iniciar_em(&transferencia->digest, transferencia->tamanho, tabela, tabela ? num_blocos : 0) < 0) {
+        concluir_transferencia(sessao);
         return -1;
     }
-    
-    while(1) {
-        if (enviar_pacote(&estado_servidor, &pack_nome) < 0) {
-            sleep(TIMEOUT_S);
-            continue;
+    transferencia->tem_digest = 1;
+    SONDA(transferencia_inicio, transferencia->tamanho, transferencia->indice_tesouro, transferencia->num_fluxos,
+          SONDA_SESSAO(sessao->ip, sessao->porta));
+
+    if (transferencia->num_fluxos > 1) {
+        REG_INFO("Enviando %llu bytes em %d fluxos paralelos\n", (unsigned long long)transferencia->tamanho,
+                 transferencia->num_fluxos);
+        // Cada fluxo registra no instantâneo até onde o cliente confirmou
+        uint64_t* progresso = sessoes_progresso_fluxos(&sessoes, sessao);
+        if (progresso) {
+            memset(progresso, 0, NUM_FLUXOS * sizeof(uint64_t));
         }
-        if (esperar_ack(&estado_servidor) < 0) {
-            sleep(TIMEOUT_S);
-            continue;
+        saida_fluxos_t saida = saida_fluxos(sessao);
+        if (multifluxo_iniciar_envio(&transferencia->multi, sessao->protocolo.ip_destino, sessao->porta,
+                                     PORTA_BASE_FLUXOS(transferencia->faixa_fluxos),
+                                     pre ? -1 : fileno(transferencia->arquivo), pre ? pre->dados : NULL,
+                                     transferencia->tamanho, transferencia->num_fluxos, progresso, &saida) < 0) {
+            REG_ERRO("🔴 Erro ao iniciar fluxos paralelos\n");
+            concluir_transferencia(sessao);
+            return -1;
         }
-        break;
+
+        // As threads dos fluxos fazem o envio; a sessão só confere de tempos em tempos se terminaram
+        sessao->estado = SESSAO_MULTIFLUXO;
+        sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + ESPERA_FLUXOS_MS);
+        return 1;
     }
 
-    // Enviar o arquivo em chunks
-    uint8_t buffer[MAX_FRAME];
-    size_t bytes_lidos;
-    size_t bytes_enviados = 0;
-    
-    while ((bytes_lidos = fread(buffer, 1, MAX_FRAME, arquivo)) > 0) {
-        pack_t pack_dados;
-        while(1){
-            int seqTemp = (estado_servidor.seq_atual + 1) % 32;
-
-               
-            if (criar_pacote(&pack_dados, seqTemp, MSG_DADOS, buffer, bytes_lidos) < 0) {
-                continue;
-            }
+    // Digest já calculado pela pré-carga
+    if (pre) {
+        digest_anexar(&transferencia->digest, &pre->digest, 0);
+    }
+
+    // Arquivo fora da pré-carga: leituras grandes pedidas à frente do envio
+    transferencia->usa_leitor = !pre && leitor_abrir(&transferencia->leitor, fileno(transferencia->arquivo), 0,
+                                                     transferencia->tamanho) == 0;
+    transferencia->enviados = 0;
+    transferencia->confirmados = 0;
+    transferencia->indice_quadro = 0;
+    transferencia->fim_leitura = 0;
+    transferencia->em_voo = 0;
+    transferencia->duplicados = 0;
+    congestionamento_iniciar(&transferencia->congestionamento);
 
-            estado_servidor.seq_atual = seqTemp;
+    // Os dados não têm pendente único: a janela guarda os frames em voo
+    quadro_soltar(&sessoes.quadros, sessao->pendente);
+    sessao->pendente = NULL;
+    return transmitir_janela_dados(sessao);
+}
+
+
+// Completa a janela de dados com os próximos blocos do arquivo
+// A janela é a do controle de congestionamento, limitada pela anunciada pelo cliente
+int transmitir_janela_dados(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    const precarga_tesouro_t* pre = transferencia->pre;
+    int permitidos = modo_transferencia == MODO_PARADA ? 1 : congestionamento_permitidos(&transferencia->congestionamento);
+    int aguarda_leitura = 0;
+
+    while (!transferencia->fim_leitura && transferencia->em_voo < permitidos) {
+        // O trabalhador não espera o disco: a janela segue quando a leitura terminar
+        if (transferencia->usa_leitor && leitor_pronto(&transferencia->leitor, MAX_FRAME) == 0) {
+            aguarda_leitura = 1;
             break;
         }
 
-        while(1) {
-            printf("Bytes enviados %zu\n", bytes_enviados);
-            if (enviar_pacote(&estado_servidor, &pack_dados) < 0) {
-                continue;
+        uint8_t seq = (sessao->protocolo.seq_atual + 1) % 32;
+        size_t bytes_lidos;
+
+        quadro_t* quadro = novo_quadro();
+        if (!quadro) {
+            if (transferencia->em_voo > 0) {
+                break;  // A janela continua com o que já está em voo
             }
-            if (esperar_ack(&estado_servidor) < 0) {
-                continue;
+            concluir_transferencia(sessao);
+            return -1;
+        }
+
+        if (pre && pre->quadros) {
+            // Frame pronto: só falta a sequência
+            if (transferencia->indice_quadro >= pre->num_quadros) {
+                quadro_soltar(&sessoes.quadros, quadro);
+                transferencia->fim_leitura = 1;
+                break;
             }
-            break;
+            quadro->pack = pre->quadros[transferencia->indice_quadro++];
+            definir_seq_pacote(&quadro->pack, seq);
+            bytes_lidos = quadro->pack.tamanho;
+        } else {
+            uint8_t buffer[MAX_FRAME];
+            ssize_t lidos;
+            {
+                PERFIL_ESCOPO(PERFIL_LEITURA_DISCO);
+                lidos = transferencia->usa_leitor ? leitor_ler(&transferencia->leitor, buffer, MAX_FRAME)
+                                                  : (ssize_t)fread(buffer, 1, MAX_FRAME, transferencia->arquivo);
+            }
+            if (lidos <= 0) {
+                quadro_soltar(&sessoes.quadros, quadro);
+                transferencia->fim_leitura = 1;
+                break;
+            }
+            bytes_lidos = (size_t)lidos;
+            if (!pre) {
+                digest_atualizar(&transferencia->digest, buffer, bytes_lidos);
+            }
+            if (criar_pacote(&quadro->pack, seq, MSG_DADOS, buffer, bytes_lidos) < 0) {
+                quadro_soltar(&sessoes.quadros, quadro);
+                transferencia->fim_leitura = 1;
+                break;
+            }
+        }
+        sessao->protocolo.seq_atual = seq;
+
+        REG_DEPURACAO("Bytes enviados %llu\n", (unsigned long long)transferencia->enviados);
+        transferencia->enviados += bytes_lidos;
+        SONDA(transferencia_frame, seq, transferencia->em_voo, transferencia->enviados,
+              SONDA_SESSAO(sessao->ip, sessao->porta));
+        transferencia->envio_us[transferencia->em_voo] = metricas_agora_us();
+        transferencia->janela[transferencia->em_voo++] = quadro;
+        if (transmitir(sessao, quadro_reter(quadro)) < 0) {
+            return -4;
         }
-        bytes_enviados += bytes_lidos;
     }
 
-    fclose(arquivo);
+    // Tudo confirmado: o digest segue no MSG_FIM_ARQUIVO
+    if (transferencia->em_voo == 0 && !aguarda_leitura) {
+        return finalizar_arquivo_tesouro(sessao);
+    }
+
+    // Sem frames em voo, nenhum ACK vai chamar a janela de novo: o prazo confere o leitor.
+    // Com frames em voo, o prazo conta a partir do último avanço da janela
+    sessao->estado = SESSAO_AGUARDA_ACK;
+    sessao->etapa = ETAPA_DADOS;
+    if (transferencia->em_voo == 0) {
+        sessoes_agendar(&sessoes, sessao, sessoes_agora_ms() + ESPERA_LEITURA_MS);
+    } else {
+        agendar_retransmissao(sessao);
+    }
     return 0;
 }
 
 
-// Exibe no terminal o log do movimento do jogador
-// Mostra horário, direção, posição e quantidade de tesouros
-void imprimir_movimento(const char* direcao, int sucesso) {
-    time_t now = time(NULL);
-    char* time_str = ctime(&now);
-    time_str[strlen(time_str) - 1] = '\0'; // Remover \n
-    
-    printf("[%s] Movimento %s: %s - Posição: (%d,%d) - Tesouros: %d/%d\n",
-           time_str, direcao, sucesso ? "OK" : "INVÁLIDO",
-           jogo.local_player.x, jogo.local_player.y,
-           jogo.tesouros_achados, MAX_TESOUROS);
+// Envia MSG_FIM_ARQUIVO com o CRC-64 calculado durante o envio
+// Se o cliente responder NACK, a tabela de blocos e os pedidos de reenvio seguem pela máquina de estados
+int finalizar_arquivo_tesouro(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+    if (transferencia->usa_leitor) {
+        leitor_fechar(&transferencia->leitor);
+        transferencia->usa_leitor = 0;
+    }
+
+    struct_frame_fim fim;
+    fim.subtipo = FIM_RESUMO;
+    fim.crc64 = transferencia->digest.crc_arquivo;
+    fim.tamanho_bloco = BLOCO_VERIFICACAO;
+    fim.num_blocos = transferencia->digest.num_blocos;
+
+    quadro_t* quadro = novo_quadro();
+    if (!quadro) {
+        concluir_transferencia(sessao);
+        return -1;
+    }
+    sessao->protocolo.seq_atual = (sessao->protocolo.seq_atual + 1) % 32;
+    criar_pacote(&quadro->pack, sessao->protocolo.seq_atual, MSG_FIM_ARQUIVO, (uint8_t*)&fim, sizeof(fim));
+    return enviar_com_confirmacao(sessao, quadro, ETAPA_FIM);
+}
+
+
+void encerrar_transferencia(sessao_t* sessao) {
+    transferencia_t* transferencia = &sessao->transferencia;
+
+    // Fluxos ainda ativos (sessão removida ou reiniciada): desistir e aguardar as threads
+    if (transferencia->multi.num_fluxos > 0) {
+        multifluxo_cancelar(&transferencia->multi);
+        multifluxo_aguardar(&transferencia->multi, NULL);
+    }
+    liberar_faixa_fluxos(transferencia);
+    liberar_transferencia(transferencia);
+
+    for (int i = 0; i < transferencia->em_voo; i++) {
+        quadro_soltar(&sessoes.quadros, transferencia->janela[i]);
+    }
+    transferencia->em_voo = 0;
+
+    if (transferencia->usa_leitor) {
+        leitor_fechar(&transferencia->leitor);
+        transferencia->usa_leitor = 0;
+    }
+    if (transferencia->tem_digest) {
+        digest_liberar(&transferencia->digest);
+        transferencia->tem_digest = 0;
+    }
+    if (transferencia->arquivo) {
+        fclose(transferencia->arquivo);
+        transferencia->arquivo = NULL;
+    }
+    if (transferencia->pre) {
+        precarga_liberar_tesouro(&precarga, transferencia->indice_tesouro);
+        transferencia->pre = NULL;
+    }
+}
+
+
+// Registra o movimento do jogador com horário, direção, posição e quantidade de tesouros
+// Roda nos trabalhadores: o horário vai para um buffer local (ctime divide o seu entre as threads)
+void imprimir_movimento(sessao_t* sessao, const char* direcao, int sucesso) {
+    time_t agora = time(NULL);
+    struct tm hora;
+    char horario[16] = "";
+    if (localtime_r(&agora, &hora)) {
+        strftime(horario, sizeof(horario), "%H:%M:%S", &hora);
+    }
+
+    // O registro guarda até quatro argumentos: posição e tesouros vão juntos em um texto
+    char situacao[48];
+    snprintf(situacao, sizeof(situacao), "(%d,%d) - Tesouros: %d/%d", sessao->jogo.local_player.x,
+             sessao->jogo.local_player.y, sessao->jogo.tesouros_achados, MAX_TESOUROS);
+    REG_INFO("[%s] Movimento %s: %s - Posição: %s\n", horario, direcao, sucesso ? "OK" : "INVÁLIDO", situacao);
+}
+
+
+void publicar_mapa(const sessao_t* sessao) {
+    if (!vista_mapa.ativo || __atomic_load_n(&sessoes.num_sessoes, __ATOMIC_RELAXED) != 1) return;
+
+    pthread_mutex_lock(&vista_mapa.trava);
+    vista_mapa.jogo = sessao->jogo;
+    vista_mapa.alterado = 1;
+    pthread_mutex_unlock(&vista_mapa.trava);
+}
+
+
+void desenhar_mapa(void) {
+    if (!vista_mapa.ativo) return;
+
+    int64_t agora_ms = sessoes_agora_ms();
+    if (agora_ms - vista_mapa.desenho_ms < INTERVALO_MAPA_MS) return;
+
+    struct_jogo jogo;
+    pthread_mutex_lock(&vista_mapa.trava);
+    int alterado = vista_mapa.alterado;
+    if (alterado) {
+        jogo = vista_mapa.jogo;
+        vista_mapa.alterado = 0;
+    }
+    pthread_mutex_unlock(&vista_mapa.trava);
+
+    if (alterado) {
+        vista_mapa.desenho_ms = agora_ms;
+        interface_servidor(&jogo);
+    }
+}
+
+
+// Lê a tabela de sessões fora da thread principal: os campos lidos só mudam quando a
+// entrada é ocupada ou liberada, e um retrato de uma sessão saindo é aceitável
+void escrever_sessoes(FILE* saida) {
+    fprintf(saida, "[");
+    int primeira = 1;
+    for (int i = 0; i < MAX_SESSOES; i++) {
+        sessao_t* sessao = &sessoes.sessoes[i];
+        if (!__atomic_load_n(&sessao->ativa, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        struct in_addr endereco;
+        endereco.s_addr = __atomic_load_n(&sessao->ip, __ATOMIC_RELAXED);
+        char ip[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &endereco, ip, sizeof(ip));      // inet_ntoa divide o buffer com a thread principal
+        metricas_sessao_t* contadores = &sessao->metricas;
+        fprintf(saida, "%s\n    {\"cliente\": \"%s:%u\", \"estado\": %d, \"etapa\": %d, \"enviados\": %llu, "
+                "\"recebidos\": %llu, \"bytes_enviados\": %llu, \"bytes_recebidos\": %llu, \"retransmissoes\": %llu}",
+                primeira ? "" : ",", ip, (unsigned)__atomic_load_n(&sessao->porta, __ATOMIC_RELAXED),
+                (int)__atomic_load_n(&sessao->estado, __ATOMIC_RELAXED),
+                (int)__atomic_load_n(&sessao->etapa, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&contadores->enviados, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&contadores->recebidos, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&contadores->bytes_enviados, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&contadores->bytes_recebidos, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&contadores->retransmissoes, __ATOMIC_RELAXED));
+        primeira = 0;
+    }
+    fprintf(saida, primeira ? "]" : "\n  ]");
 }
@@ -0,0 +1,429 @@
+#define _XOPEN_SOURCE 700   // clock_gettime()
+
+#include "sessao.h"
+#include "registro.h"
+
+
+static unsigned balde_sessao(unsigned int ip, unsigned short porta) {
+    uint32_t h = ip ^ ((uint32_t)porta * 0x9E3779B1u);
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h % BALDES_SESSOES;
+}
+
+
+int sessoes_iniciar(tabela_sessoes_t* tabela, const protocolo_type* escuta, void (*encerrar)(sessao_t* sessao)) {
+    if (!tabela || !escuta) return -1;
+
+    memset(tabela, 0, sizeof(tabela_sessoes_t));
+    tabela->sessoes = calloc(MAX_SESSOES, sizeof(sessao_t));
+    if (!tabela->sessoes) return -1;
+
+    // Toda a memória das sessões é reservada aqui: nada de malloc por frame ou por tesouro
+    tabela->arenas = malloc((size_t)MAX_SESSOES * ARENA_SESSAO);
+    if (!tabela->arenas || slab_iniciar(&tabela->quadros, sizeof(quadro_t), QUADROS_SESSOES, 64) < 0) {
+        free(tabela->arenas);
+        free(tabela->sessoes);
+        tabela->arenas = NULL;
+        tabela->sessoes = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < BALDES_SESSOES; i++) {
+        tabela->baldes[i] = -1;
+    }
+    for (int i = 0; i < MAX_SESSOES; i++) {
+        tabela->sessoes[i].proxima = i + 1 < MAX_SESSOES ? i + 1 : -1;
+    }
+    tabela->livres = 0;
+    if (roda_iniciar(&tabela->roda, sessoes_agora_ms()) < 0) {
+        slab_finalizar(&tabela->quadros);
+        free(tabela->arenas);
+        free(tabela->sessoes);
+        tabela->arenas = NULL;
+        tabela->sessoes = NULL;
+        return -1;
+    }
+    tabela->escuta = escuta;
+    tabela->encerrar = encerrar;
+    return 0;
+}
+
+
+sessao_t* sessoes_buscar(tabela_sessoes_t* tabela, unsigned int ip, unsigned short porta) {
+    if (!tabela) return NULL;
+
+    int i = tabela->baldes[balde_sessao(ip, porta)];
+    while (i >= 0) {
+        sessao_t* sessao = &tabela->sessoes[i];
+        if (sessao->ip == ip && sessao->porta == porta) {
+            return sessao;
+        }
+        i = sessao->proxima;
+    }
+    return NULL;
+}
+
+
+// Ocupa a entrada i (já fora da lista de livres) com uma sessão nova do cliente
+static int ocupar_entrada(tabela_sessoes_t* tabela, int i, unsigned int ip, unsigned short porta) {
+    sessao_t* sessao = &tabela->sessoes[i];
+
+    // Frames da sessão anterior nesta posição podem estar na fila do transmissor
+    uint32_t geracao = sessao->geracao + 1;
+    memset(sessao, 0, sizeof(sessao_t));
+    sessao->geracao = geracao ? geracao : 1;    // 0 marca "sem falha" no transmissor
+    if (vincular_protocolo(&sessao->protocolo, tabela->escuta, ip, porta) < 0) {
+        return -1;
+    }
+    sessao->transferencia.faixa_fluxos = -1;
+    arena_iniciar(&sessao->arena, tabela->arenas + (size_t)i * ARENA_SESSAO, ARENA_SESSAO);
+
+    sessao->ativa = 1;
+    sessao->ip = ip;
+    sessao->porta = porta;
+    sessao->ultimo_contato = time(NULL);
+    sessao->prazo.dono = sessao;
+    sessao->inatividade.dono = sessao;
+    roda_agendar(&tabela->roda, &sessao->inatividade, sessoes_agora_ms() + SESSAO_INATIVA_S * 1000);
+
+    unsigned b = balde_sessao(ip, porta);
+    sessao->proxima = tabela->baldes[b];
+    tabela->baldes[b] = i;
+    __atomic_add_fetch(&tabela->num_sessoes, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+
+sessao_t* sessoes_obter(tabela_sessoes_t* tabela, unsigned int ip, unsigned short porta) {
+    sessao_t* sessao = sessoes_buscar(tabela, ip, porta);
+    if (sessao || !tabela || tabela->livres < 0) {
+        return sessao;
+    }
+
+    int i = tabela->livres;
+    sessao = &tabela->sessoes[i];
+    tabela->livres = sessao->proxima;
+
+    if (ocupar_entrada(tabela, i, ip, porta) < 0) {
+        sessao->proxima = tabela->livres;
+        tabela->livres = i;
+        return NULL;
+    }
+    // O sorteio (com o tamanho de cada tesouro) fica para o trabalhador do primeiro evento:
+    // a recepção de todas as sessões passa por esta thread
+    sessao->jogo_pendente = 1;
+
+    REG_INFO("🟢 Nova sessão %s:%u (%d ativas)\n", sessao->protocolo.ip_destino, porta,
+             __atomic_load_n(&tabela->num_sessoes, __ATOMIC_RELAXED));
+    return sessao;
+}
+
+
+sessao_t* sessoes_admitir(tabela_sessoes_t* tabela, unsigned int ip, unsigned short porta, int limite,
+                          int (*sobrecarregado)(void)) {
+    sessao_t* sessao = sessoes_buscar(tabela, ip, porta);
+    if (sessao || !tabela) {
+        return sessao;
+    }
+    // As sessões que já existem continuam com a mesma latência
+    if (__atomic_load_n(&tabela->num_sessoes, __ATOMIC_RELAXED) >= limite ||
+        (sobrecarregado && sobrecarregado())) {
+        return NULL;
+    }
+    return sessoes_obter(tabela, ip, porta);
+}
+
+
+void sessoes_remover(tabela_sessoes_t* tabela, sessao_t* sessao) {
+    if (!tabela || !sessao || !sessao->ativa) return;
+
+    int i = (int)(sessao - tabela->sessoes);
+    int* elo = &tabela->baldes[balde_sessao(sessao->ip, sessao->porta)];
+    while (*elo >= 0 && *elo != i) {
+        elo = &tabela->sessoes[*elo].proxima;
+    }
+    if (*elo == i) {
+        *elo = sessao->proxima;
+    }
+
+    REG_INFO("🟡 Sessão %s:%u encerrada\n", sessao->protocolo.ip_destino, sessao->porta);
+
+    roda_cancelar(&tabela->roda, &sessao->prazo);
+    roda_cancelar(&tabela->roda, &sessao->inatividade);
+    if (tabela->encerrar) {
+        tabela->encerrar(sessao);
+    }
+
+    // Frames que nenhum trabalhador vai mais processar
+    evento_sessao_t evento;
+    while (sessao_proximo_evento(sessao, &evento)) {
+        quadro_soltar(&tabela->quadros, evento.quadro);
+    }
+    quadro_soltar(&tabela->quadros, sessao->pendente);
+    sessao->pendente = NULL;
+    if (tabela->persistente) {
+        instantaneo_apagar(&tabela->instantaneo, (uint32_t)i);
+    }
+
+    // O socket pertence à escuta: a sessão não fecha o descritor
+    sessao->ativa = 0;
+    sessao->proxima = tabela->livres;
+    tabela->livres = i;
+    __atomic_sub_fetch(&tabela->num_sessoes, 1, __ATOMIC_RELAXED);
+}
+
+
+void sessoes_finalizar(tabela_sessoes_t* tabela) {
+    if (!tabela) return;
+    free(tabela->sessoes);
+    free(tabela->arenas);
+    tabela->sessoes = NULL;
+    tabela->arenas = NULL;
+    slab_finalizar(&tabela->quadros);
+    roda_finalizar(&tabela->roda);
+    if (tabela->persistente) {
+        instantaneo_fechar(&tabela->instantaneo);
+        tabela->persistente = 0;
+    }
+    __atomic_store_n(&tabela->num_sessoes, 0, __ATOMIC_RELAXED);
+}
+
+
+int64_t sessoes_agora_ms(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (int64_t)agora.tv_sec * 1000 + agora.tv_nsec / 1000000;
+}
+
+
+int sessao_entregar(sessao_t* sessao, evento_sessao_type tipo, quadro_t* quadro) {
+    unsigned inicio = __atomic_load_n(&sessao->inicio_eventos, __ATOMIC_ACQUIRE);
+    unsigned fim = sessao->fim_eventos;
+
+    // Fila cheia: o frame se perde e o cliente retransmite
+    if (fim - inicio == FILA_EVENTOS) {
+        return -1;
+    }
+    evento_sessao_t* evento = &sessao->eventos[fim % FILA_EVENTOS];
+    evento->tipo = tipo;
+    evento->quadro = quadro;
+    __atomic_store_n(&sessao->fim_eventos, fim + 1, __ATOMIC_RELEASE);
+
+    // Só quem leva em_execucao de 0 para 1 coloca a sessão no pool
+    int livre = 0;
+    return __atomic_compare_exchange_n(&sessao->em_execucao, &livre, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+
+int sessao_proximo_evento(sessao_t* sessao, evento_sessao_t* evento) {
+    unsigned inicio = sessao->inicio_eventos;
+    if (inicio == __atomic_load_n(&sessao->fim_eventos, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    *evento = sessao->eventos[inicio % FILA_EVENTOS];
+    __atomic_store_n(&sessao->inicio_eventos, inicio + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+int sessao_liberar(sessao_t* sessao) {
+    __atomic_store_n(&sessao->em_execucao, 0, __ATOMIC_SEQ_CST);
+
+    // Um evento entregue entre a última retirada e a liberação não colocou a sessão no pool
+    if (__atomic_load_n(&sessao->fim_eventos, __ATOMIC_SEQ_CST) == sessao->inicio_eventos) {
+        return 0;
+    }
+    int livre = 0;
+    return __atomic_compare_exchange_n(&sessao->em_execucao, &livre, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+
+void sessoes_agendar(tabela_sessoes_t* tabela, sessao_t* sessao, int64_t prazo_ms) {
+    if (!tabela || !sessao) return;
+    roda_agendar(&tabela->roda, &sessao->prazo, prazo_ms);
+}
+
+
+void sessoes_desagendar(tabela_sessoes_t* tabela, sessao_t* sessao) {
+    if (!tabela || !sessao) return;
+    roda_cancelar(&tabela->roda, &sessao->prazo);
+}
+
+
+int sessoes_agendada(tabela_sessoes_t* tabela, sessao_t* sessao) {
+    if (!tabela || !sessao) return 0;
+    return roda_agendado(&tabela->roda, &sessao->prazo);
+}
+
+
+// Sessão sem tráfego há SESSAO_INATIVA_S segundos ou com falha: remover, ou conferir de novo mais tarde
+static void verificar_inatividade(tabela_sessoes_t* tabela, sessao_t* sessao, int64_t agora_ms) {
+    if (__atomic_load_n(&sessao->em_execucao, __ATOMIC_ACQUIRE)) {
+        roda_agendar(&tabela->roda, &sessao->inatividade, agora_ms + REMOCAO_ADIADA_MS);
+        return;
+    }
+
+    time_t agora = time(NULL);
+    time_t ultimo_contato = __atomic_load_n(&sessao->ultimo_contato, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&sessao->falhou, __ATOMIC_ACQUIRE) || agora - ultimo_contato > SESSAO_INATIVA_S) {
+        sessoes_remover(tabela, sessao);
+        return;
+    }
+
+    // Houve tráfego desde o agendamento: o prazo conta a partir do último contato
+    int64_t restante_s = ultimo_contato + SESSAO_INATIVA_S - agora + 1;
+    roda_agendar(&tabela->roda, &sessao->inatividade, agora_ms + restante_s * 1000);
+}
+
+
+void sessoes_disparar(tabela_sessoes_t* tabela, int64_t agora_ms, void (*prazo_vencido)(sessao_t* sessao)) {
+    if (!tabela) return;
+
+    temporizador_t* vencido = roda_avancar(&tabela->roda, agora_ms);
+    while (vencido) {
+        temporizador_t* seguinte = vencido->proximo_vencido;
+        sessao_t* sessao = (sessao_t*)vencido->dono;
+
+        // Uma sessão removida por inatividade neste mesmo lote não recebe mais prazos
+        if (sessao->ativa) {
+            if (vencido == &sessao->inatividade) {
+                verificar_inatividade(tabela, sessao, agora_ms);
+            } else if (prazo_vencido) {
+                prazo_vencido(sessao);
+            }
+        }
+        vencido = seguinte;
+    }
+}
+
+
+void sessoes_falhou(tabela_sessoes_t* tabela, sessao_t* sessao) {
+    if (!tabela || !sessao) return;
+    roda_agendar(&tabela->roda, &sessao->inatividade, sessoes_agora_ms());
+}
+
+
+// Recoloca na entrada i a sessão gravada no registro
+static int restaurar_sessao(tabela_sessoes_t* tabela, int i, const registro_sessao_t* registro) {
+    if (ocupar_entrada(tabela, i, registro->ip, registro->porta) < 0) {
+        return -1;
+    }
+    sessao_t* sessao = &tabela->sessoes[i];
+    sessao->jogo = registro->jogo;
+    sessao->protocolo.seq_atual = registro->seq_atual;
+    sessao->estado = (estado_sessao_type)registro->estado;
+    sessao->etapa = (etapa_sessao_type)registro->etapa;
+    sessao->resposta = registro->resposta;
+    sessao->tem_resposta = registro->tem_resposta;
+    if (registro->tem_pendente && (sessao->pendente = quadro_alocar(&tabela->quadros))) {
+        sessao->pendente->pack = registro->pendente;
+    }
+
+    transferencia_t* transferencia = &sessao->transferencia;
+    transferencia->indice_tesouro = registro->indice_tesouro;
+    transferencia->tipo = (mensagem_type)registro->tipo;
+    transferencia->num_fluxos = registro->num_fluxos;
+    transferencia->faixa_fluxos = registro->faixa_fluxos;
+    transferencia->tamanho = registro->tamanho;
+    transferencia->enviados = registro->enviados;
+    transferencia->proximo_bloco = registro->proximo_bloco;
+    transferencia->restante_intervalo = registro->restante_intervalo;
+    return 0;
+}
+
+
+int sessoes_persistir(tabela_sessoes_t* tabela, const char* caminho,
+                      void (*retomar)(sessao_t* sessao, const registro_sessao_t* registro)) {
+    if (!tabela || !caminho || tabela->persistente) return -1;
+
+    int existente = instantaneo_abrir(&tabela->instantaneo, caminho, sizeof(registro_sessao_t), MAX_SESSOES);
+    if (existente < 0) {
+        return -1;
+    }
+    tabela->persistente = 1;
+
+    // Cada sessão volta para a mesma entrada, então o registro dela não muda de lugar
+    int restauradas = 0;
+    registro_sessao_t registro;
+    for (int i = 0; existente && i < MAX_SESSOES; i++) {
+        if (!instantaneo_ler(&tabela->instantaneo, (uint32_t)i, &registro)) {
+            continue;
+        }
+        if (restaurar_sessao(tabela, i, &registro) < 0) {
+            instantaneo_apagar(&tabela->instantaneo, (uint32_t)i);
+            continue;
+        }
+        if (retomar) {
+            retomar(&tabela->sessoes[i], &registro);
+        }
+        REG_INFO("🟢 Sessão %s:%u retomada\n", tabela->sessoes[i].protocolo.ip_destino, registro.porta);
+        restauradas++;
+    }
+
+    // Refaz a lista de livres sem as entradas restauradas
+    tabela->livres = -1;
+    for (int i = MAX_SESSOES - 1; i >= 0; i--) {
+        if (!tabela->sessoes[i].ativa) {
+            tabela->sessoes[i].proxima = tabela->livres;
+            tabela->livres = i;
+        }
+    }
+    return restauradas;
+}
+
+
+void sessoes_gravar(tabela_sessoes_t* tabela, sessao_t* sessao) {
+    if (!tabela || !sessao || !tabela->persistente || !sessao->ativa) return;
+
+    registro_sessao_t registro;
+    size_t tamanho = offsetof(registro_sessao_t, jogo);
+    memset(&registro, 0, tamanho);
+
+    registro.ip = sessao->ip;
+    registro.porta = sessao->porta;
+    registro.seq_atual = sessao->protocolo.seq_atual;
+    registro.tem_resposta = (uint8_t)sessao->tem_resposta;
+    registro.estado = sessao->estado;
+    registro.etapa = sessao->etapa;
+    registro.resposta = sessao->resposta;
+    if (sessao->pendente) {
+        registro.tem_pendente = 1;
+        registro.pendente = sessao->pendente->pack;
+    }
+
+    const transferencia_t* transferencia = &sessao->transferencia;
+    registro.indice_tesouro = transferencia->indice_tesouro;
+    registro.tipo = transferencia->tipo;
+    registro.num_fluxos = transferencia->num_fluxos;
+    registro.faixa_fluxos = transferencia->faixa_fluxos;
+    registro.tamanho = transferencia->tamanho;
+    registro.enviados = transferencia->enviados;
+    registro.proximo_bloco = transferencia->proximo_bloco;
+    registro.restante_intervalo = transferencia->restante_intervalo;
+    registro.posicao_arquivo = transferencia->enviados;
+    if (sessao->estado == SESSAO_AGUARDA_ACK && sessao->etapa == ETAPA_DADOS) {
+        // Os frames em voo são montados de novo a partir do último confirmado
+        registro.enviados = transferencia->confirmados;
+        registro.seq_atual = (uint8_t)((sessao->protocolo.seq_atual + 32 - transferencia->em_voo) % 32);
+    }
+    if (transferencia->arquivo && (sessao->estado == SESSAO_AGUARDA_PEDIDO || sessao->etapa == ETAPA_INTERVALO)) {
+        long posicao = ftell(transferencia->arquivo);
+        registro.posicao_arquivo = posicao > 0 ? (uint64_t)posicao : 0;
+    }
+
+    if (sessao->jogo_alterado) {
+        registro.jogo = sessao->jogo;
+        tamanho = offsetof(registro_sessao_t, progresso_fluxos);
+        sessao->jogo_alterado = 0;
+    }
+    instantaneo_gravar(&tabela->instantaneo, (uint32_t)(sessao - tabela->sessoes), &registro, tamanho);
+}
+
+
+uint64_t* sessoes_progresso_fluxos(tabela_sessoes_t* tabela, sessao_t* sessao) {
+    if (!tabela || !sessao || !tabela->persistente) return NULL;
+    registro_sessao_t* registro = instantaneo_registro(&tabela->instantaneo, (uint32_t)(sessao - tabela->sessoes));
+    return registro ? registro->progresso_fluxos : NULL;
+}
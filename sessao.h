@@ -0,0 +1,264 @@
+#ifndef SESSAO_H
+#define SESSAO_H
+
+#include <time.h>
+#include <pthread.h>
+#include "protocolo.h"
+#include "precarga.h"
+#include "leitor.h"
+#include "multifluxo.h"
+#include "temporizador.h"
+#include "instantaneo.h"
+#include "transmissor.h"
+#include "congestionamento.h"
+#include "metricas.h"
+
+
+#define MAX_SESSOES 1024                    // Jogadores simultâneos em um servidor
+#define BALDES_SESSOES (2 * MAX_SESSOES)    // Tamanho do índice por (IP, porta)
+#define SESSAO_INATIVA_S 300                // Sessões sem tráfego por este tempo são removidas
+#define REMOCAO_ADIADA_MS 20                // Nova tentativa de remover uma sessão ainda em execução
+#define FILA_EVENTOS 8                      // Eventos aguardando o trabalhador da sessão
+#define ARENA_SESSAO (16 * 1024)            // Memória de cada sessão para a transferência (tabela de blocos)
+// Fila cheia, pendente e janela de cada sessão, o frame em voo de cada fluxo paralelo, mais o da recepção
+#define QUADROS_SESSOES (MAX_SESSOES * (FILA_EVENTOS + 1 + JANELA_MAXIMA) + MAX_TRANSFERENCIAS_MULTIFLUXO * NUM_FLUXOS + 1)
+
+
+//////////// Máquina de estados da sessão ////////////
+
+// O que a sessão espera do cliente (ou do tempo) para continuar
+typedef enum {
+    SESSAO_OCIOSA = 0,              // Aguardando o próximo comando do cliente
+    SESSAO_AGUARDA_ACK = 1,         // Pacote pendente enviado, retransmitido no prazo medido pelo RTT
+    SESSAO_AGUARDA_PEDIDO = 2,      // Tabela de blocos enviada, aguardando pedido de reenvio
+    SESSAO_AGUARDA_CARGA = 3,       // Tesouro ainda sendo lido pela pré-carga
+    SESSAO_MULTIFLUXO = 4,          // Fluxos paralelos em andamento nas suas threads
+} estado_sessao_type;
+
+// Qual pacote está pendente: define o próximo passo quando o ACK chegar
+typedef enum {
+    ETAPA_MAPA = 0,                 // Mapa sem tesouro: volta a aguardar comandos
+    ETAPA_MAPA_TESOURO = 1,         // Mapa com tesouro: segue para o tamanho
+    ETAPA_TAMANHO = 2,              // Segue para o nome
+    ETAPA_NOME = 3,                 // Segue para os dados (ou fluxos paralelos)
+    ETAPA_DADOS = 4,                // Janela de dados; com tudo confirmado, MSG_FIM_ARQUIVO
+    ETAPA_FIM = 5,                  // ACK conclui; NACK inicia a tabela de blocos
+    ETAPA_TABELA = 6,               // Próximo frame da tabela de blocos
+    ETAPA_INTERVALO = 7,            // Próximo frame do intervalo pedido
+} etapa_sessao_type;
+
+
+// O que acordou a sessão
+typedef enum {
+    EVENTO_FRAME = 0,               // Frame do cliente
+    EVENTO_PRAZO = 1,               // Prazo agendado venceu
+} evento_sessao_type;
+
+typedef struct {
+    evento_sessao_type tipo;
+    quadro_t* quadro;                       // Frame recebido (só EVENTO_FRAME); o trabalhador solta
+} evento_sessao_t;
+
+
+//////////// Transferência de tesouro ////////////
+
+// Tudo que o envio do arquivo precisa guardar entre um frame e outro
+typedef struct {
+    int indice_tesouro;
+    mensagem_type tipo;
+    precarga_tesouro_t* pre;                // Conteúdo da pré-carga ou NULL
+    FILE* arquivo;                          // Origem dos reenvios (fmemopen com pré-carga)
+    uint64_t tamanho;
+    uint64_t enviados;                      // Bytes já colocados em frames
+    uint64_t confirmados;                   // Bytes confirmados pelo cliente
+    int fim_leitura;                        // Todos os frames de dados já foram montados
+    size_t indice_quadro;                   // Próximo frame pronto da pré-carga
+    leitor_t leitor;
+    int usa_leitor;
+    digest_arquivo_t digest;
+    int tem_digest;
+    int tem_vaga;                           // Ocupa uma das vagas de transferência do servidor
+    int64_t inicio_us;                      // Tesouro encontrado, para o tempo de transferência
+
+    // Janela de dados (Go-Back-N): frames em voo, do mais antigo ao mais novo
+    quadro_t* janela[JANELA_MAXIMA];
+    int64_t envio_us[JANELA_MAXIMA];        // Primeiro envio de cada frame, 0 depois de repetido (RTT)
+    int em_voo;
+    int duplicados;                         // ACKs repetidos do último frame confirmado
+    congestionamento_t congestionamento;
+
+    int num_fluxos;
+    int faixa_fluxos;                       // Faixa de portas do servidor, -1 sem fluxos
+    multifluxo_t multi;
+
+    uint32_t proximo_bloco;                 // Próximo CRC da tabela de blocos
+    uint32_t restante_intervalo;            // Bytes do intervalo pedido ainda não enviados
+} transferencia_t;
+
+
+//////////// Registro da sessão no instantâneo ////////////
+
+// O que um servidor reiniciado precisa para continuar a sessão de onde parou
+// O jogo fica no fim: só é regravado quando muda
+// O progresso dos fluxos paralelos é escrito pelas próprias threads dos fluxos, fora das gravações da sessão
+typedef struct {
+    uint32_t ip;
+    uint16_t porta;
+    uint8_t seq_atual;
+    uint8_t tem_resposta;
+    int32_t estado;
+    int32_t etapa;
+    int32_t tem_pendente;
+    pack_t pendente;
+    pack_t resposta;
+
+    int32_t indice_tesouro;
+    int32_t tipo;
+    int32_t num_fluxos;
+    int32_t faixa_fluxos;
+    uint64_t tamanho;
+    uint64_t enviados;
+    uint64_t posicao_arquivo;               // Leitura do intervalo pedido
+    uint32_t proximo_bloco;
+    uint32_t restante_intervalo;
+
+    struct_jogo jogo;
+    uint64_t progresso_fluxos[NUM_FLUXOS];
+} registro_sessao_t;
+
+
+//////////// Estrutura de uma sessão ////////////
+
+// Estado de um cliente, identificado pelo IP e porta de origem dos frames
+typedef struct {
+    int ativa;
+    unsigned int ip;                        // IP do cliente (ordem de rede)
+    unsigned short porta;                   // Porta de origem do cliente
+    protocolo_type protocolo;               // Destino e sequência da sessão
+    struct_jogo jogo;
+    int jogo_alterado;                      // Jogo mudou desde a última gravação no instantâneo
+    int jogo_pendente;                      // Sessão nova: o trabalhador sorteia o jogo no primeiro evento
+    time_t ultimo_contato;                  // Recepção e ACKs dos fluxos paralelos (acesso atômico)
+
+    estado_sessao_type estado;
+    etapa_sessao_type etapa;
+    quadro_t* pendente;                     // Último pacote que espera confirmação (NULL antes do primeiro)
+    int64_t pendente_us;                    // Envio do pendente, 0 depois de repetido (RTT)
+    retransmissao_t retransmissao;          // Prazo de retransmissão pelo RTT do cliente
+    pack_t resposta;                        // ACK/OK_ACK do último comando, repetido se ele chegar de novo
+    int tem_resposta;
+    transferencia_t transferencia;
+    arena_t arena;                          // Fatia de ARENA_SESSAO da tabela, limpa a cada tesouro
+
+    // Eventos produzidos pela thread principal e consumidos pelo trabalhador que executa a sessão
+    // Uma sessão está em no máximo um trabalhador por vez, então o jogo dispensa travas
+    evento_sessao_t eventos[FILA_EVENTOS];
+    unsigned inicio_eventos;                // Só o trabalhador escreve (acesso atômico)
+    unsigned fim_eventos;                   // Só a thread principal escreve (acesso atômico)
+    int em_execucao;                        // Na fila de um trabalhador ou executando (acesso atômico)
+    int falhou;                             // Envio falhou: a thread principal remove a sessão (acesso atômico)
+    uint32_t geracao;                       // Ocupações desta posição: o transmissor separa a sessão das anteriores
+    metricas_sessao_t metricas;
+
+    temporizador_t prazo;                   // Retransmissão do pendente, pré-carga ou fluxos paralelos
+    temporizador_t inatividade;             // Remoção por falta de tráfego ou falha de envio
+
+    int proxima;                            // Próxima sessão no mesmo balde (ou livre)
+} sessao_t;
+
+
+//////////// Tabela de sessões ////////////
+
+typedef struct {
+    sessao_t* sessoes;                      // MAX_SESSOES entradas
+    int baldes[BALDES_SESSOES];             // Primeira sessão de cada balde, -1 se vazio
+    int livres;                             // Lista de entradas livres
+    int num_sessoes;                        // Só a thread principal altera (acesso atômico)
+
+    slab_t quadros;                         // Frames recebidos e pendentes de todas as sessões
+    uint8_t* arenas;                        // MAX_SESSOES fatias de ARENA_SESSAO
+
+    roda_temporizadores_t roda;             // Trabalhadores agendam, a thread principal dispara pelo timerfd
+
+    instantaneo_t instantaneo;              // Registro de cada sessão, na mesma posição da tabela
+    int persistente;
+
+    const protocolo_type* escuta;           // Socket compartilhado por todas as sessões
+    void (*encerrar)(sessao_t* sessao);     // Libera a transferência de uma sessão removida
+} tabela_sessoes_t;
+
+
+//////////// Funções da tabela de sessões ////////////
+
+// Prepara a tabela vazia; as sessões usam o socket da escuta
+// encerrar é chamada para cada sessão removida (pode ser NULL)
+int sessoes_iniciar(tabela_sessoes_t* tabela, const protocolo_type* escuta, void (*encerrar)(sessao_t* sessao));
+
+// Procura a sessão do cliente (NULL se não existir)
+sessao_t* sessoes_buscar(tabela_sessoes_t* tabela, unsigned int ip, unsigned short porta);
+
+// Procura a sessão do cliente, criando uma nova se preciso (o jogo é sorteado no primeiro evento)
+// Retorna NULL se a tabela estiver cheia
+sessao_t* sessoes_obter(tabela_sessoes_t* tabela, unsigned int ip, unsigned short porta);
+
+// Admissão: a sessão do cliente, ou uma nova se houver menos de limite sessões e o servidor
+// não estiver sobrecarregado (consultado só para clientes novos)
+// Retorna NULL se o cliente novo deve ser recusado com SERVIDOR_OCUPADO
+sessao_t* sessoes_admitir(tabela_sessoes_t* tabela, unsigned int ip, unsigned short porta, int limite,
+                          int (*sobrecarregado)(void));
+
+// Remove a sessão da tabela, soltando os frames dela
+void sessoes_remover(tabela_sessoes_t* tabela, sessao_t* sessao);
+
+// Libera a tabela
+void sessoes_finalizar(tabela_sessoes_t* tabela);
+
+//////////// Eventos da sessão ////////////
+
+// Thread principal: entrega um evento à sessão, passando a ela a referência do frame
+// Retorna 1 se a sessão precisa ser enviada ao pool, 0 se já está nele ou -1 com a fila cheia
+// (o frame continua com quem chamou)
+int sessao_entregar(sessao_t* sessao, evento_sessao_type tipo, quadro_t* quadro);
+
+// Trabalhador: retira o próximo evento (0 se não houver)
+int sessao_proximo_evento(sessao_t* sessao, evento_sessao_t* evento);
+
+// Trabalhador sem eventos: libera a sessão
+// Retorna 1 se um evento chegou nesse meio tempo e a sessão continua com este trabalhador
+int sessao_liberar(sessao_t* sessao);
+
+//////////// Eventos de tempo ////////////
+
+// Relógio monotônico em milissegundos
+int64_t sessoes_agora_ms(void);
+
+// Agenda o próximo evento de tempo da sessão, substituindo o anterior
+void sessoes_agendar(tabela_sessoes_t* tabela, sessao_t* sessao, int64_t prazo_ms);
+
+// Cancela o evento de tempo da sessão
+void sessoes_desagendar(tabela_sessoes_t* tabela, sessao_t* sessao);
+
+// Retorna 1 se a sessão tem prazo agendado (um prazo já disparado e reagendado fica obsoleto)
+int sessoes_agendada(tabela_sessoes_t* tabela, sessao_t* sessao);
+
+// Thread principal, com o timerfd da roda legível: chama prazo_vencido para cada sessão com prazo vencido
+// e remove as sessões com falha de envio ou sem tráfego há mais de SESSAO_INATIVA_S segundos
+void sessoes_disparar(tabela_sessoes_t* tabela, int64_t agora_ms, void (*prazo_vencido)(sessao_t* sessao));
+
+// Trabalhador: a sessão falhou e deve ser removida pela thread principal
+void sessoes_falhou(tabela_sessoes_t* tabela, sessao_t* sessao);
+
+//////////// Instantâneo das sessões ////////////
+
+// Antes do primeiro frame: mantém as sessões no arquivo mapeado e restaura as que já estavam nele
+// retomar reabre a transferência de cada sessão restaurada; retorna quantas foram restauradas ou -1
+int sessoes_persistir(tabela_sessoes_t* tabela, const char* caminho,
+                      void (*retomar)(sessao_t* sessao, const registro_sessao_t* registro));
+
+// Trabalhador: grava o estado da sessão depois de um evento (o jogo só se tiver mudado)
+void sessoes_gravar(tabela_sessoes_t* tabela, sessao_t* sessao);
+
+// Progresso dos fluxos paralelos da sessão no instantâneo (NULL sem instantâneo)
+uint64_t* sessoes_progresso_fluxos(tabela_sessoes_t* tabela, sessao_t* sessao);
+
+#endif // SESSAO_H
@@ -0,0 +1,77 @@
+#ifndef SONDAS_H
+#define SONDAS_H
+
+#include <stdint.h>
+
+
+//////////// Sondas estáticas (USDT) ////////////
+
+// Pontos de rastreamento do provedor "tesouro" para bpftrace, perf e systemtap, sem recompilar:
+//   bpftrace -e 'usdt:./servidor:tesouro:reenvio { @[arg3] = count(); }'
+// Inativa, cada sonda é um nop; os argumentos só são lidos por quem estiver rastreando.
+// Todas têm quatro argumentos de 64 bits com sinal:
+//   enviar_pacote, receber_pacote, reenvio   seq, tipo, tamanho, sessão
+//   esperar_ack                              seq, tipo da resposta, resultado, sessão
+//   move_player                              x, y, direção, resultado
+//   valida_tesouro                           x, y, índice do tesouro (-1 sem tesouro), tesouros achados
+//   transferencia_inicio                     tamanho, índice do tesouro, fluxos, sessão
+//   transferencia_frame                      seq, frames em voo, bytes enviados, sessão
+//   transferencia_fim                        bytes confirmados, duração em µs, índice do tesouro, sessão
+// A sessão é o IP do par (ordem de rede) seguido dos 16 bits da porta, como em SONDA_SESSAO
+
+#define SONDA_SESSAO(ip, porta) ((int64_t)(((uint64_t)(uint32_t)(ip) << 16) | (uint16_t)(porta)))
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define SONDAS_SYS_SDT
+#endif
+#endif
+
+#if defined(SONDAS_SYS_SDT)
+
+#include <sys/sdt.h>
+#define SONDA(nome, a, b, c, d) \
+    STAP_PROBE4(tesouro, nome, (int64_t)(a), (int64_t)(b), (int64_t)(c), (int64_t)(d))
+
+#elif defined(__GNUC__) && defined(__x86_64__)
+
+// Sem o sys/sdt.h do systemtap: a mesma nota .note.stapsdt, montada aqui.
+// O nop marca o endereço da sonda; a nota guarda o endereço, o provedor, o nome e onde
+// cada argumento está naquele ponto (registrador, memória ou constante)
+#define SONDA(nome, a, b, c, d) \
+    __asm__ __volatile__ ( \
+        "990: nop\n" \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+        ".balign 4\n" \
+        ".4byte 992f-991f, 994f-993f, 3\n" \
+        "991: .asciz \"stapsdt\"\n" \
+        "992: .balign 4\n" \
+        "993: .8byte 990b\n" \
+        ".8byte _.stapsdt.base\n" \
+        ".8byte 0\n" \
+        ".asciz \"tesouro\"\n" \
+        ".asciz \"" #nome "\"\n" \
+        ".asciz \"-8@%[a1] -8@%[a2] -8@%[a3] -8@%[a4]\"\n" \
+        "994: .balign 4\n" \
+        ".popsection\n" \
+        ".ifndef _.stapsdt.base\n" \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n" \
+        ".hidden _.stapsdt.base\n" \
+        "_.stapsdt.base: .space 1\n" \
+        ".size _.stapsdt.base, 1\n" \
+        ".popsection\n" \
+        ".endif\n" \
+        : \
+        : [a1] "nor" ((int64_t)(a)), [a2] "nor" ((int64_t)(b)), \
+          [a3] "nor" ((int64_t)(c)), [a4] "nor" ((int64_t)(d)))
+
+#else
+
+// Sem suporte: as sondas somem
+#define SONDA(nome, a, b, c, d) \
+    do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+
+#endif
+
+#endif // SONDAS_H
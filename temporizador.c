@@ -0,0 +1,220 @@
+#define _XOPEN_SOURCE 700   // read()
+
+#include "temporizador.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+
+#define MASCARA_POSICAO (RODA_POSICOES - 1)
+
+
+static void desligar(roda_temporizadores_t* roda, temporizador_t* temporizador) {
+    temporizador_t** cabeca = &roda->posicoes[temporizador->nivel][temporizador->posicao];
+    if (temporizador->anterior) {
+        temporizador->anterior->proximo = temporizador->proximo;
+    } else {
+        *cabeca = temporizador->proximo;
+    }
+    if (temporizador->proximo) {
+        temporizador->proximo->anterior = temporizador->anterior;
+    }
+    if (!*cabeca) {
+        roda->ocupadas[temporizador->nivel] &= ~(1ULL << temporizador->posicao);
+    }
+    temporizador->ativo = 0;
+    roda->quantidade--;
+}
+
+
+// Coloca o temporizador no menor nível cuja faixa alcança o prazo
+// minimo é o primeiro milissegundo ainda não processado: prazos vencidos saem nele
+static void ligar(roda_temporizadores_t* roda, temporizador_t* temporizador, int64_t minimo) {
+    int64_t prazo = temporizador->prazo_ms < minimo ? minimo : temporizador->prazo_ms;
+    int64_t distancia = prazo - roda->atual_ms;
+
+    int nivel = 0;
+    while (nivel < RODA_NIVEIS - 1 && distancia >= (int64_t)1 << (RODA_BITS * (nivel + 1))) {
+        nivel++;
+    }
+    // Além do último nível: fica na posição mais distante e volta a subir quando ela for alcançada
+    int64_t limite = ((int64_t)1 << (RODA_BITS * RODA_NIVEIS)) - 1;
+    if (distancia > limite) {
+        prazo = roda->atual_ms + limite;
+    }
+    int posicao = (int)((prazo >> (RODA_BITS * nivel)) & MASCARA_POSICAO);
+
+    temporizador->nivel = nivel;
+    temporizador->posicao = posicao;
+    temporizador->anterior = NULL;
+    temporizador->proximo = roda->posicoes[nivel][posicao];
+    if (temporizador->proximo) {
+        temporizador->proximo->anterior = temporizador;
+    }
+    roda->posicoes[nivel][posicao] = temporizador;
+    roda->ocupadas[nivel] |= 1ULL << posicao;
+    temporizador->ativo = 1;
+    roda->quantidade++;
+}
+
+
+static void armar(roda_temporizadores_t* roda, int64_t instante_ms) {
+    struct itimerspec valor;
+    memset(&valor, 0, sizeof(valor));
+    if (instante_ms != INT64_MAX) {
+        valor.it_value.tv_sec = instante_ms / 1000;
+        valor.it_value.tv_nsec = (instante_ms % 1000) * 1000000;
+    }
+    timerfd_settime(roda->fd, TFD_TIMER_ABSTIME, &valor, NULL);
+    roda->armado_ms = instante_ms;
+}
+
+
+// Distância (1 a RODA_POSICOES) até a próxima posição ocupada depois de inicio, -1 se nenhuma
+static int proxima_ocupada(uint64_t ocupadas, int inicio) {
+    if (!ocupadas) {
+        return -1;
+    }
+    int giro = (inicio + 1) & MASCARA_POSICAO;
+    uint64_t girado = giro ? (ocupadas >> giro) | (ocupadas << (RODA_POSICOES - giro)) : ocupadas;
+    return __builtin_ctzll(girado) + 1;
+}
+
+
+// Primeiro instante em que algo vence ou desce de nível
+static int64_t proximo_evento(roda_temporizadores_t* roda) {
+    if (roda->quantidade == 0) {
+        return INT64_MAX;
+    }
+    int64_t proximo = INT64_MAX;
+    for (int nivel = 0; nivel < RODA_NIVEIS; nivel++) {
+        int deslocamento = RODA_BITS * nivel;
+        int64_t janela = roda->atual_ms >> deslocamento;
+        int distancia = proxima_ocupada(roda->ocupadas[nivel], (int)(janela & MASCARA_POSICAO));
+        if (distancia > 0) {
+            int64_t instante = (janela + distancia) << deslocamento;
+            if (instante < proximo) {
+                proximo = instante;
+            }
+        }
+    }
+    return proximo;
+}
+
+
+int roda_iniciar(roda_temporizadores_t* roda, int64_t agora_ms) {
+    if (!roda) return -1;
+
+    memset(roda, 0, sizeof(roda_temporizadores_t));
+    roda->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (roda->fd < 0) {
+        return -1;
+    }
+    roda->atual_ms = agora_ms;
+    roda->armado_ms = INT64_MAX;
+    pthread_mutex_init(&roda->trava, NULL);
+    return 0;
+}
+
+
+void roda_agendar(roda_temporizadores_t* roda, temporizador_t* temporizador, int64_t prazo_ms) {
+    if (!roda || !temporizador) return;
+
+    pthread_mutex_lock(&roda->trava);
+    if (temporizador->ativo) {
+        desligar(roda, temporizador);
+    }
+    temporizador->prazo_ms = prazo_ms;
+    ligar(roda, temporizador, roda->atual_ms + 1);
+
+    // Quase sempre já há algo mais próximo armado e nenhuma chamada ao kernel é feita
+    int64_t instante = prazo_ms > roda->atual_ms ? prazo_ms : roda->atual_ms + 1;
+    if (instante < roda->armado_ms) {
+        armar(roda, instante);
+    }
+    pthread_mutex_unlock(&roda->trava);
+}
+
+
+void roda_cancelar(roda_temporizadores_t* roda, temporizador_t* temporizador) {
+    if (!roda || !temporizador) return;
+
+    pthread_mutex_lock(&roda->trava);
+    if (temporizador->ativo) {
+        desligar(roda, temporizador);
+    }
+    pthread_mutex_unlock(&roda->trava);
+}
+
+
+int roda_agendado(roda_temporizadores_t* roda, temporizador_t* temporizador) {
+    if (!roda || !temporizador) return 0;
+
+    pthread_mutex_lock(&roda->trava);
+    int ativo = temporizador->ativo;
+    pthread_mutex_unlock(&roda->trava);
+    return ativo;
+}
+
+
+temporizador_t* roda_avancar(roda_temporizadores_t* roda, int64_t agora_ms) {
+    if (!roda) return NULL;
+
+    // Zera a leitura pendente do timerfd (pode não haver nenhuma)
+    uint64_t disparos;
+    if (read(roda->fd, &disparos, sizeof(disparos)) < 0) {
+        disparos = 0;
+    }
+
+    temporizador_t* vencidos = NULL;
+    pthread_mutex_lock(&roda->trava);
+    while (roda->atual_ms < agora_ms) {
+        // Pular direto para o próximo milissegundo com algo a vencer ou descer
+        int64_t proximo = proximo_evento(roda);
+        if (proximo > agora_ms) {
+            roda->atual_ms = agora_ms;
+            break;
+        }
+        int64_t instante = proximo > roda->atual_ms ? proximo : roda->atual_ms + 1;
+        roda->atual_ms = instante;
+
+        // Início de uma janela: os temporizadores da posição alcançada descem de nível
+        for (int nivel = 1; nivel < RODA_NIVEIS; nivel++) {
+            int deslocamento = RODA_BITS * (nivel - 1);
+            if (((instante >> deslocamento) & MASCARA_POSICAO) != 0) {
+                break;
+            }
+            int posicao = (int)((instante >> (RODA_BITS * nivel)) & MASCARA_POSICAO);
+            temporizador_t* lista = roda->posicoes[nivel][posicao];
+            roda->posicoes[nivel][posicao] = NULL;
+            roda->ocupadas[nivel] &= ~(1ULL << posicao);
+            while (lista) {
+                temporizador_t* seguinte = lista->proximo;
+                roda->quantidade--;
+                ligar(roda, lista, instante);
+                lista = seguinte;
+            }
+        }
+
+        int posicao = (int)(instante & MASCARA_POSICAO);
+        while (roda->posicoes[0][posicao]) {
+            temporizador_t* temporizador = roda->posicoes[0][posicao];
+            desligar(roda, temporizador);
+            temporizador->proximo_vencido = vencidos;
+            vencidos = temporizador;
+        }
+    }
+
+    armar(roda, proximo_evento(roda));
+    pthread_mutex_unlock(&roda->trava);
+    return vencidos;
+}
+
+
+void roda_finalizar(roda_temporizadores_t* roda) {
+    if (!roda || roda->fd < 0) return;
+    close(roda->fd);
+    roda->fd = -1;
+    pthread_mutex_destroy(&roda->trava);
+}
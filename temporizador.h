@@ -0,0 +1,67 @@
+#ifndef TEMPORIZADOR_H
+#define TEMPORIZADOR_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+
+#define RODA_NIVEIS 4                       // Níveis da roda: 64 ms, 4 s, 4 min e 4,6 h
+#define RODA_BITS 6
+#define RODA_POSICOES (1 << RODA_BITS)      // Posições de cada nível (resolução de 1 ms no primeiro)
+
+
+//////////// Temporizador ////////////
+
+// Fica embutido em quem o usa (a sessão); agendar e cancelar só ligam e desligam ponteiros
+typedef struct temporizador {
+    int64_t prazo_ms;                       // Relógio monotônico
+    struct temporizador* anterior;          // Lista da posição na roda
+    struct temporizador* proximo;
+    struct temporizador* proximo_vencido;   // Lista entregue por roda_avancar
+    int nivel;
+    int posicao;
+    int ativo;
+    void* dono;
+} temporizador_t;
+
+
+//////////// Roda hierárquica ////////////
+
+// Cada nível cobre RODA_POSICOES vezes o anterior. Um temporizador entra no menor
+// nível que alcança o prazo e desce de nível quando a posição dele é alcançada.
+// Um único timerfd é armado para o próximo instante em que algo vence ou desce.
+typedef struct {
+    temporizador_t* posicoes[RODA_NIVEIS][RODA_POSICOES];
+    uint64_t ocupadas[RODA_NIVEIS];         // Bit de cada posição não vazia
+    int64_t atual_ms;                       // Último milissegundo já processado
+    int quantidade;
+
+    int fd;                                 // timerfd (CLOCK_MONOTONIC, tempo absoluto)
+    int64_t armado_ms;                      // Instante armado no timerfd (INT64_MAX se desarmado)
+    pthread_mutex_t trava;                  // Os trabalhadores agendam, a thread principal avança
+} roda_temporizadores_t;
+
+
+//////////// Funções da roda ////////////
+
+// Cria a roda e o timerfd, começando em agora_ms
+int roda_iniciar(roda_temporizadores_t* roda, int64_t agora_ms);
+
+// Agenda (ou reagenda) o temporizador para prazo_ms; O(1)
+// Arma o timerfd se o prazo for o mais próximo
+void roda_agendar(roda_temporizadores_t* roda, temporizador_t* temporizador, int64_t prazo_ms);
+
+// Cancela o temporizador, se agendado; O(1)
+void roda_cancelar(roda_temporizadores_t* roda, temporizador_t* temporizador);
+
+// Retorna 1 se o temporizador está agendado
+int roda_agendado(roda_temporizadores_t* roda, temporizador_t* temporizador);
+
+// Thread principal, com o timerfd legível: processa a roda até agora_ms e rearma o timerfd
+// Retorna os temporizadores vencidos, já desagendados, ligados por proximo_vencido
+temporizador_t* roda_avancar(roda_temporizadores_t* roda, int64_t agora_ms);
+
+// Fecha o timerfd
+void roda_finalizar(roda_temporizadores_t* roda);
+
+#endif // TEMPORIZADOR_H
@@ -0,0 +1,1253 @@
+#define _XOPEN_SOURCE 700   // clock_gettime(), mkstemp()
+
+#include "integridade.h"
+#include "memoria.h"
+#include "transmissor.h"
+#include "perturbacao.h"
+#include "temporizador.h"
+#include "instantaneo.h"
+#include "congestionamento.h"
+#include "histograma.h"
+#include "captura.h"
+#include "registro.h"
+#include "escritor.h"
+#include "leitor.h"
+#include "precarga.h"
+#include "sessao.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+
+//////////// Testes de resposta conhecida ////////////
+
+// Cada módulo é conferido contra valores calculados à mão ou por uma referência externa,
+// sem rede nem root. make test compila e roda: cada verificação que falha é listada, e o
+// programa termina com erro se houver alguma
+
+static int verificacoes;
+static int falhas;
+
+#define CONFERIR(condicao) conferir((condicao) != 0, #condicao, __FILE__, __LINE__)
+
+static void conferir(int ok, const char* expressao, const char* arquivo, int linha) {
+    verificacoes++;
+    if (!ok) {
+        falhas++;
+        printf("🔴 %s:%d: %s\n", arquivo, linha, expressao);
+    }
+}
+
+
+// Dados pseudoaleatórios reproduzíveis (LCG), para os testes que precisam de volume
+static void preencher(uint8_t* dados, size_t tamanho, uint32_t semente) {
+    for (size_t i = 0; i < tamanho; i++) {
+        semente = semente * 1103515245u + 12345u;
+        dados[i] = (uint8_t)(semente >> 16);
+    }
+}
+
+
+//////////// CRC-64 e digest ////////////
+
+static void testar_integridade(void) {
+    // Valor de verificação do catálogo para CRC-64/XZ
+    const uint8_t padrao[] = "123456789";
+    CONFERIR(crc64_atualizar(0, padrao, 9) == 0x995dc9bbdf1939faULL);
+    CONFERIR(crc64_atualizar(0, padrao, 0) == 0);
+
+    // Em partes ou de uma vez, o mesmo CRC
+    CONFERIR(crc64_atualizar(crc64_atualizar(0, padrao, 4), padrao + 4, 5) == 0x995dc9bbdf1939faULL);
+
+    // Combinar os CRCs de A e B dá o CRC de A+B
+    CONFERIR(crc64_combinar(crc64_atualizar(0, padrao, 4), crc64_atualizar(0, padrao + 4, 5), 5) ==
+             0x995dc9bbdf1939faULL);
+    CONFERIR(crc64_combinar(0x995dc9bbdf1939faULL, 0, 0) == 0x995dc9bbdf1939faULL);
+
+    size_t tamanho = 3 * BLOCO_VERIFICACAO + 1000;
+    uint8_t* dados = malloc(tamanho);
+    uint8_t* copia = malloc(tamanho);
+    if (!dados || !copia) {
+        CONFERIR(dados && copia);
+        free(dados);
+        free(copia);
+        return;
+    }
+    preencher(dados, tamanho, 27);
+    uint64_t crc_total = crc64_atualizar(0, dados, tamanho);
+    size_t corte = BLOCO_VERIFICACAO + 123;
+    CONFERIR(crc64_combinar(crc64_atualizar(0, dados, corte), crc64_atualizar(0, dados + corte, tamanho - corte),
+                            tamanho - corte) == crc_total);
+
+    // Digest em pedaços de tamanhos irregulares: o do arquivo e um por bloco
+    CONFERIR(digest_num_blocos(0) == 0);
+    CONFERIR(digest_num_blocos(BLOCO_VERIFICACAO) == 1);
+    CONFERIR(digest_num_blocos(tamanho) == 4);
+
+    digest_arquivo_t original;
+    CONFERIR(digest_iniciar(&original, tamanho) == 0);
+    for (size_t feito = 0; feito < tamanho;) {
+        size_t parte = tamanho - feito < 127 ? tamanho - feito : 127;
+        digest_atualizar(&original, dados + feito, parte);
+        feito += parte;
+    }
+    CONFERIR(original.crc_arquivo == crc_total);
+    CONFERIR(original.num_blocos == 4);
+    for (uint32_t b = 0; b < original.num_blocos; b++) {
+        size_t offset = (size_t)b * BLOCO_VERIFICACAO;
+        size_t parte = tamanho - offset < BLOCO_VERIFICACAO ? tamanho - offset : BLOCO_VERIFICACAO;
+        CONFERIR(original.crc_blocos[b] == crc64_atualizar(0, dados + offset, parte));
+    }
+
+    // Reenvio: um bit trocado no bloco 2 só muda o CRC desse bloco, e regravá-lo restaura o do arquivo
+    memcpy(copia, dados, tamanho);
+    copia[2 * BLOCO_VERIFICACAO + 77] ^= 0x10;
+    digest_arquivo_t recebido;
+    CONFERIR(digest_iniciar(&recebido, tamanho) == 0);
+    digest_atualizar(&recebido, copia, tamanho);
+    CONFERIR(recebido.crc_arquivo != original.crc_arquivo);
+    for (uint32_t b = 0; b < recebido.num_blocos; b++) {
+        CONFERIR((recebido.crc_blocos[b] != original.crc_blocos[b]) == (b == 2));
+    }
+    memcpy(copia + 2 * BLOCO_VERIFICACAO, dados + 2 * BLOCO_VERIFICACAO, BLOCO_VERIFICACAO);
+    CONFERIR(crc64_atualizar(0, copia, tamanho) == crc_total);
+    digest_liberar(&recebido);
+
+    // Fluxos paralelos: trechos em fronteira de bloco anexados em ordem dão o digest do arquivo
+    digest_arquivo_t montado, trecho;
+    CONFERIR(digest_iniciar(&montado, tamanho) == 0);
+    size_t inicio_trecho[] = { 0, BLOCO_VERIFICACAO, 3 * BLOCO_VERIFICACAO, tamanho };
+    for (int t = 0; t < 3; t++) {
+        size_t parte = inicio_trecho[t + 1] - inicio_trecho[t];
+        CONFERIR(digest_iniciar(&trecho, parte) == 0);
+        digest_atualizar(&trecho, dados + inicio_trecho[t], parte);
+        digest_anexar(&montado, &trecho, inicio_trecho[t]);
+        digest_liberar(&trecho);
+    }
+    CONFERIR(montado.crc_arquivo == crc_total);
+    CONFERIR(memcmp(montado.crc_blocos, original.crc_blocos, 4 * sizeof(uint64_t)) == 0);
+    digest_liberar(&montado);
+
+    digest_liberar(&original);
+    free(dados);
+    free(copia);
+}
+
+
+//////////// Slab e arena ////////////
+
+#define SLAB_THREADS 4
+#define SLAB_RODADAS 200000
+
+static slab_t slab_disputado;
+static int slab_conflitos;
+
+// Aloca, marca com o número da thread e devolve: um objeto entregue a duas threads troca de marca
+static void* disputar_slab(void* arg) {
+    uint32_t marca = (uint32_t)(uintptr_t)arg;
+    for (int i = 0; i < SLAB_RODADAS; i++) {
+        uint32_t* objeto = slab_alocar(&slab_disputado);
+        if (!objeto) continue;
+        __atomic_store_n(objeto, marca, __ATOMIC_RELAXED);
+        for (int espera = 0; espera < 8; espera++) {
+            if (__atomic_load_n(objeto, __ATOMIC_RELAXED) != marca) {
+                __atomic_add_fetch(&slab_conflitos, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        slab_devolver(&slab_disputado, objeto);
+    }
+    return NULL;
+}
+
+
+static void testar_memoria(void) {
+    // Objetos arredondados ao alinhamento, entregues em ordem até esgotar
+    slab_t slab;
+    CONFERIR(slab_iniciar(&slab, 40, 4, 64) == 0);
+    CONFERIR(slab.tamanho_objeto == 64);
+    uint8_t* objetos[4];
+    for (int i = 0; i < 4; i++) {
+        objetos[i] = slab_alocar(&slab);
+        CONFERIR(objetos[i] == slab.memoria + 64 * i);
+        CONFERIR(((uintptr_t)objetos[i] & 63) == 0);
+    }
+    CONFERIR(slab_alocar(&slab) == NULL);
+    CONFERIR(slab.em_uso == 4);
+
+    // O último devolvido é o próximo a sair, e cada troca do topo avança a versão
+    uint32_t versao = (uint32_t)(slab.topo >> 32);
+    slab_devolver(&slab, objetos[2]);
+    slab_devolver(&slab, objetos[0]);
+    CONFERIR((uint32_t)(slab.topo >> 32) == versao + 2);
+    CONFERIR((uint32_t)slab.topo == 1);
+    CONFERIR(slab_alocar(&slab) == objetos[0]);
+    CONFERIR(slab_alocar(&slab) == objetos[2]);
+    CONFERIR((uint32_t)(slab.topo >> 32) == versao + 4);
+
+    // Endereços de fora são ignorados
+    uint8_t fora;
+    CONFERIR(!slab_contem(&slab, &fora));
+    CONFERIR(slab_contem(&slab, objetos[3] + 63));
+    CONFERIR(!slab_contem(&slab, objetos[3] + 64));
+    slab_devolver(&slab, &fora);
+    CONFERIR(slab.em_uso == 4);
+    for (int i = 0; i < 4; i++) {
+        slab_devolver(&slab, objetos[i]);
+    }
+    CONFERIR(slab.em_uso == 0);
+    slab_finalizar(&slab);
+
+    // Várias threads disputando poucos objetos: nenhum é entregue a duas ao mesmo tempo
+    CONFERIR(slab_iniciar(&slab_disputado, sizeof(uint32_t), SLAB_THREADS, 64) == 0);
+    pthread_t threads[SLAB_THREADS];
+    for (int t = 0; t < SLAB_THREADS; t++) {
+        pthread_create(&threads[t], NULL, disputar_slab, (void*)(uintptr_t)(t + 1));
+    }
+    for (int t = 0; t < SLAB_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    CONFERIR(slab_conflitos == 0);
+    CONFERIR(slab_disputado.em_uso == 0);
+    int livres = 0;
+    while (slab_alocar(&slab_disputado)) {
+        livres++;
+    }
+    CONFERIR(livres == SLAB_THREADS);
+    slab_finalizar(&slab_disputado);
+
+    // Arena: blocos alinhados em sequência até o fim da memória
+    static uint8_t memoria[100] __attribute__((aligned(16)));
+    arena_t arena;
+    arena_iniciar(&arena, memoria, sizeof(memoria));
+    CONFERIR(arena_alocar(&arena, 1) == memoria);
+    CONFERIR(arena_alocar(&arena, 1) == memoria + 16);
+    CONFERIR(arena_alocar(&arena, 60) == memoria + 32);
+    CONFERIR(arena_alocar(&arena, 5) == NULL);
+    CONFERIR(arena_alocar(&arena, 4) == memoria + 96);
+    CONFERIR(arena_alocar(&arena, 0) == NULL);
+    arena_limpar(&arena);
+    CONFERIR(arena_alocar(&arena, 100) == memoria);
+}
+
+
+//////////// Anel de transmissão ////////////
+
+#define TRANSMISSOR_PRODUTORES 4
+#define TRANSMISSOR_FRAMES 5000             // Por produtor
+#define TRANSMISSOR_QUADROS 64              // Menos frames que o anel: os produtores esperam o slab
+
+static transmissor_t transmissor;
+static slab_t quadros_transmissor;
+static rawsocket_t destino_transmissor;     // Nunca usado: a perturbação descarta todos os frames
+
+static void* produzir_envios(void* arg) {
+    remetente_t remetente = { (int)(intptr_t)arg, 1 };
+    for (int i = 0; i < TRANSMISSOR_FRAMES; i++) {
+        quadro_t* quadro;
+        while (!(quadro = quadro_alocar(&quadros_transmissor))) {
+            sched_yield();
+        }
+        quadro->pack.tamanho = (uint8_t)(i % MAX_FRAME);
+        if (transmissor_enviar(&transmissor, quadro, &destino_transmissor, remetente) < 0) {
+            quadro_soltar(&quadros_transmissor, quadro);
+        }
+    }
+    return NULL;
+}
+
+
+static int64_t relogio_us(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (int64_t)agora.tv_sec * 1000000 + agora.tv_nsec / 1000;
+}
+
+
+static void testar_transmissor(void) {
+    // Ritmo: a tabela e os valores da variável RITMO por cima, em KB/s
+    ritmo_interface_t ritmo;
+    CONFERIR(transmissor_ritmo(&ritmo, "lo", NULL) == 0);
+    CONFERIR(ritmo.taxa_global == 0 && ritmo.taxa_sessao == 0);
+    CONFERIR(transmissor_ritmo(&ritmo, "desconhecida", "total=100,sessao=10,rajada=3000") == 0);
+    CONFERIR(ritmo.taxa_global == 100000 && ritmo.taxa_sessao == 10000 && ritmo.rajada == 3000);
+    CONFERIR(transmissor_ritmo(&ritmo, "lo", "total=1") == 0);
+    CONFERIR(ritmo.taxa_global == 1000 && ritmo.rajada == CABECALHOS_QUADRO + MAX_FRAME);
+    CONFERIR(transmissor_ritmo(&ritmo, "lo", "total=-1") < 0);
+    CONFERIR(transmissor_ritmo(&ritmo, "lo", "velocidade=1") < 0);
+
+    // Os frames são "enviados" pela perturbação, que descarta todos sem tocar na rede
+    CONFERIR(perturbacao_iniciar("perda=1") == 0);
+    destino_transmissor.sockfd = -1;
+    CONFERIR(slab_iniciar(&quadros_transmissor, sizeof(quadro_t), TRANSMISSOR_QUADROS, 64) == 0);
+
+    // Vários produtores: cada frame aceito é transmitido uma vez e volta ao slab
+    transmissor_ritmo(&ritmo, "lo", NULL);
+    CONFERIR(transmissor_iniciar(&transmissor, &quadros_transmissor, &ritmo, TRANSMISSOR_PRODUTORES) == 0);
+    pthread_t produtores[TRANSMISSOR_PRODUTORES];
+    for (int p = 0; p < TRANSMISSOR_PRODUTORES; p++) {
+        pthread_create(&produtores[p], NULL, produzir_envios, (void*)(intptr_t)p);
+    }
+    for (int p = 0; p < TRANSMISSOR_PRODUTORES; p++) {
+        pthread_join(produtores[p], NULL);
+    }
+    int falhas = 0;
+    for (int p = 0; p < TRANSMISSOR_PRODUTORES; p++) {
+        remetente_t remetente = { p, 1 };
+        falhas += transmissor_falhou(&transmissor, remetente);
+    }
+    transmissor_finalizar(&transmissor);
+    CONFERIR(transmissor.transmitidos == TRANSMISSOR_PRODUTORES * TRANSMISSOR_FRAMES);
+    CONFERIR(transmissor_pendentes(&transmissor) == 0);
+    CONFERIR(quadros_transmissor.em_uso == 0);
+    CONFERIR(falhas == 0);
+
+    // Com ritmo, a transmissão não termina antes do que a taxa permite além da rajada
+    ritmo.taxa_global = 1000000;
+    ritmo.rajada = CABECALHOS_QUADRO + MAX_FRAME;
+    CONFERIR(transmissor_iniciar(&transmissor, &quadros_transmissor, &ritmo, 0) == 0);
+    int64_t inicio = relogio_us();
+    uint64_t bytes = 0;
+    for (int i = 0; i < 200; i++) {
+        quadro_t* quadro;
+        while (!(quadro = quadro_alocar(&quadros_transmissor))) {
+            sched_yield();
+        }
+        quadro->pack.tamanho = 100;
+        bytes += CABECALHOS_QUADRO + 100;
+        transmissor_enviar(&transmissor, quadro, &destino_transmissor, SEM_REMETENTE);
+    }
+    while (transmissor_pendentes(&transmissor) > 0) {
+        sched_yield();
+    }
+    int64_t decorrido_us = relogio_us() - inicio;
+    transmissor_finalizar(&transmissor);
+    CONFERIR(decorrido_us >= (int64_t)((bytes - ritmo.rajada) * 1000000 / ritmo.taxa_global) - 1000);
+    CONFERIR(quadros_transmissor.em_uso == 0);
+
+    // Sem a perturbação o envio no socket inválido falha (depois de MAX_RETRY tentativas):
+    // a falha fica com a geração do remetente, e o frame atrasado da sessão anterior na
+    // mesma posição não marca a sessão que a ocupa agora
+    perturbacao_finalizar();
+    transmissor_ritmo(&ritmo, "lo", NULL);
+    CONFERIR(transmissor_iniciar(&transmissor, &quadros_transmissor, &ritmo, 2) == 0);
+    remetente_t atual = { 1, 7 };
+    remetente_t anterior = { 1, 6 };
+    remetente_t vizinha = { 0, 6 };
+    CONFERIR(!transmissor_falhou(&transmissor, anterior) && !transmissor_falhou(&transmissor, SEM_REMETENTE));
+    quadro_t* quadro = quadro_alocar(&quadros_transmissor);
+    transmissor_enviar(&transmissor, quadro, &destino_transmissor, anterior);
+    while (transmissor_pendentes(&transmissor) > 0) {
+        sched_yield();
+    }
+    CONFERIR(transmissor_falhou(&transmissor, anterior));
+    CONFERIR(!transmissor_falhou(&transmissor, atual) && !transmissor_falhou(&transmissor, vizinha));
+    transmissor_finalizar(&transmissor);
+    CONFERIR(quadros_transmissor.em_uso == 0);
+
+    slab_finalizar(&quadros_transmissor);
+}
+
+
+//////////// Roda de temporizadores ////////////
+
+#define RODA_INICIO_MS 1000
+
+static void testar_temporizador(void) {
+    roda_temporizadores_t roda;
+    CONFERIR(roda_iniciar(&roda, RODA_INICIO_MS) == 0);
+
+    // Prazos em cada nível, nas fronteiras das posições: os dos níveis altos descem até o primeiro
+    static const int64_t prazos[] = { 1, 63, 64, 65, 100, 4095, 4096, 4097, 5000, 262143, 262144, 300000 };
+    enum { NUM_PRAZOS = sizeof(prazos) / sizeof(prazos[0]) };
+    temporizador_t temporizadores[NUM_PRAZOS];
+    int64_t vencido_em[NUM_PRAZOS];
+    memset(temporizadores, 0, sizeof(temporizadores));
+    for (int i = 0; i < NUM_PRAZOS; i++) {
+        temporizadores[i].dono = &vencido_em[i];
+        vencido_em[i] = 0;
+        roda_agendar(&roda, &temporizadores[i], RODA_INICIO_MS + prazos[i]);
+    }
+    CONFERIR(roda.quantidade == NUM_PRAZOS);
+    CONFERIR(temporizadores[0].nivel == 0);
+    CONFERIR(temporizadores[4].nivel == 1);
+    CONFERIR(temporizadores[8].nivel == 2);
+    CONFERIR(temporizadores[11].nivel == 3);
+
+    // Cancelado não vence; reagendado vence só no novo prazo
+    temporizador_t cancelado, reagendado;
+    memset(&cancelado, 0, sizeof(cancelado));
+    memset(&reagendado, 0, sizeof(reagendado));
+    roda_agendar(&roda, &cancelado, RODA_INICIO_MS + 70);
+    roda_cancelar(&roda, &cancelado);
+    CONFERIR(!roda_agendado(&roda, &cancelado));
+    roda_agendar(&roda, &reagendado, RODA_INICIO_MS + 10);
+    roda_agendar(&roda, &reagendado, RODA_INICIO_MS + 5000);
+    int64_t reagendado_em = 0;
+
+    // Um milissegundo por vez: cada temporizador sai exatamente no seu prazo
+    int indevidos = 0;
+    for (int64_t agora = RODA_INICIO_MS + 1; agora <= RODA_INICIO_MS + 300001; agora++) {
+        for (temporizador_t* t = roda_avancar(&roda, agora); t; t = t->proximo_vencido) {
+            if (t == &reagendado) {
+                reagendado_em = agora;
+            } else if (t->dono) {
+                *(int64_t*)t->dono = agora;
+            } else {
+                indevidos++;
+            }
+        }
+    }
+    for (int i = 0; i < NUM_PRAZOS; i++) {
+        CONFERIR(vencido_em[i] == RODA_INICIO_MS + prazos[i]);
+    }
+    CONFERIR(reagendado_em == RODA_INICIO_MS + 5000);
+    CONFERIR(indevidos == 0);
+    CONFERIR(roda.quantidade == 0);
+
+    // Um salto grande entrega tudo que venceu no caminho; prazo no passado vence no próximo avanço
+    int64_t agora = roda.atual_ms;
+    for (int i = 0; i < NUM_PRAZOS; i++) {
+        roda_agendar(&roda, &temporizadores[i], agora + prazos[i]);
+    }
+    roda_agendar(&roda, &cancelado, agora - 50);
+    int vencidos = 0;
+    for (temporizador_t* t = roda_avancar(&roda, agora + 5000); t; t = t->proximo_vencido) {
+        vencidos++;
+    }
+    CONFERIR(vencidos == 10);
+    CONFERIR(!roda_agendado(&roda, &cancelado));
+    CONFERIR(roda_agendado(&roda, &temporizadores[9]));
+    CONFERIR(roda.quantidade == 3);
+    roda_finalizar(&roda);
+}
+
+
+//////////// Tabela de sessões ////////////
+
+static int sessoes_encerradas;
+
+static void contar_encerrada(sessao_t* sessao) {
+    (void)sessao;
+    sessoes_encerradas++;
+}
+
+static void testar_sessoes(void) {
+    // O socket da escuta não é usado: as sessões só copiam o descritor e montam o destino
+    static protocolo_type escuta;
+    static tabela_sessoes_t tabela;
+    escuta.rawsock.sockfd = -1;
+    CONFERIR(sessoes_iniciar(&tabela, &escuta, contar_encerrada) == 0);
+
+    unsigned int ip = 0x0100007f;
+    sessao_t* primeira = sessoes_obter(&tabela, ip, 23623);
+    sessao_t* segunda = sessoes_obter(&tabela, ip, 23633);
+    CONFERIR(primeira && segunda && primeira != segunda);
+    CONFERIR(tabela.num_sessoes == 2);
+    CONFERIR(sessoes_obter(&tabela, ip, 23623) == primeira && tabela.num_sessoes == 2);
+    CONFERIR(sessoes_buscar(&tabela, ip, 23633) == segunda);
+    CONFERIR(sessoes_buscar(&tabela, ip, 23643) == NULL);
+
+    // O jogo é sorteado pelo trabalhador do primeiro evento, não na recepção
+    CONFERIR(primeira->jogo_pendente == 1 && primeira->jogo.tesouros[0].nome_tesouro[0] == '\0');
+
+    // A entrada liberada volta limpa para o próximo cliente
+    primeira->jogo_pendente = 0;
+    primeira->estado = SESSAO_AGUARDA_ACK;
+    primeira->transferencia.faixa_fluxos = 3;
+    primeira->falhou = 1;
+    sessoes_remover(&tabela, primeira);
+    CONFERIR(sessoes_encerradas == 1 && tabela.num_sessoes == 1);
+    CONFERIR(sessoes_buscar(&tabela, ip, 23623) == NULL);
+    sessao_t* terceira = sessoes_obter(&tabela, ip, 23653);
+    CONFERIR(terceira == primeira);
+    CONFERIR(terceira->porta == 23653 && terceira->jogo_pendente == 1 && terceira->estado == SESSAO_OCIOSA);
+    CONFERIR(terceira->transferencia.faixa_fluxos == -1 && terceira->falhou == 0);
+    CONFERIR(sessoes_buscar(&tabela, ip, 23653) == terceira && sessoes_buscar(&tabela, ip, 23633) == segunda);
+
+    // Falha de envio: a remoção fica para a thread principal, no próximo disparo da roda
+    sessoes_falhou(&tabela, segunda);
+    __atomic_store_n(&segunda->falhou, 1, __ATOMIC_RELEASE);
+    sessoes_disparar(&tabela, sessoes_agora_ms() + 2, NULL);
+    CONFERIR(!segunda->ativa && sessoes_encerradas == 2 && tabela.num_sessoes == 1);
+    CONFERIR(sessoes_buscar(&tabela, ip, 23633) == NULL);
+
+    sessoes_remover(&tabela, terceira);
+    CONFERIR(tabela.num_sessoes == 0);
+    sessoes_finalizar(&tabela);
+}
+
+
+//////////// Admissão com SERVIDOR_OCUPADO ////////////
+
+static int sobrecarga_teste;
+static int consultas_sobrecarga;
+
+static int sobrecarregado_teste(void) {
+    consultas_sobrecarga++;
+    return sobrecarga_teste;
+}
+
+static void testar_admissao(void) {
+    static protocolo_type escuta;
+    static tabela_sessoes_t tabela;
+    escuta.rawsock.sockfd = -1;
+    CONFERIR(sessoes_iniciar(&tabela, &escuta, NULL) == 0);
+
+    // No limite de 2 sessões o terceiro cliente é recusado; os que já existem continuam,
+    // sem consultar a sobrecarga
+    unsigned int ip = 0x0100007f;
+    sessao_t* primeira = sessoes_admitir(&tabela, ip, 23623, 2, sobrecarregado_teste);
+    sessao_t* segunda = sessoes_admitir(&tabela, ip, 23633, 2, sobrecarregado_teste);
+    CONFERIR(primeira && segunda && tabela.num_sessoes == 2);
+    CONFERIR(sessoes_admitir(&tabela, ip, 23643, 2, sobrecarregado_teste) == NULL);
+    CONFERIR(tabela.num_sessoes == 2 && sessoes_buscar(&tabela, ip, 23643) == NULL);
+    sobrecarga_teste = 1;
+    consultas_sobrecarga = 0;
+    CONFERIR(sessoes_admitir(&tabela, ip, 23623, 2, sobrecarregado_teste) == primeira);
+    CONFERIR(consultas_sobrecarga == 0);
+
+    // Abaixo do limite, a sobrecarga recusa o cliente novo; passada ela, ele entra
+    sessoes_remover(&tabela, segunda);
+    CONFERIR(sessoes_admitir(&tabela, ip, 23643, 2, sobrecarregado_teste) == NULL);
+    CONFERIR(consultas_sobrecarga == 1 && tabela.num_sessoes == 1);
+    sobrecarga_teste = 0;
+    CONFERIR(sessoes_admitir(&tabela, ip, 23643, 2, sobrecarregado_teste) != NULL);
+    CONFERIR(tabela.num_sessoes == 2);
+
+    // A recusa leva a sequência do comando e a espera; o cliente repete o mesmo comando
+    pack_t pack;
+    uint16_t espera_ms = 0;
+    CONFERIR(criar_erro_ocupado(&pack, 17, 350) == 0);
+    CONFERIR(pack.tipo == MSG_ERRO && getSeq(pack) == 17 && pack.dados[0] == SERVIDOR_OCUPADO);
+    CONFERIR(ler_erro_ocupado(&pack, &espera_ms) == 1 && espera_ms == 350);
+
+    // Outros erros, ou o código sem a espera, não são servidor ocupado
+    uint8_t erro = SEM_PERMISSAO;
+    criar_pacote(&pack, 17, MSG_ERRO, &erro, 1);
+    CONFERIR(ler_erro_ocupado(&pack, &espera_ms) == 0);
+    erro = SERVIDOR_OCUPADO;
+    criar_pacote(&pack, 17, MSG_ERRO, &erro, 1);
+    CONFERIR(ler_erro_ocupado(&pack, &espera_ms) == 0);
+    criar_pacote(&pack, 17, MSG_ACK, NULL, 0);
+    CONFERIR(ler_erro_ocupado(&pack, &espera_ms) == 0);
+
+    sessoes_finalizar(&tabela);
+}
+
+
+//////////// Instantâneo das sessões ////////////
+
+typedef struct {
+    uint32_t sessao;
+    char nome[92];
+} registro_teste_t;
+
+static void testar_instantaneo(void) {
+    char caminho[] = "/tmp/testes_instantaneo_XXXXXX";
+    int fd = mkstemp(caminho);
+    CONFERIR(fd >= 0);
+    if (fd < 0) return;
+    close(fd);
+
+    // Arquivo vazio: criado do zero, com todas as entradas livres
+    instantaneo_t instantaneo;
+    registro_teste_t registro, lido;
+    CONFERIR(instantaneo_abrir(&instantaneo, caminho, sizeof(registro_teste_t), 8) == 0);
+    CONFERIR(instantaneo.tamanho_registro == 128);
+    CONFERIR(!instantaneo_ler(&instantaneo, 0, &lido));
+
+    for (uint32_t i = 0; i < 8; i += 2) {
+        memset(&registro, 0, sizeof(registro));
+        registro.sessao = 100 + i;
+        snprintf(registro.nome, sizeof(registro.nome), "sessao %u", (unsigned)i);
+        instantaneo_gravar(&instantaneo, i, &registro, sizeof(registro));
+    }
+    instantaneo_apagar(&instantaneo, 4);
+
+    // Processo morto no meio de uma gravação: versão ímpar, o registro não vale
+    uint64_t* versao = (uint64_t*)instantaneo_registro(&instantaneo, 6) - 1;
+    *versao += 1;
+    instantaneo_fechar(&instantaneo);
+
+    // Reabrir com o mesmo formato restaura as entradas íntegras
+    CONFERIR(instantaneo_abrir(&instantaneo, caminho, sizeof(registro_teste_t), 8) == 1);
+    CONFERIR(instantaneo_ler(&instantaneo, 0, &lido) && lido.sessao == 100 && strcmp(lido.nome, "sessao 0") == 0);
+    CONFERIR(instantaneo_ler(&instantaneo, 2, &lido) && lido.sessao == 102 && strcmp(lido.nome, "sessao 2") == 0);
+    CONFERIR(!instantaneo_ler(&instantaneo, 1, &lido));
+    CONFERIR(!instantaneo_ler(&instantaneo, 4, &lido));
+    CONFERIR(!instantaneo_ler(&instantaneo, 6, &lido));
+    CONFERIR(!instantaneo_ler(&instantaneo, 8, &lido));
+
+    // Regravar a entrada interrompida a torna válida de novo
+    registro.sessao = 106;
+    instantaneo_gravar(&instantaneo, 6, &registro, sizeof(registro));
+    CONFERIR(instantaneo_ler(&instantaneo, 6, &lido) && lido.sessao == 106);
+    instantaneo_fechar(&instantaneo);
+
+    // Outro formato (outra versão do servidor) recomeça vazio
+    CONFERIR(instantaneo_abrir(&instantaneo, caminho, sizeof(registro_teste_t), 16) == 0);
+    CONFERIR(!instantaneo_ler(&instantaneo, 0, &lido));
+    instantaneo_fechar(&instantaneo);
+    unlink(caminho);
+}
+
+
+//////////// Janela AIMD ////////////
+
+static void testar_congestionamento(void) {
+    congestionamento_t controle;
+    congestionamento_iniciar(&controle);
+    CONFERIR(congestionamento_permitidos(&controle) == 1);
+
+    // Partida lenta: dobra a cada janela confirmada, até JANELA_MAXIMA
+    congestionamento_confirmou(&controle, 1);
+    CONFERIR(congestionamento_permitidos(&controle) == 2);
+    congestionamento_confirmou(&controle, 2);
+    CONFERIR(congestionamento_permitidos(&controle) == 4);
+    congestionamento_confirmou(&controle, 4);
+    CONFERIR(congestionamento_permitidos(&controle) == 8);
+    congestionamento_confirmou(&controle, 8);
+    CONFERIR(congestionamento_permitidos(&controle) == 15);
+
+    // Perda: metade (7,5 frames), depois um frame a mais por janela confirmada
+    congestionamento_perda(&controle);
+    CONFERIR(controle.janela == 15 * ESCALA_JANELA / 2);
+    CONFERIR(congestionamento_permitidos(&controle) == 7);
+    congestionamento_confirmou(&controle, 7);
+    CONFERIR(congestionamento_permitidos(&controle) == 8);
+
+    // Fim do prazo: um frame, com o limiar na metade
+    uint32_t antes = controle.janela;
+    congestionamento_expirou(&controle);
+    CONFERIR(congestionamento_permitidos(&controle) == 1);
+    CONFERIR(controle.limiar == antes / 2);
+    congestionamento_confirmou(&controle, 1);
+    congestionamento_confirmou(&controle, 2);
+    CONFERIR(congestionamento_permitidos(&controle) == 4);
+
+    // A janela anunciada pelo receptor limita; a perda nunca deixa menos de 2 frames
+    congestionamento_anunciada(&controle, 3);
+    CONFERIR(congestionamento_permitidos(&controle) == 3);
+    congestionamento_anunciada(&controle, 0);
+    CONFERIR(congestionamento_permitidos(&controle) == 3);
+    congestionamento_anunciada(&controle, 100);
+    congestionamento_expirou(&controle);
+    congestionamento_perda(&controle);
+    CONFERIR(congestionamento_permitidos(&controle) == 2);
+}
+
+
+//////////// Janela Go-Back-N ////////////
+
+static void testar_janela(void) {
+    // Último enviado 3 com 6 em voo: o mais antigo é o 30, antes da volta da sequência
+    CONFERIR(janela_distancia(3, 6, 30) == 0);
+    CONFERIR(janela_distancia(3, 6, 3) == 5);
+    CONFERIR(janela_distancia(3, 6, 29) == 31);
+    CONFERIR(janela_distancia(3, 0, 3) == 31);
+
+    // 6 frames de 127 bytes em voo depois de 1000 bytes confirmados
+    uint8_t tamanhos[JANELA_MAXIMA];
+    memset(tamanhos, 127, sizeof(tamanhos));
+    uint64_t confirmados = 1000;
+
+    // ACK cumulativo do terceiro frame (seq 0, depois da volta) e do último
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 3 * 127, 0,
+                                    janela_distancia(3, 6, 0)) == 1);
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 6 * 127, 0,
+                                    janela_distancia(3, 6, 3)) == 1);
+
+    // ACK repetido do último confirmado (seq 29, distância 31): só com a contagem que já vale
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000, 0, 31) == 1);
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 - 127, 0, 31) == 0);
+
+    // ACK atrasado da volta anterior com a mesma sequência 0: cai na janela pela distância,
+    // mas a contagem é de 32 frames atrás e não desliza nada
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 3 * 127 - 32 * 127, 0,
+                                    janela_distancia(3, 6, 0)) == 0);
+    // Contagem que não fecha em frame nenhum, ou que aponta para outro frame que a sequência
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 100, 0, 0) == 0);
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 2 * 127, 0, 4) == 0);
+
+    // NACK conta só os frames antes do recusado e precisa estar em voo
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 2 * 127, 1, 2) == 1);
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000, 1, 0) == 1);
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 3 * 127, 1, 2) == 0);
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, 1000 + 6 * 127, 1, 6) == 0);
+
+    // A contagem é de 32 bits: a volta dela também fecha no frame certo
+    confirmados = UINT32_MAX - 100;
+    CONFERIR(janela_resposta_valida(confirmados, tamanhos, 6, (uint32_t)(confirmados + 127), 0, 0) == 1);
+}
+
+
+//////////// Prazo de retransmissão ////////////
+
+static void testar_retransmissao(void) {
+    // SRTT + 4 × RTTVAR, dobrado a cada vencimento até o teto
+    retransmissao_t prazo;
+    memset(&prazo, 0, sizeof(prazo));
+    CONFERIR(retransmissao_prazo_ms(&prazo) == PRAZO_INICIAL_MS);
+    retransmissao_medir(&prazo, 10000);
+    CONFERIR(prazo.srtt_us == 10000 && prazo.rttvar_us == 5000);
+    CONFERIR(retransmissao_prazo_ms(&prazo) == 30);
+    retransmissao_medir(&prazo, 20000);
+    CONFERIR(prazo.srtt_us == 11250 && prazo.rttvar_us == 6250);
+    CONFERIR(retransmissao_prazo_ms(&prazo) == 37);
+    retransmissao_expirou(&prazo);
+    CONFERIR(retransmissao_prazo_ms(&prazo) == 74);
+    for (int i = 0; i < 8; i++) {
+        retransmissao_expirou(&prazo);
+    }
+    CONFERIR(retransmissao_prazo_ms(&prazo) == PRAZO_MAXIMO_MS);
+
+    // Uma medida nova desfaz as dobras; RTT curto fica no piso
+    retransmissao_medir(&prazo, 20000);
+    CONFERIR(retransmissao_prazo_ms(&prazo) == 40);
+    memset(&prazo, 0, sizeof(prazo));
+    retransmissao_medir(&prazo, 100);
+    CONFERIR(retransmissao_prazo_ms(&prazo) == PRAZO_MINIMO_MS);
+}
+
+
+//////////// Baldes do histograma ////////////
+
+static void testar_histograma(void) {
+    // Um balde por valor até 31; depois 16 por potência de 2
+    CONFERIR(histograma_balde(0) == 0);
+    CONFERIR(histograma_balde(31) == 31);
+    CONFERIR(histograma_balde(32) == 32 && histograma_balde(33) == 32 && histograma_balde(34) == 33);
+    CONFERIR(histograma_balde(63) == 47 && histograma_balde(64) == 48);
+    CONFERIR(histograma_balde(1000) == 111);
+    CONFERIR(histograma_limite_balde(32) == 33);
+    CONFERIR(histograma_limite_balde(48) == 67);
+    CONFERIR(histograma_limite_balde(111) == 1023);
+    CONFERIR(histograma_balde((uint64_t)1 << HISTOGRAMA_BITS) == HISTOGRAMA_BALDES - 1);
+    CONFERIR(histograma_balde(UINT64_MAX) == HISTOGRAMA_BALDES - 1);
+
+    // Os baldes cobrem os valores sem buracos: o limite de um é o vizinho do primeiro do seguinte
+    int contiguos = 1;
+    for (int b = 0; b < HISTOGRAMA_BALDES - 1; b++) {
+        uint64_t limite = histograma_limite_balde(b);
+        if (histograma_balde(limite) != b || histograma_balde(limite + 1) != b + 1) {
+            contiguos = 0;
+        }
+    }
+    CONFERIR(contiguos);
+
+    // Erro relativo do limite de até 1/16 acima de 32
+    CONFERIR(histograma_limite_balde(histograma_balde(1000000)) - 1000000 <= 1000000 / HISTOGRAMA_SUBBALDES);
+
+    // 1 a 100: a mediana cai no balde [50, 51] e o máximo limita o último percentil
+    static histograma_t histograma;
+    CONFERIR(histograma_percentil(&histograma, 50) == 0);
+    for (uint64_t v = 1; v <= 100; v++) {
+        histograma_registrar(&histograma, v);
+    }
+    CONFERIR(histograma.total == 100 && histograma.soma == 5050 && histograma.maximo == 100);
+    CONFERIR(histograma_percentil(&histograma, 0) == 1);
+    CONFERIR(histograma_percentil(&histograma, 50) == 51);
+    CONFERIR(histograma_percentil(&histograma, 99) == 99);
+    CONFERIR(histograma_percentil(&histograma, 100) == 100);
+}
+
+
+//////////// Anel da captura ////////////
+
+#define CAPTURA_PRODUTORES 4
+#define CAPTURA_POR_PRODUTOR 1000           // No total, menos frames que o anel: nenhum é perdido
+
+// Início dos dados de cada frame de teste: quem gravou e em que ordem
+typedef struct {
+    uint32_t produtor;
+    uint32_t indice;
+} marca_captura_t;
+
+// Cabeçalhos zerados: a captura reordena os campos deles, e zeros continuam zeros
+static const uint8_t cabecalhos_captura[TAMANHO_CABECALHOS];
+
+static void* produzir_capturas(void* arg) {
+    marca_captura_t marca = { (uint32_t)(uintptr_t)arg, 0 };
+    uint8_t dados[sizeof(marca) + 64];
+    for (; marca.indice < CAPTURA_POR_PRODUTOR; marca.indice++) {
+        size_t tamanho = marca.indice % 64;
+        memcpy(dados, &marca, sizeof(marca));
+        memset(dados + sizeof(marca), (int)(marca.produtor * 31 + marca.indice), tamanho);
+        captura_registrar(cabecalhos_captura, sizeof(cabecalhos_captura), dados, sizeof(marca) + tamanho);
+    }
+    return NULL;
+}
+
+
+static void testar_captura(void) {
+    char prefixo[64];
+    snprintf(prefixo, sizeof(prefixo), "/tmp/testes_captura_%d", (int)getpid());
+    CONFERIR(captura_iniciar(prefixo) == 0);
+
+    pthread_t produtores[CAPTURA_PRODUTORES];
+    for (int p = 0; p < CAPTURA_PRODUTORES; p++) {
+        pthread_create(&produtores[p], NULL, produzir_capturas, (void*)(uintptr_t)p);
+    }
+    for (int p = 0; p < CAPTURA_PRODUTORES; p++) {
+        pthread_join(produtores[p], NULL);
+    }
+
+    // Frame maior que o slot: guardado até CAPTURA_FRAME, com o tamanho original
+    uint8_t grande[CAPTURA_FRAME];
+    marca_captura_t marca = { CAPTURA_PRODUTORES, 0 };
+    memset(grande, 0xAB, sizeof(grande));
+    memcpy(grande, &marca, sizeof(marca));
+    captura_registrar(cabecalhos_captura, sizeof(cabecalhos_captura), grande, sizeof(grande));
+    captura_finalizar();
+
+    // O arquivo tem todos os frames, e os de cada produtor na ordem em que ele os gravou
+    char caminho[80];
+    snprintf(caminho, sizeof(caminho), "%s.0.pcap", prefixo);
+    FILE* arquivo = fopen(caminho, "rb");
+    CONFERIR(arquivo != NULL);
+    if (!arquivo) return;
+
+    uint32_t cabecalho[6];
+    CONFERIR(fread(cabecalho, sizeof(cabecalho), 1, arquivo) == 1);
+    CONFERIR(cabecalho[0] == 0xa1b23c4dU && cabecalho[4] == CAPTURA_FRAME && cabecalho[5] == 1);
+
+    uint32_t proximo[CAPTURA_PRODUTORES] = { 0 };
+    int frames = 0, fora_de_ordem = 0, corrompidos = 0, grandes = 0;
+    uint32_t registro[4];
+    uint8_t dados[CAPTURA_FRAME];
+    while (fread(registro, sizeof(registro), 1, arquivo) == 1) {
+        if (registro[2] > sizeof(dados) || fread(dados, 1, registro[2], arquivo) != registro[2]) {
+            corrompidos++;
+            break;
+        }
+        frames++;
+        if (registro[2] < TAMANHO_CABECALHOS + sizeof(marca)) {
+            corrompidos++;
+            continue;
+        }
+        const uint8_t* conteudo = dados + TAMANHO_CABECALHOS;
+        memcpy(&marca, conteudo, sizeof(marca));
+        if (marca.produtor == CAPTURA_PRODUTORES) {
+            grandes += registro[2] == CAPTURA_FRAME && registro[3] == TAMANHO_CABECALHOS + sizeof(grande);
+            continue;
+        }
+        if (marca.produtor > CAPTURA_PRODUTORES || marca.indice != proximo[marca.produtor]++) {
+            fora_de_ordem++;
+            continue;
+        }
+        size_t tamanho = marca.indice % 64;
+        uint8_t esperado = (uint8_t)(marca.produtor * 31 + marca.indice);
+        int integro = registro[2] == TAMANHO_CABECALHOS + sizeof(marca) + tamanho && registro[3] == registro[2];
+        for (size_t i = 0; integro && i < tamanho; i++) {
+            integro = conteudo[sizeof(marca) + i] == esperado;
+        }
+        corrompidos += !integro;
+    }
+    fclose(arquivo);
+    unlink(caminho);
+
+    CONFERIR(frames == CAPTURA_PRODUTORES * CAPTURA_POR_PRODUTOR + 1);
+    CONFERIR(fora_de_ordem == 0);
+    CONFERIR(corrompidos == 0);
+    CONFERIR(grandes == 1);
+}
+
+
+//////////// Formatação do registro ////////////
+
+// Formata como a thread de escrita faria, com até quatro argumentos
+static int formatado(const char* esperado, size_t tamanho, const char* formato, uint64_t a, uint64_t b,
+                     uint64_t c, uint64_t d) {
+    registro_t registro;
+    registro_montar(&registro, REGISTRO_INFO, formato, a, b, c, d);
+
+    char texto[128];
+    memset(texto, '#', sizeof(texto));
+    registro_formatar(&registro, texto, tamanho);
+    if (strcmp(texto, esperado) != 0) {
+        printf("   \"%s\" formatou \"%s\", esperado \"%s\"\n", formato, texto, esperado);
+        return 0;
+    }
+    return 1;
+}
+
+#define TEXTO(s) ((uint64_t)(uintptr_t)(s))
+
+static void testar_registro(void) {
+    CONFERIR(formatado("seq -3 tipo 7", 128, "seq %d tipo %u", (uint64_t)(int64_t)-3, 7, 0, 0));
+    CONFERIR(formatado("   42|7   |005|+1", 128, "%5d|%-4d|%03u|%+d", 42, 7, 5, 1));
+
+    // Modificadores de tamanho não mudam o argumento, que já vem com 64 bits
+    CONFERIR(formatado("1234567890123 12 255 -1", 128, "%lld %zu %hhu %ld", 1234567890123ULL, 12, 255,
+                       (uint64_t)(int64_t)-1));
+    CONFERIR(formatado("ff FF 010 0x1f", 128, "%x %X %#o %#x", 255, 255, 8, 31));
+    CONFERIR(formatado("nome=abc (null) |  ab|", 128, "%s=%.3s %s |%4.2s|", TEXTO("nome"), TEXTO("abcdef"), 0,
+                       TEXTO("abc")));
+    CONFERIR(formatado("ok 100%", 128, "%c%c 100%%", 'o', 'k', 0, 0));
+
+    // Conversão desconhecida sai como está; % no fim encerra o texto
+    CONFERIR(formatado("a %y b", 128, "a %y b", 0, 0, 0, 0));
+    CONFERIR(formatado("fim ", 128, "fim %", 0, 0, 0, 0));
+
+    // Argumentos além dos quatro guardados valem 0
+    CONFERIR(formatado("1 2 3 4 0", 128, "%d %d %d %d %d", 1, 2, 3, 4));
+
+    // O texto é cortado no tamanho do buffer, inclusive no meio de uma conversão
+    CONFERIR(formatado("abcdefg", 8, "abcdefghij", 0, 0, 0, 0));
+    CONFERIR(formatado("ab123", 6, "ab%d", 123456, 0, 0, 0));
+    CONFERIR(formatado("", 1, "%d", 5, 0, 0, 0));
+
+    // O %s é copiado na montagem: mudar o texto depois não muda o registro
+    char nome[16] = "3.txt";
+    registro_t registro;
+    registro_montar(&registro, REGISTRO_INFO, "tesouro %s de %d", TEXTO(nome), 7, 0, 0);
+    strcpy(nome, "8.mp4");
+    char texto[128];
+    registro_formatar(&registro, texto, sizeof(texto));
+    CONFERIR(strcmp(texto, "tesouro 3.txt de 7") == 0);
+
+    // Os textos somados são cortados em REGISTRO_TEXTO; o que não cabe sai vazio
+    char longo[2 * REGISTRO_TEXTO];
+    memset(longo, 'x', sizeof(longo) - 1);
+    longo[sizeof(longo) - 1] = '\0';
+    registro_montar(&registro, REGISTRO_INFO, "%s|%s|%d", TEXTO(longo), TEXTO("abc"), 5, 0);
+    registro_formatar(&registro, texto, sizeof(texto));
+    CONFERIR(strlen(texto) == REGISTRO_TEXTO - 1 + 3 && strcmp(texto + REGISTRO_TEXTO - 1, "||5") == 0);
+}
+
+
+//////////// Escritor ////////////
+
+static void testar_escritor(void) {
+    size_t tamanho = 3 * ESCRITOR_TAM_BUFFER + 17;
+    uint8_t* dados = malloc(tamanho);
+    uint8_t* lido = malloc(tamanho);
+    if (!dados || !lido) {
+        CONFERIR(dados && lido);
+        free(dados);
+        free(lido);
+        return;
+    }
+    preencher(dados, tamanho, 26);
+
+    // Um trecho no meio do arquivo, em payloads do tamanho de um frame
+    char caminho[] = "/tmp/testes_escritorXXXXXX";
+    int fd = mkstemp(caminho);
+    CONFERIR(fd >= 0);
+    if (fd >= 0) {
+        escritor_t escritor;
+        CONFERIR(escritor_iniciar_trecho(&escritor, fd, 1000, tamanho) == 0);
+        int falhou = 0;
+        for (size_t feito = 0; feito < tamanho; feito += 127) {
+            size_t parte = tamanho - feito < 127 ? tamanho - feito : 127;
+            falhou |= escritor_adicionar(&escritor, dados + feito, parte) < 0;
+        }
+        CONFERIR(!falhou);
+        CONFERIR(escritor_fechar(&escritor) == 0);
+        CONFERIR(pread(fd, lido, tamanho, 1000) == (ssize_t)tamanho);
+        CONFERIR(memcmp(dados, lido, tamanho) == 0);
+        close(fd);
+        unlink(caminho);
+    }
+
+    // A falha da thread de gravação chega a quem adiciona, sem precisar fechar
+    fd = open("/dev/full", O_WRONLY);
+    if (fd >= 0) {
+        escritor_t escritor;
+        CONFERIR(escritor_iniciar_trecho(&escritor, fd, 0, tamanho) == 0);
+        int falhou = 0;
+        for (size_t feito = 0; feito < tamanho && !falhou; feito += 127) {
+            size_t parte = tamanho - feito < 127 ? tamanho - feito : 127;
+            falhou = escritor_adicionar(&escritor, dados + feito, parte) < 0;
+        }
+        // A gravação do primeiro buffer pode ainda estar em andamento
+        int64_t limite = relogio_us() + 1000000;
+        while (!falhou && relogio_us() < limite) {
+            sched_yield();
+            falhou = escritor_adicionar(&escritor, dados, 0) < 0;
+        }
+        CONFERIR(falhou);
+        CONFERIR(escritor_fechar(&escritor) < 0);
+        CONFERIR(escritor.erro == ENOSPC);
+        close(fd);
+    }
+    free(dados);
+    free(lido);
+}
+
+
+//////////// Leitor de arquivo ////////////
+
+// Leitura sem esperar o disco (como a sessão faz) e fechamento com leituras em andamento
+static void testar_leitor(void) {
+    size_t tamanho = 2 * LEITOR_NUM_BUFFERS * LEITOR_TAM_BUFFER + 123;
+    uint8_t* dados = malloc(tamanho);
+    uint8_t* lido = malloc(tamanho);
+    char caminho[] = "/tmp/testes_leitorXXXXXX";
+    int fd = mkstemp(caminho);
+    if (!dados || !lido || fd < 0) {
+        CONFERIR(dados && lido && fd >= 0);
+        free(dados);
+        free(lido);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    preencher(dados, tamanho, 30);
+    CONFERIR(write(fd, dados, tamanho) == (ssize_t)tamanho);
+
+    // Trecho a partir de um offset, em frames; leitor_ler só depois de leitor_pronto
+    leitor_t leitor;
+    uint64_t offset = 7;
+    CONFERIR(leitor_abrir(&leitor, fd, offset, tamanho - offset) == 0);
+    size_t feito = 0;
+    int falhou = 0;
+    int64_t limite = relogio_us() + 5000000;
+    while (feito < tamanho - offset && !falhou && relogio_us() < limite) {
+        int pronto = leitor_pronto(&leitor, MAX_FRAME);
+        if (pronto == 0) {
+            sched_yield();
+            continue;
+        }
+        ssize_t n = leitor_ler(&leitor, lido + feito, MAX_FRAME);
+        falhou = pronto < 0 || n <= 0;
+        feito += n > 0 ? (size_t)n : 0;
+    }
+    CONFERIR(!falhou);
+    CONFERIR(feito == tamanho - offset);
+    CONFERIR(memcmp(lido, dados + offset, feito) == 0);
+    CONFERIR(leitor_pronto(&leitor, MAX_FRAME) == 1);
+    CONFERIR(leitor_ler(&leitor, lido, MAX_FRAME) == 0);
+    leitor_fechar(&leitor);
+
+    // Fechar logo depois de abrir cancela as leituras; os buffers voltam a servir outro leitor
+    CONFERIR(leitor_abrir(&leitor, fd, 0, tamanho) == 0);
+    leitor_fechar(&leitor);
+    CONFERIR(leitor_abrir(&leitor, fd, 0, tamanho) == 0);
+    CONFERIR(leitor_ler(&leitor, lido, MAX_FRAME) == MAX_FRAME);
+    CONFERIR(memcmp(lido, dados, MAX_FRAME) == 0);
+    leitor_fechar(&leitor);
+
+    close(fd);
+    unlink(caminho);
+    free(dados);
+    free(lido);
+}
+
+
+//////////// Pré-carga ////////////
+
+static estado_precarga_type estado_precarga(precarga_t* precarga, int indice) {
+    pthread_mutex_lock(&precarga->trava);
+    estado_precarga_type estado = precarga->tesouros[indice].estado;
+    pthread_mutex_unlock(&precarga->trava);
+    return estado;
+}
+
+
+// A thread de pré-carga trabalha sozinha: espera o tesouro chegar ao estado, até limite_ms
+static int esperar_precarga(precarga_t* precarga, int indice, estado_precarga_type estado, int limite_ms) {
+    int64_t limite = relogio_us() + (int64_t)limite_ms * 1000;
+    while (estado_precarga(precarga, indice) != estado && relogio_us() < limite) {
+        struct timespec pausa = { 0, 1000000L };
+        nanosleep(&pausa, NULL);
+    }
+    return estado_precarga(precarga, indice) == estado;
+}
+
+
+static void pausar_ms(int ms) {
+    struct timespec pausa = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&pausa, NULL);
+}
+
+
+static int gravar_arquivo(const char* caminho, size_t tamanho, uint32_t semente) {
+    uint8_t* dados = malloc(tamanho);
+    FILE* arquivo = fopen(caminho, "wb");
+    int ok = dados && arquivo;
+    if (ok) {
+        preencher(dados, tamanho, semente);
+        ok = fwrite(dados, 1, tamanho, arquivo) == tamanho;
+    }
+    if (arquivo) fclose(arquivo);
+    free(dados);
+    return ok ? 0 : -1;
+}
+
+
+// Falha que volta a ser tentada, orçamento de memória e abandono dos arquivos grandes
+static void testar_precarga(void) {
+    precarga_t precarga;
+    if (precarga_iniciar(&precarga, DISTANCIA_PRECARGA) < 0) {
+        CONFERIR(!"precarga_iniciar");
+        return;
+    }
+    pthread_mutex_lock(&precarga.trava);
+    precarga.nova_tentativa_ms = 50;
+    precarga.abandono_ms = 100;
+    pthread_mutex_unlock(&precarga.trava);
+
+    static struct_jogo jogo;
+    memset(&jogo, 0, sizeof(jogo));
+    const char* caminhos[3] = { "/tmp/testes_precarga_0", "/tmp/testes_precarga_1", "/tmp/testes_precarga_2" };
+    posicao_t posicoes[3] = { { 1, 0 }, { 0, 1 }, { 1, 1 } };
+    for (int i = 0; i < MAX_TESOUROS; i++) {
+        jogo.tesouros[i].encontrado = i >= 3;
+        if (i < 3) {
+            jogo.tesouros[i].posicao = posicoes[i];
+            strcpy(jogo.tesouros[i].patch, caminhos[i]);
+            unlink(caminhos[i]);
+        }
+    }
+    jogo.tesouros[1].encontrado = 1;
+    jogo.tesouros[2].encontrado = 1;
+
+    // Arquivo ainda ausente: falha, e a nova tentativa só vale depois de nova_tentativa_ms
+    precarga_atualizar(&precarga, &jogo);
+    CONFERIR(esperar_precarga(&precarga, 0, PRECARGA_FALHOU, 1000));
+    CONFERIR(gravar_arquivo(caminhos[0], 1000, 29) == 0);
+    precarga_atualizar(&precarga, &jogo);
+    CONFERIR(estado_precarga(&precarga, 0) == PRECARGA_FALHOU);
+    pausar_ms(60);
+    precarga_atualizar(&precarga, &jogo);
+    CONFERIR(esperar_precarga(&precarga, 0, PRECARGA_PRONTA, 1000));
+
+    precarga_tesouro_t* primeiro = NULL;
+    CONFERIR(precarga_obter(&precarga, 0, &primeiro) == 0);
+    CONFERIR(primeiro && primeiro->tamanho == 1000 && primeiro->num_quadros == 8);
+    pthread_mutex_lock(&precarga.trava);
+    CONFERIR(precarga.em_memoria == 1000 + 8 * sizeof(pack_t));
+    precarga.orcamento = 3000 + 16 * sizeof(pack_t);    // Cabe o segundo, mas não os dois
+    pthread_mutex_unlock(&precarga.trava);
+
+    // Sem espaço no orçamento e o primeiro em uso: o segundo falha e será tentado de novo
+    CONFERIR(gravar_arquivo(caminhos[1], 2000, 31) == 0);
+    jogo.tesouros[1].encontrado = 0;
+    precarga_atualizar(&precarga, &jogo);
+    CONFERIR(esperar_precarga(&precarga, 1, PRECARGA_FALHOU, 1000));
+    CONFERIR(estado_precarga(&precarga, 0) == PRECARGA_PRONTA);
+
+    // Primeiro devolvido: a nova tentativa o tira da memória para o segundo caber
+    precarga_liberar_tesouro(&precarga, 0);
+    CONFERIR(estado_precarga(&precarga, 0) == PRECARGA_PRONTA);
+    pausar_ms(60);
+    jogo.tesouros[0].encontrado = 1;
+    precarga_atualizar(&precarga, &jogo);
+    CONFERIR(esperar_precarga(&precarga, 1, PRECARGA_PRONTA, 1000));
+    CONFERIR(estado_precarga(&precarga, 0) == PRECARGA_VAZIA);
+    pthread_mutex_lock(&precarga.trava);
+    CONFERIR(precarga.em_memoria == precarga.tesouros[1].memoria);
+    precarga.orcamento = PRECARGA_ORCAMENTO;
+    pthread_mutex_unlock(&precarga.trava);
+
+    // Arquivo grande: sai da memória quando nenhum jogador fica por perto; o pequeno fica
+    CONFERIR(gravar_arquivo(caminhos[2], LIMITE_PRE_QUADROS + 1, 37) == 0);
+    jogo.tesouros[1].encontrado = 1;
+    jogo.tesouros[2].encontrado = 0;
+    precarga_atualizar(&precarga, &jogo);
+    CONFERIR(esperar_precarga(&precarga, 2, PRECARGA_PRONTA, 2000));
+    CONFERIR(esperar_precarga(&precarga, 2, PRECARGA_VAZIA, 1000));
+    CONFERIR(estado_precarga(&precarga, 1) == PRECARGA_PRONTA);
+    pthread_mutex_lock(&precarga.trava);
+    CONFERIR(precarga.em_memoria == precarga.tesouros[1].memoria);
+    pthread_mutex_unlock(&precarga.trava);
+
+    precarga_finalizar(&precarga);
+    CONFERIR(precarga.em_memoria == 0);
+    for (int i = 0; i < 3; i++) {
+        unlink(caminhos[i]);
+    }
+}
+
+
+//////////// Fluxos paralelos ////////////
+
+// Digests dos trechos juntados na ordem dos offsets dão o digest do arquivo inteiro
+static void testar_multifluxo(void) {
+    uint64_t tamanho = 5 * BLOCO_VERIFICACAO + 321;
+    uint8_t* dados = malloc(tamanho);
+    if (!dados) {
+        CONFERIR(dados != NULL);
+        return;
+    }
+    preencher(dados, tamanho, 28);
+
+    digest_arquivo_t inteiro;
+    digest_arquivo_t juntado;
+    CONFERIR(digest_iniciar(&inteiro, tamanho) == 0);
+    CONFERIR(digest_iniciar(&juntado, tamanho) == 0);
+    digest_atualizar(&inteiro, dados, tamanho);
+
+    // Os fluxos sem threads: só o resultado de cada trecho, como as threads deixariam
+    multifluxo_t multi;
+    memset(&multi, 0, sizeof(multi));
+    multi.papel = FLUXO_RECEPCAO;
+    multi.num_fluxos = NUM_FLUXOS;
+    uint64_t coberto = 0;
+    for (int i = 0; i < NUM_FLUXOS; i++) {
+        fluxo_t* fluxo = &multi.fluxos[i];
+        multifluxo_trecho(tamanho, NUM_FLUXOS, i, &fluxo->offset, &fluxo->tamanho);
+        CONFERIR(fluxo->offset == coberto);
+        coberto += fluxo->tamanho;
+        CONFERIR(digest_iniciar(&fluxo->digest, fluxo->tamanho) == 0);
+        digest_atualizar(&fluxo->digest, dados + fluxo->offset, fluxo->tamanho);
+    }
+    CONFERIR(coberto == tamanho);
+
+    // Enquanto um trecho não tem resultado não há o que juntar
+    for (int i = 0; i < NUM_FLUXOS - 1; i++) {
+        __atomic_store_n(&multi.fluxos[i].pronto, 1, __ATOMIC_RELEASE);
+    }
+    CONFERIR(!multifluxo_concluido(&multi));
+    CONFERIR(multifluxo_juntar_digest(&multi, &juntado) < 0);
+
+    __atomic_store_n(&multi.fluxos[NUM_FLUXOS - 1].pronto, 1, __ATOMIC_RELEASE);
+    CONFERIR(multifluxo_concluido(&multi));
+    CONFERIR(multifluxo_juntar_digest(&multi, &juntado) == 0);
+    CONFERIR(juntado.crc_arquivo == inteiro.crc_arquivo);
+    CONFERIR(juntado.num_blocos == inteiro.num_blocos);
+    CONFERIR(memcmp(juntado.crc_blocos, inteiro.crc_blocos, inteiro.num_blocos * sizeof(uint64_t)) == 0);
+
+    // Um trecho que falhou faz o arquivo inteiro falhar
+    multi.fluxos[1].resultado = -1;
+    CONFERIR(multifluxo_juntar_digest(&multi, NULL) < 0);
+
+    for (int i = 0; i < NUM_FLUXOS; i++) {
+        digest_liberar(&multi.fluxos[i].digest);
+    }
+    digest_liberar(&inteiro);
+    digest_liberar(&juntado);
+    free(dados);
+}
+
+
+int main(void) {
+    testar_integridade();
+    testar_memoria();
+    testar_transmissor();
+    testar_temporizador();
+    testar_instantaneo();
+    testar_sessoes();
+    testar_admissao();
+    testar_congestionamento();
+    testar_janela();
+    testar_retransmissao();
+    testar_histograma();
+    testar_captura();
+    testar_registro();
+    testar_escritor();
+    testar_leitor();
+    testar_precarga();
+    testar_multifluxo();
+
+    printf("%s %d verificações, %d falhas\n", falhas ? "🔴" : "🟢", verificacoes, falhas);
+    return falhas ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#define _XOPEN_SOURCE 700   // sysconf()
+
+#include "trabalho.h"
+
+#include <string.h>
+#include <unistd.h>
+
+
+static int fila_colocar(fila_tarefas_t* fila, tarefa_t tarefa) {
+    pthread_mutex_lock(&fila->trava);
+    if (fila->fim - fila->inicio == CAPACIDADE_TAREFAS) {
+        pthread_mutex_unlock(&fila->trava);
+        return -1;
+    }
+    fila->tarefas[fila->fim % CAPACIDADE_TAREFAS] = tarefa;
+    fila->fim++;
+    pthread_mutex_unlock(&fila->trava);
+    return 0;
+}
+
+
+// Dono da fila: retira a tarefa mais recente
+static int fila_retirar(fila_tarefas_t* fila, tarefa_t* tarefa) {
+    pthread_mutex_lock(&fila->trava);
+    if (fila->fim == fila->inicio) {
+        pthread_mutex_unlock(&fila->trava);
+        return 0;
+    }
+    fila->fim--;
+    *tarefa = fila->tarefas[fila->fim % CAPACIDADE_TAREFAS];
+    pthread_mutex_unlock(&fila->trava);
+    return 1;
+}
+
+
+// Outro trabalhador: rouba a tarefa mais antiga, sem esperar se a fila estiver ocupada
+static int fila_roubar(fila_tarefas_t* fila, tarefa_t* tarefa) {
+    if (pthread_mutex_trylock(&fila->trava) != 0) {
+        return 0;
+    }
+    if (fila->fim == fila->inicio) {
+        pthread_mutex_unlock(&fila->trava);
+        return 0;
+    }
+    *tarefa = fila->tarefas[fila->inicio % CAPACIDADE_TAREFAS];
+    fila->inicio++;
+    pthread_mutex_unlock(&fila->trava);
+    return 1;
+}
+
+
+// Procura trabalho na própria fila e depois nas dos vizinhos
+static int buscar_tarefa(trabalhador_t* trabalhador, tarefa_t* tarefa) {
+    pool_trabalho_t* pool = trabalhador->pool;
+    if (fila_retirar(&trabalhador->fila, tarefa)) {
+        return 1;
+    }
+    for (int i = 1; i < pool->num_trabalhadores; i++) {
+        trabalhador_t* vitima = &pool->trabalhadores[(trabalhador->indice + i) % pool->num_trabalhadores];
+        if (fila_roubar(&vitima->fila, tarefa)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static void* thread_trabalhador(void* arg) {
+    trabalhador_t* trabalhador = (trabalhador_t*)arg;
+    pool_trabalho_t* pool = trabalhador->pool;
+
+    while (1) {
+        tarefa_t tarefa;
+        if (buscar_tarefa(trabalhador, &tarefa)) {
+            __atomic_sub_fetch(&pool->pendentes, 1, __ATOMIC_ACQ_REL);
+            tarefa.funcao(tarefa.argumento);
+            continue;
+        }
+
+        // Nenhuma fila com trabalho: dormir até chegar tarefa
+        // Uma tarefa roubada por outro entre a busca e o sono só custa mais uma volta
+        pthread_mutex_lock(&pool->trava);
+        while (__atomic_load_n(&pool->pendentes, __ATOMIC_ACQUIRE) <= 0 && !pool->encerrar) {
+            pthread_cond_wait(&pool->tem_tarefa, &pool->trava);
+        }
+        int encerrar = pool->encerrar && __atomic_load_n(&pool->pendentes, __ATOMIC_ACQUIRE) <= 0;
+        pthread_mutex_unlock(&pool->trava);
+        if (encerrar) {
+            return NULL;
+        }
+    }
+}
+
+
+int trabalho_iniciar(pool_trabalho_t* pool, int num_trabalhadores) {
+    if (!pool) return -1;
+
+    if (num_trabalhadores <= 0) {
+        long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+        num_trabalhadores = nucleos > 0 ? (int)nucleos : 1;
+    }
+    if (num_trabalhadores > MAX_TRABALHADORES) {
+        num_trabalhadores = MAX_TRABALHADORES;
+    }
+
+    memset(pool, 0, sizeof(pool_trabalho_t));
+    pthread_mutex_init(&pool->trava, NULL);
+    pthread_cond_init(&pool->tem_tarefa, NULL);
+    for (int i = 0; i < num_trabalhadores; i++) {
+        trabalhador_t* trabalhador = &pool->trabalhadores[i];
+        trabalhador->indice = i;
+        trabalhador->pool = pool;
+        pthread_mutex_init(&trabalhador->fila.trava, NULL);
+    }
+
+    for (int i = 0; i < num_trabalhadores; i++) {
+        if (pthread_create(&pool->trabalhadores[i].thread, NULL, thread_trabalhador, &pool->trabalhadores[i]) != 0) {
+            // Mantém as threads já criadas; o pool só fica menor
+            if (i == 0) {
+                pthread_cond_destroy(&pool->tem_tarefa);
+                pthread_mutex_destroy(&pool->trava);
+                return -1;
+            }
+            break;
+        }
+        pool->num_trabalhadores = i + 1;
+    }
+    return 0;
+}
+
+
+int trabalho_enviar(pool_trabalho_t* pool, void (*funcao)(void* argumento), void* argumento) {
+    if (!pool || !funcao || pool->num_trabalhadores == 0) return -1;
+
+    tarefa_t tarefa = { funcao, argumento };
+    trabalhador_t* trabalhador = &pool->trabalhadores[pool->proximo++ % pool->num_trabalhadores];
+    if (fila_colocar(&trabalhador->fila, tarefa) < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->trava);
+    __atomic_add_fetch(&pool->pendentes, 1, __ATOMIC_ACQ_REL);
+    pthread_cond_signal(&pool->tem_tarefa);
+    pthread_mutex_unlock(&pool->trava);
+    return 0;
+}
+
+
+int trabalho_pendentes(pool_trabalho_t* pool) {
+    return pool ? __atomic_load_n(&pool->pendentes, __ATOMIC_RELAXED) : 0;
+}
+
+
+void trabalho_finalizar(pool_trabalho_t* pool) {
+    if (!pool || pool->num_trabalhadores == 0) return;
+
+    pthread_mutex_lock(&pool->trava);
+    pool->encerrar = 1;
+    pthread_cond_broadcast(&pool->tem_tarefa);
+    pthread_mutex_unlock(&pool->trava);
+
+    for (int i = 0; i < pool->num_trabalhadores; i++) {
+        pthread_join(pool->trabalhadores[i].thread, NULL);
+        pthread_mutex_destroy(&pool->trabalhadores[i].fila.trava);
+    }
+    pthread_cond_destroy(&pool->tem_tarefa);
+    pthread_mutex_destroy(&pool->trava);
+    pool->num_trabalhadores = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef TRABALHO_H
+#define TRABALHO_H
+
+#include <pthread.h>
+
+
+#define MAX_TRABALHADORES 16                // Limite de threads do pool
+#define CAPACIDADE_TAREFAS 1024             // Tarefas por fila (cada sessão tem no máximo uma)
+
+
+// Uma unidade de trabalho: processar os eventos de uma sessão, por exemplo
+typedef struct {
+    void (*funcao)(void* argumento);
+    void* argumento;
+} tarefa_t;
+
+
+//////////// Fila de tarefas de um trabalhador ////////////
+
+// O dono retira pelo fim (a tarefa mais recente, ainda quente no cache);
+// os outros trabalhadores roubam pelo início (a mais antiga)
+typedef struct {
+    tarefa_t tarefas[CAPACIDADE_TAREFAS];
+    unsigned inicio;
+    unsigned fim;
+    pthread_mutex_t trava;
+} fila_tarefas_t;
+
+
+//////////// Estrutura do pool ////////////
+
+typedef struct pool_trabalho pool_trabalho_t;
+
+typedef struct {
+    int indice;
+    pthread_t thread;
+    fila_tarefas_t fila;
+    pool_trabalho_t* pool;
+} trabalhador_t;
+
+struct pool_trabalho {
+    trabalhador_t trabalhadores[MAX_TRABALHADORES];
+    int num_trabalhadores;
+    unsigned proximo;                       // Fila que recebe a próxima tarefa externa
+
+    pthread_mutex_t trava;                  // Protege o sono dos trabalhadores
+    pthread_cond_t tem_tarefa;
+    int pendentes;                          // Tarefas em alguma fila (acesso atômico)
+    int encerrar;
+};
+
+
+//////////// Funções do pool ////////////
+
+// Inicia num_trabalhadores threads (0 = uma por núcleo disponível)
+int trabalho_iniciar(pool_trabalho_t* pool, int num_trabalhadores);
+
+// Coloca a tarefa na fila de um trabalhador; os ociosos roubam das filas cheias
+// Retorna -1 se a fila escolhida estiver cheia
+int trabalho_enviar(pool_trabalho_t* pool, void (*funcao)(void* argumento), void* argumento);
+
+// Tarefas ainda nas filas, esperando um trabalhador
+int trabalho_pendentes(pool_trabalho_t* pool);
+
+// Executa as tarefas que restam e encerra as threads
+void trabalho_finalizar(pool_trabalho_t* pool);
+
+#endif // TRABALHO_H
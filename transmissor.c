@@ -0,0 +1,380 @@
+#define _XOPEN_SOURCE 700   // sched_yield(), pthread_condattr_setclock()
+
+#include "transmissor.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+// Ritmo padrão de cada interface: taxa total e por sessão em bytes/s (0 = sem limite) e rajada em bytes
+// A última linha vale para as interfaces que não estão na tabela; a variável RITMO substitui os valores
+static const ritmo_interface_t ritmos_interfaces[] = {
+    { "lo", 0, 0, 0 },                                          // Loopback: sem fila de placa a proteger
+    { INTERFACE_PADRAO, 12500000, 2500000, 32 * 1024 },         // 100 Mbit/s, 20 Mbit/s por sessão
+    { NULL, 12500000, 2500000, 32 * 1024 },
+};
+
+
+static int64_t agora_ns(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (int64_t)agora.tv_sec * 1000000000 + agora.tv_nsec;
+}
+
+
+// Primeiro horário em que o balde aceita um frame (agora se ainda há fichas)
+static int64_t horario_balde(const balde_ritmo_t* balde, uint64_t taxa, uint64_t rajada, int64_t agora) {
+    if (taxa == 0) {
+        return agora;
+    }
+    int64_t horario = balde->teorico_ns - (int64_t)(rajada * 1000000000ull / taxa);
+    return horario > agora ? horario : agora;
+}
+
+
+// Tira do balde as fichas de um frame liberado no horário
+static void consumir_balde(balde_ritmo_t* balde, uint64_t taxa, int64_t horario, size_t bytes) {
+    if (taxa == 0) {
+        return;
+    }
+    int64_t base = balde->teorico_ns > horario ? balde->teorico_ns : horario;
+    balde->teorico_ns = base + (int64_t)(bytes * 1000000000ull / taxa);
+}
+
+
+// Estado da posição do remetente, ou NULL sem sessão
+static estado_remetente_t* estado_remetente(transmissor_t* transmissor, remetente_t remetente) {
+    if (remetente.indice < 0 || remetente.indice >= transmissor->num_remetentes) {
+        return NULL;
+    }
+    return &transmissor->remetentes[remetente.indice];
+}
+
+
+// Diferença entre gerações em aritmética de série: positiva se a geração a é mais nova que b
+static int32_t comparar_geracoes(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+
+// Balde de ritmo da sessão que enviou o frame
+// A primeira vez que uma geração nova aparece o balde recomeça cheio; frames de uma
+// geração anterior (a sessão já saiu) só passam pelo ritmo global
+static balde_ritmo_t* balde_remetente(transmissor_t* transmissor, remetente_t remetente) {
+    estado_remetente_t* estado = estado_remetente(transmissor, remetente);
+    if (!estado) {
+        return NULL;
+    }
+    int32_t diferenca = comparar_geracoes(remetente.geracao, estado->geracao_ritmo);
+    if (diferenca < 0) {
+        return NULL;
+    }
+    if (diferenca > 0) {
+        estado->geracao_ritmo = remetente.geracao;
+        estado->ritmo.teorico_ns = 0;
+    }
+    return &estado->ritmo;
+}
+
+
+// Horário de liberação do frame pelos baldes da sessão e da interface
+static int64_t liberacao_envio(transmissor_t* transmissor, const envio_t* envio, int64_t agora) {
+    const ritmo_interface_t* ritmo = &transmissor->ritmo;
+    size_t bytes = CABECALHOS_QUADRO + envio->quadro->pack.tamanho;
+
+    int64_t liberacao = horario_balde(&transmissor->global, ritmo->taxa_global, ritmo->rajada, agora);
+    balde_ritmo_t* balde = balde_remetente(transmissor, envio->remetente);
+    if (balde) {
+        int64_t sessao = horario_balde(balde, ritmo->taxa_sessao, ritmo->rajada, agora);
+        if (sessao > liberacao) {
+            liberacao = sessao;
+        }
+        consumir_balde(balde, ritmo->taxa_sessao, liberacao, bytes);
+    }
+    consumir_balde(&transmissor->global, ritmo->taxa_global, liberacao, bytes);
+    return liberacao;
+}
+
+
+static int antes(const envio_agendado_t* a, const envio_agendado_t* b) {
+    return a->liberacao_ns < b->liberacao_ns || (a->liberacao_ns == b->liberacao_ns && a->ordem < b->ordem);
+}
+
+
+static void agendar_envio(transmissor_t* transmissor, const envio_t* envio, int64_t liberacao) {
+    envio_agendado_t* heap = transmissor->agendados;
+    size_t i = transmissor->num_agendados++;
+    heap[i].envio = *envio;
+    heap[i].liberacao_ns = liberacao;
+    heap[i].ordem = transmissor->ordem++;
+
+    while (i > 0 && antes(&heap[i], &heap[(i - 1) / 2])) {
+        envio_agendado_t troca = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = troca;
+        i = (i - 1) / 2;
+    }
+}
+
+
+static envio_t retirar_agendado(transmissor_t* transmissor) {
+    envio_agendado_t* heap = transmissor->agendados;
+    envio_t envio = heap[0].envio;
+    size_t n = --transmissor->num_agendados;
+    heap[0] = heap[n];
+
+    size_t i = 0;
+    while (1) {
+        size_t menor = i;
+        size_t esquerda = 2 * i + 1;
+        size_t direita = 2 * i + 2;
+        if (esquerda < n && antes(&heap[esquerda], &heap[menor])) menor = esquerda;
+        if (direita < n && antes(&heap[direita], &heap[menor])) menor = direita;
+        if (menor == i) break;
+        envio_agendado_t troca = heap[i];
+        heap[i] = heap[menor];
+        heap[menor] = troca;
+        i = menor;
+    }
+    return envio;
+}
+
+
+// Há um frame pronto na cabeça do anel
+static int tem_pronto(transmissor_t* transmissor) {
+    celula_envio_t* celula = &transmissor->celulas[transmissor->cabeca & (CAPACIDADE_TRANSMISSAO - 1)];
+    return __atomic_load_n(&celula->sequencia, __ATOMIC_SEQ_CST) == transmissor->cabeca + 1;
+}
+
+
+static int retirar(transmissor_t* transmissor, envio_t* envio) {
+    if (!tem_pronto(transmissor)) {
+        return 0;
+    }
+    celula_envio_t* celula = &transmissor->celulas[transmissor->cabeca & (CAPACIDADE_TRANSMISSAO - 1)];
+    *envio = celula->envio;
+
+    // Libera a célula para a próxima volta dos produtores
+    __atomic_store_n(&celula->sequencia, transmissor->cabeca + CAPACIDADE_TRANSMISSAO, __ATOMIC_RELEASE);
+    transmissor->cabeca++;
+    return 1;
+}
+
+
+static void transmitir_envio(transmissor_t* transmissor, envio_t* envio) {
+    // A falha fica com a geração: a de uma sessão que já saiu não marca a seguinte
+    estado_remetente_t* estado = estado_remetente(transmissor, envio->remetente);
+    if (enviar_pacote_rawsocket(&envio->destino, &envio->quadro->pack) < 0 && estado &&
+        comparar_geracoes(envio->remetente.geracao, __atomic_load_n(&estado->falhou, __ATOMIC_RELAXED)) > 0) {
+        __atomic_store_n(&estado->falhou, envio->remetente.geracao, __ATOMIC_RELEASE);
+    }
+    quadro_soltar(transmissor->quadros, envio->quadro);
+    __atomic_store_n(&transmissor->transmitidos, transmissor->transmitidos + 1, __ATOMIC_RELAXED);
+}
+
+
+static void* thread_transmissao(void* arg) {
+    transmissor_t* transmissor = (transmissor_t*)arg;
+
+    while (1) {
+        int64_t agora = agora_ns();
+
+        // Frames retidos cujo horário chegou
+        while (transmissor->num_agendados > 0 && transmissor->agendados[0].liberacao_ns <= agora) {
+            envio_t envio = retirar_agendado(transmissor);
+            transmitir_envio(transmissor, &envio);
+        }
+
+        // Com o heap cheio o anel fica parado e os produtores esperam
+        envio_t envio;
+        if (transmissor->num_agendados < CAPACIDADE_TRANSMISSAO && retirar(transmissor, &envio)) {
+            int64_t liberacao = liberacao_envio(transmissor, &envio, agora);
+            if (liberacao <= agora && transmissor->num_agendados == 0) {
+                transmitir_envio(transmissor, &envio);
+            } else {
+                agendar_envio(transmissor, &envio, liberacao);
+            }
+            continue;
+        }
+
+        // Anel vazio: dormir até um produtor avisar ou até o primeiro frame retido
+        // O produtor publica a célula antes de olhar dormindo, e aqui é o contrário: um dos dois vê o outro
+        pthread_mutex_lock(&transmissor->trava);
+        __atomic_store_n(&transmissor->dormindo, 1, __ATOMIC_SEQ_CST);
+        if (transmissor->num_agendados > 0) {
+            int64_t liberacao = transmissor->agendados[0].liberacao_ns;
+            struct timespec prazo = { (time_t)(liberacao / 1000000000), (long)(liberacao % 1000000000) };
+            if ((transmissor->num_agendados == CAPACIDADE_TRANSMISSAO || !tem_pronto(transmissor)) &&
+                !transmissor->encerrar) {
+                pthread_cond_timedwait(&transmissor->tem_envio, &transmissor->trava, &prazo);
+            }
+        } else {
+            while (!tem_pronto(transmissor) && !transmissor->encerrar) {
+                pthread_cond_wait(&transmissor->tem_envio, &transmissor->trava);
+            }
+        }
+        __atomic_store_n(&transmissor->dormindo, 0, __ATOMIC_RELAXED);
+        int encerrar = transmissor->encerrar && !tem_pronto(transmissor);
+        pthread_mutex_unlock(&transmissor->trava);
+        if (encerrar) {
+            // Frames retidos saem sem esperar o ritmo
+            while (transmissor->num_agendados > 0) {
+                envio_t retido = retirar_agendado(transmissor);
+                transmitir_envio(transmissor, &retido);
+            }
+            return NULL;
+        }
+    }
+}
+
+
+int transmissor_ritmo(ritmo_interface_t* ritmo, const char* interface, const char* config) {
+    if (!ritmo) return -1;
+
+    const ritmo_interface_t* padrao = ritmos_interfaces;
+    while (padrao->interface && (!interface || strcmp(padrao->interface, interface) != 0)) {
+        padrao++;
+    }
+    *ritmo = *padrao;
+    ritmo->interface = interface;
+    if (!config) {
+        return 0;
+    }
+
+    // "nome=valor" separados por vírgula; os campos ausentes ficam com o valor da tabela
+    const char* p = config;
+    while (*p) {
+        char nome[16];
+        double valor;
+        int lidos;
+        if (sscanf(p, " %15[a-z] = %lf%n", nome, &valor, &lidos) != 2 || valor < 0) {
+            return -1;
+        }
+        p += lidos;
+
+        if (strcmp(nome, "total") == 0) ritmo->taxa_global = (uint64_t)(valor * 1000);
+        else if (strcmp(nome, "sessao") == 0) ritmo->taxa_sessao = (uint64_t)(valor * 1000);
+        else if (strcmp(nome, "rajada") == 0) ritmo->rajada = (uint64_t)valor;
+        else return -1;
+
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+    }
+
+    // Com taxa e sem rajada nenhum frame caberia no balde
+    if (ritmo->rajada < CABECALHOS_QUADRO + MAX_FRAME && (ritmo->taxa_global || ritmo->taxa_sessao)) {
+        ritmo->rajada = CABECALHOS_QUADRO + MAX_FRAME;
+    }
+    return 0;
+}
+
+
+int transmissor_iniciar(transmissor_t* transmissor, slab_t* quadros, const ritmo_interface_t* ritmo,
+                        int num_remetentes) {
+    if (!transmissor || !quadros || !ritmo || num_remetentes < 0) return -1;
+
+    memset(transmissor, 0, sizeof(transmissor_t));
+    for (size_t i = 0; i < CAPACIDADE_TRANSMISSAO; i++) {
+        transmissor->celulas[i].sequencia = i;
+    }
+    transmissor->quadros = quadros;
+    transmissor->ritmo = *ritmo;
+    if (num_remetentes > 0) {
+        transmissor->remetentes = calloc((size_t)num_remetentes, sizeof(estado_remetente_t));
+        if (!transmissor->remetentes) return -1;
+        transmissor->num_remetentes = num_remetentes;
+    }
+
+    // Horários de liberação no relógio monotônico, o mesmo da espera
+    pthread_condattr_t atributos;
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_mutex_init(&transmissor->trava, NULL);
+    pthread_cond_init(&transmissor->tem_envio, &atributos);
+    pthread_condattr_destroy(&atributos);
+
+    if (pthread_create(&transmissor->thread, NULL, thread_transmissao, transmissor) != 0) {
+        pthread_cond_destroy(&transmissor->tem_envio);
+        pthread_mutex_destroy(&transmissor->trava);
+        free(transmissor->remetentes);
+        transmissor->remetentes = NULL;
+        return -1;
+    }
+    transmissor->ativo = 1;
+    return 0;
+}
+
+
+int transmissor_enviar(transmissor_t* transmissor, quadro_t* quadro, const rawsocket_t* destino,
+                       remetente_t remetente) {
+    if (!transmissor || !transmissor->ativo || !quadro || !destino) return -1;
+
+    // Reservar uma célula: o CAS na cauda decide entre produtores concorrentes
+    size_t cauda = __atomic_load_n(&transmissor->cauda, __ATOMIC_RELAXED);
+    celula_envio_t* celula;
+    while (1) {
+        celula = &transmissor->celulas[cauda & (CAPACIDADE_TRANSMISSAO - 1)];
+        size_t sequencia = __atomic_load_n(&celula->sequencia, __ATOMIC_ACQUIRE);
+        intptr_t diferenca = (intptr_t)sequencia - (intptr_t)cauda;
+        if (diferenca == 0) {
+            if (__atomic_compare_exchange_n(&transmissor->cauda, &cauda, cauda + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diferenca < 0) {
+            // Anel cheio: a thread de transmissão está atrás, esperar por ela mantém a ordem dos frames
+            sched_yield();
+            cauda = __atomic_load_n(&transmissor->cauda, __ATOMIC_RELAXED);
+        } else {
+            cauda = __atomic_load_n(&transmissor->cauda, __ATOMIC_RELAXED);
+        }
+    }
+
+    celula->envio.quadro = quadro;
+    celula->envio.destino = *destino;
+    celula->envio.remetente = remetente;
+    __atomic_store_n(&celula->sequencia, cauda + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&transmissor->dormindo, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&transmissor->trava);
+        pthread_cond_signal(&transmissor->tem_envio);
+        pthread_mutex_unlock(&transmissor->trava);
+    }
+    return 0;
+}
+
+
+int transmissor_falhou(transmissor_t* transmissor, remetente_t remetente) {
+    if (!transmissor) return 0;
+    estado_remetente_t* estado = estado_remetente(transmissor, remetente);
+    return estado && remetente.geracao && __atomic_load_n(&estado->falhou, __ATOMIC_ACQUIRE) == remetente.geracao;
+}
+
+
+size_t transmissor_pendentes(transmissor_t* transmissor) {
+    if (!transmissor) return 0;
+    size_t transmitidos = __atomic_load_n(&transmissor->transmitidos, __ATOMIC_RELAXED);
+    size_t cauda = __atomic_load_n(&transmissor->cauda, __ATOMIC_RELAXED);
+    return cauda > transmitidos ? cauda - transmitidos : 0;
+}
+
+
+void transmissor_finalizar(transmissor_t* transmissor) {
+    if (!transmissor || !transmissor->ativo) return;
+
+    pthread_mutex_lock(&transmissor->trava);
+    transmissor->encerrar = 1;
+    pthread_cond_signal(&transmissor->tem_envio);
+    pthread_mutex_unlock(&transmissor->trava);
+
+    pthread_join(transmissor->thread, NULL);
+    pthread_cond_destroy(&transmissor->tem_envio);
+    pthread_mutex_destroy(&transmissor->trava);
+    free(transmissor->remetentes);
+    transmissor->remetentes = NULL;
+    transmissor->num_remetentes = 0;
+    transmissor->ativo = 0;
+}
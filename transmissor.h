@@ -0,0 +1,125 @@
+#ifndef TRANSMISSOR_H
+#define TRANSMISSOR_H
+
+#include <pthread.h>
+#include "protocolo.h"
+
+
+#define CAPACIDADE_TRANSMISSAO 4096         // Frames aguardando a thread de transmissão (potência de 2)
+#define CABECALHOS_QUADRO (42 + 4)          // Ethernet, IP e UDP mais o cabeçalho do pack, contados no ritmo
+
+
+//////////// Ritmo de envio ////////////
+
+// Balde de fichas guardado como horário teórico (GCRA): um frame de b bytes sai em
+// max(agora, teorico - rajada/taxa) e empurra o horário teórico em b/taxa
+typedef struct {
+    int64_t teorico_ns;                     // Só a thread de transmissão usa
+} balde_ritmo_t;
+
+// Ritmo de uma interface em bytes por segundo (0 = sem limite) e rajada em bytes
+typedef struct {
+    const char* interface;                  // NULL: as interfaces fora da tabela
+    uint64_t taxa_global;
+    uint64_t taxa_sessao;
+    uint64_t rajada;
+} ritmo_interface_t;
+
+
+// Quem enviou o frame: a posição da sessão na tabela e a geração da sessão que a ocupa
+// Um frame na fila pode sobreviver à sessão, e a posição ser reaproveitada por outra:
+// pela geração, o ritmo e a falha de um frame antigo não caem na sessão nova
+typedef struct {
+    int indice;                             // -1: sem sessão (só o ritmo global, falha ignorada)
+    uint32_t geracao;                       // Começa em 1 e cresce a cada ocupação da posição
+} remetente_t;
+
+#define SEM_REMETENTE ((remetente_t){ -1, 0 })
+
+// Estado de envio de cada posição da tabela de sessões, guardado pelo transmissor
+typedef struct {
+    balde_ritmo_t ritmo;                    // Só a thread de transmissão usa
+    uint32_t geracao_ritmo;                 // Geração dona do balde (só a thread de transmissão)
+    uint32_t falhou;                        // Geração com envio falho, 0 se nenhuma (acesso atômico)
+} estado_remetente_t;
+
+// Um frame a transmitir, com a cópia do destino: a sessão pode mudar antes do envio
+typedef struct {
+    quadro_t* quadro;                       // Referência solta depois do envio
+    rawsocket_t destino;
+    remetente_t remetente;
+} envio_t;
+
+// Frame retido pelo ritmo até o horário de liberação
+typedef struct {
+    envio_t envio;
+    int64_t liberacao_ns;
+    uint64_t ordem;                         // Desempate: frames da mesma sessão saem na ordem de chegada
+} envio_agendado_t;
+
+// Cada célula diz pela sequência se está livre para a volta atual dos produtores
+// ou pronta para o consumidor
+typedef struct {
+    envio_t envio;
+    size_t sequencia;                       // Acesso atômico
+} celula_envio_t;
+
+
+//////////// Estágio de transmissão ////////////
+
+// Os trabalhadores colocam frames no anel sem travas (vários produtores);
+// uma única thread retira em ordem e faz as chamadas de envio no socket.
+// Frames acima do ritmo da sessão ou da interface esperam em um heap pelo
+// horário de liberação, e a thread dorme até o primeiro deles
+typedef struct {
+    celula_envio_t celulas[CAPACIDADE_TRANSMISSAO];
+    size_t cauda;                           // Próxima célula dos produtores (acesso atômico)
+    size_t cabeca;                          // Próxima célula do consumidor (só a thread de transmissão)
+    size_t transmitidos;                    // Frames já enviados (só a thread de transmissão escreve, acesso atômico)
+    slab_t* quadros;                        // De onde vêm os frames enviados
+
+    ritmo_interface_t ritmo;
+    balde_ritmo_t global;
+    estado_remetente_t* remetentes;         // Uma entrada por posição da tabela de sessões
+    int num_remetentes;
+    envio_agendado_t agendados[CAPACIDADE_TRANSMISSAO];     // Heap pelo horário de liberação
+    size_t num_agendados;
+    uint64_t ordem;
+
+    pthread_t thread;
+    int ativo;
+    pthread_mutex_t trava;                  // Protege só o sono da thread
+    pthread_cond_t tem_envio;
+    int dormindo;                           // Acesso atômico
+    int encerrar;
+} transmissor_t;
+
+
+//////////// Funções do transmissor ////////////
+
+// Ritmo da interface pela tabela de transmissor.c, com os valores de config por cima:
+// "total=<KB/s>,sessao=<KB/s>,rajada=<bytes>" (0 = sem limite), vindo da variável RITMO
+// Retorna -1 se config for inválida
+int transmissor_ritmo(ritmo_interface_t* ritmo, const char* interface, const char* config);
+
+// Inicia a thread de transmissão com o ritmo da interface
+// Os frames enviados voltam ao slab quadros; num_remetentes é o tamanho da tabela de sessões
+int transmissor_iniciar(transmissor_t* transmissor, slab_t* quadros, const ritmo_interface_t* ritmo,
+                        int num_remetentes);
+
+// Coloca o frame no anel, passando a referência para a thread de transmissão
+// O remetente escolhe o balde de ritmo da sessão; com o anel cheio, espera a thread abrir espaço
+// Retorna -1 se a thread não estiver ativa
+int transmissor_enviar(transmissor_t* transmissor, quadro_t* quadro, const rawsocket_t* destino,
+                       remetente_t remetente);
+
+// Retorna 1 se um frame desta geração do remetente não pôde ser enviado
+int transmissor_falhou(transmissor_t* transmissor, remetente_t remetente);
+
+// Frames aceitos e ainda não enviados (no anel ou retidos pelo ritmo)
+size_t transmissor_pendentes(transmissor_t* transmissor);
+
+// Transmite o que resta no anel e encerra a thread
+void transmissor_finalizar(transmissor_t* transmissor);
+
+#endif // TRANSMISSOR_H